@@ -0,0 +1,481 @@
+#include "bake_cache.hpp"
+
+#include <atomic>
+#include <random>
+#include <system_error>
+
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kReadChunkSize_ = 1024*1024;
+
+	// Sanity limit for counts in cache entries
+	constexpr std::uint32_t kMaxCount_ = 1u << 30;
+
+	constexpr char kEntryMagic_[16] = "cw2-bake-mesh";
+	constexpr char kStateHeader_[] = "cw2-bake-cache";
+
+	struct FileCloser_
+	{
+		FILE* file;
+		~FileCloser_() { if( file ) std::fclose( file ); }
+	};
+
+	std::vector<char> read_file_( std::filesystem::path const& );
+
+	std::filesystem::path entry_path_( std::filesystem::path const& aCacheDir, std::uint64_t aKey );
+	std::filesystem::path temp_path_( std::filesystem::path const& aPath );
+
+	bool valid_ranges_( std::vector<Meshlet> const&, std::size_t aIndexCount );
+	bool valid_ranges_( std::vector<MeshLod> const&, std::size_t aIndexCount );
+
+	void checked_write_( FILE*, std::size_t, void const* );
+	void checked_read_( FILE*, std::size_t, void* );
+
+	template< typename tType >
+	void write_vector_( FILE*, std::vector<tType> const& );
+	template< typename tType >
+	void read_vector_( FILE*, std::vector<tType>& );
+}
+
+//--    hash_bytes()                    ///{{{2///////////////////////////////
+std::uint64_t hash_bytes( void const* aData, std::size_t aSize, std::uint64_t aSeed )
+{
+	constexpr std::uint64_t m = 0xc6a4a7935bd1e995ull;
+	constexpr int r = 47;
+
+	std::uint64_t h = aSeed ^ (aSize * m);
+
+	auto const* bytes = static_cast<unsigned char const*>(aData);
+	std::size_t const words = aSize / 8;
+
+	for( std::size_t i = 0; i < words; ++i )
+	{
+		std::uint64_t k;
+		std::memcpy( &k, bytes + i*8, sizeof(k) );
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	auto const* tail = bytes + words*8;
+	switch( aSize & 7 )
+	{
+		case 7: h ^= std::uint64_t(tail[6]) << 48; [[fallthrough]];
+		case 6: h ^= std::uint64_t(tail[5]) << 40; [[fallthrough]];
+		case 5: h ^= std::uint64_t(tail[4]) << 32; [[fallthrough]];
+		case 4: h ^= std::uint64_t(tail[3]) << 24; [[fallthrough]];
+		case 3: h ^= std::uint64_t(tail[2]) << 16; [[fallthrough]];
+		case 2: h ^= std::uint64_t(tail[1]) << 8; [[fallthrough]];
+		case 1: h ^= std::uint64_t(tail[0]);
+				h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+//--    hash_file()                     ///{{{2///////////////////////////////
+std::uint64_t hash_file( std::filesystem::path const& aPath, std::uint64_t aSeed )
+{
+	FileCloser_ fin{ std::fopen( aPath.string().c_str(), "rb" ) };
+	if( !fin.file )
+		throw lut::Error( "hash_file(): unable to open '%s'", aPath.string().c_str() );
+
+	std::vector<char> buffer( kReadChunkSize_ );
+
+	std::uint64_t ret = aSeed;
+	while( auto const bytes = std::fread( buffer.data(), 1, buffer.size(), fin.file ) )
+		ret = hash_bytes( buffer.data(), bytes, ret );
+
+	if( std::ferror( fin.file ) )
+		throw lut::Error( "hash_file(): error reading '%s'", aPath.string().c_str() );
+
+	return ret;
+}
+
+//--    hash_obj_sources()              ///{{{2///////////////////////////////
+std::uint64_t hash_obj_sources( std::filesystem::path const& aObjPath, std::uint64_t aSeed )
+{
+	auto const obj = read_file_( aObjPath );
+	auto ret = hash_bytes( obj.data(), obj.size(), aSeed );
+
+	// Find "mtllib" statements at the start of a line. The names are relative
+	// to the OBJ file.
+	constexpr char kMtllib[] = "mtllib";
+	constexpr std::size_t kMtllibLength = sizeof(kMtllib)-1;
+
+	for( std::size_t i = 0; i + kMtllibLength < obj.size(); ++i )
+	{
+		if( (0 != i && '\n' != obj[i-1]) || 0 != std::memcmp( obj.data()+i, kMtllib, kMtllibLength ) )
+			continue;
+
+		std::size_t beg = i + kMtllibLength;
+		if( ' ' != obj[beg] && '\t' != obj[beg] )
+			continue;
+
+		while( beg < obj.size() && (' ' == obj[beg] || '\t' == obj[beg]) )
+			++beg;
+
+		std::size_t end = beg;
+		while( end < obj.size() && '\n' != obj[end] && '\r' != obj[end] )
+			++end;
+
+		while( end > beg && (' ' == obj[end-1] || '\t' == obj[end-1]) )
+			--end;
+
+		std::string const name( obj.data()+beg, obj.data()+end );
+		auto const path = aObjPath.parent_path() / name;
+
+		ret = hash_bytes( name.data(), name.size(), ret );
+		if( std::filesystem::exists( path ) )
+			ret = hash_file( path, ret );
+		else
+			ret = hash_bytes( "missing", 7, ret );
+
+		i = end;
+	}
+
+	return ret;
+}
+
+//--    load_cached_meshes()            ///{{{2///////////////////////////////
+bool load_cached_meshes( std::filesystem::path const& aCacheDir, std::uint64_t aKey, std::vector<CachedMesh>& aMeshes )
+{
+	auto const path = entry_path_( aCacheDir, aKey );
+
+	FileCloser_ fin{ std::fopen( path.string().c_str(), "rb" ) };
+	if( !fin.file )
+		return false;
+
+	try
+	{
+		char magic[16];
+		checked_read_( fin.file, sizeof(magic), magic );
+
+		std::uint32_t version;
+		checked_read_( fin.file, sizeof(version), &version );
+
+		std::uint64_t key;
+		checked_read_( fin.file, sizeof(key), &key );
+
+		if( 0 != std::memcmp( magic, kEntryMagic_, sizeof(magic) ) || kBakeCacheVersion != version || aKey != key )
+			return false;
+
+		std::uint32_t count;
+		checked_read_( fin.file, sizeof(count), &count );
+		if( count > kMaxCount_ )
+			return false;
+
+		std::vector<CachedMesh> meshes( count );
+		for( auto& cached : meshes )
+		{
+			auto& mesh = cached.mesh;
+			checked_read_( fin.file, sizeof(glm::vec3), &mesh.aabbMin );
+			checked_read_( fin.file, sizeof(glm::vec3), &mesh.aabbMax );
+
+			read_vector_( fin.file, mesh.vert );
+			read_vector_( fin.file, mesh.norm );
+			read_vector_( fin.file, mesh.text );
+			read_vector_( fin.file, mesh.tangent );
+			read_vector_( fin.file, mesh.packedTbn );
+			read_vector_( fin.file, mesh.indices );
+
+			read_vector_( fin.file, cached.meshlets );
+			read_vector_( fin.file, cached.lods );
+
+			// Check sizes and references, so that a damaged entry cannot
+			// produce an invalid file
+			auto const V = mesh.vert.size();
+			if( mesh.norm.size() != V || mesh.text.size() != V || mesh.tangent.size() != V || mesh.packedTbn.size() != V )
+				return false;
+
+			for( auto const index : mesh.indices )
+			{
+				if( index >= V )
+					return false;
+			}
+
+			if( !valid_ranges_( cached.meshlets, mesh.indices.size() ) || !valid_ranges_( cached.lods, mesh.indices.size() ) )
+				return false;
+		}
+
+		aMeshes = std::move(meshes);
+		return true;
+	}
+	catch( lut::Error const& )
+	{
+		return false;
+	}
+}
+
+//--    store_cached_meshes()           ///{{{2///////////////////////////////
+bool store_cached_meshes( std::filesystem::path const& aCacheDir, std::uint64_t aKey, std::vector<CachedMesh> const& aMeshes )
+{
+	auto const path = entry_path_( aCacheDir, aKey );
+
+	// Write to a temporary file first, such that an interrupted bake never
+	// leaves a partial entry behind. Meshes with the same key may be stored
+	// concurrently (by other threads or processes), so each writer uses its
+	// own temporary file; the last rename wins, with identical contents.
+	auto const tmppath = temp_path_( path );
+
+	try
+	{
+		std::filesystem::create_directories( path.parent_path() );
+
+		{
+			FileCloser_ fof{ std::fopen( tmppath.string().c_str(), "wb" ) };
+			if( !fof.file )
+				throw lut::Error( "unable to open '%s' for writing", tmppath.string().c_str() );
+
+			checked_write_( fof.file, sizeof(kEntryMagic_), kEntryMagic_ );
+			checked_write_( fof.file, sizeof(kBakeCacheVersion), &kBakeCacheVersion );
+			checked_write_( fof.file, sizeof(aKey), &aKey );
+
+			std::uint32_t const count = std::uint32_t(aMeshes.size());
+			checked_write_( fof.file, sizeof(count), &count );
+
+			for( auto const& cached : aMeshes )
+			{
+				auto const& mesh = cached.mesh;
+				checked_write_( fof.file, sizeof(glm::vec3), &mesh.aabbMin );
+				checked_write_( fof.file, sizeof(glm::vec3), &mesh.aabbMax );
+
+				write_vector_( fof.file, mesh.vert );
+				write_vector_( fof.file, mesh.norm );
+				write_vector_( fof.file, mesh.text );
+				write_vector_( fof.file, mesh.tangent );
+				write_vector_( fof.file, mesh.packedTbn );
+				write_vector_( fof.file, mesh.indices );
+
+				write_vector_( fof.file, cached.meshlets );
+				write_vector_( fof.file, cached.lods );
+			}
+		}
+
+		std::filesystem::rename( tmppath, path );
+		return true;
+	}
+	catch( std::exception const& eErr )
+	{
+		std::fprintf( stderr, "Warning: unable to write bake cache entry '%s': %s\n", path.string().c_str(), eErr.what() );
+
+		std::error_code ec;
+		std::filesystem::remove( tmppath, ec );
+		return false;
+	}
+}
+
+//--    load_cache_state()              ///{{{2///////////////////////////////
+BakeCacheState load_cache_state( std::filesystem::path const& aPath )
+{
+	// Format: a header line, followed by one record per line. Fields are
+	// separated by tabs:
+	//   cw2-bake-cache <version>
+	//   model <hash>
+	//   texture <hash> <usage> <destination> <source>
+	BakeCacheState ret;
+
+	std::error_code ec;
+	if( !std::filesystem::exists( aPath, ec ) )
+		return ret;
+
+	std::vector<char> data;
+	try
+	{
+		data = read_file_( aPath );
+	}
+	catch( lut::Error const& )
+	{
+		return ret;
+	}
+
+	std::vector<std::string> fields;
+	std::size_t line = 0;
+	for( std::size_t beg = 0; beg < data.size(); ++line )
+	{
+		std::size_t end = beg;
+		while( end < data.size() && '\n' != data[end] )
+			++end;
+
+		// Split line into fields
+		fields.clear();
+		for( std::size_t fbeg = beg; fbeg <= end; )
+		{
+			std::size_t fend = fbeg;
+			while( fend < end && '\t' != data[fend] )
+				++fend;
+
+			fields.emplace_back( data.data()+fbeg, data.data()+fend );
+			fbeg = fend+1;
+		}
+
+		beg = end+1;
+
+		if( 0 == line )
+		{
+			if( 2 != fields.size() || kStateHeader_ != fields[0] || std::to_string( kBakeCacheVersion ) != fields[1] )
+				return BakeCacheState{};
+
+			continue;
+		}
+
+		if( 2 == fields.size() && "model" == fields[0] )
+		{
+			ret.modelHash = std::strtoull( fields[1].c_str(), nullptr, 16 );
+		}
+		else if( 5 == fields.size() && "texture" == fields[0] )
+		{
+			ret.textures[fields[3]] = BakeCacheState::Texture{
+				std::strtoull( fields[1].c_str(), nullptr, 16 ),
+				std::uint32_t(std::strtoul( fields[2].c_str(), nullptr, 10 )),
+				fields[4]
+			};
+		}
+	}
+
+	return ret;
+}
+
+//--    save_cache_state()              ///{{{2///////////////////////////////
+void save_cache_state( std::filesystem::path const& aPath, BakeCacheState const& aState )
+{
+	std::filesystem::create_directories( aPath.parent_path() );
+
+	FileCloser_ fof{ std::fopen( aPath.string().c_str(), "wb" ) };
+	if( !fof.file )
+		throw lut::Error( "Unable to open '%s' for writing", aPath.string().c_str() );
+
+	std::fprintf( fof.file, "%s\t%u\n", kStateHeader_, kBakeCacheVersion );
+	std::fprintf( fof.file, "model\t%016" PRIx64 "\n", aState.modelHash );
+
+	for( auto const& entry : aState.textures )
+		std::fprintf( fof.file, "texture\t%016" PRIx64 "\t%u\t%s\t%s\n", entry.second.hash, entry.second.usage, entry.first.c_str(), entry.second.source.c_str() );
+
+	if( std::ferror( fof.file ) )
+		throw lut::Error( "Error writing '%s'", aPath.string().c_str() );
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	std::vector<char> read_file_( std::filesystem::path const& aPath )
+	{
+		FileCloser_ fin{ std::fopen( aPath.string().c_str(), "rb" ) };
+		if( !fin.file )
+			throw lut::Error( "Unable to open '%s' for reading", aPath.string().c_str() );
+
+		std::vector<char> ret;
+
+		std::size_t size = 0;
+		do
+		{
+			ret.resize( size + kReadChunkSize_ );
+			size += std::fread( ret.data() + size, 1, kReadChunkSize_, fin.file );
+		} while( size == ret.size() );
+
+		if( std::ferror( fin.file ) )
+			throw lut::Error( "Error reading '%s'", aPath.string().c_str() );
+
+		ret.resize( size );
+		return ret;
+	}
+
+	std::filesystem::path entry_path_( std::filesystem::path const& aCacheDir, std::uint64_t aKey )
+	{
+		char name[32];
+		std::snprintf( name, sizeof(name), "%016" PRIx64 ".mesh", aKey );
+
+		// Spread entries over subdirectories by the first two hex digits
+		return aCacheDir / std::string( name, name+2 ) / name;
+	}
+
+	std::filesystem::path temp_path_( std::filesystem::path const& aPath )
+	{
+		// Random per process, plus a counter per call
+		static std::uint64_t const process = [] {
+			std::random_device rd;
+			return (std::uint64_t(rd()) << 32) ^ std::uint64_t(rd());
+		}();
+		static std::atomic<std::uint64_t> counter{ 0 };
+
+		char suffix[48];
+		std::snprintf( suffix, sizeof(suffix), ".%016" PRIx64 "-%" PRIu64 ".tmp", process, counter++ );
+
+		auto ret = aPath;
+		ret += suffix;
+		return ret;
+	}
+
+	bool valid_ranges_( std::vector<Meshlet> const& aMeshlets, std::size_t aIndexCount )
+	{
+		for( auto const& meshlet : aMeshlets )
+		{
+			if( 0 != meshlet.indexCount % 3 || std::uint64_t(meshlet.firstIndex) + meshlet.indexCount > aIndexCount )
+				return false;
+		}
+
+		return true;
+	}
+	bool valid_ranges_( std::vector<MeshLod> const& aLods, std::size_t aIndexCount )
+	{
+		for( auto const& lod : aLods )
+		{
+			if( 0 != lod.indexCount % 3 || std::uint64_t(lod.firstIndex) + lod.indexCount > aIndexCount )
+				return false;
+		}
+
+		return true;
+	}
+
+	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	{
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+	}
+	void checked_read_( FILE* aIn, std::size_t aBytes, void* aData )
+	{
+		auto const ret = std::fread( aData, 1, aBytes, aIn );
+
+		if( ret != aBytes )
+			throw lut::Error( "fread() failed: %zu instead of %zu", ret, aBytes );
+	}
+
+	template< typename tType >
+	void write_vector_( FILE* aOut, std::vector<tType> const& aVector )
+	{
+		std::uint32_t const count = std::uint32_t(aVector.size());
+		checked_write_( aOut, sizeof(count), &count );
+		checked_write_( aOut, sizeof(tType)*count, aVector.data() );
+	}
+	template< typename tType >
+	void read_vector_( FILE* aIn, std::vector<tType>& aVector )
+	{
+		std::uint32_t count;
+		checked_read_( aIn, sizeof(count), &count );
+		if( count > kMaxCount_ )
+			throw lut::Error( "read_vector_(): unexpected count %u", count );
+
+		aVector.resize( count );
+		checked_read_( aIn, sizeof(tType)*count, aVector.data() );
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
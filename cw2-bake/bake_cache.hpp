@@ -0,0 +1,86 @@
+#ifndef BAKE_CACHE_HPP_0C6E2F4A_91B3_4D78_A5E2_7F13D8B96C05
+#define BAKE_CACHE_HPP_0C6E2F4A_91B3_4D78_A5E2_7F13D8B96C05
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "meshlet.hpp"
+#include "index_mesh.hpp"
+#include "simplify_mesh.hpp"
+
+/* Content-addressed cache for the baker.
+ *
+ * Meshes are cached individually, keyed by a hash of their (resolved) vertex
+ * data and of the options that affect their processing. An entry holds all
+ * output meshes derived from one input mesh (several if it was split) with
+ * their meshlets and levels of detail.
+ *
+ * In addition, a small state file records the hash of the model's sources
+ * (OBJ + MTL files + options) from the last bake, and the source hash of each
+ * texture that was placed in the output directory.
+ *
+ * The cache is purely an optimization. Entries that cannot be read (missing,
+ * truncated, or from a different version of the baker) are treated as misses.
+ */
+
+// Bump when the processing of meshes changes, to invalidate old entries
+constexpr std::uint32_t kBakeCacheVersion = 4;
+
+// Hashing (MurmurHash64A). Chain calls by passing the previous result as seed.
+std::uint64_t hash_bytes( void const* aData, std::size_t aSize, std::uint64_t aSeed = 0 );
+
+// Hash a file's contents. Throws if the file cannot be read.
+std::uint64_t hash_file( std::filesystem::path const&, std::uint64_t aSeed = 0 );
+
+// Hash an OBJ file and the MTL files it references (via "mtllib"). Throws if
+// the OBJ file cannot be read; missing MTL files are hashed as such.
+std::uint64_t hash_obj_sources( std::filesystem::path const& aObjPath, std::uint64_t aSeed = 0 );
+
+
+struct CachedMesh
+{
+	IndexedMesh mesh;
+	std::vector<Meshlet> meshlets; // Empty if meshlets are disabled
+	std::vector<MeshLod> lods; // Empty if levels of detail are disabled
+};
+
+// Returns false if there is no (valid) entry for aKey in aCacheDir.
+bool load_cached_meshes(
+	std::filesystem::path const& aCacheDir,
+	std::uint64_t aKey,
+	std::vector<CachedMesh>&
+);
+
+// Returns false (after printing a warning) if the entry could not be written.
+bool store_cached_meshes(
+	std::filesystem::path const& aCacheDir,
+	std::uint64_t aKey,
+	std::vector<CachedMesh> const&
+);
+
+
+struct BakeCacheState
+{
+	struct Texture
+	{
+		std::uint64_t hash;
+		std::uint32_t usage; // opaque here; see TextureUsage in bake_texture.hpp
+		std::string source;
+	};
+
+	std::uint64_t modelHash = 0;
+	std::unordered_map<std::string,Texture> textures; // by destination path
+};
+
+// Returns an empty state if the file does not exist or cannot be parsed.
+BakeCacheState load_cache_state( std::filesystem::path const& );
+
+// Throws on failure.
+void save_cache_state( std::filesystem::path const&, BakeCacheState const& );
+
+#endif // BAKE_CACHE_HPP_0C6E2F4A_91B3_4D78_A5E2_7F13D8B96C05
@@ -0,0 +1,302 @@
+#include "bake_profile.hpp"
+
+#include <chrono>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/time.h>
+#	include <sys/resource.h>
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	constexpr int kFormatVersion_ = 1;
+
+	struct FileCloser_
+	{
+		FILE* file;
+		~FileCloser_() { if( file ) std::fclose( file ); }
+	};
+
+	double wall_seconds_();
+
+	void write_string_( FILE*, std::string const& );
+	void write_number_( FILE*, double );
+
+	// Bytes per second, in MB/s; zero if no time was measured
+	double throughput_( std::uint64_t aBytes, double aSeconds );
+}
+
+//--    sample_process_usage()          ///{{{2///////////////////////////////
+ProcessUsage sample_process_usage()
+{
+	ProcessUsage ret;
+
+#	if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if( GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+	{
+		auto const ticks_ = [] (FILETIME const& aTime) {
+			return (std::uint64_t(aTime.dwHighDateTime) << 32) | aTime.dwLowDateTime;
+		};
+		ret.cpuSeconds = double(ticks_( kernel ) + ticks_( user )) * 1e-7; // 100 ns ticks
+	}
+
+	PROCESS_MEMORY_COUNTERS counters{};
+	if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+		ret.peakRssBytes = std::uint64_t(counters.PeakWorkingSetSize);
+#	else // !_WIN32
+	rusage usage{};
+	if( 0 == getrusage( RUSAGE_SELF, &usage ) )
+	{
+		auto const seconds_ = [] (timeval const& aTime) {
+			return double(aTime.tv_sec) + double(aTime.tv_usec) * 1e-6;
+		};
+		ret.cpuSeconds = seconds_( usage.ru_utime ) + seconds_( usage.ru_stime );
+
+#		if defined(__APPLE__)
+		ret.peakRssBytes = std::uint64_t(usage.ru_maxrss); // bytes
+#		else
+		ret.peakRssBytes = std::uint64_t(usage.ru_maxrss) * 1024; // kilobytes
+#		endif
+	}
+#	endif // ~ _WIN32
+
+	return ret;
+}
+
+//--    BakeProfile                     ///{{{2///////////////////////////////
+BakeProfile::BakeProfile( std::string aInput, std::string aOutput, std::size_t aWorkerCount )
+	: mInput( std::move(aInput) )
+	, mOutput( std::move(aOutput) )
+	, mWorkerCount( aWorkerCount )
+	, mStartWall( wall_seconds_() )
+	, mStartUsage( sample_process_usage() )
+{}
+
+void BakeProfile::begin_stage( char const* aName )
+{
+	assert( aName );
+	assert( mStageName.empty() ); // stages must not overlap
+
+	mStageName = aName;
+	mStageWall = wall_seconds_();
+	mStageUsage = sample_process_usage();
+}
+
+void BakeProfile::end_stage( std::uint64_t aBytesIn, std::uint64_t aBytesOut )
+{
+	assert( !mStageName.empty() );
+
+	auto const usage = sample_process_usage();
+
+	mStages.emplace_back( Stage_{
+		std::move(mStageName),
+		wall_seconds_() - mStageWall,
+		usage.cpuSeconds - mStageUsage.cpuSeconds,
+		usage.peakRssBytes,
+		aBytesIn,
+		aBytesOut
+	} );
+
+	mStageName.clear();
+}
+
+void BakeProfile::add_mesh( ProfileMesh aMesh )
+{
+	mMeshes.emplace_back( std::move(aMesh) );
+}
+
+void BakeProfile::set_metric( char const* aName, double aValue )
+{
+	for( auto& metric : mMetrics )
+	{
+		if( metric.first == aName )
+		{
+			metric.second = aValue;
+			return;
+		}
+	}
+
+	mMetrics.emplace_back( aName, aValue );
+}
+
+void BakeProfile::set_unchanged( bool aUnchanged )
+{
+	mUnchanged = aUnchanged;
+}
+
+void BakeProfile::write_json( std::filesystem::path const& aPath ) const
+{
+	// Format (all times in seconds, sizes in bytes, throughput in MB/s):
+	//  {
+	//    "version": 1, "input": path, "output": path, "unchanged": bool,
+	//    "workers": N, "wallSeconds", "cpuSeconds", "peakRssBytes",
+	//    "stages": [ { "name", "wallSeconds", "cpuSeconds", "peakRssBytes",
+	//      "bytesIn", "bytesOut", "inputMBps", "outputMBps" }, ... ],
+	//    "metrics": { name: value, ... },
+	//    "meshes": [ { "name", "cached", "bytesOut", and unless cached:
+	//      "inputVertices", "indexedVertices", "weldRatio", "triangles",
+	//      "outputMeshes", "acmrBefore", "acmrAfter", "seconds",
+	//      "verticesPerSecond", "steps": { "index", "optimize", "meshlets",
+	//      "tangents", "lods", "encode" } }, ... ]
+	//  }
+	// Numbers that are not finite are written as null.
+	FileCloser_ fof{ std::fopen( aPath.string().c_str(), "wb" ) };
+	if( !fof.file )
+		throw lut::Error( "Unable to open '%s' for writing", aPath.string().c_str() );
+
+	FILE* const f = fof.file;
+	auto const usage = sample_process_usage();
+
+	std::fprintf( f, "{\n\t\"version\": %d,\n\t\"input\": ", kFormatVersion_ );
+	write_string_( f, mInput );
+	std::fprintf( f, ",\n\t\"output\": " );
+	write_string_( f, mOutput );
+	std::fprintf( f, ",\n\t\"unchanged\": %s,\n\t\"workers\": %zu", mUnchanged ? "true" : "false", mWorkerCount );
+	std::fprintf( f, ",\n\t\"wallSeconds\": " );
+	write_number_( f, wall_seconds_() - mStartWall );
+	std::fprintf( f, ",\n\t\"cpuSeconds\": " );
+	write_number_( f, usage.cpuSeconds - mStartUsage.cpuSeconds );
+	std::fprintf( f, ",\n\t\"peakRssBytes\": %llu", static_cast<unsigned long long>(usage.peakRssBytes) );
+
+	// Stages
+	std::fprintf( f, ",\n\t\"stages\": [" );
+	for( std::size_t i = 0; i < mStages.size(); ++i )
+	{
+		auto const& stage = mStages[i];
+
+		std::fprintf( f, "%s\n\t\t{ \"name\": ", i ? "," : "" );
+		write_string_( f, stage.name );
+		std::fprintf( f, ", \"wallSeconds\": " );
+		write_number_( f, stage.wallSeconds );
+		std::fprintf( f, ", \"cpuSeconds\": " );
+		write_number_( f, stage.cpuSeconds );
+		std::fprintf( f, ", \"peakRssBytes\": %llu, \"bytesIn\": %llu, \"bytesOut\": %llu",
+			static_cast<unsigned long long>(stage.peakRssBytes),
+			static_cast<unsigned long long>(stage.bytesIn),
+			static_cast<unsigned long long>(stage.bytesOut)
+		);
+		std::fprintf( f, ", \"inputMBps\": " );
+		write_number_( f, throughput_( stage.bytesIn, stage.wallSeconds ) );
+		std::fprintf( f, ", \"outputMBps\": " );
+		write_number_( f, throughput_( stage.bytesOut, stage.wallSeconds ) );
+		std::fprintf( f, " }" );
+	}
+	std::fprintf( f, "%s]", mStages.empty() ? "" : "\n\t" );
+
+	// Metrics
+	std::fprintf( f, ",\n\t\"metrics\": {" );
+	for( std::size_t i = 0; i < mMetrics.size(); ++i )
+	{
+		std::fprintf( f, "%s\n\t\t", i ? "," : "" );
+		write_string_( f, mMetrics[i].first );
+		std::fprintf( f, ": " );
+		write_number_( f, mMetrics[i].second );
+	}
+	std::fprintf( f, "%s}", mMetrics.empty() ? "" : "\n\t" );
+
+	// Meshes
+	std::fprintf( f, ",\n\t\"meshes\": [" );
+	for( std::size_t i = 0; i < mMeshes.size(); ++i )
+	{
+		auto const& mesh = mMeshes[i];
+
+		std::fprintf( f, "%s\n\t\t{ \"name\": ", i ? "," : "" );
+		write_string_( f, mesh.name );
+		std::fprintf( f, ", \"cached\": %s, \"bytesOut\": %llu", mesh.cached ? "true" : "false", static_cast<unsigned long long>(mesh.bytesOut) );
+
+		if( !mesh.cached )
+		{
+			double const seconds = mesh.indexSeconds + mesh.optimizeSeconds + mesh.meshletSeconds + mesh.tangentSeconds + mesh.lodSeconds + mesh.encodeSeconds;
+
+			std::fprintf( f, ", \"inputVertices\": %zu, \"indexedVertices\": %zu, \"weldRatio\": ", mesh.inputVertices, mesh.indexedVertices );
+			write_number_( f, mesh.inputVertices ? double(mesh.indexedVertices) / double(mesh.inputVertices) : 0.0 );
+			std::fprintf( f, ", \"triangles\": %zu, \"outputMeshes\": %zu, \"acmrBefore\": ", mesh.triangles, mesh.outputMeshes );
+			write_number_( f, mesh.acmrBefore );
+			std::fprintf( f, ", \"acmrAfter\": " );
+			write_number_( f, mesh.acmrAfter );
+			std::fprintf( f, ", \"seconds\": " );
+			write_number_( f, seconds );
+			std::fprintf( f, ", \"verticesPerSecond\": " );
+			write_number_( f, seconds > 0.0 ? double(mesh.inputVertices) / seconds : 0.0 );
+
+			std::fprintf( f, ", \"steps\": { \"index\": " );
+			write_number_( f, mesh.indexSeconds );
+			std::fprintf( f, ", \"optimize\": " );
+			write_number_( f, mesh.optimizeSeconds );
+			std::fprintf( f, ", \"meshlets\": " );
+			write_number_( f, mesh.meshletSeconds );
+			std::fprintf( f, ", \"tangents\": " );
+			write_number_( f, mesh.tangentSeconds );
+			std::fprintf( f, ", \"lods\": " );
+			write_number_( f, mesh.lodSeconds );
+			std::fprintf( f, ", \"encode\": " );
+			write_number_( f, mesh.encodeSeconds );
+			std::fprintf( f, " }" );
+		}
+
+		std::fprintf( f, " }" );
+	}
+	std::fprintf( f, "%s]\n}\n", mMeshes.empty() ? "" : "\n\t" );
+
+	if( std::ferror( f ) )
+		throw lut::Error( "Error writing '%s'", aPath.string().c_str() );
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	double wall_seconds_()
+	{
+		return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	void write_string_( FILE* aOut, std::string const& aString )
+	{
+		std::fputc( '"', aOut );
+		for( char const c : aString )
+		{
+			switch( c )
+			{
+				case '"': std::fputs( "\\\"", aOut ); break;
+				case '\\': std::fputs( "\\\\", aOut ); break;
+				case '\n': std::fputs( "\\n", aOut ); break;
+				case '\r': std::fputs( "\\r", aOut ); break;
+				case '\t': std::fputs( "\\t", aOut ); break;
+				default:
+					if( static_cast<unsigned char>(c) < 0x20 )
+						std::fprintf( aOut, "\\u%04x", unsigned(c) );
+					else
+						std::fputc( c, aOut ); // UTF-8 passes through
+			}
+		}
+		std::fputc( '"', aOut );
+	}
+
+	void write_number_( FILE* aOut, double aValue )
+	{
+		if( std::isfinite( aValue ) )
+			std::fprintf( aOut, "%.9g", aValue );
+		else
+			std::fputs( "null", aOut );
+	}
+
+	double throughput_( std::uint64_t aBytes, double aSeconds )
+	{
+		return aSeconds > 0.0 ? double(aBytes) / aSeconds * 1e-6 : 0.0;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
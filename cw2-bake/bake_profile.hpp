@@ -0,0 +1,107 @@
+#ifndef BAKE_PROFILE_HPP_5C1E9A47_2B8D_4F03_9E6A_D84B17C0F295
+#define BAKE_PROFILE_HPP_5C1E9A47_2B8D_4F03_9E6A_D84B17C0F295
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Profile of a single bake, written as JSON next to the baked model (see
+ * write_json() for the format). It holds:
+ *
+ *  - Stages: consecutive parts of the bake (loading, mesh processing,
+ *    writing, textures, ...), with wall and CPU time, the peak resident set
+ *    size so far, and the bytes that went in and out.
+ *  - Meshes: per input mesh, the time spent in each processing step, and
+ *    quality metrics (weld ratio, ACMR).
+ *  - Metrics: model-wide numbers, e.g., the overall weld ratio.
+ *
+ * CPU time and peak memory are measured for the whole process. When several
+ * models are baked at the same time (see batch.hpp), they include the other
+ * models. Meshes are processed concurrently, so only their wall times are
+ * recorded.
+ */
+
+// Process-wide resource use. Zero where the platform does not provide it.
+struct ProcessUsage
+{
+	double cpuSeconds = 0.0; // user + system
+	std::uint64_t peakRssBytes = 0;
+};
+
+ProcessUsage sample_process_usage();
+
+
+struct ProfileMesh
+{
+	std::string name;
+	bool cached = false; // if set, only the name and bytesOut are used
+
+	std::size_t inputVertices = 0; // three per triangle
+	std::size_t indexedVertices = 0;
+	std::size_t triangles = 0;
+	std::size_t outputMeshes = 0;
+
+	// Zero if the mesh was not optimized
+	double acmrBefore = 0.0, acmrAfter = 0.0;
+
+	std::uint64_t bytesOut = 0;
+
+	// Wall time of the processing steps, in seconds
+	double indexSeconds = 0.0; // includes welding
+	double optimizeSeconds = 0.0;
+	double meshletSeconds = 0.0;
+	double tangentSeconds = 0.0;
+	double lodSeconds = 0.0;
+	double encodeSeconds = 0.0; // quantization and compression
+};
+
+class BakeProfile final
+{
+	public:
+		BakeProfile( std::string aInput, std::string aOutput, std::size_t aWorkerCount );
+
+	public:
+		// Stages are timed from begin_stage() to end_stage(), and must not
+		// overlap.
+		void begin_stage( char const* aName );
+		void end_stage( std::uint64_t aBytesIn = 0, std::uint64_t aBytesOut = 0 );
+
+		void add_mesh( ProfileMesh );
+		void set_metric( char const* aName, double aValue );
+
+		// Set if the bake was skipped, since nothing changed
+		void set_unchanged( bool );
+
+		// Throws lut::Error
+		void write_json( std::filesystem::path const& ) const;
+
+	private:
+		struct Stage_
+		{
+			std::string name;
+			double wallSeconds, cpuSeconds;
+			std::uint64_t peakRssBytes;
+			std::uint64_t bytesIn, bytesOut;
+		};
+
+		std::string mInput, mOutput;
+		std::size_t mWorkerCount;
+		bool mUnchanged = false;
+
+		double mStartWall;
+		ProcessUsage mStartUsage;
+
+		std::string mStageName;
+		double mStageWall = 0.0;
+		ProcessUsage mStageUsage;
+
+		std::vector<Stage_> mStages;
+		std::vector<ProfileMesh> mMeshes;
+		std::vector<std::pair<std::string,double>> mMetrics;
+};
+
+#endif // BAKE_PROFILE_HPP_5C1E9A47_2B8D_4F03_9E6A_D84B17C0F295
@@ -0,0 +1,402 @@
+#include "bake_texture.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <system_error>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include <stb_image.h>
+
+#include "bc_encode.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/parallel.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kRowsPerItem_ = 16;
+
+	// Linear RGBA, used for all levels except the first
+	struct Texel_
+	{
+		float r, g, b, a;
+	};
+
+	struct Level_
+	{
+		std::uint32_t width, height;
+		std::vector<std::uint8_t> bytes; // RGBA8, as stored in the file
+	};
+
+	struct FileCloser_
+	{
+		FILE* file;
+		~FileCloser_() { if( file ) std::fclose( file ); }
+	};
+
+	float srgb_to_linear_( float aX )
+	{
+		return aX <= 0.04045f ? aX / 12.92f : std::pow( (aX + 0.055f) / 1.055f, 2.4f );
+	}
+	float linear_to_srgb_( float aX )
+	{
+		return aX <= 0.0031308f ? aX * 12.92f : 1.055f * std::pow( aX, 1.f/2.4f ) - 0.055f;
+	}
+
+	std::uint8_t to_unorm8_( float aX )
+	{
+		return std::uint8_t( std::clamp( aX, 0.f, 1.f ) * 255.f + 0.5f );
+	}
+
+	// Averaged normals are shorter than unit length; rescale the [0,1]
+	// encoded vector.
+	void renormalize_( Texel_& aTexel )
+	{
+		float const x = aTexel.r*2.f-1.f, y = aTexel.g*2.f-1.f, z = aTexel.b*2.f-1.f;
+		float const len = std::sqrt( x*x + y*y + z*z );
+		if( len > 1e-6f )
+		{
+			aTexel.r = (x/len)*0.5f+0.5f;
+			aTexel.g = (y/len)*0.5f+0.5f;
+			aTexel.b = (z/len)*0.5f+0.5f;
+		}
+	}
+
+	// Compute the next level from aWidth x aHeight source texels. The 2x2
+	// footprint is clamped at the edges, so odd sizes drop the last row or
+	// column (as a linear blit would).
+	template< typename tFetch >
+	void downsample_( std::uint32_t aWidth, std::uint32_t aHeight, tFetch&& aFetch, TextureUsage aUsage, std::size_t aWorkerCount, std::vector<Texel_>& aTexels, Level_& aOut )
+	{
+		aOut.width = std::max( 1u, aWidth / 2 );
+		aOut.height = std::max( 1u, aHeight / 2 );
+		aOut.bytes.resize( std::size_t(aOut.width) * aOut.height * 4 );
+		aTexels.resize( std::size_t(aOut.width) * aOut.height );
+
+		auto const items = (aOut.height + kRowsPerItem_-1) / kRowsPerItem_;
+		lut::parallel_for( items, aWorkerCount, [&] (std::size_t aItem) {
+			auto const yend = std::min<std::size_t>( aOut.height, (aItem+1) * kRowsPerItem_ );
+			for( std::size_t y = aItem * kRowsPerItem_; y < yend; ++y )
+			{
+				auto const y0 = std::min<std::size_t>( 2*y, aHeight-1 );
+				auto const y1 = std::min<std::size_t>( 2*y+1, aHeight-1 );
+
+				for( std::size_t x = 0; x < aOut.width; ++x )
+				{
+					auto const x0 = std::min<std::size_t>( 2*x, aWidth-1 );
+					auto const x1 = std::min<std::size_t>( 2*x+1, aWidth-1 );
+
+					Texel_ const t[4] = {
+						aFetch( x0, y0 ), aFetch( x1, y0 ),
+						aFetch( x0, y1 ), aFetch( x1, y1 )
+					};
+
+					Texel_ avg{
+						0.25f * (t[0].r + t[1].r + t[2].r + t[3].r),
+						0.25f * (t[0].g + t[1].g + t[2].g + t[3].g),
+						0.25f * (t[0].b + t[1].b + t[2].b + t[3].b),
+						0.25f * (t[0].a + t[1].a + t[2].a + t[3].a)
+					};
+
+					if( TextureUsage::normal == aUsage )
+						renormalize_( avg );
+
+					auto const index = y * aOut.width + x;
+					aTexels[index] = avg;
+
+					auto* out = aOut.bytes.data() + index*4;
+					if( TextureUsage::color == aUsage )
+					{
+						out[0] = to_unorm8_( linear_to_srgb_( avg.r ) );
+						out[1] = to_unorm8_( linear_to_srgb_( avg.g ) );
+						out[2] = to_unorm8_( linear_to_srgb_( avg.b ) );
+					}
+					else
+					{
+						out[0] = to_unorm8_( avg.r );
+						out[1] = to_unorm8_( avg.g );
+						out[2] = to_unorm8_( avg.b );
+					}
+					out[3] = to_unorm8_( avg.a );
+				}
+			}
+		} );
+	}
+
+	// Replace the level's texels with 4x4 blocks. Partial blocks at the edges
+	// repeat the last row/column.
+	void compress_( Level_& aLevel, lut::TextureFileFormat aFormat, std::size_t aWorkerCount )
+	{
+		auto const blockBytes = lut::texture_file_block_bytes( aFormat );
+		std::size_t const bw = (aLevel.width + 3) / 4, bh = (aLevel.height + 3) / 4;
+
+		std::vector<std::uint8_t> blocks( bw * bh * blockBytes );
+
+		auto const items = (bh + kRowsPerItem_-1) / kRowsPerItem_;
+		lut::parallel_for( items, aWorkerCount, [&] (std::size_t aItem) {
+			std::uint8_t texels[64];
+
+			auto const byend = std::min( bh, (aItem+1) * kRowsPerItem_ );
+			for( std::size_t by = aItem * kRowsPerItem_; by < byend; ++by )
+			{
+				for( std::size_t bx = 0; bx < bw; ++bx )
+				{
+					for( std::size_t i = 0; i < 16; ++i )
+					{
+						auto const x = std::min<std::size_t>( bx*4 + i%4, aLevel.width-1 );
+						auto const y = std::min<std::size_t>( by*4 + i/4, aLevel.height-1 );
+						std::memcpy( texels + i*4, aLevel.bytes.data() + (y*aLevel.width + x)*4, 4 );
+					}
+
+					auto* out = blocks.data() + (by*bw + bx) * blockBytes;
+					switch( aFormat )
+					{
+						case lut::TextureFileFormat::bc1_srgb:
+						case lut::TextureFileFormat::bc1_unorm: encode_bc1( texels, out ); break;
+						case lut::TextureFileFormat::bc3_srgb: encode_bc3( texels, out ); break;
+						case lut::TextureFileFormat::bc4_unorm: encode_bc4( texels, out ); break;
+						case lut::TextureFileFormat::bc5_unorm: encode_bc5( texels, out ); break;
+						default: assert( false );
+					}
+				}
+			}
+		} );
+
+		aLevel.bytes = std::move(blocks);
+	}
+
+	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	{
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+	}
+
+	// Decode to RGBA8, bottom row first
+	Level_ decode_( std::filesystem::path const& aSource )
+	{
+		int width, height, channels;
+		stbi_uc* data = stbi_load( aSource.string().c_str(), &width, &height, &channels, 4 );
+		if( !data )
+			throw lut::Error( "%s: unable to load image (%s)", aSource.string().c_str(), stbi_failure_reason() );
+
+		Level_ ret;
+		ret.width = std::uint32_t(width);
+		ret.height = std::uint32_t(height);
+		ret.bytes.resize( std::size_t(width) * height * 4 );
+
+		// Flip rows here instead of via stbi_set_flip_vertically_on_load(),
+		// which is global state (textures are baked concurrently).
+		std::size_t const rowBytes = std::size_t(width) * 4;
+		for( std::size_t y = 0; y < std::size_t(height); ++y )
+			std::memcpy( ret.bytes.data() + y*rowBytes, data + (height-1-y)*rowBytes, rowBytes );
+
+		stbi_image_free( data );
+		return ret;
+	}
+
+	// Build the mip chain from aBase, compress and write
+	void bake_levels_( Level_ aBase, TextureUsage aUsage, lut::TextureFileFormat aFormat, std::filesystem::path const& aDest, std::size_t aWorkerCount )
+	{
+		std::vector<Level_> levels;
+		levels.emplace_back( std::move(aBase) );
+
+		float decode[256];
+		for( std::size_t i = 0; i < 256; ++i )
+			decode[i] = TextureUsage::color == aUsage ? srgb_to_linear_( i / 255.f ) : i / 255.f;
+
+		std::vector<Texel_> prev, next;
+		while( levels.back().width > 1 || levels.back().height > 1 )
+		{
+			Level_ level;
+			auto const& src = levels.back();
+
+			if( 1 == levels.size() )
+			{
+				auto const* bytes = src.bytes.data();
+				auto const w = src.width;
+				downsample_( src.width, src.height, [&] (std::size_t aX, std::size_t aY) {
+					auto const* t = bytes + (aY*w + aX)*4;
+					return Texel_{ decode[t[0]], decode[t[1]], decode[t[2]], t[3] / 255.f };
+				}, aUsage, aWorkerCount, next, level );
+			}
+			else
+			{
+				auto const w = src.width;
+				downsample_( src.width, src.height, [&] (std::size_t aX, std::size_t aY) {
+					return prev[aY*w + aX];
+				}, aUsage, aWorkerCount, next, level );
+			}
+
+			std::swap( prev, next );
+			levels.emplace_back( std::move(level) );
+		}
+
+		// Compress (after filtering, which needs the uncompressed texels)
+		if( lut::texture_file_is_compressed( aFormat ) )
+		{
+			for( auto& level : levels )
+				compress_( level, aFormat, aWorkerCount );
+		}
+
+		// Write
+		auto const levelCount = std::uint32_t(levels.size());
+
+		std::vector<lut::TextureFileLevel> table( levelCount );
+		std::uint64_t offset = 0;
+		for( std::uint32_t i = 0; i < levelCount; ++i )
+		{
+			table[i].offset = offset;
+			table[i].size = levels[i].bytes.size();
+			table[i].width = levels[i].width;
+			table[i].height = levels[i].height;
+
+			offset += (table[i].size + lut::kTextureFileAlignment-1) / lut::kTextureFileAlignment * lut::kTextureFileAlignment;
+		}
+
+		lut::TextureFileHeader header{};
+		std::memcpy( header.magic, lut::kTextureFileMagic, sizeof(header.magic) );
+		header.format = std::uint32_t(aFormat);
+		header.width = levels[0].width;
+		header.height = levels[0].height;
+		header.levelCount = levelCount;
+		header.dataSize = offset;
+
+		auto tmppath = aDest;
+		tmppath += ".tmp";
+
+		try
+		{
+			{
+				FileCloser_ fof{ std::fopen( tmppath.string().c_str(), "wb" ) };
+				if( !fof.file )
+					throw lut::Error( "unable to open '%s' for writing", tmppath.string().c_str() );
+
+				static constexpr char kPadding[lut::kTextureFileAlignment] = {};
+
+				checked_write_( fof.file, sizeof(header), &header );
+				checked_write_( fof.file, table.size()*sizeof(lut::TextureFileLevel), table.data() );
+
+				auto const tableEnd = sizeof(header) + table.size()*sizeof(lut::TextureFileLevel);
+				checked_write_( fof.file, lut::texture_file_data_offset( levelCount ) - tableEnd, kPadding );
+
+				for( std::uint32_t i = 0; i < levelCount; ++i )
+				{
+					checked_write_( fof.file, levels[i].bytes.size(), levels[i].bytes.data() );
+
+					auto const end = table[i].offset + table[i].size;
+					auto const nextOffset = i+1 < levelCount ? table[i+1].offset : header.dataSize;
+					checked_write_( fof.file, nextOffset - end, kPadding );
+				}
+			}
+
+			std::filesystem::rename( tmppath, aDest );
+		}
+		catch( ... )
+		{
+			std::error_code ec;
+			std::filesystem::remove( tmppath, ec );
+			throw;
+		}
+	}
+}
+
+//--    bake_texture()                  ///{{{2///////////////////////////////
+lut::TextureFileFormat bake_texture( std::filesystem::path const& aSource, std::filesystem::path const& aDest, TextureUsage aUsage, bool aCompress, std::size_t aWorkerCount )
+{
+	auto base = decode_( aSource );
+
+	lut::TextureFileFormat format = lut::TextureFileFormat::rgba8_unorm;
+	switch( aUsage )
+	{
+		case TextureUsage::color:
+		{
+			bool opaque = true;
+			for( std::size_t i = 3; i < base.bytes.size() && opaque; i += 4 )
+				opaque = 255 == base.bytes[i];
+
+			if( !aCompress )
+				format = lut::TextureFileFormat::rgba8_srgb;
+			else
+				format = opaque ? lut::TextureFileFormat::bc1_srgb : lut::TextureFileFormat::bc3_srgb;
+		} break;
+		case TextureUsage::scalar:
+			format = aCompress ? lut::TextureFileFormat::bc4_unorm : lut::TextureFileFormat::rgba8_unorm;
+			break;
+		case TextureUsage::normal:
+			format = aCompress ? lut::TextureFileFormat::bc5_unorm : lut::TextureFileFormat::rgba8_unorm;
+			break;
+		case TextureUsage::packed:
+			format = aCompress ? lut::TextureFileFormat::bc5_unorm : lut::TextureFileFormat::rgba8_unorm;
+			break;
+	}
+
+	bake_levels_( std::move(base), aUsage, format, aDest, aWorkerCount );
+	return format;
+}
+
+//--    bake_packed_texture()           ///{{{2///////////////////////////////
+lut::TextureFileFormat bake_packed_texture( TextureChannelSource const (&aChannels)[2], std::filesystem::path const& aDest, bool aCompress, std::size_t aWorkerCount )
+{
+	Level_ sources[2];
+
+	std::uint32_t width = 1, height = 1;
+	for( std::size_t c = 0; c < 2; ++c )
+	{
+		if( aChannels[c].path.empty() )
+			continue;
+
+		sources[c] = decode_( aChannels[c].path );
+		width = std::max( width, sources[c].width );
+		height = std::max( height, sources[c].height );
+	}
+
+	// Sources of different sizes are resampled (nearest) to the largest one
+	Level_ base;
+	base.width = width;
+	base.height = height;
+	base.bytes.resize( std::size_t(width) * height * 4 );
+
+	for( std::size_t c = 0; c < 2; ++c )
+	{
+		auto const& src = sources[c];
+		if( aChannels[c].path.empty() )
+		{
+			auto const value = to_unorm8_( aChannels[c].value );
+			for( std::size_t i = 0; i < std::size_t(width) * height; ++i )
+				base.bytes[i*4+c] = value;
+
+			continue;
+		}
+
+		for( std::size_t y = 0; y < height; ++y )
+		{
+			auto const sy = y * src.height / height;
+			for( std::size_t x = 0; x < width; ++x )
+			{
+				auto const sx = x * src.width / width;
+				base.bytes[(y*width + x)*4 + c] = src.bytes[(sy*src.width + sx)*4];
+			}
+		}
+	}
+
+	for( std::size_t i = 0; i < std::size_t(width) * height; ++i )
+	{
+		base.bytes[i*4+2] = 0;
+		base.bytes[i*4+3] = 255;
+	}
+
+	auto const format = aCompress ? lut::TextureFileFormat::bc5_unorm : lut::TextureFileFormat::rgba8_unorm;
+	bake_levels_( std::move(base), TextureUsage::packed, format, aDest, aWorkerCount );
+	return format;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,66 @@
+#ifndef BAKE_TEXTURE_HPP_5A0D3E71_C2B8_4F96_9E14_83B7A6D2F04C
+#define BAKE_TEXTURE_HPP_5A0D3E71_C2B8_4F96_9E14_83B7A6D2F04C
+
+#include <filesystem>
+
+#include <cstddef>
+
+#include "../labutils/texture_file.hpp"
+
+enum class TextureUsage
+{
+	color,  // sRGB color, optionally with alpha (base color, alpha mask)
+	scalar, // linear, single channel (roughness, metalness)
+	normal, // tangent space normal map; only x and y are kept
+	packed  // linear, two channels (see bake_packed_texture())
+};
+
+struct TextureChannelSource
+{
+	std::filesystem::path path; // first channel of this image, or
+	float value; // this constant if path is empty
+};
+
+/* Decode an image (any format supported by stb_image) and write it as a baked
+ * texture with a complete mip chain. See labutils/texture_file.hpp for the
+ * file format.
+ *
+ * The format follows from the usage. With aCompress, color becomes BC1 (BC3
+ * if any texel is not fully opaque), scalar BC4, and normal and packed BC5.
+ * Otherwise, color is stored as RGBA8 sRGB, and the others as RGBA8 unorm. Returns the
+ * format that was written.
+ *
+ * Mip levels are computed with a 2x2 box filter. Color is converted to linear
+ * before filtering and back afterwards; alpha is filtered as-is. Normals are
+ * renormalized. Each level is computed from the unquantized previous one.
+ * Mip generation and block compression are distributed over up to
+ * aWorkerCount threads.
+ *
+ * The output is written to a temporary file that replaces aDest once it is
+ * complete. Throws lut::Error on failure.
+ */
+labutils::TextureFileFormat bake_texture(
+	std::filesystem::path const& aSource,
+	std::filesystem::path const& aDest,
+	TextureUsage,
+	bool aCompress,
+	std::size_t aWorkerCount
+);
+
+/* Pack two single-channel sources into the R and G channels of one baked
+ * texture (B is zero, alpha is one), e.g., roughness and metalness. Images of
+ * different sizes are resampled to the largest one. Otherwise as
+ * bake_texture() with TextureUsage::packed, which gives BC5 with aCompress
+ * and RGBA8 unorm otherwise.
+ *
+ * The channels are unrelated, so they are compressed independently (BC5)
+ * rather than along a shared color line (BC1).
+ */
+labutils::TextureFileFormat bake_packed_texture(
+	TextureChannelSource const (&aChannels)[2],
+	std::filesystem::path const& aDest,
+	bool aCompress,
+	std::size_t aWorkerCount
+);
+
+#endif // BAKE_TEXTURE_HPP_5A0D3E71_C2B8_4F96_9E14_83B7A6D2F04C
@@ -0,0 +1,285 @@
+#include "batch.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <numeric>
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <condition_variable>
+
+#include <cstdio>
+#include <cstdarg>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Output of the job running on this thread; see batch_printf()
+	thread_local std::string* currentJobLog_ = nullptr;
+
+	std::vector<std::string> split_manifest_line_( std::string const&, std::size_t aLine, std::filesystem::path const& );
+}
+
+//--    load_batch_manifest()           ///{{{2///////////////////////////////
+std::vector<BatchJob> load_batch_manifest( std::filesystem::path const& aPath )
+{
+	FILE* fin = std::fopen( aPath.string().c_str(), "rb" );
+	if( !fin )
+		throw lut::Error( "Unable to open manifest '%s'", aPath.string().c_str() );
+
+	std::string data;
+	char buffer[4096];
+	while( auto const read = std::fread( buffer, 1, sizeof(buffer), fin ) )
+		data.append( buffer, read );
+
+	bool const failed = std::ferror( fin );
+	std::fclose( fin );
+
+	if( failed )
+		throw lut::Error( "Error reading manifest '%s'", aPath.string().c_str() );
+
+	auto const base = aPath.parent_path();
+	auto const resolve_ = [&] (std::string const& aPath) {
+		std::filesystem::path const path( aPath );
+		return (path.is_absolute() ? path : base / path).lexically_normal().string();
+	};
+
+	std::vector<BatchJob> ret;
+
+	std::size_t line = 0;
+	for( std::size_t beg = 0; beg < data.size(); )
+	{
+		auto end = data.find( '\n', beg );
+		if( std::string::npos == end )
+			end = data.size();
+
+		++line;
+		auto const fields = split_manifest_line_( data.substr( beg, end-beg ), line, aPath );
+		beg = end+1;
+
+		if( fields.empty() )
+			continue;
+
+		if( 2 != fields.size() )
+			throw lut::Error( "%s:%zu: expected an input and an output path", aPath.string().c_str(), line );
+
+		BatchJob job;
+		job.input = resolve_( fields[0] );
+		job.output = resolve_( fields[1] );
+		ret.emplace_back( std::move(job) );
+	}
+
+	return ret;
+}
+
+//--    run_batch()                     ///{{{2///////////////////////////////
+std::vector<BatchResult> run_batch( std::vector<BatchJob> const& aJobs, BatchSettings const& aSettings, std::function<void(BatchJob const&,std::size_t)> const& aBake )
+{
+	std::vector<BatchResult> results( aJobs.size() );
+
+	// Jobs that have not started yet, largest first
+	std::vector<std::size_t> pending( aJobs.size() );
+	std::iota( pending.begin(), pending.end(), std::size_t(0) );
+	std::stable_sort( pending.begin(), pending.end(), [&] (std::size_t aX, std::size_t aY) {
+		return aJobs[aX].memoryEstimate > aJobs[aY].memoryEstimate;
+	} );
+
+	auto const runners = std::min( std::max( std::size_t(1), aSettings.maxConcurrent ), aJobs.size() );
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::uint64_t memoryInUse = 0;
+	std::size_t running = 0;
+
+	auto const fits_ = [&] (std::size_t aJob) {
+		return 0 == aSettings.memoryBudget
+			|| 0 == running
+			|| memoryInUse + aJobs[aJob].memoryEstimate <= aSettings.memoryBudget
+		;
+	};
+
+	auto const run_ = [&] {
+		for( ;; )
+		{
+			std::size_t job, workers;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+
+				// Take the largest pending job that fits into the budget.
+				// Without one, wait for a running job to finish.
+				auto it = pending.end();
+				changed.wait( lock, [&] {
+					it = std::find_if( pending.begin(), pending.end(), fits_ );
+					return pending.empty() || pending.end() != it;
+				} );
+
+				if( pending.empty() )
+					return;
+
+				job = *it;
+				pending.erase( it );
+
+				memoryInUse += aJobs[job].memoryEstimate;
+				++running;
+
+				// Split the workers between the models that can run at the
+				// same time as this one: those already running, and pending
+				// ones that would still fit into the budget.
+				std::size_t sharing = running;
+				std::uint64_t memory = memoryInUse;
+				for( auto const other : pending )
+				{
+					if( sharing >= runners )
+						break;
+
+					if( aSettings.memoryBudget && memory + aJobs[other].memoryEstimate > aSettings.memoryBudget )
+						continue;
+
+					memory += aJobs[other].memoryEstimate;
+					++sharing;
+				}
+
+				workers = std::max( std::size_t(1), aSettings.workerCount / sharing );
+			}
+
+			auto& result = results[job];
+			result.workerCount = workers;
+
+			std::string log;
+			currentJobLog_ = &log;
+
+			auto const start = std::chrono::steady_clock::now();
+			try
+			{
+				aBake( aJobs[job], workers );
+				result.succeeded = true;
+			}
+			catch( std::exception const& eErr )
+			{
+				result.error = eErr.what();
+			}
+			catch( ... )
+			{
+				result.error = "unknown exception";
+			}
+
+			result.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+			currentJobLog_ = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+
+				memoryInUse -= aJobs[job].memoryEstimate;
+				--running;
+
+				std::fputs( log.c_str(), stdout );
+				std::fflush( stdout );
+
+				if( !result.succeeded )
+					std::fprintf( stderr, "%s: FAILED: %s\n", aJobs[job].input.c_str(), result.error.c_str() );
+			}
+
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve( runners-1 );
+
+	try
+	{
+		for( std::size_t i = 1; i < runners; ++i )
+			threads.emplace_back( run_ );
+	}
+	catch( std::system_error const& )
+	{
+		// Continue with the threads that did start
+	}
+
+	run_();
+
+	for( auto& thread : threads )
+		thread.join();
+
+	return results;
+}
+
+//--    batch_printf()                  ///{{{2///////////////////////////////
+void batch_printf( char const* aFmt, ... )
+{
+	va_list args;
+	va_start( args, aFmt );
+
+	if( !currentJobLog_ )
+	{
+		std::vprintf( aFmt, args );
+		va_end( args );
+		return;
+	}
+
+	va_list copy;
+	va_copy( copy, args );
+	auto const length = std::vsnprintf( nullptr, 0, aFmt, copy );
+	va_end( copy );
+
+	if( length > 0 )
+	{
+		auto const offset = currentJobLog_->size();
+		currentJobLog_->resize( offset + std::size_t(length) + 1 );
+		std::vsnprintf( currentJobLog_->data() + offset, std::size_t(length) + 1, aFmt, args );
+		currentJobLog_->resize( offset + std::size_t(length) );
+	}
+
+	va_end( args );
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	std::vector<std::string> split_manifest_line_( std::string const& aLine, std::size_t aLineNumber, std::filesystem::path const& aPath )
+	{
+		std::vector<std::string> ret;
+
+		std::size_t i = 0;
+		auto const skip_space_ = [&] {
+			while( i < aLine.size() && (' ' == aLine[i] || '\t' == aLine[i] || '\r' == aLine[i]) )
+				++i;
+		};
+
+		skip_space_();
+		if( i < aLine.size() && '#' == aLine[i] )
+			return ret;
+
+		while( i < aLine.size() )
+		{
+			std::string field;
+			if( '"' == aLine[i] )
+			{
+				auto const close = aLine.find( '"', i+1 );
+				if( std::string::npos == close )
+					throw lut::Error( "%s:%zu: missing closing quote", aPath.string().c_str(), aLineNumber );
+
+				field = aLine.substr( i+1, close-i-1 );
+				i = close+1;
+			}
+			else
+			{
+				auto const beg = i;
+				while( i < aLine.size() && ' ' != aLine[i] && '\t' != aLine[i] && '\r' != aLine[i] )
+					++i;
+
+				field = aLine.substr( beg, i-beg );
+			}
+
+			ret.emplace_back( std::move(field) );
+			skip_space_();
+		}
+
+		return ret;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,78 @@
+#ifndef BATCH_HPP_8D2E5B17_C3A9_4F60_B1E4_6A07F92D3C58
+#define BATCH_HPP_8D2E5B17_C3A9_4F60_B1E4_6A07F92D3C58
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Baking of many models in one process.
+ *
+ * Models are baked concurrently, up to a maximum number at a time. The
+ * workers are shared: each model is given an equal part of them for its own
+ * parallel work (see labutils::parallel_for()), based on the number of
+ * models that can still run. Models are started largest first, which keeps a
+ * single large model from delaying the end of the batch.
+ *
+ * Optionally, the estimated memory use of the running models is kept below a
+ * budget. A model that does not fit waits for others to finish. A model that
+ * exceeds the budget by itself still runs, but only alone.
+ *
+ * A model that fails (i.e., throws) is reported, and the remaining models are
+ * baked regardless. Errors that end the process (crashes, std::terminate())
+ * are not isolated.
+ */
+
+struct BatchJob
+{
+	std::string input; // OBJ file
+	std::string output; // .comp5822mesh file
+
+	// Estimated peak memory use when baking, in bytes
+	std::uint64_t memoryEstimate = 0;
+};
+
+struct BatchSettings
+{
+	std::size_t workerCount = 1;
+
+	// Maximum number of models baked at the same time
+	std::size_t maxConcurrent = 1;
+
+	// Zero means no limit
+	std::uint64_t memoryBudget = 0;
+};
+
+struct BatchResult
+{
+	bool succeeded = false;
+	std::string error; // if !succeeded
+
+	double seconds = 0.0;
+	std::size_t workerCount = 0;
+};
+
+// Reads jobs from a manifest. Each line holds an input and an output path,
+// separated by whitespace; paths that contain whitespace are enclosed in
+// double quotes. Relative paths are relative to the manifest's directory.
+// Empty lines and lines starting with '#' are ignored. Throws lut::Error.
+std::vector<BatchJob> load_batch_manifest( std::filesystem::path const& );
+
+// Calls aBake( job, workerCount ) for each job, as described above. Returns
+// one result per job, in the order of aJobs.
+std::vector<BatchResult> run_batch(
+	std::vector<BatchJob> const& aJobs,
+	BatchSettings const&,
+	std::function<void(BatchJob const&,std::size_t)> const& aBake
+);
+
+// Like std::printf(). While a job of run_batch() runs (and only on the thread
+// that called aBake), the output is collected instead, and printed in one
+// piece once the job has finished. This keeps the output of concurrent jobs
+// apart.
+void batch_printf( char const* aFmt, ... );
+
+#endif // BATCH_HPP_8D2E5B17_C3A9_4F60_B1E4_6A07F92D3C58
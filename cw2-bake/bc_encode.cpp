@@ -0,0 +1,245 @@
+#include "bc_encode.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	struct Color_
+	{
+		float r, g, b;
+	};
+
+	std::uint16_t pack_565_( Color_ const& aColor )
+	{
+		auto const q = [] (float aX, float aMax) {
+			return unsigned( std::clamp( aX, 0.f, 255.f ) * aMax / 255.f + 0.5f );
+		};
+
+		return std::uint16_t( (q( aColor.r, 31.f ) << 11) | (q( aColor.g, 63.f ) << 5) | q( aColor.b, 31.f ) );
+	}
+
+	Color_ unpack_565_( std::uint16_t aColor )
+	{
+		unsigned const r = (aColor >> 11) & 31, g = (aColor >> 5) & 63, b = aColor & 31;
+		return Color_{
+			float( (r << 3) | (r >> 2) ),
+			float( (g << 2) | (g >> 4) ),
+			float( (b << 3) | (b >> 2) )
+		};
+	}
+
+	float distance2_( Color_ const& aA, Color_ const& aB )
+	{
+		float const dr = aA.r - aB.r, dg = aA.g - aB.g, db = aA.b - aB.b;
+		return dr*dr + dg*dg + db*db;
+	}
+
+	// Selects the closest palette entry for each texel. Returns the total
+	// squared error; the indices are written to aIndices.
+	float select_bc1_indices_( Color_ const (&aTexels)[16], std::uint16_t aC0, std::uint16_t aC1, std::uint32_t& aIndices )
+	{
+		auto const c0 = unpack_565_( aC0 ), c1 = unpack_565_( aC1 );
+
+		Color_ const palette[4] = {
+			c0, c1,
+			{ (2.f*c0.r + c1.r) / 3.f, (2.f*c0.g + c1.g) / 3.f, (2.f*c0.b + c1.b) / 3.f },
+			{ (c0.r + 2.f*c1.r) / 3.f, (c0.g + 2.f*c1.g) / 3.f, (c0.b + 2.f*c1.b) / 3.f }
+		};
+
+		float error = 0.f;
+		aIndices = 0;
+		for( unsigned i = 0; i < 16; ++i )
+		{
+			unsigned best = 0;
+			float bestError = distance2_( aTexels[i], palette[0] );
+			for( unsigned k = 1; k < 4; ++k )
+			{
+				float const e = distance2_( aTexels[i], palette[k] );
+				if( e < bestError )
+				{
+					bestError = e;
+					best = k;
+				}
+			}
+
+			aIndices |= best << (2*i);
+			error += bestError;
+		}
+
+		return error;
+	}
+
+	// Four-color mode requires c0 > c1. Swapping the endpoints maps index 0
+	// to 1 and 2 to 3 (and vice versa), which is an xor with 01 per texel.
+	void order_bc1_endpoints_( std::uint16_t& aC0, std::uint16_t& aC1, std::uint32_t& aIndices )
+	{
+		if( aC0 < aC1 )
+		{
+			std::swap( aC0, aC1 );
+			aIndices ^= 0x55555555u;
+		}
+		else if( aC0 == aC1 )
+		{
+			aIndices = 0;
+		}
+	}
+
+	void encode_bc1_color_( std::uint8_t const aTexels[64], std::uint8_t aOut[8] )
+	{
+		Color_ texels[16];
+		Color_ mean{ 0.f, 0.f, 0.f };
+		for( unsigned i = 0; i < 16; ++i )
+		{
+			texels[i] = Color_{ float(aTexels[i*4+0]), float(aTexels[i*4+1]), float(aTexels[i*4+2]) };
+			mean.r += texels[i].r / 16.f;
+			mean.g += texels[i].g / 16.f;
+			mean.b += texels[i].b / 16.f;
+		}
+
+		// Principal axis of the colors (power iteration on the covariance)
+		float cov[6] = {}; // rr, rg, rb, gg, gb, bb
+		for( auto const& t : texels )
+		{
+			float const r = t.r - mean.r, g = t.g - mean.g, b = t.b - mean.b;
+			cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+			cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+		}
+
+		Color_ axis{ 1.f, 1.f, 1.f };
+		for( unsigned iter = 0; iter < 8; ++iter )
+		{
+			Color_ const next{
+				cov[0]*axis.r + cov[1]*axis.g + cov[2]*axis.b,
+				cov[1]*axis.r + cov[3]*axis.g + cov[4]*axis.b,
+				cov[2]*axis.r + cov[4]*axis.g + cov[5]*axis.b
+			};
+
+			float const len = std::max( std::abs( next.r ), std::max( std::abs( next.g ), std::abs( next.b ) ) );
+			if( len < 1e-6f )
+				break;
+
+			axis = Color_{ next.r / len, next.g / len, next.b / len };
+		}
+
+		float const axisLen2 = axis.r*axis.r + axis.g*axis.g + axis.b*axis.b;
+
+		// Endpoints at the extents of the projection
+		float tmin = 0.f, tmax = 0.f;
+		for( auto const& t : texels )
+		{
+			float const proj = ((t.r - mean.r)*axis.r + (t.g - mean.g)*axis.g + (t.b - mean.b)*axis.b) / axisLen2;
+			tmin = std::min( tmin, proj );
+			tmax = std::max( tmax, proj );
+		}
+
+		std::uint16_t c0 = pack_565_( Color_{ mean.r + tmax*axis.r, mean.g + tmax*axis.g, mean.b + tmax*axis.b } );
+		std::uint16_t c1 = pack_565_( Color_{ mean.r + tmin*axis.r, mean.g + tmin*axis.g, mean.b + tmin*axis.b } );
+
+		std::uint32_t indices;
+		float error = select_bc1_indices_( texels, c0, c1, indices );
+
+		// Refine: least-squares endpoints for the chosen indices
+		if( error > 0.f && c0 != c1 )
+		{
+			constexpr float kWeights[4] = { 1.f, 0.f, 2.f/3.f, 1.f/3.f }; // weight of c0
+
+			float aa = 0.f, bb = 0.f, ab = 0.f;
+			Color_ ax{ 0.f, 0.f, 0.f }, bx{ 0.f, 0.f, 0.f };
+			for( unsigned i = 0; i < 16; ++i )
+			{
+				float const a = kWeights[(indices >> (2*i)) & 3], b = 1.f - a;
+				aa += a*a; bb += b*b; ab += a*b;
+				ax.r += a*texels[i].r; ax.g += a*texels[i].g; ax.b += a*texels[i].b;
+				bx.r += b*texels[i].r; bx.g += b*texels[i].g; bx.b += b*texels[i].b;
+			}
+
+			float const det = aa*bb - ab*ab;
+			if( std::abs( det ) > 1e-6f )
+			{
+				float const inv = 1.f / det;
+				std::uint16_t const r0 = pack_565_( Color_{
+					(ax.r*bb - bx.r*ab) * inv,
+					(ax.g*bb - bx.g*ab) * inv,
+					(ax.b*bb - bx.b*ab) * inv
+				} );
+				std::uint16_t const r1 = pack_565_( Color_{
+					(bx.r*aa - ax.r*ab) * inv,
+					(bx.g*aa - ax.g*ab) * inv,
+					(bx.b*aa - ax.b*ab) * inv
+				} );
+
+				std::uint32_t refined;
+				float const refinedError = select_bc1_indices_( texels, r0, r1, refined );
+				if( refinedError < error )
+				{
+					c0 = r0;
+					c1 = r1;
+					indices = refined;
+					error = refinedError;
+				}
+			}
+		}
+
+		order_bc1_endpoints_( c0, c1, indices );
+
+		std::memcpy( aOut+0, &c0, sizeof(c0) );
+		std::memcpy( aOut+2, &c1, sizeof(c1) );
+		std::memcpy( aOut+4, &indices, sizeof(indices) );
+	}
+}
+
+//--    encode_bc1()                    ///{{{2///////////////////////////////
+void encode_bc1( std::uint8_t const aTexels[64], std::uint8_t aOut[8] )
+{
+	encode_bc1_color_( aTexels, aOut );
+}
+
+//--    encode_bc3()                    ///{{{2///////////////////////////////
+void encode_bc3( std::uint8_t const aTexels[64], std::uint8_t aOut[16] )
+{
+	encode_bc4( aTexels, aOut, 3 );
+	encode_bc1_color_( aTexels, aOut+8 );
+}
+
+//--    encode_bc4()                    ///{{{2///////////////////////////////
+void encode_bc4( std::uint8_t const aTexels[64], std::uint8_t aOut[8], unsigned aChannel )
+{
+	unsigned lo = 255, hi = 0;
+	for( unsigned i = 0; i < 16; ++i )
+	{
+		lo = std::min<unsigned>( lo, aTexels[i*4+aChannel] );
+		hi = std::max<unsigned>( hi, aTexels[i*4+aChannel] );
+	}
+
+	// Eight-value mode (e0 > e1): e0, e1, then six values from e0 towards
+	// e1. A texel at step k (of 7) from lo towards hi thus gets index 1 for
+	// k = 0, 0 for k = 7, and 8-k otherwise.
+	std::uint64_t indices = 0;
+	if( hi > lo )
+	{
+		float const scale = 7.f / float(hi - lo);
+		for( unsigned i = 0; i < 16; ++i )
+		{
+			auto const k = unsigned( (aTexels[i*4+aChannel] - lo) * scale + 0.5f );
+			std::uint64_t const index = 0 == k ? 1 : (7 == k ? 0 : 8-k);
+			indices |= index << (3*i);
+		}
+	}
+
+	aOut[0] = std::uint8_t(hi);
+	aOut[1] = std::uint8_t(lo);
+	for( unsigned i = 0; i < 6; ++i )
+		aOut[2+i] = std::uint8_t( indices >> (8*i) );
+}
+
+//--    encode_bc5()                    ///{{{2///////////////////////////////
+void encode_bc5( std::uint8_t const aTexels[64], std::uint8_t aOut[16] )
+{
+	encode_bc4( aTexels, aOut, 0 );
+	encode_bc4( aTexels, aOut+8, 1 );
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,30 @@
+#ifndef BC_ENCODE_HPP_8E2B4C17_6F0A_4D93_B5C8_1A7D3E9F2064
+#define BC_ENCODE_HPP_8E2B4C17_6F0A_4D93_B5C8_1A7D3E9F2064
+
+#include <cstdint>
+
+/* Block compression (BCn) of single 4x4 blocks. The input is always 16 RGBA8
+ * texels in row-major order; each encoder only looks at the channels its
+ * format stores. Values are encoded as-is, i.e., sRGB color is compressed in
+ * sRGB space (as with the *_SRGB_BLOCK formats).
+ *
+ * The encoders aim for reasonable quality at a low cost, not for the best
+ * possible result:
+ *  - BC1: endpoints along the principal axis of the block's colors, followed
+ *    by one least-squares refinement. Always uses the four-color mode.
+ *  - BC4: endpoints at the block's minimum and maximum, eight-value mode.
+ */
+
+// 8 bytes: RGB, alpha ignored
+void encode_bc1( std::uint8_t const aTexels[64], std::uint8_t aOut[8] );
+
+// 16 bytes: BC4 alpha block followed by a BC1 color block
+void encode_bc3( std::uint8_t const aTexels[64], std::uint8_t aOut[16] );
+
+// 8 bytes: channel aChannel (0-3) only
+void encode_bc4( std::uint8_t const aTexels[64], std::uint8_t aOut[8], unsigned aChannel = 0 );
+
+// 16 bytes: R and G in two BC4 blocks
+void encode_bc5( std::uint8_t const aTexels[64], std::uint8_t aOut[16] );
+
+#endif // BC_ENCODE_HPP_8E2B4C17_6F0A_4D93_B5C8_1A7D3E9F2064
@@ -1,18 +1,46 @@
 #include "index_mesh.hpp"
 
-#include <numeric>
+#include <limits>
 #include <unordered_map>
+#include <numeric>
+#include <algorithm>
 
+#include <cassert>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
 
 #include <glm/glm.hpp>
 
+#include "input_model.hpp"
+
+#include "../labutils/parallel.hpp"
+namespace lut = labutils;
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <immintrin.h>
+#	define INDEX_MESH_SIMD_ 1
+#endif
+
 namespace
 {
 	// Tweakables
 	constexpr float kAABBMarginFactor = 10.f;
 	constexpr std::size_t kSparseGridMaxSize = 1024*1024;
 
+	// Faces or vertices per work item in ensure_normals()
+	constexpr std::size_t kNormalChunkSize = 16*1024;
+
+	// Positions with more corners than this compare buckets of similar face
+	// normals in ensure_normals(), rather than all pairs of faces. Faces
+	// within kNormalBucketAngle (radians) of a bucket's first face share it.
+	constexpr std::size_t kMaxPairwiseCorners = 64;
+	constexpr float kNormalBucketAngle = 0.035f; // ~2 degrees
+
+	constexpr float kPi = 3.14159265358979f;
+
+	constexpr unsigned kRadixBits = 11;
+
 	// Discretize mesh positions
 	struct DiscretizedPosition_
 	{
@@ -28,26 +56,77 @@ namespace
 		float scale;
 	};
 
-	// hash discretized mesh positions
-	using VicinityKey_ = std::size_t;
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aPos );
+	// Pack discretized mesh positions into sortable cell keys. With x in the
+	// lowest bits, the cells (x-1,y,z), (x,y,z) and (x+1,y,z) are adjacent in
+	// sorted order, so each row of neighbouring cells is a single contiguous
+	// range.
+	using CellKey_ = std::uint64_t;
 
-	// generate vicinity map 
-	using VicinityMap_ = std::unordered_multimap<VicinityKey_,std::size_t>;
-	void build_vicinity_map_( 
-		VicinityMap_&, 
+	struct CellKeyPacker_
+	{
+		explicit CellKeyPacker_( std::uint32_t aFactor );
+		inline CellKey_ pack( std::uint32_t aX, std::uint32_t aY, std::uint32_t aZ ) const;
+
+		unsigned bits;
+	};
+
+	// Vertex data packed into a single record: position, normal, texture
+	// coordinate. Two vertices are compared with a single (AVX) or two (SSE)
+	// vector compares.
+	struct alignas(32) VertexRecord_
+	{
+		float v[8];
+	};
+
+	static_assert( sizeof(VertexRecord_) == 8*sizeof(float) );
+
+	// Flat spatial grid: vertices sorted by cell key.
+	struct SpatialGrid_
+	{
+		// Vertex indices and packed vertex records, both sorted by cell
+		std::vector<std::uint32_t> order;
+		std::vector<VertexRecord_> records;
+
+		// Position of each (original) vertex in the sorted arrays, and the
+		// (unique) cell that it belongs to.
+		std::vector<std::uint32_t> rank;
+		std::vector<std::uint32_t> cellOf;
+
+		// Ranges of sorted vertices for the nine neighbouring rows of each
+		// cell. Each row covers three cells along x.
+		static constexpr std::size_t kRowCount = 9;
+		struct Span { std::uint32_t begin, end; };
+		std::vector<Span> rows;
+	};
+
+	void build_spatial_grid_(
+		SpatialGrid_&,
 		Discretizer_ const&,
-		std::vector<glm::vec3> const&
+		CellKeyPacker_ const&,
+		TriangleSoup const&
+	);
+
+	void radix_sort_keys_(
+		std::vector<CellKey_>&,
+		std::vector<std::uint32_t>& aValues,
+		unsigned aKeyBits
 	);
 
 	// is a vertex mergable?
-	bool mergable_( 
-		TriangleSoup const&, 
-		std::size_t aVertexAIndex, std::size_t aVertexBIndex,
-		glm::vec3 const& aVertexAPos, glm::vec3 const& aVertexBPos,
+	inline bool mergable_(
+		VertexRecord_ const&,
+		VertexRecord_ const&,
 		float
 	);
 
+	// exact deduplication of input vertices
+	std::size_t dedup_input_vertices_(
+		std::vector<std::uint32_t>& aIndices,
+		std::vector<InputVertex>& aUnique,
+		InputVertex const*,
+		std::size_t aCount
+	);
+
 	// collapse vertices
 	using VertexMapping_ = std::vector<std::size_t>;
 	using IndexBuffer_ = std::vector<std::uint32_t>;
@@ -55,9 +134,7 @@ namespace
 	std::size_t collapse_vertices_( 
 		IndexBuffer_&, 
 		VertexMapping_&, 
-		VicinityMap_ const&, 
-		Discretizer_ const&, 
-		TriangleSoup const&, 
+		SpatialGrid_ const&, 
 		float
 	);
 
@@ -66,15 +143,22 @@ namespace
 //--    IndexedMesh                     ///{{{2///////////////////////////////
 IndexedMesh::IndexedMesh()
 	: aabbMin( std::numeric_limits<float>::max() )
-	, aabbMax( std::numeric_limits<float>::min() )
+	, aabbMax( std::numeric_limits<float>::lowest() )
 {}
 
 //--    make_indexed_mesh()             ///{{{2///////////////////////////////
 IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance )
 {
+	assert( aSoup.vert.size() == aSoup.text.size() );
+	assert( aSoup.norm.empty() || aSoup.vert.size() == aSoup.norm.size() );
+	assert( aSoup.vert.size() <= std::numeric_limits<std::uint32_t>::max() );
+
+	if( aSoup.vert.empty() )
+		return IndexedMesh();
+
 	// compute bounding volume
 	glm::vec3 bmin( std::numeric_limits<float>::max() );
-	glm::vec3 bmax( std::numeric_limits<float>::min() );
+	glm::vec3 bmax( std::numeric_limits<float>::lowest() );
 
 	for( std::size_t vert = 0; vert < aSoup.vert.size(); ++vert )
 	{
@@ -94,16 +178,17 @@ IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance
 
 	// parameters for discretization
 	Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+	CellKeyPacker_ packer( static_cast<std::uint32_t>(subdiv) );
 
-	// build the vincinity map
-	VicinityMap_ vincinityMap;
-	build_vicinity_map_( vincinityMap, dis, aSoup.vert );
+	// build the spatial grid
+	SpatialGrid_ grid;
+	build_spatial_grid_( grid, dis, packer, aSoup );
 
 	// collapse vertices
 	IndexBuffer_ indices;
 	VertexMapping_ vertexMapping;
 
-	size_t verts = collapse_vertices_( indices, vertexMapping, vincinityMap, dis, aSoup, aErrorTolerance );
+	size_t verts = collapse_vertices_( indices, vertexMapping, grid, aErrorTolerance );
 
 	assert( indices.size() == aSoup.vert.size() );
 	assert( verts == vertexMapping.size() );
@@ -138,48 +223,548 @@ IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance
 	return ret;
 }
 
-#if 0
+IndexedMesh make_indexed_mesh( InputModel const& aModel, InputMeshInfo const& aMesh, float aErrorTolerance )
+{
+	assert( aMesh.vertexStartIndex + aMesh.vertexCount <= aModel.vertices.size() );
+
+	// Merge vertices with identical index triples
+	std::vector<std::uint32_t> indices;
+	std::vector<InputVertex> unique;
+	dedup_input_vertices_( indices, unique, aModel.vertices.data() + aMesh.vertexStartIndex, aMesh.vertexCount );
+
+	// Gather vertex data. Normals are only included if at least one of the
+	// vertices has one. Missing attributes are set to zero.
+	bool hasNormals = false;
+	for( auto const& v : unique )
+		hasNormals = hasNormals || kNoInputAttribute != v.normal;
+
+	TriangleSoup verts;
+	verts.vert.reserve( unique.size() );
+	verts.text.reserve( unique.size() );
+	if( hasNormals )
+		verts.norm.reserve( unique.size() );
+
+	for( auto const& v : unique )
+	{
+		assert( v.position < aModel.positions.size() );
+		verts.vert.emplace_back( aModel.positions[v.position] );
+
+		assert( kNoInputAttribute == v.texcoord || v.texcoord < aModel.texcoords.size() );
+		verts.text.emplace_back( kNoInputAttribute != v.texcoord ? aModel.texcoords[v.texcoord] : glm::vec2( 0.f ) );
+
+		if( hasNormals )
+		{
+			assert( kNoInputAttribute == v.normal || v.normal < aModel.normals.size() );
+			verts.norm.emplace_back( kNoInputAttribute != v.normal ? aModel.normals[v.normal] : glm::vec3( 0.f ) );
+		}
+	}
+
+	// Weld remaining vertices, if requested. This runs on the (much smaller)
+	// set of unique vertices. The welded mesh's indices map each unique
+	// vertex to its output vertex.
+	if( aErrorTolerance > 0.f )
+	{
+		auto ret = make_indexed_mesh( verts, aErrorTolerance );
+		assert( ret.indices.size() == unique.size() );
+
+		for( auto& index : indices )
+			index = ret.indices[index];
+
+		ret.indices = std::move(indices);
+		return ret;
+	}
+
+	IndexedMesh ret;
+	for( auto const& pos : verts.vert )
+	{
+		ret.aabbMin = min( ret.aabbMin, pos );
+		ret.aabbMax = max( ret.aabbMax, pos );
+	}
+
+	ret.vert = std::move(verts.vert);
+	ret.norm = std::move(verts.norm);
+	ret.text = std::move(verts.text);
+	ret.indices = std::move(indices);
+
+	return ret;
+}
+
+//--    position_remap()                ///{{{2///////////////////////////////
+std::vector<std::uint32_t> position_remap( std::vector<glm::vec3> const& aPositions )
+{
+	struct Key_
+	{
+		std::uint32_t bits[3];
+		bool operator==( Key_ const& aOther ) const
+		{
+			return 0 == std::memcmp( bits, aOther.bits, sizeof(bits) );
+		}
+	};
+	struct Hash_
+	{
+		std::size_t operator()( Key_ const& aKey ) const
+		{
+			std::uint64_t h = 0xcbf29ce484222325ull;
+			for( auto const b : aKey.bits )
+				h = (h ^ b) * 0x100000001b3ull;
+			return std::size_t(h ^ (h >> 29));
+		}
+	};
+
+	std::unordered_map<Key_,std::uint32_t,Hash_> first;
+	first.reserve( aPositions.size() );
+
+	std::vector<std::uint32_t> ret( aPositions.size() );
+	for( std::uint32_t i = 0; i < aPositions.size(); ++i )
+	{
+		Key_ key;
+		std::memcpy( key.bits, &aPositions[i], sizeof(key.bits) );
+
+		ret[i] = first.emplace( key, i ).first->second;
+	}
+
+	return ret;
+}
+
 //--    ensure_normals()                ///{{{2///////////////////////////////
-void ensure_normals( IndexedMesh& aMesh )
+std::size_t ensure_normals( IndexedMesh& aMesh, float aCreaseAngle, std::size_t aWorkerCount )
 {
-	// Got normals? Done.
-	if( !aMesh.norm.empty() )
-		return;
+	std::size_t const vertexCount = aMesh.vert.size();
+	std::size_t const cornerCount = aMesh.indices.size() - aMesh.indices.size() % 3;
+
+	assert( aMesh.tangent.empty() && aMesh.packedTbn.empty() );
+	assert( aMesh.text.empty() || aMesh.text.size() == vertexCount );
+	assert( aMesh.norm.empty() || aMesh.norm.size() == vertexCount );
+
+	// Vertices that need a normal: all of them, or those whose normal was
+	// missing in the input (zero)
+	if( aMesh.norm.empty() )
+		aMesh.norm.assign( vertexCount, glm::vec3( 0.f ) );
+
+	std::vector<std::uint8_t> missing( vertexCount );
+	std::size_t missingCount = 0;
+	for( std::size_t i = 0; i < vertexCount; ++i )
+	{
+		missing[i] = glm::vec3( 0.f ) == aMesh.norm[i];
+		missingCount += missing[i];
+	}
+
+	if( 0 == missingCount )
+		return 0;
+
+	auto const chunks_ = [] (std::size_t aCount) {
+		return (aCount + kNormalChunkSize - 1) / kNormalChunkSize;
+	};
+
+	// Unit face normals, and the weight of each corner: the face's area
+	// times the angle at the corner. Zero for degenerate faces.
+	std::vector<glm::vec3> faceNormals( cornerCount/3 );
+	std::vector<float> cornerWeights( cornerCount );
+
+	lut::parallel_for( chunks_( faceNormals.size() ), aWorkerCount, [&] (std::size_t aChunk) {
+		auto const end = std::min( faceNormals.size(), (aChunk+1)*kNormalChunkSize );
+		for( std::size_t face = aChunk*kNormalChunkSize; face < end; ++face )
+		{
+			glm::vec3 const p[3] = {
+				aMesh.vert[aMesh.indices[face*3+0]],
+				aMesh.vert[aMesh.indices[face*3+1]],
+				aMesh.vert[aMesh.indices[face*3+2]]
+			};
+
+			auto const n = glm::cross( p[1] - p[0], p[2] - p[0] );
+			float const doubleArea = glm::length( n );
+			faceNormals[face] = doubleArea > 0.f ? n / doubleArea : glm::vec3( 0.f );
+
+			if( !(doubleArea > 0.f) )
+			{
+				for( std::size_t k = 0; k < 3; ++k )
+					cornerWeights[face*3+k] = 0.f;
+				continue;
+			}
+
+			// Edge k runs from corner k to corner k+1. Each edge is
+			// normalized once; the angle at corner k is then between edge k
+			// and the reversed edge k-1.
+			glm::vec3 edges[3];
+			for( std::size_t k = 0; k < 3; ++k )
+				edges[k] = glm::normalize( p[(k+1)%3] - p[k] );
+
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				float const cosAngle = -glm::dot( edges[k], edges[(k+2)%3] );
+				float const angle = std::acos( std::clamp( cosAngle, -1.f, 1.f ) );
+				cornerWeights[face*3+k] = 0.5f * doubleArea * angle;
+			}
+		}
+	} );
+
+	// Normals are accumulated per position, over the faces of all vertices
+	// that share it, so that vertices split by a texture seam get the same
+	// normal. remap maps each vertex to the first vertex at its position.
+	auto const remap = position_remap( aMesh.vert );
+
+	std::vector<std::uint8_t> positionMissing( vertexCount, 0 );
+	for( std::size_t i = 0; i < vertexCount; ++i )
+		positionMissing[remap[i]] |= missing[i];
+
+	// Position-to-corner adjacency (CSR) of the positions that need a
+	// normal: the corners at position p are adjCorners[adjOffsets[p]] to
+	// adjCorners[adjOffsets[p+1]-1], in increasing order. Each position
+	// then gathers its own sum, so the passes below need no
+	// synchronization.
+	std::vector<std::uint32_t> adjOffsets( vertexCount+1, 0 );
+	for( std::size_t i = 0; i < cornerCount; ++i )
+	{
+		auto const p = remap[aMesh.indices[i]];
+		adjOffsets[p+1] += positionMissing[p];
+	}
+
+	std::partial_sum( adjOffsets.begin(), adjOffsets.end(), adjOffsets.begin() );
+
+	std::vector<std::uint32_t> adjCorners( adjOffsets.back() );
+	{
+		std::vector<std::uint32_t> cursor( adjOffsets.begin(), adjOffsets.end()-1 );
+		for( std::size_t i = 0; i < cornerCount; ++i )
+		{
+			auto const p = remap[aMesh.indices[i]];
+			if( positionMissing[p] )
+				adjCorners[cursor[p]++] = std::uint32_t(i);
+		}
+	}
+
+	// Vertices without any (non-degenerate) faces get an arbitrary, but
+	// valid, normal; later steps expect unit normals.
+	auto const safe_normalize_ = [] (glm::vec3 const& aSum) {
+		float const length = glm::length( aSum );
+		return length > 0.f ? aSum / length : glm::vec3( 0.f, 0.f, 1.f );
+	};
+
+	// Without creases, each position gets the weighted sum of all its faces,
+	// which is then copied to the vertices at that position
+	if( aCreaseAngle >= kPi )
+	{
+		std::vector<glm::vec3> positionNormals( vertexCount );
+
+		lut::parallel_for( chunks_( vertexCount ), aWorkerCount, [&] (std::size_t aChunk) {
+			auto const end = std::min( vertexCount, (aChunk+1)*kNormalChunkSize );
+			for( std::size_t p = aChunk*kNormalChunkSize; p < end; ++p )
+			{
+				if( !positionMissing[p] )
+					continue;
+
+				glm::vec3 sum( 0.f );
+				for( auto i = adjOffsets[p]; i < adjOffsets[p+1]; ++i )
+				{
+					auto const corner = adjCorners[i];
+					sum += cornerWeights[corner] * faceNormals[corner/3];
+				}
+
+				positionNormals[p] = safe_normalize_( sum );
+			}
+		} );
+
+		lut::parallel_for( chunks_( vertexCount ), aWorkerCount, [&] (std::size_t aChunk) {
+			auto const end = std::min( vertexCount, (aChunk+1)*kNormalChunkSize );
+			for( std::size_t v = aChunk*kNormalChunkSize; v < end; ++v )
+			{
+				if( missing[v] )
+					aMesh.norm[v] = positionNormals[remap[v]];
+			}
+		} );
+
+		return missingCount;
+	}
+
+	// With creases, each corner only sums the faces at its position whose
+	// normal is within the crease angle of its own face's (all faces for
+	// degenerate ones). Corners of a vertex whose sums differ are then
+	// split off into new vertices, one per distinct normal. The sums are
+	// formed in the same order for all corners at a position, so corners
+	// with the same set of faces produce identical normals, also across
+	// the vertices at that position.
+	//
+	// Comparing all pairs of faces is quadratic in the number of corners at
+	// a position. Above kMaxPairwiseCorners, the faces are first gathered
+	// into buckets of similar normals, and the crease test compares the
+	// buckets' first normals instead. All corners of a bucket then get the
+	// same normal.
+	float const cosCrease = std::cos( aCreaseAngle );
+	float const cosBucket = std::cos( kNormalBucketAngle );
+
+	std::vector<glm::vec3> cornerNormals( cornerCount );
+	std::vector<std::uint32_t> cornerGroups( cornerCount, 0 );
+	std::vector<std::uint32_t> extraVertices( vertexCount+1, 0 );
+
+	// Unreferenced vertices keep this
+	for( std::size_t v = 0; v < vertexCount; ++v )
+	{
+		if( missing[v] )
+			aMesh.norm[v] = glm::vec3( 0.f, 0.f, 1.f );
+	}
+
+	lut::parallel_for( chunks_( vertexCount ), aWorkerCount, [&] (std::size_t aChunk) {
+		// Distinct normals of the corners at the current position, per
+		// vertex. The group of a corner is the rank of its normal among
+		// those of its vertex.
+		struct Group_
+		{
+			std::uint32_t vertex;
+			std::uint32_t rank;
+			glm::vec3 normal;
+		};
+		std::vector<Group_> groups;
+
+		struct Bucket_
+		{
+			glm::vec3 normal; // of the first face
+			glm::vec3 sum;
+			glm::vec3 result;
+		};
+		std::vector<Bucket_> buckets;
+		std::vector<std::uint32_t> cornerBuckets;
+
+		// Crease-limited sums of the corners at position aP (see above)
+		auto const corner_normals_ = [&] (std::size_t aP) {
+			auto const begin = adjOffsets[aP], end = adjOffsets[aP+1];
+
+			if( end - begin <= kMaxPairwiseCorners )
+			{
+				for( auto i = begin; i < end; ++i )
+				{
+					auto const corner = adjCorners[i];
+					if( !missing[aMesh.indices[corner]] )
+						continue;
+
+					auto const& own = faceNormals[corner/3];
+					bool const degenerate = glm::vec3( 0.f ) == own;
+
+					glm::vec3 sum( 0.f );
+					for( auto j = begin; j < end; ++j )
+					{
+						auto const other = adjCorners[j];
+						auto const& n = faceNormals[other/3];
+						if( degenerate || glm::dot( own, n ) >= cosCrease )
+							sum += cornerWeights[other] * n;
+					}
+
+					cornerNormals[corner] = safe_normalize_( sum );
+				}
+
+				return;
+			}
+
+			// Degenerate faces have no weight, and go to no bucket
+			constexpr std::uint32_t kNoBucket_ = ~std::uint32_t(0);
+
+			buckets.clear();
+			cornerBuckets.clear();
+
+			glm::vec3 total( 0.f );
+			for( auto i = begin; i < end; ++i )
+			{
+				auto const corner = adjCorners[i];
+				auto const& n = faceNormals[corner/3];
+
+				std::uint32_t bucket = kNoBucket_;
+				if( glm::vec3( 0.f ) != n )
+				{
+					bucket = 0;
+					while( bucket < buckets.size() && glm::dot( buckets[bucket].normal, n ) < cosBucket )
+						++bucket;
+
+					if( buckets.size() == bucket )
+						buckets.emplace_back( Bucket_{ n, glm::vec3( 0.f ), glm::vec3( 0.f ) } );
+
+					buckets[bucket].sum += cornerWeights[corner] * n;
+				}
+
+				total += cornerWeights[corner] * n;
+				cornerBuckets.emplace_back( bucket );
+			}
 
-	// Nope?
-	aMesh.norm.resize( aMesh.vert.size(), glm::vec3(0.f) );
+			for( auto& bucket : buckets )
+			{
+				glm::vec3 sum( 0.f );
+				for( auto const& other : buckets )
+				{
+					if( glm::dot( bucket.normal, other.normal ) >= cosCrease )
+						sum += other.sum;
+				}
+
+				// The bucket's own faces count even for tiny crease angles
+				if( !(glm::dot( bucket.normal, bucket.normal ) >= cosCrease) )
+					sum += bucket.sum;
+
+				bucket.result = safe_normalize_( sum );
+			}
+
+			auto const all = safe_normalize_( total );
+			for( auto i = begin; i < end; ++i )
+			{
+				auto const corner = adjCorners[i];
+				auto const bucket = cornerBuckets[i-begin];
+				cornerNormals[corner] = kNoBucket_ == bucket ? all : buckets[bucket].result;
+			}
+		};
 
-	for( size_t face = 0; face < aMesh.indices.size()/3; ++face )
+		auto const end = std::min( vertexCount, (aChunk+1)*kNormalChunkSize );
+		for( std::size_t p = aChunk*kNormalChunkSize; p < end; ++p )
+		{
+			if( !positionMissing[p] )
+				continue;
+
+			corner_normals_( p );
+
+			groups.clear();
+			for( auto i = adjOffsets[p]; i < adjOffsets[p+1]; ++i )
+			{
+				auto const corner = adjCorners[i];
+				auto const vertex = aMesh.indices[corner];
+				if( !missing[vertex] )
+					continue;
+
+				auto const normal = cornerNormals[corner];
+
+				std::uint32_t rank = 0;
+				auto it = groups.begin();
+				for( ; groups.end() != it; ++it )
+				{
+					if( it->vertex != vertex )
+						continue;
+					if( it->normal == normal )
+						break;
+					++rank;
+				}
+
+				cornerGroups[corner] = groups.end() == it ? rank : it->rank;
+
+				if( groups.end() == it )
+				{
+					groups.emplace_back( Group_{ vertex, rank, normal } );
+					if( 0 == rank )
+						aMesh.norm[vertex] = normal;
+					else
+						extraVertices[vertex+1] = rank;
+				}
+			}
+		}
+	} );
+
+	// New vertices go to the end, in order of the vertices they split from
+	std::partial_sum( extraVertices.begin(), extraVertices.end(), extraVertices.begin() );
+
+	std::size_t const extraCount = extraVertices.back();
+	if( 0 == extraCount )
+		return missingCount;
+
+	aMesh.vert.resize( vertexCount + extraCount );
+	aMesh.norm.resize( vertexCount + extraCount );
+	if( !aMesh.text.empty() )
+		aMesh.text.resize( vertexCount + extraCount );
+
+	lut::parallel_for( chunks_( vertexCount ), aWorkerCount, [&] (std::size_t aChunk) {
+		auto const end = std::min( vertexCount, (aChunk+1)*kNormalChunkSize );
+		for( std::size_t p = aChunk*kNormalChunkSize; p < end; ++p )
+		{
+			if( !positionMissing[p] )
+				continue;
+
+			for( auto i = adjOffsets[p]; i < adjOffsets[p+1]; ++i )
+			{
+				auto const corner = adjCorners[i];
+				auto const v = aMesh.indices[corner];
+				if( !missing[v] || 0 == cornerGroups[corner] )
+					continue;
+
+				auto const target = vertexCount + extraVertices[v] + cornerGroups[corner] - 1;
+				aMesh.indices[corner] = std::uint32_t(target);
+
+				aMesh.vert[target] = aMesh.vert[v];
+				aMesh.norm[target] = cornerNormals[corner];
+				if( !aMesh.text.empty() )
+					aMesh.text[target] = aMesh.text[v];
+			}
+		}
+	} );
+
+	return missingCount + extraCount;
+}
+
+//--    split_indexed_mesh()            ///{{{2///////////////////////////////
+std::vector<IndexedMesh> split_indexed_mesh( IndexedMesh const& aMesh, std::size_t aMaxVertices )
+{
+	assert( aMaxVertices >= 3 );
+
+	std::vector<IndexedMesh> ret;
+	if( aMesh.vert.size() <= aMaxVertices )
 	{
-		size_t const idx = face*3;
-		size_t const i = aMesh.indices[idx+0];
-		size_t const j = aMesh.indices[idx+1];
-		size_t const k = aMesh.indices[idx+2];
+		ret.emplace_back( aMesh );
+		return ret;
+	}
 
+	bool const hasNormals = aMesh.norm.size() == aMesh.vert.size();
+	bool const hasTexcoords = aMesh.text.size() == aMesh.vert.size();
+
+	// Chunk-local index of each source vertex, or kUnused_ if the vertex is
+	// not (yet) part of the current chunk
+	constexpr std::uint32_t kUnused_ = ~std::uint32_t(0);
+	std::vector<std::uint32_t> remap( aMesh.vert.size(), kUnused_ );
+
+	IndexedMesh chunk;
+	std::vector<std::uint32_t> chunkVertices; // source index per chunk vertex
+
+	auto const finish_chunk_ = [&] {
+		for( auto const v : chunkVertices )
 		{
-			glm::vec3 const a = aMesh.vert[j] - aMesh.vert[i];
-			glm::vec3 const b = aMesh.vert[k] - aMesh.vert[i];
-			glm::vec3 const c = cross( a, b );
-			aMesh.norm[i] += normalize(c);
+			chunk.vert.emplace_back( aMesh.vert[v] );
+			if( hasNormals )
+				chunk.norm.emplace_back( aMesh.norm[v] );
+			if( hasTexcoords )
+				chunk.text.emplace_back( aMesh.text[v] );
+
+			chunk.aabbMin = glm::min( chunk.aabbMin, aMesh.vert[v] );
+			chunk.aabbMax = glm::max( chunk.aabbMax, aMesh.vert[v] );
+
+			remap[v] = kUnused_;
 		}
+
+		ret.emplace_back( std::move(chunk) );
+		chunk = IndexedMesh();
+		chunkVertices.clear();
+	};
+
+	for( std::size_t i = 0; i+2 < aMesh.indices.size(); i += 3 )
+	{
+		// Vertices repeated within a (degenerate) triangle are counted
+		// twice; this only makes the split slightly conservative.
+		std::size_t fresh = 0;
+		for( std::size_t k = 0; k < 3; ++k )
 		{
-			glm::vec3 const a = aMesh.vert[k] - aMesh.vert[j];
-			glm::vec3 const b = aMesh.vert[i] - aMesh.vert[j];
-			glm::vec3 const c = cross( a, b );
-			aMesh.norm[j] += normalize(c);
+			if( kUnused_ == remap[aMesh.indices[i+k]] )
+				++fresh;
 		}
+
+		if( chunkVertices.size() + fresh > aMaxVertices )
+			finish_chunk_();
+
+		for( std::size_t k = 0; k < 3; ++k )
 		{
-			glm::vec3 const a = aMesh.vert[i] - aMesh.vert[k];
-			glm::vec3 const b = aMesh.vert[j] - aMesh.vert[k];
-			glm::vec3 const c = cross( a, b );
-			aMesh.norm[k] += normalize(c);
+			auto const v = aMesh.indices[i+k];
+			if( kUnused_ == remap[v] )
+			{
+				remap[v] = std::uint32_t(chunkVertices.size());
+				chunkVertices.emplace_back( v );
+			}
+
+			chunk.indices.emplace_back( remap[v] );
 		}
 	}
 
-	for( auto& n : aMesh.norm )
-		n = normalize(n);
+	if( !chunk.indices.empty() )
+		finish_chunk_();
+
+	return ret;
 }
-#endif
 
 
 //--    $ local functions               ///{{{2///////////////////////////////
@@ -204,178 +789,308 @@ namespace
 
 namespace
 {
-	std::hash<VicinityKey_> gHash_;
+	CellKeyPacker_::CellKeyPacker_( std::uint32_t aFactor )
+	{
+		// Discretized coordinates are in [0, aFactor]; neighbour queries may
+		// ask for one more than that.
+		bits = 1;
+		while( (std::uint64_t(1) << bits) <= std::uint64_t(aFactor)+1 )
+			++bits;
 
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aDP )
+		assert( 3*bits <= 64 );
+	}
+
+	inline
+	CellKey_ CellKeyPacker_::pack( std::uint32_t aX, std::uint32_t aY, std::uint32_t aZ ) const
 	{
-		// Based on boost::hash_combine.
-		std::size_t hash = gHash_(aDP.x);
-		hash ^= gHash_(aDP.y) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		hash ^= gHash_(aDP.z) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		return hash;
+		return (CellKey_(aZ) << (2*bits)) | (CellKey_(aY) << bits) | CellKey_(aX);
 	}
 }
 
 namespace
 {
-	void build_vicinity_map_( VicinityMap_& aMap, Discretizer_ const& aD, std::vector<glm::vec3> const& aPositions )
+	void radix_sort_keys_( std::vector<CellKey_>& aKeys, std::vector<std::uint32_t>& aValues, unsigned aKeyBits )
 	{
-		for( std::size_t index = 0; index < aPositions.size(); ++index )
+		// LSD radix sort. Each pass is stable, so vertices that end up in the
+		// same cell remain in their original (ascending) order. Passes where
+		// all keys share the same digit are skipped.
+		assert( aKeys.size() == aValues.size() );
+
+		constexpr std::size_t kBuckets = std::size_t(1) << kRadixBits;
+		constexpr CellKey_ kMask = kBuckets-1;
+
+		std::size_t const count = aKeys.size();
+
+		std::vector<CellKey_> tmpKeys( count );
+		std::vector<std::uint32_t> tmpValues( count );
+
+		std::vector<std::size_t> histogram( kBuckets );
+		for( unsigned shift = 0; shift < aKeyBits; shift += kRadixBits )
 		{
-			DiscretizedPosition_ dp = aD.discretize( aPositions[index] );
-			VicinityKey_ vk = hash_discretized_position_( dp );
+			std::fill( histogram.begin(), histogram.end(), 0 );
+			for( auto const key : aKeys )
+				++histogram[(key >> shift) & kMask];
+
+			if( histogram[(aKeys[0] >> shift) & kMask] == count )
+				continue;
 
-			aMap.insert( std::make_pair(vk, index) );
+			std::size_t offset = 0;
+			for( auto& bucket : histogram )
+			{
+				auto const n = bucket;
+				bucket = offset;
+				offset += n;
+			}
+
+			for( std::size_t i = 0; i < count; ++i )
+			{
+				auto const dest = histogram[(aKeys[i] >> shift) & kMask]++;
+				tmpKeys[dest] = aKeys[i];
+				tmpValues[dest] = aValues[i];
+			}
+
+			aKeys.swap( tmpKeys );
+			aValues.swap( tmpValues );
 		}
 	}
 }
 
 namespace
 {
-	bool mergable_( TriangleSoup const& aSoup, size_t aI, size_t aJ, glm::vec3 const& aIPos, glm::vec3 const& aJPos, float aErrorTolerance )
+	void build_spatial_grid_( SpatialGrid_& aGrid, Discretizer_ const& aD, CellKeyPacker_ const& aPacker, TriangleSoup const& aSoup )
 	{
-		// Compare all elements component-wise. 
-		// start with positions, since we've already got those
-		for( std::size_t i = 0; i < 3; ++i )
+		std::size_t const count = aSoup.vert.size();
+
+		// Compute cell keys and sort the vertices by them
+		std::vector<CellKey_> keys( count );
+		for( std::size_t i = 0; i < count; ++i )
 		{
-			if( std::abs(aIPos[i]-aJPos[i]) > aErrorTolerance )
-				return false;
+			DiscretizedPosition_ const dp = aD.discretize( aSoup.vert[i] );
+			keys[i] = aPacker.pack( dp.x, dp.y, dp.z );
 		}
 
-		// Compare normals
-		if( !aSoup.norm.empty() )
+		aGrid.order.resize( count );
+		std::iota( aGrid.order.begin(), aGrid.order.end(), std::uint32_t(0) );
+
+		radix_sort_keys_( keys, aGrid.order, 3*aPacker.bits );
+
+		// Pack vertex data in sorted order, and find the unique cells
+		aGrid.records.resize( count );
+		aGrid.rank.resize( count );
+		aGrid.cellOf.resize( count );
+
+		std::vector<CellKey_> cellKeys;
+		std::vector<std::uint32_t> cellStart;
+
+		for( std::size_t s = 0; s < count; ++s )
 		{
-			auto const nI = aSoup.norm[aI];
-			auto const nJ = aSoup.norm[aJ];
-			for( size_t i = 0; i < 3; ++i )
+			if( 0 == s || keys[s] != keys[s-1] )
 			{
-				if( std::abs(nI[i]-nJ[i]) > aErrorTolerance )
-					return false;
+				cellKeys.emplace_back( keys[s] );
+				cellStart.emplace_back( std::uint32_t(s) );
 			}
+
+			auto const i = aGrid.order[s];
+			aGrid.rank[i] = std::uint32_t(s);
+			aGrid.cellOf[i] = std::uint32_t(cellKeys.size()-1);
+
+			auto& rec = aGrid.records[s];
+			auto const& pos = aSoup.vert[i];
+			auto const& tex = aSoup.text[i];
+			auto const nrm = aSoup.norm.empty() ? glm::vec3( 0.f ) : aSoup.norm[i];
+
+			rec.v[0] = pos.x; rec.v[1] = pos.y; rec.v[2] = pos.z;
+			rec.v[3] = nrm.x; rec.v[4] = nrm.y; rec.v[5] = nrm.z;
+			rec.v[6] = tex.x; rec.v[7] = tex.y;
 		}
 
-		// Compare tex coord
-		auto const tI = aSoup.text[aI];
-		auto const tJ = aSoup.text[aJ];
-		for( std::size_t i = 0; i < 2; ++i )
+		cellStart.emplace_back( std::uint32_t(count) );
+
+		// Find neighbouring rows for each cell
+		auto const axisMask = (CellKey_(1) << aPacker.bits) - 1;
+
+		aGrid.rows.resize( cellKeys.size() * SpatialGrid_::kRowCount );
+		for( std::size_t c = 0; c < cellKeys.size(); ++c )
 		{
-			if( std::abs(tI[i]-tJ[i]) > aErrorTolerance )
-				return false;
+			auto const key = cellKeys[c];
+			auto const x = std::uint32_t(key & axisMask);
+			auto const y = std::uint32_t((key >> aPacker.bits) & axisMask);
+			auto const z = std::uint32_t(key >> (2*aPacker.bits));
+
+			auto* rows = &aGrid.rows[c * SpatialGrid_::kRowCount];
+			for( int dz = -1; dz <= 1; ++dz )
+			{
+				for( int dy = -1; dy <= 1; ++dy )
+				{
+					auto& span = *rows++;
+					span = SpatialGrid_::Span{ 0, 0 };
+
+					if( (0 == z && dz < 0) || (0 == y && dy < 0) )
+						continue;
+
+					auto const rz = std::uint32_t(std::int64_t(z) + dz);
+					auto const ry = std::uint32_t(std::int64_t(y) + dy);
+
+					auto const lo = aPacker.pack( x > 0 ? x-1 : 0, ry, rz );
+					auto const hi = aPacker.pack( x+1, ry, rz );
+
+					auto const beg = std::lower_bound( cellKeys.begin(), cellKeys.end(), lo );
+					auto const end = std::upper_bound( beg, cellKeys.end(), hi );
+
+					span.begin = cellStart[beg - cellKeys.begin()];
+					span.end = cellStart[end - cellKeys.begin()];
+				}
+			}
 		}
-	
-		return true;
 	}
 }
 
 namespace
 {
-	// neighbours
-	const size_t kNeighbourCount_ = 27;
+	inline
+	std::uint64_t hash_input_vertex_( InputVertex const& aVertex )
+	{
+		std::uint64_t hash = (std::uint64_t(aVertex.position) << 32) | aVertex.normal;
+		hash ^= std::uint64_t(aVertex.texcoord) * 0xc2b2ae3d27d4eb4full;
+		hash *= 0x9e3779b97f4a7c15ull;
+		return hash ^ (hash >> 29);
+	}
 
-	DiscretizedPosition_ neighbour_( DiscretizedPosition_ const& aDP, std::size_t aJ )
+	std::size_t dedup_input_vertices_( std::vector<std::uint32_t>& aIndices, std::vector<InputVertex>& aUnique, InputVertex const* aVertices, std::size_t aCount )
 	{
-		static constexpr std::int32_t offset[kNeighbourCount_][3] = {
-			{ 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
-			{ 0, 1, 0 }, { 0, 1, 1 }, { 0, 1, -1 },
-			{ 0, -1, 0 }, { 0, -1, 1 }, { 0, -1, -1 },
-
-			{ 1, 0, 0 }, { 1, 0, 1 }, { 1, 0, -1 },
-			{ 1, 1, 0 }, { 1, 1, 1 }, { 1, 1, -1 },
-			{ 1, -1, 0 }, { 1, -1, 1 }, { 1, -1, -1 },
-
-			{ -1, 0, 0 }, { -1, 0, 1 }, { -1, 0, -1 },
-			{ -1, 1, 0 }, { -1, 1, 1 }, { -1, 1, -1 },
-			{ -1, -1, 0 }, { -1, -1, 1 }, { -1, -1, -1 },
-		};
+		// Open addressing with linear probing. The table stores indices into
+		// aUnique, and is kept at most half full.
+		constexpr auto kEmpty = ~std::uint32_t(0);
 
-		assert( aJ < kNeighbourCount_ );
-		
-		DiscretizedPosition_ ret = aDP;
-		ret.x += offset[aJ][0];
-		ret.y += offset[aJ][1];
-		ret.z += offset[aJ][2];
-		return ret;
+		std::size_t tableSize = 16;
+		while( tableSize < 2*aCount )
+			tableSize *= 2;
+
+		std::size_t const mask = tableSize-1;
+		std::vector<std::uint32_t> table( tableSize, kEmpty );
+
+		aIndices.resize( aCount );
+		aUnique.clear();
+
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			auto const& v = aVertices[i];
+
+			std::size_t slot = std::size_t(hash_input_vertex_( v ) >> 32) & mask;
+			while( true )
+			{
+				auto const id = table[slot];
+				if( kEmpty == id )
+				{
+					table[slot] = aIndices[i] = std::uint32_t(aUnique.size());
+					aUnique.emplace_back( v );
+					break;
+				}
+
+				auto const& u = aUnique[id];
+				if( u.position == v.position && u.normal == v.normal && u.texcoord == v.texcoord )
+				{
+					aIndices[i] = id;
+					break;
+				}
+
+				slot = (slot+1) & mask;
+			}
+		}
+
+		return aUnique.size();
+	}
+}
+
+namespace
+{
+	inline
+	bool mergable_( VertexRecord_ const& aI, VertexRecord_ const& aJ, float aErrorTolerance )
+	{
+		// Compare all elements component-wise: positions, normals (zero if
+		// the mesh has none) and texture coordinates. The comparison is
+		// "greater than", so that NaNs compare the same as in the scalar
+		// version.
+#		if defined(__AVX__)
+		__m256 const signMask = _mm256_set1_ps( -0.f );
+		__m256 const tol = _mm256_set1_ps( aErrorTolerance );
+
+		__m256 const d = _mm256_andnot_ps( signMask, _mm256_sub_ps( _mm256_load_ps( aI.v ), _mm256_load_ps( aJ.v ) ) );
+		return 0 == _mm256_movemask_ps( _mm256_cmp_ps( d, tol, _CMP_GT_OQ ) );
+
+#		elif defined(INDEX_MESH_SIMD_)
+		__m128 const signMask = _mm_set1_ps( -0.f );
+		__m128 const tol = _mm_set1_ps( aErrorTolerance );
+
+		__m128 const d0 = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_load_ps( aI.v+0 ), _mm_load_ps( aJ.v+0 ) ) );
+		__m128 const d1 = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_load_ps( aI.v+4 ), _mm_load_ps( aJ.v+4 ) ) );
+		__m128 const gt = _mm_or_ps( _mm_cmpgt_ps( d0, tol ), _mm_cmpgt_ps( d1, tol ) );
+		return 0 == _mm_movemask_ps( gt );
+
+#		else
+		for( std::size_t i = 0; i < 8; ++i )
+		{
+			if( std::abs(aI.v[i]-aJ.v[i]) > aErrorTolerance )
+				return false;
+		}
+
+		return true;
+#		endif
 	}
+}
 
+namespace
+{
 	// Merge vertices
-	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, float aMaxError )
+	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, SpatialGrid_ const& aGrid, float aMaxError )
 	{
+		std::size_t const count = aGrid.order.size();
+
 		aVertices.clear();
-		aVertices.reserve( aSoup.vert.size() );
+		aVertices.reserve( count );
 
 		aIndices.clear();
-		aIndices.reserve( aSoup.vert.size() );
+		aIndices.reserve( count );
 
 		// initialize collapse map
-		VertexMapping_ collapseMap( aSoup.vert.size() );
-		std::fill( collapseMap.begin(), collapseMap.end(), ~std::size_t(0) );
+		constexpr auto kNone = ~std::uint32_t(0);
+		std::vector<std::uint32_t> collapseMap( count, kNone );
 
 		// process vertices
 		std::size_t nextVertex = 0;
-		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
+		for( std::size_t i = 0; i < count; ++i )
 		{
 			// check if this vertex already was merged somewhere
-			if( ~size_t(0) != collapseMap[i] )
+			if( kNone != collapseMap[i] )
 			{
 				assert( collapseMap[i] < aVertices.size() );
-				aIndices.push_back( std::uint32_t(collapseMap[i]) );
+				aIndices.push_back( collapseMap[i] );
 				continue;
 			}
 
-			// get position and look for possible neighbours
-			auto const self = aSoup.vert[i];
-			DiscretizedPosition_ const dp = aD.discretize( self );
+			// this vertex starts a new output vertex; merge all vertices in
+			// the neighbouring cells that haven't been merged yet
+			auto const toWhere = std::uint32_t(nextVertex++);
+			aVertices.push_back( i );
 
-			bool merged = false;
-			std::size_t target = ~std::size_t(0);
+			collapseMap[i] = toWhere;
+			aIndices.push_back( toWhere );
 
-			for( std::size_t j = 0; j < kNeighbourCount_; ++j )
-			{
-				DiscretizedPosition_ const dq = neighbour_( dp, j );
-				VicinityKey_ const vk = hash_discretized_position_( dq );
+			auto const& self = aGrid.records[aGrid.rank[i]];
+			auto const* rows = &aGrid.rows[aGrid.cellOf[i] * SpatialGrid_::kRowCount];
 
-				// get vertices in this bucket
-				for( auto [it, jt] = aVM.equal_range( vk ); it != jt; ++it )
+			for( std::size_t r = 0; r < SpatialGrid_::kRowCount; ++r )
+			{
+				for( auto s = rows[r].begin; s < rows[r].end; ++s )
 				{
-					std::size_t const idx =  it->second;
+					auto const idx = aGrid.order[s];
 
-					if( idx == i ) continue; // don't try to merge with self
-					if( ~std::size_t(0) != collapseMap[idx] ) continue; // don't remerge
-
-					auto const other = aSoup.vert[idx];
-					if( mergable_( aSoup, i, idx, self, other, aMaxError ) )
-					{
-						std::size_t toWhere;
-						
-						if( merged )
-						{
-							toWhere = target;
-						}
-						else
-						{
-							toWhere = nextVertex++;
-							aVertices.push_back( i );
-
-							collapseMap[i] = toWhere;
-							aIndices.push_back( std::uint32_t(toWhere) );
-						}
+					if( kNone != collapseMap[idx] ) continue; // don't remerge (or merge with self)
 
+					if( mergable_( self, aGrid.records[s], aMaxError ) )
 						collapseMap[idx] = toWhere;
-						
-						target = toWhere;
-						merged = true;
-					}
 				}
 			}
-
-			if( !merged )
-			{
-				std::size_t toWhere = nextVertex++;
-
-				collapseMap[i] = toWhere;
-				aVertices.push_back( i );
-				aIndices.push_back( std::uint32_t(toWhere) );
-			}
 		}
 
 		return nextVertex;
@@ -10,7 +10,7 @@
 
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
-//#include <glm/vec4.hpp>
+#include <glm/vec4.hpp>
 
 //--    types                                   ///{{{1///////////////////////
 struct TriangleSoup
@@ -25,7 +25,9 @@ struct IndexedMesh
 	std::vector<glm::vec3> norm;
 	std::vector<glm::vec2> text;
 
-	//std::vector<glm::vec4> tangent; // Task 1.4
+	// Tangent space; see compute_tangent_space(). Empty until computed.
+	std::vector<glm::vec4> tangent; // xyz = tangent, w = handedness
+	std::vector<std::uint32_t> packedTbn; // see encode_quat()
 
 	std::vector<std::uint32_t> indices;
 
@@ -34,6 +36,9 @@ struct IndexedMesh
 	IndexedMesh();
 };
 
+struct InputModel;
+struct InputMeshInfo;
+
 //--    functions                               ///{{{1///////////////////////
 
 IndexedMesh make_indexed_mesh(
@@ -41,6 +46,65 @@ IndexedMesh make_indexed_mesh(
 	float aErrorTol = 1e-6f
 );
 
-void ensure_normals( IndexedMesh& );
+/* Index a mesh of an InputModel. Vertices that reference the same position,
+ * normal and texture coordinate (i.e., have the same index triple) are merged
+ * exactly in a single pass. If aErrorTol is larger than zero, the resulting
+ * unique vertices are then welded with the TriangleSoup version of
+ * make_indexed_mesh() above.
+ */
+IndexedMesh make_indexed_mesh(
+	InputModel const&,
+	InputMeshInfo const&,
+	float aErrorTol = 1e-6f
+);
+
+/* Map each vertex to the first vertex with a bitwise identical position.
+ * Meshes made with make_indexed_mesh() are welded already, so there is no
+ * need for a tolerance. Vertices that share a position but differ in other
+ * attributes (e.g., at texture seams) map to the same vertex.
+ */
+std::vector<std::uint32_t> position_remap(
+	std::vector<glm::vec3> const& aPositions
+);
+
+/* Generate normals for the vertices of a mesh that have none, i.e., all of
+ * them if aMesh.norm is empty, or those whose normal is zero. Each is the sum
+ * of the normals of the faces around its position, weighted by face area and
+ * by the angle of the face at the vertex. Faces are gathered over all
+ * vertices at the same position (see position_remap()), so vertices that are
+ * only split by a texture seam get the same normal.
+ *
+ * Faces whose normals differ by more than aCreaseAngle (in radians) do not
+ * contribute to each other's corners. Corners of a vertex that end up with
+ * different normals are split off into new vertices, appended to the mesh.
+ * An angle of pi or more smooths across all edges, and adds no vertices.
+ * At positions with many faces, the faces are first bucketed by normal and
+ * the test compares buckets, which keeps the cost linear in the number of
+ * faces for all but pathological inputs.
+ *
+ * Faces are processed in parallel, as are positions via a position-to-face
+ * adjacency built with prefix sums, so no accumulation needs to be
+ * synchronized. Must run before any further per-vertex data is computed
+ * (e.g., the tangent space). Returns the number of generated normals,
+ * including those of new vertices.
+ */
+std::size_t ensure_normals(
+	IndexedMesh& aMesh,
+	float aCreaseAngle = 3.14159265f,
+	std::size_t aWorkerCount = 1
+);
+
+/* Split a mesh into chunks of at most aMaxVertices vertices each, e.g., such
+ * that each chunk can be drawn with 16-bit indices. Triangles are assigned to
+ * chunks in order; vertices that are shared by several chunks are
+ * duplicated. Returns a single copy of the mesh if it is small enough.
+ *
+ * Only the positions, normals and texture coordinates are carried over, so
+ * this should run before any further per-vertex data is computed.
+ */
+std::vector<IndexedMesh> split_indexed_mesh(
+	IndexedMesh const&,
+	std::size_t aMaxVertices
+);
 
 #endif // INDEX_MESH_HPP_8617BC10_313B_4397_9E27_33AA16A4C308
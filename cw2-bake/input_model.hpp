@@ -41,6 +41,19 @@ struct InputMeshInfo
 	std::size_t vertexCount;
 };
 
+/* Vertex (face corner) as referenced by an OBJ face: separate indices into the
+ * position, normal and texture coordinate lists. Missing attributes are
+ * indicated by kNoInputAttribute.
+ */
+constexpr std::uint32_t kNoInputAttribute = ~std::uint32_t(0);
+
+struct InputVertex
+{
+	std::uint32_t position;
+	std::uint32_t normal;
+	std::uint32_t texcoord;
+};
+
 struct InputModel
 {
 	std::string modelSourcePath;
@@ -48,6 +61,11 @@ struct InputModel
 	std::vector<InputMaterialInfo> materials;
 	std::vector<InputMeshInfo> meshes;
 
+	// Vertices of all meshes (three per triangle). A mesh's vertices are
+	// vertices[vertexStartIndex] ... vertices[vertexStartIndex+vertexCount-1].
+	std::vector<InputVertex> vertices;
+
+	// Attribute data, shared by all meshes, as referenced by the vertices.
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texcoords;
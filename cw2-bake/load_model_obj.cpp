@@ -1,18 +1,76 @@
 #include "load_model_obj.hpp"
 
-#include <unordered_set>
-
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <string_view>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cassert>
 #include <cstring>
 
 #include <rapidobj/rapidobj.hpp>
 
-#include "../labutils/error.hpp"
 #include "input_model.hpp"
 
+#include "../labutils/error.hpp"
+#include "../labutils/parallel.hpp"
+
 namespace lut = labutils;
 
-InputModel load_wavefront_obj( char const* aPath )
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kReadChunkSize_ = std::size_t(4) << 20; // bytes, see for_each_line_()
+
+	constexpr std::size_t kNoMaterial_ = ~std::size_t(0);
+
+	// Materials used by one shape, and their number of faces
+	struct ShapeBuckets_
+	{
+		std::vector<std::size_t> materials; // in order of first use
+		std::vector<std::size_t> faceCounts;
+
+		std::size_t firstMesh = 0; // index of the first mesh in InputModel::meshes
+	};
+
+	struct FileCloser_
+	{
+		FILE* file;
+		~FileCloser_() { if( file ) std::fclose( file ); }
+	};
+
+	// Per-thread map from material index to the shape's bucket. All entries
+	// are kNoMaterial_ between uses.
+	std::vector<std::size_t>& material_slots_( std::size_t aMaterialCount );
+
+	// Directory of the OBJ file, including the trailing '/'; texture paths
+	// are relative to it
+	std::string path_prefix_( char const* aPath );
+
+	void convert_materials_( std::vector<rapidobj::Material> const&, std::string const& aPrefix, InputModel& );
+
+	// Calls aFunc( line, lineNumber ) for each line of the file, without the
+	// line terminator. The file is read in chunks of kReadChunkSize_ bytes.
+	template< typename tFunc >
+	void for_each_line_( char const* aPath, tFunc&& aFunc );
+
+	// Removes and returns the first whitespace-separated token of aLine
+	std::string_view next_token_( std::string_view& aLine ) noexcept;
+	std::string_view trim_( std::string_view ) noexcept;
+
+	float parse_float_( std::string_view, char const* aPath, std::size_t aLine );
+
+	// Resolves a (1-based or negative, i.e., relative) OBJ index into an
+	// attribute list with aCount entries, aSeen of which precede the face
+	std::uint32_t resolve_index_( std::string_view, std::size_t aSeen, std::size_t aCount, char const* aPath, std::size_t aLine );
+}
+
+InputModel load_wavefront_obj( char const* aPath, std::size_t aWorkerCount )
 {
 	assert( aPath );
 	
@@ -27,59 +85,20 @@ InputModel load_wavefront_obj( char const* aPath )
 	// for us.
 	rapidobj::Triangulate( result );
 
-	// Find the path to the OBJ file
-	char const* pathBeg = aPath;
-	char const* pathEnd = std::strrchr( pathBeg, '/' );
-	
-	std::string const prefix = pathEnd
-		? std::string( pathBeg, pathEnd+1 )
-		: ""
-	;
-
 	// Convert the OBJ data into a InputModel structure.
 	// First, extract material data.
 	InputModel ret;
 
 	ret.modelSourcePath = aPath;
 
-	for( auto const& mat : result.materials )
-	{
-		InputMaterialInfo mi;
-
-		mi.materialName  = mat.name;
-
-		mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		mi.baseRoughness  = mat.roughness;
-		mi.baseMetalness  = mat.metallic;
-
-		if( !mat.diffuse_texname.empty() )
-			mi.baseColorTexturePath  = prefix + mat.diffuse_texname;
-
-		if( !mat.roughness_texname.empty() )
-			mi.roughnessTexturePath  = prefix + mat.roughness_texname;
-		if( !mat.metallic_texname.empty() )
-			mi.metalnessTexturePath  = prefix + mat.metallic_texname;
-
-		if( !mat.alpha_texname.empty() )
-			mi.alphaMaskTexturePath  = prefix + mat.alpha_texname;
-
-		if( !mat.normal_texname.empty() )
-			mi.normalMapTexturePath  = prefix + mat.normal_texname;
-
-#	if 0
-		mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		if( !mat.diffuse_texname.empty() )
-			mi.diffuseTexturePath  = prefix + mat.diffuse_texname;
-#	endif
-
-		ret.materials.emplace_back( std::move(mi) );
-	}
+	convert_materials_( result.materials, path_prefix_( aPath ), ret );
 
 	// Next, extract the actual mesh data. There are some complications:
-	// - OBJ use separate indices to positions, normals and texture coords. To
-	//   deal with this, the mesh is turned into an unindexed triangle soup.
+	// - OBJ use separate indices to positions, normals and texture coords.
+	//   The attribute lists are copied as-is, and each vertex keeps the three
+	//   indices. Identical index triples are merged when the meshes are
+	//   indexed (see make_indexed_mesh()). This avoids expanding the data
+	//   into a (much larger) triangle soup.
 	// - OBJ uses three methods of grouping faces:
 	//   - 'o' = object
 	//   - 'g' = group
@@ -88,85 +107,544 @@ InputModel load_wavefront_obj( char const* aPath )
 	//  materials. We want to primarily group faces by material (and possibly
 	//  secondarily by other logical groupings). 
 	//
-	// Unfortunately, RapidOBJ exposes a per-face material index.
+	// Unfortunately, RapidOBJ exposes a per-face material index. Faces are
+	// therefore bucketed by material with a counting sort (see below).
+	auto const& attrib = result.attributes;
 
-	std::unordered_set<std::size_t> activeMaterials;
-	for( auto const& shape : result.shapes )
-	{
-		auto const& shapeName = shape.name;
+	ret.positions.reserve( attrib.positions.size()/3 );
+	for( std::size_t i = 0; i+2 < attrib.positions.size(); i += 3 )
+		ret.positions.emplace_back( glm::vec3{ attrib.positions[i+0], attrib.positions[i+1], attrib.positions[i+2] } );
+
+	ret.normals.reserve( attrib.normals.size()/3 );
+	for( std::size_t i = 0; i+2 < attrib.normals.size(); i += 3 )
+		ret.normals.emplace_back( glm::vec3{ attrib.normals[i+0], attrib.normals[i+1], attrib.normals[i+2] } );
+
+	ret.texcoords.reserve( attrib.texcoords.size()/2 );
+	for( std::size_t i = 0; i+1 < attrib.texcoords.size(); i += 2 )
+		ret.texcoords.emplace_back( glm::vec2{ attrib.texcoords[i+0], attrib.texcoords[i+1] } );
+
+	auto const attrib_index_ = [] (int aIndex) {
+		return aIndex < 0 ? kNoInputAttribute : std::uint32_t(aIndex);
+	};
+
+	// First pass: count the faces of each material in each shape. Materials
+	// are ordered by their first use in the shape.
+	//
+	// Note: we still keep different "shapes" separate. For static meshes,
+	// the baker merges all vertices with the same material afterwards;
+	// see merge_meshes_by_material().
+	auto const& shapes = result.shapes;
+	std::size_t const materialCount = ret.materials.size();
+
+	std::vector<ShapeBuckets_> buckets( shapes.size() );
+	lut::parallel_for( shapes.size(), aWorkerCount, [&] (std::size_t aShape) {
+		auto const& mesh = shapes[aShape].mesh;
+		auto& bucket = buckets[aShape];
 
-		// Scan shape for materials
-		activeMaterials.clear();
+		auto const faceCount = mesh.indices.size()/3; // Always triangles; see Triangulate() above
+		assert( faceCount <= mesh.material_ids.size() );
 
-		for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
+		auto& slots = material_slots_( materialCount );
+
+		std::size_t invalid = 0;
+		for( std::size_t i = 0; i < faceCount; ++i )
 		{
-			auto const faceId = i/3; // Always triangles; see Triangulate() above
+			auto const matId = mesh.material_ids[i];
+			if( matId < 0 || std::size_t(matId) >= materialCount )
+			{
+				++invalid;
+				continue;
+			}
 
-			assert( faceId < shape.mesh.material_ids.size() );
-			auto const matId = shape.mesh.material_ids[faceId];
+			auto& slot = slots[std::size_t(matId)];
+			if( kNoMaterial_ == slot )
+			{
+				slot = bucket.materials.size();
+				bucket.materials.emplace_back( std::size_t(matId) );
+				bucket.faceCounts.emplace_back( 0 );
+			}
 
-			assert( matId < int(ret.materials.size()) );
-			activeMaterials.emplace( matId );
+			++bucket.faceCounts[slot];
 		}
 
-		// Process vertices for active material
-		// This does multiple passes over the vertex data, which is less than
-		// optimal...
-		//
-		// Note: we still keep different "shapes" separate. For static meshes,
-		// one could merge all vertices with the same material for a bit more
-		// efficient rendering.
-		for( auto const matId : activeMaterials )
+		for( auto const matId : bucket.materials )
+			slots[matId] = kNoMaterial_;
+
+		if( invalid )
+			throw lut::Error( "Unable to load OBJ file '%s': %zu face(s) of '%s' have no (valid) material", aPath, invalid, shapes[aShape].name.c_str() );
+	} );
+
+	// Prefix sum: lay out the meshes back to back
+	std::size_t vertexCount = 0, meshCount = 0;
+	for( auto& bucket : buckets )
+	{
+		bucket.firstMesh = meshCount;
+		meshCount += bucket.materials.size();
+	}
+
+	ret.meshes.reserve( meshCount );
+	for( std::size_t i = 0; i < shapes.size(); ++i )
+	{
+		auto const& bucket = buckets[i];
+		auto const& shapeName = shapes[i].name;
+
+		for( std::size_t j = 0; j < bucket.materials.size(); ++j )
 		{
+			auto const matId = bucket.materials[j];
+
 			// Keep track of mesh names; this can be useful for debugging.
 			std::string meshName;
-			if( 1 == activeMaterials.size() )
+			if( 1 == bucket.materials.size() )
 				meshName = shapeName;
 			else
 				meshName = shapeName + "::" + ret.materials[matId].materialName;
 
-			// Extract this material's vertices.
-			auto const firstVertex = ret.positions.size();
-			
-			for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
+			ret.meshes.emplace_back( InputMeshInfo{
+				std::move(meshName),
+				matId,
+				vertexCount,
+				3*bucket.faceCounts[j]
+			} );
+
+			vertexCount += 3*bucket.faceCounts[j];
+		}
+	}
+
+	// Second pass: scatter the vertices of each face into its mesh
+	ret.vertices.resize( vertexCount );
+
+	lut::parallel_for( shapes.size(), aWorkerCount, [&] (std::size_t aShape) {
+		auto const& mesh = shapes[aShape].mesh;
+		auto const& bucket = buckets[aShape];
+
+		auto& slots = material_slots_( materialCount );
+
+		std::vector<InputVertex*> cursors( bucket.materials.size() );
+		for( std::size_t j = 0; j < bucket.materials.size(); ++j )
+		{
+			slots[bucket.materials[j]] = j;
+			cursors[j] = ret.vertices.data() + ret.meshes[bucket.firstMesh + j].vertexStartIndex;
+		}
+
+		auto const faceCount = mesh.indices.size()/3;
+		for( std::size_t i = 0; i < faceCount; ++i )
+		{
+			auto& out = cursors[slots[std::size_t(mesh.material_ids[i])]];
+			for( std::size_t k = 0; k < 3; ++k )
 			{
-				auto const faceId = i/3; // Always triangles; see Triangulate() above
-				auto const faceMat = std::size_t(shape.mesh.material_ids[faceId]);
+				auto const& idx = mesh.indices[3*i+k];
+
+				assert( idx.position_index >= 0 );
+				*out++ = InputVertex{
+					std::uint32_t(idx.position_index),
+					attrib_index_( idx.normal_index ),
+					attrib_index_( idx.texcoord_index )
+				};
+			}
+		}
 
-				if( faceMat != matId )
-					continue;
+		for( auto const matId : bucket.materials )
+			slots[matId] = kNoMaterial_;
+	} );
 
-				auto const& idx = shape.mesh.indices[i];
+	return ret;
+}
 
-				ret.positions.emplace_back( glm::vec3{
-					result.attributes.positions[idx.position_index*3+0],
-					result.attributes.positions[idx.position_index*3+1],
-					result.attributes.positions[idx.position_index*3+2]
-				} );
+//--    ObjStream                       ///{{{2///////////////////////////////
+ObjStream::ObjStream( char const* aPath )
+{
+	assert( aPath );
 
-				ret.texcoords.emplace_back( glm::vec2{
-					result.attributes.texcoords[idx.texcoord_index*2+0],
-					result.attributes.texcoords[idx.texcoord_index*2+1]
-				} );
+	mModel.modelSourcePath = aPath;
+
+	// Read the attribute data, and collect the material libraries
+	std::string libraries;
+	for_each_line_( aPath, [&] (std::string_view aLine, std::size_t aLineNumber) {
+		auto const keyword = next_token_( aLine );
 
-				ret.normals.emplace_back( glm::vec3{
-					result.attributes.normals[idx.normal_index*3+0],
-					result.attributes.normals[idx.normal_index*3+1],
-					result.attributes.normals[idx.normal_index*3+2]
+		if( "v" == keyword )
+		{
+			glm::vec3 pos;
+			for( int i = 0; i < 3; ++i )
+				pos[i] = parse_float_( next_token_( aLine ), aPath, aLineNumber );
+
+			mModel.positions.emplace_back( pos ); // w and vertex colors are ignored
+		}
+		else if( "vn" == keyword )
+		{
+			glm::vec3 nrm;
+			for( int i = 0; i < 3; ++i )
+				nrm[i] = parse_float_( next_token_( aLine ), aPath, aLineNumber );
+
+			mModel.normals.emplace_back( nrm );
+		}
+		else if( "vt" == keyword )
+		{
+			glm::vec2 tex;
+			tex.x = parse_float_( next_token_( aLine ), aPath, aLineNumber );
+
+			auto const v = next_token_( aLine );
+			tex.y = v.empty() ? 0.f : parse_float_( v, aPath, aLineNumber );
+
+			mModel.texcoords.emplace_back( tex );
+		}
+		else if( "mtllib" == keyword )
+		{
+			libraries += "mtllib ";
+			libraries += trim_( aLine );
+			libraries += '\n';
+		}
+	} );
+
+	// Let rapidobj parse the material libraries, such that materials are
+	// identical to those from load_wavefront_obj().
+	if( !libraries.empty() )
+	{
+		auto dir = std::filesystem::path( aPath ).parent_path();
+		if( dir.empty() )
+			dir = ".";
+
+		std::istringstream stream( libraries );
+		auto const result = rapidobj::ParseStream( stream, rapidobj::MaterialLibrary::SearchPath( dir ) );
+		if( result.error )
+			throw lut::Error( "Unable to load materials of OBJ file '%s': %s", aPath, result.error.code.message().c_str() );
+
+		convert_materials_( result.materials, path_prefix_( aPath ), mModel );
+	}
+
+	for( std::size_t i = 0; i < mModel.materials.size(); ++i )
+	{
+		mMaterialNames.emplace_back( mModel.materials[i].materialName );
+		mMaterialIds.emplace( mModel.materials[i].materialName, i ); // first one wins
+	}
+}
+
+InputModel& ObjStream::model() noexcept
+{
+	return mModel;
+}
+InputModel const& ObjStream::model() const noexcept
+{
+	return mModel;
+}
+
+std::size_t ObjStream::for_each_shape( std::function<void(InputModel&)> const& aFunc )
+{
+	char const* path = mModel.modelSourcePath.c_str();
+
+	// Attributes seen so far; relative indices count back from these
+	std::size_t positions = 0, normals = 0, texcoords = 0;
+
+	// Current shape: vertices per material, in order of first use
+	std::string shapeName;
+	std::vector<std::vector<InputVertex>> vertices( mMaterialNames.size() );
+	std::vector<std::size_t> used;
+
+	std::size_t shapes = 0;
+	auto const flush_ = [&] {
+		if( used.empty() )
+			return;
+
+		auto& model = mModel;
+		assert( model.meshes.empty() && model.vertices.empty() );
+
+		if( 1 == used.size() )
+		{
+			// Common case: hand over the vertices without a copy
+			model.vertices.swap( vertices[used[0]] );
+			model.meshes.emplace_back( InputMeshInfo{ shapeName, used[0], 0, model.vertices.size() } );
+		}
+		else
+		{
+			std::size_t total = 0;
+			for( auto const matId : used )
+				total += vertices[matId].size();
+
+			model.vertices.reserve( total );
+			for( auto const matId : used )
+			{
+				auto& source = vertices[matId];
+				model.meshes.emplace_back( InputMeshInfo{
+					shapeName + "::" + mMaterialNames[matId],
+					matId,
+					model.vertices.size(),
+					source.size()
 				} );
+
+				model.vertices.insert( model.vertices.end(), source.begin(), source.end() );
+				std::vector<InputVertex>().swap( source );
 			}
+		}
 
-			auto const vertexCount = ret.positions.size() - firstVertex;
+		used.clear();
+		++shapes;
 
-			ret.meshes.emplace_back( InputMeshInfo{
-				std::move(meshName),
-				matId,
-				firstVertex,
-				vertexCount
-			} );
+		aFunc( model );
+
+		// Release the shape
+		model.meshes.clear();
+		std::vector<InputVertex>().swap( model.vertices );
+	};
+
+	std::size_t material = kNoMaterial_;
+	std::vector<InputVertex> polygon;
+
+	for_each_line_( path, [&] (std::string_view aLine, std::size_t aLineNumber) {
+		auto const keyword = next_token_( aLine );
+
+		if( "v" == keyword )
+			++positions;
+		else if( "vn" == keyword )
+			++normals;
+		else if( "vt" == keyword )
+			++texcoords;
+		else if( "o" == keyword || "g" == keyword )
+		{
+			flush_();
+			shapeName = std::string( trim_( aLine ) );
 		}
+		else if( "usemtl" == keyword )
+		{
+			auto const name = std::string( trim_( aLine ) );
+
+			auto const it = mMaterialIds.find( name );
+			if( mMaterialIds.end() == it )
+				throw lut::Error( "%s:%zu: unknown material '%s'", path, aLineNumber, name.c_str() );
+
+			material = it->second;
+		}
+		else if( "f" == keyword )
+		{
+			if( kNoMaterial_ == material )
+				throw lut::Error( "%s:%zu: face without material", path, aLineNumber );
+
+			// Corners are p, p/t, p//n or p/t/n
+			polygon.clear();
+			for( auto corner = next_token_( aLine ); !corner.empty(); corner = next_token_( aLine ) )
+			{
+				auto const slash0 = corner.find( '/' );
+				auto const slash1 = std::string_view::npos == slash0 ? slash0 : corner.find( '/', slash0+1 );
+
+				InputVertex vert{ 0, kNoInputAttribute, kNoInputAttribute };
+				vert.position = resolve_index_( corner.substr( 0, slash0 ), positions, mModel.positions.size(), path, aLineNumber );
+
+				if( std::string_view::npos != slash0 )
+				{
+					auto const tex = corner.substr( slash0+1, std::string_view::npos == slash1 ? slash1 : slash1-slash0-1 );
+					if( !tex.empty() )
+						vert.texcoord = resolve_index_( tex, texcoords, mModel.texcoords.size(), path, aLineNumber );
+				}
+
+				if( std::string_view::npos != slash1 )
+					vert.normal = resolve_index_( corner.substr( slash1+1 ), normals, mModel.normals.size(), path, aLineNumber );
+
+				polygon.emplace_back( vert );
+			}
+
+			if( polygon.size() < 3 )
+				throw lut::Error( "%s:%zu: face with fewer than three vertices", path, aLineNumber );
+
+			if( used.end() == std::find( used.begin(), used.end(), material ) )
+				used.emplace_back( material );
+
+			auto& target = vertices[material];
+			for( std::size_t i = 1; i+1 < polygon.size(); ++i )
+			{
+				target.emplace_back( polygon[0] );
+				target.emplace_back( polygon[i] );
+				target.emplace_back( polygon[i+1] );
+			}
+		}
+	} );
+
+	flush_();
+
+	return shapes;
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	std::vector<std::size_t>& material_slots_( std::size_t aMaterialCount )
+	{
+		thread_local std::vector<std::size_t> slots;
+		if( slots.size() < aMaterialCount )
+			slots.resize( aMaterialCount, kNoMaterial_ );
+
+		return slots;
 	}
 
-	return ret;
+	std::string path_prefix_( char const* aPath )
+	{
+		// Find the path to the OBJ file
+		char const* pathBeg = aPath;
+		char const* pathEnd = std::strrchr( pathBeg, '/' );
+		
+		return pathEnd
+			? std::string( pathBeg, pathEnd+1 )
+			: ""
+		;
+	}
+
+	void convert_materials_( std::vector<rapidobj::Material> const& aMaterials, std::string const& aPrefix, InputModel& aModel )
+	{
+		for( auto const& mat : aMaterials )
+		{
+			InputMaterialInfo mi;
+
+			mi.materialName  = mat.name;
+
+			mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			mi.baseRoughness  = mat.roughness;
+			mi.baseMetalness  = mat.metallic;
+
+			if( !mat.diffuse_texname.empty() )
+				mi.baseColorTexturePath  = aPrefix + mat.diffuse_texname;
+
+			if( !mat.roughness_texname.empty() )
+				mi.roughnessTexturePath  = aPrefix + mat.roughness_texname;
+			if( !mat.metallic_texname.empty() )
+				mi.metalnessTexturePath  = aPrefix + mat.metallic_texname;
+
+			if( !mat.alpha_texname.empty() )
+				mi.alphaMaskTexturePath  = aPrefix + mat.alpha_texname;
+
+			if( !mat.normal_texname.empty() )
+				mi.normalMapTexturePath  = aPrefix + mat.normal_texname;
+
+#		if 0
+			mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			if( !mat.diffuse_texname.empty() )
+				mi.diffuseTexturePath  = aPrefix + mat.diffuse_texname;
+#		endif
+
+			aModel.materials.emplace_back( std::move(mi) );
+		}
+	}
+
+	template< typename tFunc >
+	void for_each_line_( char const* aPath, tFunc&& aFunc )
+	{
+		FileCloser_ fin{ std::fopen( aPath, "rb" ) };
+		if( !fin.file )
+			throw lut::Error( "Unable to open OBJ file '%s'", aPath );
+
+		// Lines that do not fit into the buffer grow it
+		std::vector<char> buffer( kReadChunkSize_ );
+		std::size_t carry = 0, lineNumber = 0;
+
+		auto const line_ = [&] (char const* aBeg, char const* aEnd) {
+			if( aEnd != aBeg && '\r' == aEnd[-1] )
+				--aEnd;
+
+			aFunc( std::string_view( aBeg, std::size_t(aEnd-aBeg) ), ++lineNumber );
+		};
+
+		for( ;; )
+		{
+			auto const read = std::fread( buffer.data() + carry, 1, buffer.size() - carry, fin.file );
+			if( 0 == read )
+			{
+				if( std::ferror( fin.file ) )
+					throw lut::Error( "Error reading OBJ file '%s'", aPath );
+
+				if( carry ) // Last line without terminator
+					line_( buffer.data(), buffer.data() + carry );
+
+				return;
+			}
+
+			char const* const data = buffer.data();
+			char const* const end = data + carry + read;
+
+			char const* beg = data;
+			while( auto const* nl = static_cast<char const*>(std::memchr( beg, '\n', std::size_t(end-beg) )) )
+			{
+				line_( beg, nl );
+				beg = nl+1;
+			}
+
+			carry = std::size_t(end-beg);
+			std::memmove( buffer.data(), beg, carry );
+
+			if( carry == buffer.size() )
+				buffer.resize( 2*buffer.size() );
+		}
+	}
+
+	std::string_view next_token_( std::string_view& aLine ) noexcept
+	{
+		std::size_t beg = 0;
+		while( beg < aLine.size() && (' ' == aLine[beg] || '\t' == aLine[beg]) )
+			++beg;
+
+		std::size_t end = beg;
+		while( end < aLine.size() && ' ' != aLine[end] && '\t' != aLine[end] )
+			++end;
+
+		auto const ret = aLine.substr( beg, end-beg );
+		aLine.remove_prefix( end );
+		return ret;
+	}
+	std::string_view trim_( std::string_view aString ) noexcept
+	{
+		while( !aString.empty() && (' ' == aString.front() || '\t' == aString.front()) )
+			aString.remove_prefix( 1 );
+		while( !aString.empty() && (' ' == aString.back() || '\t' == aString.back()) )
+			aString.remove_suffix( 1 );
+
+		return aString;
+	}
+
+	float parse_float_( std::string_view aToken, char const* aPath, std::size_t aLine )
+	{
+		if( !aToken.empty() && '+' == aToken.front() )
+			aToken.remove_prefix( 1 );
+
+#		if defined(__cpp_lib_to_chars)
+		float ret = 0.f;
+		auto const [ptr, ec] = std::from_chars( aToken.data(), aToken.data() + aToken.size(), ret );
+		if( std::errc() != ec || aToken.data() + aToken.size() != ptr )
+			throw lut::Error( "%s:%zu: invalid number '%.*s'", aPath, aLine, int(aToken.size()), aToken.data() );
+
+		return ret;
+#		else // !__cpp_lib_to_chars
+		// Standard libraries without floating point std::from_chars() (e.g.,
+		// libstdc++ before GCC 11). std::strtof() needs a terminated string,
+		// so copy the token; no valid number in an OBJ file comes close to the
+		// buffer's size.
+		char buffer[128];
+		if( aToken.empty() || aToken.size() >= sizeof(buffer) )
+			throw lut::Error( "%s:%zu: invalid number '%.*s'", aPath, aLine, int(aToken.size()), aToken.data() );
+
+		std::memcpy( buffer, aToken.data(), aToken.size() );
+		buffer[aToken.size()] = '\0';
+
+		errno = 0;
+		char* end = nullptr;
+		float const ret = std::strtof( buffer, &end );
+		if( ERANGE == errno || buffer + aToken.size() != end )
+			throw lut::Error( "%s:%zu: invalid number '%.*s'", aPath, aLine, int(aToken.size()), aToken.data() );
+
+		return ret;
+#		endif // ~ __cpp_lib_to_chars
+	}
+
+	std::uint32_t resolve_index_( std::string_view aToken, std::size_t aSeen, std::size_t aCount, char const* aPath, std::size_t aLine )
+	{
+		long long index = 0;
+		auto const [ptr, ec] = std::from_chars( aToken.data(), aToken.data() + aToken.size(), index );
+		if( std::errc() != ec || aToken.data() + aToken.size() != ptr || 0 == index )
+			throw lut::Error( "%s:%zu: invalid index '%.*s'", aPath, aLine, int(aToken.size()), aToken.data() );
+
+		long long const resolved = index > 0 ? index-1 : (long long)(aSeen) + index;
+		if( resolved < 0 || std::size_t(resolved) >= aCount )
+			throw lut::Error( "%s:%zu: index %lld out of range", aPath, aLine, index );
+
+		return std::uint32_t(resolved);
+	}
 }
 
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
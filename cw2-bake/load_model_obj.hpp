@@ -1,10 +1,66 @@
 #ifndef LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 #define LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <cstddef>
+
 #include "input_model.hpp"
 
-// Load a Wavefront OBJ model
-InputModel load_wavefront_obj( char const* aPath );
+// Load a Wavefront OBJ model. Faces are grouped into one mesh per shape and
+// material; the shapes are processed in parallel by up to aWorkerCount
+// threads.
+InputModel load_wavefront_obj(
+	char const* aPath,
+	std::size_t aWorkerCount = 1
+);
 
-#endif // LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
+/* Streaming OBJ loader, for models whose faces do not fit into memory at
+ * once. The file is read twice, in fixed-size chunks:
+ *
+ *  - The constructor reads the materials and the attribute data (positions,
+ *    normals and texture coordinates) into model(). Faces may reference
+ *    attributes from anywhere in the file, so these stay resident.
+ *  - for_each_shape() reads the faces, one shape ('o' or 'g') at a time. For
+ *    each shape, model().meshes and model().vertices are replaced by the
+ *    shape's meshes (one per material, as with load_wavefront_obj()), and
+ *    aFunc( model() ) is called. The shape's vertices are released before
+ *    the next shape is read.
+ *
+ * Peak memory is thus the attribute data plus the largest shape, rather than
+ * all faces of the model.
+ *
+ * The attribute data may be modified in place (but not resized) between the
+ * two steps, e.g., by apply_static_transform(). Mesh material indices always
+ * refer to the materials as loaded by the constructor.
+ *
+ * Polygons are triangulated as fans. Faces before the first 'usemtl', or
+ * that use an unknown material, are an error. Errors throw lut::Error.
+ */
+class ObjStream final
+{
+	public:
+		explicit ObjStream( char const* aPath );
+
+		ObjStream( ObjStream const& ) = delete;
+		ObjStream& operator= (ObjStream const&) = delete;
+
+	public:
+		InputModel& model() noexcept;
+		InputModel const& model() const noexcept;
 
+		// Returns the number of (non-empty) shapes
+		std::size_t for_each_shape( std::function<void(InputModel&)> const& aFunc );
+
+	private:
+		InputModel mModel;
+
+		// Materials as loaded, by index and by name
+		std::vector<std::string> mMaterialNames;
+		std::unordered_map<std::string,std::size_t> mMaterialIds;
+};
+
+#endif // LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
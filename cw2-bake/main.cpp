@@ -1,3 +1,7 @@
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <thread>
 #include <iterator>
 #include <vector>
 #include <typeinfo>
@@ -5,48 +9,205 @@
 #include <filesystem>
 #include <system_error>
 #include <unordered_map>
+#include <condition_variable>
+#include <algorithm>
+#include <limits>
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <cassert>
 
-#include <tgen.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "index_mesh.hpp"
+#include "optimize_mesh.hpp"
+#include "meshlet.hpp"
+#include "simplify_mesh.hpp"
+#include "tangent_space.hpp"
+#include "merge_model.hpp"
+#include "static_transform.hpp"
+#include "bake_cache.hpp"
+#include "bake_texture.hpp"
+#include "output_file.hpp"
+#include "mesh_writer.hpp"
+#include "batch.hpp"
 #include "input_model.hpp"
 #include "load_model_obj.hpp"
+#include "bake_profile.hpp"
 
 #include "../labutils/error.hpp"
+#include "../labutils/parallel.hpp"
+#include "../labutils/mesh_file.hpp"
 namespace lut = labutils;
 
 namespace
 {
 	// constants
-	/* File "magic". The first 16 bytes of our custom file are equal to this
-	 * magic value. This allows us to check whether a certain file is
-	 * (probably) of the right type. Having a file magic is relatively common
-	 * practice -- you can find a list of such magic sequences e.g. here:
-     * https://en.wikipedia.org/wiki/List_of_file_signatures
-	 *
-	 * When picking a signature there are a few considerations. For example,
-	 * including non-printable characters (e.g. the \0) early keeps the file
-	 * from being misidentified as text.
-	 */
-	 constexpr char kFileMagic[16] = "\0\0COMP5822Mmesh";
-
-	/* Note: change the file variant if you change the file format! 
-	 *
-	 * Suggestion: use 'uid-tag'. For example, I would use "scsmbil-tan" to
-	 * indicate that this is a custom format by myself (=scsmbil) with
-	 * additional tangent space information.
-	 */
-	constexpr char kFileVariant[16] = "default";
+	// File magic, variant and feature flags: see labutils/mesh_file.hpp
+
+	// Estimated peak memory use while baking a model, per byte of its OBJ
+	// file; see estimate_bake_memory_()
+	constexpr std::uint64_t kBakeMemoryPerObjByte = 8;
+
+	// Same, when streaming the OBJ (see BakeOptions_::streamObj). Only the
+	// attribute data stays resident, plus the shape that is being baked.
+	constexpr std::uint64_t kStreamMemoryPerObjByte = 2;
+
+	// Finished meshes that may wait for the writer in bake_meshes_(), per
+	// worker. Limits peak memory to a few meshes per worker rather than the
+	// whole model.
+	constexpr std::size_t kPendingMeshesPerWorker = 2;
+
+	// Meshes with 16-bit indices can address at most this many vertices
+	constexpr std::size_t kMaxVertices16 = std::size_t(1) << 16;
+
+	// Packed textures (TextureUsage::packed) are identified by their channel
+	// sources joined with this character. Each source is either a path or a
+	// constant ("=value").
+	constexpr char kPackSeparator = '\x1f';
 
 	// types
+	struct BakeOptions_
+	{
+		std::size_t workerCount;
+
+		// Vertices that are closer than this (in all attributes) are welded
+		// after exact deduplication. Zero disables welding.
+		float weldTolerance = 1e-5f;
+
+		// Vertices without normals get generated ones (see ensure_normals()).
+		// Faces that meet at a larger angle than this, in degrees, do not
+		// share normals; 180 smooths across all edges.
+		float creaseAngle = 180.f;
+
+		// Reorder triangles and vertices for vertex cache and fetch locality
+		bool optimizeVertexCache = true;
+
+		// Reorder triangle clusters to reduce overdraw, allowing the ACMR of
+		// each cluster to grow by this factor. Zero disables the pass.
+		float overdrawThreshold = 0.f;
+
+		// Split meshes into meshlets with culling information
+		bool buildMeshlets = true;
+
+		// Number of levels of detail per mesh, including the original. One
+		// disables simplification.
+		std::size_t lodCount = 4;
+
+		// Maximum error introduced by each level of detail, relative to the
+		// size of the mesh.
+		float lodMaxError = 0.02f;
+
+		// Store quantized positions, normals and texture coordinates
+		bool quantize = true;
+
+		// Store 16-bit indices, splitting meshes that have too many vertices
+		bool index16 = true;
+
+		// Merge all meshes that use the same material
+		bool mergeByMaterial = true;
+
+		// Transform applied to the model when baking
+		glm::mat4 staticTransform = glm::mat4( 1.f );
+
+		// Reuse results from previous bakes; see bake_cache.hpp
+		bool useCache = true;
+
+		// Store textures in BCn formats; see bake_texture.hpp
+		bool compressTextures = true;
+
+		// Pack roughness and metalness into one two-channel texture
+		bool packOrm = true;
+
+		// Compress vertex and index data; see labutils/geometry_codec.hpp.
+		// Opt-in: the runtime must decode the streams before upload.
+		bool compressGeometry = false;
+
+		// Read and bake the OBJ one shape at a time; see ObjStream. Meshes
+		// are then only merged by material within each shape.
+		bool streamObj = false;
+
+		// Write a profile of the bake next to the output; see BakeProfile
+		bool writeProfile = true;
+	};
+
+	struct OptimizationReport_
+	{
+		VertexCacheStats before, after;
+		float overdrawBefore = 0.f, overdrawAfter = 0.f;
+		std::size_t triangles = 0;
+	};
+
+	// Statistics from processing one input mesh (see process_mesh_()). These
+	// are summarized once all meshes are done.
+	struct MeshReport_
+	{
+		std::string meshName;
+
+		bool cached = false; // if set, only bytesOut is used below
+
+		std::size_t inputVertices = 0;
+
+		std::size_t indexedVertices = 0, indexedIndices = 0;
+		std::size_t generatedNormals = 0; // including vertices split at creases
+		std::size_t outputMeshes = 0; // more than one if split
+
+		std::vector<OptimizationReport_> optimization; // one per output mesh
+
+		std::size_t meshlets = 0;
+		std::size_t tangentVertices = 0;
+
+		std::size_t lodTriangles[kMaxLodCount] = {};
+		std::size_t lodMeshes[kMaxLodCount] = {};
+
+		// Wall time of each step, in seconds; see ProfileMesh
+		double indexSeconds = 0.0, optimizeSeconds = 0.0, meshletSeconds = 0.0;
+		double tangentSeconds = 0.0, lodSeconds = 0.0, encodeSeconds = 0.0;
+
+		std::uint64_t bytesOut = 0; // written to the mesh section
+	};
+
+	// State of the mesh section of the output, which may be filled by
+	// several calls to bake_meshes_()
+	struct MeshSection_
+	{
+		QuantizationBox box{};
+
+		// Large meshes may be split, so the number of output meshes is only
+		// known at the end
+		std::uint64_t meshCountOffset = 0;
+		std::uint32_t meshCount = 0;
+
+		std::vector<std::vector<Meshlet>> meshlets; // one per output mesh
+		std::vector<MeshReport_> reports; // one per input mesh
+
+		std::size_t indexCount = 0, vertexCount = 0, compressedBytes = 0;
+		float positionError = 0.f, normalDot = 1.f, texcoordError = 0.f;
+	};
+
+	// All output meshes derived from one input mesh, ready to be written
+	struct BakedMesh_
+	{
+		std::vector<CachedMesh> meshes;
+		std::vector<QuantizedMesh> quantized; // Empty if not quantized
+		std::vector<std::vector<std::uint8_t>> compressed; // Empty if not compressed
+	};
+
+	struct TextureJob_
+	{
+		std::string source;
+		std::string destination; // relative to the output directory
+		TextureUsage usage;
+	};
+
 	struct TextureInfo_
 	{
 		std::uint32_t uniqueId;
 		std::uint8_t channels;
+		TextureUsage usage;
 		std::string newPath;
 	};
 
@@ -54,27 +215,129 @@ namespace
 	void process_model_(
 		char const* aOutput,
 		char const* aInputOBJ,
-		glm::mat4x4 const& aStaticTransform = glm::mat4x4( 1.f ) //TODO
+		BakeOptions_ const&
 	);
 
 
-	void write_model_data_(
-		FILE*,
+	void write_model_header_(
+		OutputFile&,
 		InputModel const&,
-		std::vector<IndexedMesh> const&,
+		std::uint32_t aFeatures,
 		std::unordered_map<std::string,TextureInfo_> const&
 	);
 
+	void write_mesh_(
+		OutputFile&,
+		InputModel const&,
+		std::size_t aSourceMesh,
+		CachedMesh const&,
+		QuantizedMesh const*, // null if not quantized
+		std::vector<std::uint8_t> const* aCompressed, // null if not compressed
+		std::uint32_t aFeatures
+	);
 
-	std::vector<IndexedMesh> index_meshes_(
+	// The mesh section is written in three steps: begin_meshes_() writes the
+	// quantization box and a placeholder for the mesh count. bake_meshes_()
+	// processes the meshes of a model concurrently, and writes them as they
+	// complete; it may be called several times (e.g., per shape when
+	// streaming). end_meshes_() writes the meshlet section and the mesh
+	// count, and prints the reports.
+	MeshSection_ begin_meshes_(
+		OutputFile&,
+		QuantizationBox const&,
+		std::uint32_t aFeatures
+	);
+	void bake_meshes_(
+		OutputFile&,
+		MeshSection_&,
 		InputModel const&,
-		float aErrorTolerance = 1e-5f
+		std::uint32_t aFeatures,
+		std::filesystem::path const& aCacheDir,
+		BakeOptions_ const&
+	);
+	void end_meshes_(
+		OutputFile&,
+		MeshSection_&,
+		std::uint32_t aFeatures,
+		BakeOptions_ const&
 	);
 
-	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
+	std::vector<CachedMesh> process_mesh_(
+		InputModel const&,
+		std::size_t aMeshIndex,
+		BakeOptions_ const&,
+		std::size_t aWorkerCount,
+		MeshReport_&
+	);
+
+	void print_mesh_reports_(
+		std::vector<MeshReport_> const&,
+		BakeOptions_ const&
+	);
+
+	// Adds the meshes and model-wide mesh metrics to the profile
+	void profile_meshes_(
+		BakeProfile&,
+		std::vector<MeshReport_> const&
+	);
+
+	std::vector<OptimizationReport_> optimize_meshes_(
+		std::vector<IndexedMesh>&,
+		BakeOptions_ const&,
+		std::size_t aWorkerCount
+	);
+
+	QuantizationBox quantization_box_(
 		InputModel const&
 	);
 
+	std::uint64_t hash_options_(
+		BakeOptions_ const&
+	);
+
+	std::uint64_t hash_mesh_(
+		InputModel const&,
+		std::size_t aMeshIndex,
+		BakeOptions_ const&
+	);
+
+	// Bakes textures whose source changed (or whose output is missing)
+	// according to aOld, and records them in aNew. Returns the number of
+	// failures.
+	std::size_t bake_textures_(
+		std::vector<TextureJob_> const&,
+		std::filesystem::path const& aRootDir,
+		BakeCacheState const& aOld,
+		BakeCacheState& aNew,
+		BakeOptions_ const&
+	);
+
+	BakeOptions_ parse_options_(
+		int aArgc,
+		char* aArgv[],
+		std::vector<BatchJob>& aJobs,
+		BatchSettings& aBatch
+	);
+
+	std::uint64_t estimate_bake_memory_( std::string const& aInputOBJ, BakeOptions_ const& );
+
+	// Size of the file, or zero if it does not exist
+	std::uint64_t file_size_or_zero_( std::filesystem::path const& );
+
+	double seconds_since_( std::chrono::steady_clock::time_point );
+
+	std::string packed_orm_key_(
+		InputMaterialInfo const&
+	);
+	std::vector<std::string> split_pack_key_(
+		std::string const&
+	);
+
+	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
+		InputModel const&,
+		bool aPackOrm
+	);
+
 	std::unordered_map<std::string,TextureInfo_> new_paths_(
 		std::unordered_map<std::string,TextureInfo_>,
 		std::filesystem::path const& aTexDir
@@ -82,14 +345,59 @@ namespace
 }
 
 
-int main() try
+int main( int aArgc, char* aArgv[] ) try
 {
-	process_model_(
-		"assets/cw2/sponza-pbr.comp5822mesh",
-		"assets-src/cw2/sponza-pbr.obj"
-	);
+	std::vector<BatchJob> jobs;
+	BatchSettings batch;
+	auto const options = parse_options_( aArgc, aArgv, jobs, batch );
+
+	if( jobs.empty() )
+		jobs.emplace_back( BatchJob{ "assets-src/cw2/sponza-pbr.obj", "assets/cw2/sponza-pbr.comp5822mesh" } );
+
+	// Each model writes next to its output (mesh file, textures, cache), so
+	// two jobs with the same output would clash.
+	std::unordered_map<std::string,std::size_t> outputs;
+	for( std::size_t i = 0; i < jobs.size(); ++i )
+	{
+		auto const key = std::filesystem::path( jobs[i].output ).replace_extension().lexically_normal().string();
+		auto const [it, added] = outputs.emplace( key, i );
+		if( !added )
+			throw lut::Error( "'%s' and '%s' have the same output '%s'", jobs[it->second].input.c_str(), jobs[i].input.c_str(), jobs[i].output.c_str() );
+
+		jobs[i].memoryEstimate = estimate_bake_memory_( jobs[i].input, options );
+	}
+
+	auto const start = std::chrono::steady_clock::now();
+
+	auto const results = run_batch( jobs, batch, [&] (BatchJob const& aJob, std::size_t aWorkerCount) {
+		auto modelOptions = options;
+		modelOptions.workerCount = aWorkerCount;
+
+		process_model_( aJob.output.c_str(), aJob.input.c_str(), modelOptions );
+	} );
+
+	double const seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+	// Summary
+	std::size_t failed = 0;
+	for( auto const& result : results )
+		failed += !result.succeeded;
+
+	std::printf( "Baked %zu of %zu model(s) in %.2f s", jobs.size() - failed, jobs.size(), seconds );
+	if( jobs.size() > 1 )
+		std::printf( " (up to %zu at a time)", std::min( batch.maxConcurrent, jobs.size() ) );
+	std::printf( ":\n" );
 
-	return 0;
+	for( std::size_t i = 0; i < jobs.size(); ++i )
+	{
+		auto const& result = results[i];
+		if( result.succeeded )
+			std::printf( " - %s: %.2f s, %zu worker(s)\n", jobs[i].input.c_str(), result.seconds, result.workerCount );
+		else
+			std::printf( " - %s: FAILED after %.2f s: %s\n", jobs[i].input.c_str(), result.seconds, result.error.c_str() );
+	}
+
+	return failed ? 1 : 0;
 }
 catch( std::exception const& eErr )
 {
@@ -99,7 +407,7 @@ catch( std::exception const& eErr )
 
 namespace
 {
-	void process_model_( char const* aOutput, char const* aInputOBJ, glm::mat4x4 const& aStaticTransform )
+	void process_model_( char const* aOutput, char const* aInputOBJ, BakeOptions_ const& aOptions )
 	{
 		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
 
@@ -108,119 +416,274 @@ namespace
 		std::filesystem::path const rootdir = outname.parent_path();
 		std::filesystem::path const basename = outname.stem();
 		std::filesystem::path const texdir = basename.string() + "-tex";
+		std::filesystem::path const cachedir = rootdir / (basename.string() + "-cache");
+		std::filesystem::path const statepath = cachedir / "state.txt";
 
-		// Load input model
-		auto const model = load_wavefront_obj( aInputOBJ );
+		std::filesystem::path const profilepath = rootdir / (basename.string() + "-profile.json");
 
-		std::size_t inputVerts = 0;
-		for( auto const& imesh : model.meshes )
-			inputVerts += imesh.vertexCount;
+		auto mainpath = rootdir / basename;
+		mainpath.replace_extension( "comp5822mesh" );
+
+		// The profile is always collected (which is cheap), but only written
+		// if requested.
+		BakeProfile profile( aInputOBJ, mainpath.string(), aOptions.workerCount );
+		std::uint64_t const objBytes = file_size_or_zero_( aInputOBJ );
+
+		auto const write_profile_ = [&] {
+			if( !aOptions.writeProfile )
+				return;
+
+			profile.write_json( profilepath );
+			batch_printf( " - profile: %s\n", profilepath.string().c_str() );
+		};
+
+		// Texture sources count as input (except constants in packed
+		// textures), and the baked textures as output.
+		auto const bake_textures_profiled_ = [&] (std::vector<TextureJob_> const& aTextures, BakeCacheState const& aOld, BakeCacheState& aNew) {
+			profile.begin_stage( "textures" );
+			auto const errors = bake_textures_( aTextures, rootdir, aOld, aNew, aOptions );
+
+			std::uint64_t bytesIn = 0, bytesOut = 0;
+			for( auto const& tex : aTextures )
+			{
+				if( TextureUsage::packed == tex.usage )
+				{
+					for( auto const& source : split_pack_key_( tex.source ) )
+					{
+						if( !source.empty() && '=' != source[0] )
+							bytesIn += file_size_or_zero_( source );
+					}
+				}
+				else
+					bytesIn += file_size_or_zero_( tex.source );
 
-		std::printf( "%s: %zu meshes, %zu materials\n", aInputOBJ, model.meshes.size(), model.materials.size() );
-		std::printf( " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
+				bytesOut += file_size_or_zero_( rootdir / tex.destination );
+			}
+
+			profile.end_stage( bytesIn, bytesOut );
+			return errors;
+		};
 
-		// Index meshes
-		auto const indexed = index_meshes_( model );
+		// Skip everything if neither the sources nor the options changed since
+		// the last bake. Textures are still checked individually.
+		BakeCacheState const oldState = aOptions.useCache ? load_cache_state( statepath ) : BakeCacheState{};
 
-		std::size_t outputVerts = 0, outputIndices = 0;
-		for( auto const& mesh : indexed )
+		BakeCacheState newState;
+		if( aOptions.useCache )
 		{
-			outputVerts += mesh.vert.size();
-			outputIndices += mesh.indices.size();
+			profile.begin_stage( "cache-check" );
+			newState.modelHash = hash_obj_sources( aInputOBJ, hash_options_( aOptions ) );
+			profile.end_stage( objBytes );
+
+			if( newState.modelHash == oldState.modelHash && std::filesystem::exists( mainpath ) )
+			{
+				batch_printf( "%s: unchanged since the last bake of '%s'\n", aInputOBJ, mainpath.string().c_str() );
+
+				std::vector<TextureJob_> copies;
+				for( auto const& entry : oldState.textures )
+					copies.emplace_back( TextureJob_{ entry.second.source, entry.first, TextureUsage(entry.second.usage) } );
+
+				if( bake_textures_profiled_( copies, oldState, newState ) )
+					newState.modelHash = 0; // Retry next time
+
+				save_cache_state( statepath, newState );
+
+				profile.set_unchanged( true );
+				write_profile_();
+				return;
+			}
 		}
 
-		std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+		// Load input model. When streaming, only the materials and attribute
+		// data are loaded here; the faces follow one shape at a time.
+		std::unique_ptr<ObjStream> stream;
+		InputModel loaded;
 
-		// Find list of unique textures
-		auto const textures = new_paths_( find_unique_textures_( model ), texdir );
+		profile.begin_stage( "load" );
+		if( aOptions.streamObj )
+			stream = std::make_unique<ObjStream>( aInputOBJ );
+		else
+			loaded = load_wavefront_obj( aInputOBJ, aOptions.workerCount );
+
+		auto& model = stream ? stream->model() : loaded;
+
+		std::size_t const attributeBytes = model.positions.size()*sizeof(glm::vec3)
+			+ model.normals.size()*sizeof(glm::vec3)
+			+ model.texcoords.size()*sizeof(glm::vec2)
+		;
+
+		profile.end_stage( objBytes, model.vertices.size()*sizeof(InputVertex) + attributeBytes );
+
+		if( stream )
+		{
+			batch_printf( "%s: streaming, %zu materials\n", aInputOBJ, model.materials.size() );
+			batch_printf( " - attribute data: %zu positions, %zu normals, %zu texture coordinates => %zu kB\n", model.positions.size(), model.normals.size(), model.texcoords.size(), attributeBytes/1024 );
+		}
+		else
+		{
+			std::size_t inputVerts = 0;
+			for( auto const& imesh : model.meshes )
+				inputVerts += imesh.vertexCount;
+
+			batch_printf( "%s: %zu meshes, %zu materials\n", aInputOBJ, model.meshes.size(), model.materials.size() );
+			std::size_t const loadedBytes = model.vertices.size()*sizeof(InputVertex) + attributeBytes;
+
+			batch_printf( " - triangle soup vertices: %zu => %zu kB (loaded as OBJ indices: %zu kB)\n", inputVerts, inputVerts*vertexSize/1024, loadedBytes/1024 );
+		}
+
+		// Apply the static transform to the attribute data
+		if( aOptions.staticTransform != glm::mat4x4( 1.f ) )
+		{
+			profile.begin_stage( "transform" );
+			apply_static_transform( model, aOptions.staticTransform, aOptions.workerCount );
+			profile.end_stage();
 
-		std::printf( " - unique textures: %zu\n", textures.size() );
+			batch_printf( " - applied static transform to %zu positions and %zu normals\n", model.positions.size(), model.normals.size() );
+		}
+
+		// Remove duplicate materials, and merge meshes by material. This only
+		// regroups the vertices; the attribute data is unchanged. Streamed
+		// shapes already come with one mesh per material.
+		profile.begin_stage( "materials" );
+
+		std::vector<std::size_t> materialRemap;
+		if( auto const removed = deduplicate_materials( model, &materialRemap ) )
+			batch_printf( " - removed %zu duplicate material(s) => %zu materials\n", removed, model.materials.size() );
+
+		if( aOptions.mergeByMaterial && !stream )
+		{
+			if( auto const merged = merge_meshes_by_material( model ) )
+				batch_printf( " - merged meshes by material: %zu => %zu meshes\n", model.meshes.size() + merged, model.meshes.size() );
+		}
+
+		// Find list of unique textures
+		auto const textures = new_paths_( find_unique_textures_( model, aOptions.packOrm ), texdir );
+
+		profile.end_stage();
+
+		batch_printf( " - unique textures: %zu\n", textures.size() );
+
+		std::uint32_t features = 0;
+		if( aOptions.buildMeshlets )
+			features |= lut::kMeshFeatureMeshlets;
+		if( aOptions.lodCount > 1 )
+			features |= lut::kMeshFeatureLods;
+		if( aOptions.quantize )
+			features |= lut::kMeshFeatureQuantized;
+		if( aOptions.index16 )
+			features |= lut::kMeshFeatureIndex16;
+		if( aOptions.packOrm )
+			features |= lut::kMeshFeaturePackedOrm;
+		if( aOptions.compressGeometry )
+			features |= lut::kMeshFeatureCompressed;
 
 		// Ensure output directory exists
 		std::filesystem::create_directories( rootdir );
 
-		// Output mesh data
-		auto mainpath = rootdir / basename;
-		mainpath.replace_extension( "comp5822mesh" );
+		// Output mesh data. The file only replaces the previous one once it
+		// is complete.
+		OutputFile out( mainpath );
 
-		FILE* fof = std::fopen( mainpath.string().c_str(), "wb" );
-		if( !fof )
-			throw lut::Error( "Unable to open '%s' for writing", mainpath.string().c_str() );
+		write_model_header_( out, model, features, textures );
 
-		try
+		// Indexing only selects vertices and never moves them, so the box can
+		// be computed before any mesh is processed. When streaming, the faces
+		// are not known yet, and the box covers all positions instead.
+		QuantizationBox box{};
+		if( features & lut::kMeshFeatureQuantized )
+			box = stream ? quantization_box( model.positions ) : quantization_box_( model );
+
+		profile.begin_stage( "meshes" );
+		auto const sectionStart = out.offset();
+
+		auto section = begin_meshes_( out, box, features );
+
+		if( stream )
 		{
-			write_model_data_( fof, model, indexed, textures );
+			// apply_static_transform() restores the winding of mirrored
+			// models only for the vertices that were loaded at the time,
+			// i.e., none of the streamed ones.
+			bool const mirrored = glm::determinant( glm::mat3( aOptions.staticTransform ) ) < 0.f;
+
+			auto const shapes = stream->for_each_shape( [&] (InputModel& aShape) {
+				for( auto& mesh : aShape.meshes )
+					mesh.materialIndex = materialRemap[mesh.materialIndex];
+
+				if( mirrored )
+				{
+					for( std::size_t i = 0; i+2 < aShape.vertices.size(); i += 3 )
+						std::swap( aShape.vertices[i+1], aShape.vertices[i+2] );
+				}
+
+				bake_meshes_( out, section, aShape, features, cachedir, aOptions );
+			} );
+
+			batch_printf( " - streamed %zu shape(s) => %zu meshes\n", shapes, section.reports.size() );
 		}
-		catch( ... )
+		else
 		{
-			std::fclose( fof );
-			throw;
+			bake_meshes_( out, section, model, features, cachedir, aOptions );
 		}
 
-		std::fclose( fof );
+		end_meshes_( out, section, features, aOptions );
+
+		// Input are the triangle soup vertices, as with the report above
+		std::size_t inputVerts = 0;
+		for( auto const& rep : section.reports )
+			inputVerts += rep.inputVertices;
+
+		profile.end_stage( inputVerts*vertexSize, out.offset() - sectionStart );
+		profile_meshes_( profile, section.reports );
+
+		profile.begin_stage( "write" );
+		auto const outputBytes = out.offset();
+		out.commit();
+		profile.end_stage( 0, outputBytes );
 
-		// Copy textures
+		profile.set_metric( "outputBytes", double(outputBytes) );
+
+		// Bake textures
 		std::filesystem::create_directories( rootdir / texdir );
 
-		std::size_t errors = 0;
+		std::vector<TextureJob_> copies;
 		for( auto const& entry : textures )
-		{
-			auto const dest = rootdir / entry.second.newPath;
+			copies.emplace_back( TextureJob_{ entry.first, entry.second.newPath, entry.second.usage } );
 
-			std::error_code ec;
-			bool ret = std::filesystem::copy_file( 
-				entry.first,
-				dest,
-				std::filesystem::copy_options::none,
-				ec
-			);
+		if( bake_textures_profiled_( copies, oldState, newState ) )
+			newState.modelHash = 0; // Retry next time
 
-			if( !ret )
-			{
-				++errors;
-				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
-			}
-		}
+		if( aOptions.useCache )
+			save_cache_state( statepath, newState );
 
-		auto const total = textures.size();
-		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
-		if( errors )
-		{
-			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
-		}
+		write_profile_();
 	}
 }
 
 namespace
 {
-	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
-	{
-		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
-
-		if( ret != aBytes )
-			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
-	}
-
-	void write_string_( FILE* aOut, char const* aString )
+	void write_string_( OutputFile& aOut, char const* aString )
 	{
 		// Write a string
 		// Format:
 		//  - uint32_t : N = length of string in bytes, including terminating '\0'
 		//  - N x char : string
 		std::uint32_t const length = std::uint32_t(std::strlen(aString)+1);
-		checked_write_( aOut, sizeof(std::uint32_t), &length );
+		aOut.write( sizeof(std::uint32_t), &length );
 
-		checked_write_( aOut, length, aString );
+		aOut.write( length, aString );
 	}
 
-	void write_model_data_( FILE* aOut, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::unordered_map<std::string,TextureInfo_> const& aTextures )
+	void write_model_header_( OutputFile& aOut, InputModel const& aModel, std::uint32_t aFeatures, std::unordered_map<std::string,TextureInfo_> const& aTextures )
 	{
 		// Write header
 		// Format:
 		//   - char[16] : file magic
 		//   - char[16] : file variant ID
-		checked_write_( aOut, sizeof(char)*16, kFileMagic );
-		checked_write_( aOut, sizeof(char)*16, kFileVariant );
+		//   - uint32_t : feature flags
+		aOut.write( sizeof(char)*16, lut::kMeshFileMagic );
+		aOut.write( sizeof(char)*16, lut::kMeshFileVariant );
+
+		aOut.write( sizeof(aFeatures), &aFeatures );
 		
 		// Write list of unique textures
 		// Format:
@@ -236,7 +699,7 @@ namespace
 		}
 
 		std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
-		checked_write_( aOut, sizeof(textureCount), &textureCount );
+		aOut.write( sizeof(textureCount), &textureCount );
 
 		for( auto const& tex : orderedUnqiue )
 		{
@@ -244,7 +707,7 @@ namespace
 			write_string_( aOut, tex->newPath.c_str() );
 
 			std::uint8_t channels = tex->channels;
-			checked_write_( aOut, sizeof(channels), &channels );
+			aOut.write( sizeof(channels), &channels );
 		}
 
 		// Write material information
@@ -254,11 +717,13 @@ namespace
 		//    - uin32_t : base color texture index
 		//    - uin32_t : roughness texture index
 		//    - uin32_t : metalness texture index
+		//      (with kMeshFeaturePackedOrm, both refer to the same texture, with
+		//      roughness in R and metalness in G)
 		//    - uin32_t : alphaMask texture index (or 0xffffffff if none)
 		//    - uin32_t : normalMap texture index (or 0xffffffff if none)
 		//    - TODO: base color, metalness and roughness
 		std::uint32_t const materialCount = std::uint32_t(aModel.materials.size());
-		checked_write_( aOut, sizeof(materialCount), &materialCount );
+		aOut.write( sizeof(materialCount), &materialCount );
 
 		for( auto const& mat : aModel.materials )
 		{
@@ -266,136 +731,1331 @@ namespace
 				if( aTexturePath.empty() )
 				{
 					static constexpr std::uint32_t sentinel = ~std::uint32_t(0);
-					checked_write_( aOut, sizeof(std::uint32_t), &sentinel );
+					aOut.write( sizeof(std::uint32_t), &sentinel );
 					return;
 				}
 
 				auto const it = aTextures.find( aTexturePath );
 				assert( aTextures.end() != it );
 
-				checked_write_( aOut, sizeof(std::uint32_t), &it->second.uniqueId );
+				aOut.write( sizeof(std::uint32_t), &it->second.uniqueId );
 			};
 
 			write_tex_( mat.baseColorTexturePath );
-			write_tex_( mat.roughnessTexturePath );
-			write_tex_( mat.metalnessTexturePath );
+			if( aFeatures & lut::kMeshFeaturePackedOrm )
+			{
+				auto const orm = packed_orm_key_( mat );
+				write_tex_( orm );
+				write_tex_( orm );
+			}
+			else
+			{
+				write_tex_( mat.roughnessTexturePath );
+				write_tex_( mat.metalnessTexturePath );
+			}
 			write_tex_( mat.alphaMaskTexturePath );
 			write_tex_( mat.normalMapTexturePath );
 		}
+	}
+
+	void write_mesh_( OutputFile& aOut, InputModel const& aModel, std::size_t aSourceMesh, CachedMesh const& aMesh, QuantizedMesh const* aQuantized, std::vector<std::uint8_t> const* aCompressed, std::uint32_t aFeatures )
+	{
+		auto const& mmesh = aModel.meshes[aSourceMesh];
+		auto const& imesh = aMesh.mesh;
+
+		if( imesh.norm.size() != imesh.vert.size() )
+			throw lut::Error( "Mesh '%s' has no normals", mmesh.meshName.c_str() );
+
+		if( aFeatures & lut::kMeshFeatureIndex16 && imesh.vert.size() > kMaxVertices16 )
+			throw lut::Error( "Mesh '%s' has too many vertices (%zu) for 16-bit indices", mmesh.meshName.c_str(), imesh.vert.size() );
 
+		write_mesh( aOut, std::uint32_t(mmesh.materialIndex), imesh, aMesh.lods, aQuantized, aCompressed, aFeatures );
+	}
+}
+
+namespace
+{
+	MeshSection_ begin_meshes_( OutputFile& aOut, QuantizationBox const& aBox, std::uint32_t aFeatures )
+	{
 		// Write mesh data
 		// Format:
+		//  - if kMeshFeatureQuantized:
+		//    - vec3 : quantization box minimum
+		//    - vec3 : quantization box maximum
 		//  - uint32_t : M = number of meshes
 		//  - repeat M times:
 		//    - uint32_t : material index
 		//    - uint32_t : V = number of vertices
 		//    - uint32_t : I = number of indices
-		//    - repeat V times: vec3 position
-		//    - repeat V times: vec3 normal
-		//    - repeat V times: vec2 texture coordinate
-		//    - repeat I times: uint32_t index
-		std::uint32_t const meshCount = std::uint32_t(aModel.meshes.size());
-		checked_write_( aOut, sizeof(meshCount), &meshCount );
-
-		assert( aModel.meshes.size() == aIndexedMeshes.size() );
-		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		//    - if kMeshFeatureQuantized:
+		//      - vec3 : mesh bounding box minimum
+		//      - vec3 : mesh bounding box maximum
+		//      - repeat V times: uint16_t[4] position (unorm, relative to the
+		//        quantization box; w = 0)
+		//      - repeat V times: int16_t[2] normal (snorm, octahedral)
+		//      - repeat V times: uint16_t[2] texture coordinate (half float)
+		//    - otherwise:
+		//      - repeat V times: vec3 position
+		//      - repeat V times: vec3 normal
+		//      - repeat V times: vec2 texture coordinate
+		//    - repeat V times: vec4 tangent (w = handedness)
+		//    - repeat V times: uint32_t packed TBN quaternion
+		//    - repeat I times: uint16_t index if kMeshFeatureIndex16 (all meshes
+		//      have at most 65536 vertices), uint32_t index otherwise
+		//    - if kMeshFeatureLods:
+		//      - uint32_t : L = number of levels of detail
+		//      - repeat L times:
+		//        - uint32_t : first index
+		//        - uint32_t : index count
+		//        - float : error (in model units)
+		//  With kMeshFeatureCompressed, each of the "repeat V/I times" arrays is
+		//  instead stored as
+		//    - uint32_t : S = size in bytes
+		//    - S bytes : the array, encoded with encode_geometry_stream() (see
+		//      mesh_file_stream() in labutils/mesh_file.hpp for the element and
+		//      component sizes), or encode_index_stream() for the indices.
+		//      Decoded triangles may be rotated.
+
+		MeshSection_ ret;
+		ret.box = aBox;
+
+		if( aFeatures & lut::kMeshFeatureQuantized )
 		{
-			auto const& mmesh = aModel.meshes[i];
+			aOut.write( sizeof(glm::vec3), &aBox.min );
+			aOut.write( sizeof(glm::vec3), &aBox.max );
+		}
 
-			std::uint32_t materialIndex = std::uint32_t(mmesh.materialIndex);
-			checked_write_( aOut, sizeof(materialIndex), &materialIndex );
+		// Placeholder; see end_meshes_()
+		ret.meshCountOffset = aOut.offset();
+		aOut.write( sizeof(ret.meshCount), &ret.meshCount );
 
-			auto const& imesh = aIndexedMeshes[i];
+		return ret;
+	}
+
+	void bake_meshes_( OutputFile& aOut, MeshSection_& aSection, InputModel const& aModel, std::uint32_t aFeatures, std::filesystem::path const& aCacheDir, BakeOptions_ const& aOptions )
+	{
+		// Meshes are processed concurrently. Each job hands its result to the
+		// writer thread, which writes the meshes in order as they become
+		// available, and releases them afterwards. Only the meshlets are kept
+		// until the end. Remaining workers go to the parts of a split mesh.
+		//
+		// A job only starts once its mesh is fewer than maxPending meshes
+		// ahead of the writer, which bounds the number of finished meshes in
+		// memory. Jobs are handed out in order, so the writer's next mesh is
+		// always being processed and cannot be held up by this.
+		std::size_t const count = aModel.meshes.size();
+		auto const innerWorkers = std::max( std::size_t(1), aOptions.workerCount / std::max( std::size_t(1), count ) );
+		auto const maxPending = std::max( std::size_t(1), kPendingMeshesPerWorker * aOptions.workerCount );
+
+		auto const firstReport = aSection.reports.size();
+		aSection.reports.resize( firstReport + count );
+
+		std::mutex mutex;
+		std::condition_variable readyCond, writtenCond;
+		std::vector<std::unique_ptr<BakedMesh_>> ready( count );
+		std::size_t written = 0;
+		bool aborted = false;
+		std::exception_ptr writeError;
+
+		std::thread writer( [&] {
+			try
+			{
+				for( std::size_t i = 0; i < count; ++i )
+				{
+					std::unique_ptr<BakedMesh_> baked;
+					{
+						std::unique_lock<std::mutex> lock( mutex );
+						readyCond.wait( lock, [&] { return aborted || ready[i]; } );
+
+						if( aborted )
+							return;
+
+						baked = std::move(ready[i]);
+					}
+
+					auto const offset = aOut.offset();
+
+					for( std::size_t j = 0; j < baked->meshes.size(); ++j )
+					{
+						auto& cached = baked->meshes[j];
+
+						QuantizedMesh const* qmesh = nullptr;
+						if( !baked->quantized.empty() )
+						{
+							qmesh = &baked->quantized[j];
+							aSection.positionError = std::max( aSection.positionError, qmesh->maxPositionError );
+							aSection.normalDot = std::min( aSection.normalDot, qmesh->minNormalDot );
+							aSection.texcoordError = std::max( aSection.texcoordError, qmesh->maxTexcoordError );
+						}
+
+						std::vector<std::uint8_t> const* compressed = nullptr;
+						if( !baked->compressed.empty() )
+						{
+							compressed = &baked->compressed[j];
+							aSection.compressedBytes += compressed->size();
+						}
+
+						write_mesh_( aOut, aModel, i, cached, qmesh, compressed, aFeatures );
+
+						if( aFeatures & lut::kMeshFeatureMeshlets )
+							aSection.meshlets.emplace_back( std::move(cached.meshlets) );
+
+						aSection.indexCount += cached.mesh.indices.size();
+						aSection.vertexCount += cached.mesh.vert.size();
+						++aSection.meshCount;
+					}
+
+					aSection.reports[firstReport + i].bytesOut = aOut.offset() - offset;
+
+					baked.reset();
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						written = i+1;
+					}
+
+					writtenCond.notify_all();
+				}
+			}
+			catch( ... )
+			{
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					writeError = std::current_exception();
+					aborted = true;
+				}
 
-			std::uint32_t vertexCount = std::uint32_t(imesh.vert.size());
-			checked_write_( aOut, sizeof(vertexCount), &vertexCount );
-			std::uint32_t indexCount = std::uint32_t(imesh.indices.size());
-			checked_write_( aOut, sizeof(indexCount), &indexCount );
+				writtenCond.notify_all();
+			}
+		} );
 
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
-			checked_write_( aOut, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
+		try
+		{
+			lut::parallel_for( count, aOptions.workerCount, [&] (std::size_t aMeshIndex) {
+				try
+				{
+					{
+						std::unique_lock<std::mutex> lock( mutex );
+						writtenCond.wait( lock, [&] { return aborted || aMeshIndex < written + maxPending; } );
+
+						if( aborted ) // writer or another job failed; skip remaining work
+							return;
+					}
+
+					auto& report = aSection.reports[firstReport + aMeshIndex];
+					report.meshName = aModel.meshes[aMeshIndex].meshName;
+					report.inputVertices = aModel.meshes[aMeshIndex].vertexCount;
+
+					auto baked = std::make_unique<BakedMesh_>();
+
+					// Look up mesh in the bake cache, and process it if necessary
+					std::uint64_t key = 0;
+					if( aOptions.useCache )
+					{
+						key = hash_mesh_( aModel, aMeshIndex, aOptions );
+						report.cached = load_cached_meshes( aCacheDir, key, baked->meshes );
+					}
+
+					if( !report.cached )
+					{
+						baked->meshes = process_mesh_( aModel, aMeshIndex, aOptions, innerWorkers, report );
+
+						if( aOptions.useCache )
+							store_cached_meshes( aCacheDir, key, baked->meshes );
+					}
+
+					// Quantize vertex attributes
+					auto const encodeStart = std::chrono::steady_clock::now();
+					if( aFeatures & lut::kMeshFeatureQuantized )
+					{
+						for( auto const& cached : baked->meshes )
+							baked->quantized.emplace_back( quantize_mesh( cached.mesh, aSection.box ) );
+					}
+
+					// Compress vertex and index data
+					if( aFeatures & lut::kMeshFeatureCompressed )
+					{
+						for( std::size_t i = 0; i < baked->meshes.size(); ++i )
+						{
+							auto const* qmesh = baked->quantized.empty() ? nullptr : &baked->quantized[i];
+							baked->compressed.emplace_back( compress_mesh_streams( baked->meshes[i].mesh, qmesh, aFeatures ) );
+						}
+					}
+
+					report.encodeSeconds = seconds_since_( encodeStart );
+
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						ready[aMeshIndex] = std::move(baked);
+					}
+
+					readyCond.notify_all();
+				}
+				catch( ... )
+				{
+					// Release jobs that wait for the writer, which will not get
+					// past this mesh
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						aborted = true;
+					}
+
+					writtenCond.notify_all();
+					readyCond.notify_all();
+					throw;
+				}
+			} );
+		}
+		catch( ... )
+		{
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				aborted = true;
+			}
 
-			checked_write_( aOut, sizeof(std::uint32_t)*indexCount, imesh.indices.data() );
+			readyCond.notify_all();
+			writer.join();
+			throw;
 		}
+
+		writer.join();
+
+		if( writeError )
+			std::rethrow_exception( writeError );
 	}
-}
 
-namespace
-{
-	std::vector<IndexedMesh> index_meshes_( InputModel const& aModel, float aErrorTolerance )
+	void end_meshes_( OutputFile& aOut, MeshSection_& aSection, std::uint32_t aFeatures, BakeOptions_ const& aOptions )
 	{
-		std::vector<IndexedMesh> indexed;
-
-		for( auto const& imesh : aModel.meshes )
+		// Write meshlets (if kMeshFeatureMeshlets)
+		// Format:
+		//  - repeat M times (once per mesh):
+		//    - uint32_t : C = number of meshlets
+		//    - repeat C times:
+		//      - uint32_t : first index
+		//      - uint32_t : index count
+		//      - vec3 : bounding sphere center
+		//      - float : bounding sphere radius
+		//      - vec3 : normal cone apex
+		//      - vec3 : normal cone axis
+		//      - float : normal cone cutoff
+		if( aFeatures & lut::kMeshFeatureMeshlets )
 		{
-			auto const endIndex = imesh.vertexStartIndex + imesh.vertexCount;
+			assert( aSection.meshlets.size() == aSection.meshCount );
+			for( auto const& ml : aSection.meshlets )
+			{
+				std::uint32_t meshletCount = std::uint32_t(ml.size());
+				aOut.write( sizeof(meshletCount), &meshletCount );
 
-			TriangleSoup soup;
+				aOut.write( sizeof(Meshlet)*meshletCount, ml.data() );
+			}
+		}
 
-			soup.vert.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.vert.emplace_back( aModel.positions[i] );
+		aOut.patch( aSection.meshCountOffset, sizeof(aSection.meshCount), &aSection.meshCount );
 
-			soup.text.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.text.emplace_back( aModel.texcoords[i] );
+		// Report
+		print_mesh_reports_( aSection.reports, aOptions );
 
-			soup.norm.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.norm.emplace_back( aModel.normals[i] );
+		if( aFeatures & lut::kMeshFeatureIndex16 )
+			batch_printf( " - 16-bit indices: %zu kB => %zu kB\n", aSection.indexCount*sizeof(std::uint32_t)/1024, aSection.indexCount*sizeof(std::uint16_t)/1024 );
 
+		if( aFeatures & lut::kMeshFeatureQuantized )
+		{
+			static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
+			std::size_t const quantizedSize = 4*sizeof(std::uint16_t) + sizeof(OctahedralNormal) + 2*sizeof(std::uint16_t);
+			batch_printf( " - quantized vertices: %zu => %zu bytes per vertex\n", vertexSize, quantizedSize );
+			batch_printf( "   - max error: position %g, normal %.4f degrees, texture coordinate %g\n", double(aSection.positionError), std::acos( double(aSection.normalDot) ) * 180.0 / 3.14159265358979, double(aSection.texcoordError) );
+		}
 
-			indexed.emplace_back( make_indexed_mesh( soup, aErrorTolerance ) );
+		if( aFeatures & lut::kMeshFeatureCompressed )
+		{
+			std::size_t const vertexBytes = (aFeatures & lut::kMeshFeatureQuantized)
+				? 4*sizeof(std::uint16_t) + sizeof(OctahedralNormal) + 2*sizeof(std::uint16_t)
+				: sizeof(float)*(3+3+2)
+			;
+			std::size_t const indexBytes = (aFeatures & lut::kMeshFeatureIndex16) ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+			std::size_t const rawBytes = aSection.vertexCount*(vertexBytes + sizeof(glm::vec4) + sizeof(std::uint32_t)) + aSection.indexCount*indexBytes;
+
+			batch_printf( " - compressed geometry: %zu kB => %zu kB\n", rawBytes/1024, aSection.compressedBytes/1024 );
 		}
 
-		return indexed;
+		batch_printf( " - wrote %u meshes (%llu kB)\n", aSection.meshCount, static_cast<unsigned long long>(aOut.offset()/1024) );
 	}
-}
 
-namespace
-{
-	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel )
+	std::vector<CachedMesh> process_mesh_( InputModel const& aModel, std::size_t aMeshIndex, BakeOptions_ const& aOptions, std::size_t aWorkerCount, MeshReport_& aReport )
 	{
-		std::unordered_map<std::string,TextureInfo_> unique;
+		auto const& input = aModel.meshes[aMeshIndex];
+		auto step = std::chrono::steady_clock::now();
 
-		std::uint32_t texid = 0;
-		auto const add_unique_ = [&] (std::string const& aPath, std::uint8_t aChannels)
-		{
-			if( aPath.empty() )
-				return;
+		auto const end_step_ = [&step] (double& aSeconds) {
+			aSeconds = seconds_since_( step );
+			step = std::chrono::steady_clock::now();
+		};
 
-			TextureInfo_ info{};
-			info.uniqueId = texid;
-			info.channels = aChannels;
+		// Index mesh
+		std::vector<IndexedMesh> meshes;
+		meshes.emplace_back( make_indexed_mesh( aModel, input, aOptions.weldTolerance ) );
 
-			auto const [it, isNew] = unique.emplace( std::make_pair(aPath,info) );
+		// Generate missing normals. This may add vertices at creases, so it
+		// runs before the mesh is split.
+		aReport.generatedNormals = ensure_normals( meshes[0], glm::radians( aOptions.creaseAngle ), aWorkerCount );
 
-			if( isNew )
-				++texid;
-		};
+		aReport.indexedVertices = meshes[0].vert.size();
+		aReport.indexedIndices = meshes[0].indices.size();
 
-		for( auto const& mat : aModel.materials )
+		// Split meshes that cannot be addressed with 16-bit indices
+		if( aOptions.index16 && meshes[0].vert.size() > kMaxVertices16 )
+			meshes = split_indexed_mesh( meshes[0], kMaxVertices16 );
+
+		aReport.outputMeshes = meshes.size();
+		end_step_( aReport.indexSeconds );
+
+		// Optimize for the post-transform vertex cache, overdraw and vertex
+		// fetch
+		if( aOptions.optimizeVertexCache || aOptions.overdrawThreshold > 0.f )
+			aReport.optimization = optimize_meshes_( meshes, aOptions, aWorkerCount );
+
+		end_step_( aReport.optimizeSeconds );
+
+		// Split meshes into meshlets
+		std::vector<std::vector<Meshlet>> meshlets;
+		if( aOptions.buildMeshlets )
 		{
-			add_unique_( mat.baseColorTexturePath, 4 );
-			add_unique_( mat.roughnessTexturePath, 1 ); 
-			add_unique_( mat.metalnessTexturePath, 1 ); 
-			add_unique_( mat.alphaMaskTexturePath, 4 );  // assume == baseColor
-			add_unique_( mat.normalMapTexturePath, 4 );  // eh...
+			meshlets.resize( meshes.size() );
+			lut::parallel_for( meshes.size(), aWorkerCount, [&] (std::size_t aPart) {
+				meshlets[aPart] = build_meshlets( meshes[aPart] );
+			} );
+
+			for( auto const& ml : meshlets )
+				aReport.meshlets += ml.size();
 		}
 
-		return unique;
-	}
+		end_step_( aReport.meshletSeconds );
 
-	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir )
-	{
-		for( auto& entry : aTextures )
-		{
+		// Compute tangent space. The levels of detail reuse the vertices, so
+		// this only considers the full-detail triangles, i.e., it must run
+		// before the levels of detail are appended to the index buffers.
+		lut::parallel_for( meshes.size(), aWorkerCount, [&] (std::size_t aPart) {
+			auto& mesh = meshes[aPart];
+			assert( mesh.norm.size() == mesh.vert.size() ); // see ensure_normals()
+
+			compute_tangent_space( mesh, mesh.indices.size() );
+		} );
+
+		for( auto const& mesh : meshes )
+			aReport.tangentVertices += mesh.tangent.size();
+
+		end_step_( aReport.tangentSeconds );
+
+		// Build levels of detail. This appends the simplified triangles to
+		// the index buffers; the meshlets above only cover the original ones.
+		std::vector<std::vector<MeshLod>> lods;
+		if( aOptions.lodCount > 1 )
+		{
+			lods.resize( meshes.size() );
+			lut::parallel_for( meshes.size(), aWorkerCount, [&] (std::size_t aPart) {
+				lods[aPart] = build_lod_chain( meshes[aPart], aOptions.lodCount, aOptions.lodMaxError );
+			} );
+
+			for( auto const& chain : lods )
+			{
+				for( std::size_t i = 0; i < chain.size(); ++i )
+				{
+					aReport.lodTriangles[i] += chain[i].indexCount/3;
+					++aReport.lodMeshes[i];
+				}
+			}
+		}
+
+		end_step_( aReport.lodSeconds );
+
+		// Collect the results
+		std::vector<CachedMesh> ret( meshes.size() );
+		for( std::size_t i = 0; i < meshes.size(); ++i )
+		{
+			ret[i].mesh = std::move(meshes[i]);
+			if( !meshlets.empty() )
+				ret[i].meshlets = std::move(meshlets[i]);
+			if( !lods.empty() )
+				ret[i].lods = std::move(lods[i]);
+		}
+
+		return ret;
+	}
+
+	void print_mesh_reports_( std::vector<MeshReport_> const& aReports, BakeOptions_ const& aOptions )
+	{
+		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
+
+		std::size_t processed = 0;
+		for( auto const& rep : aReports )
+		{
+			if( !rep.cached )
+				++processed;
+		}
+
+		if( aOptions.useCache )
+			batch_printf( " - bake cache: reused %zu of %zu meshes\n", aReports.size() - processed, aReports.size() );
+
+		if( !processed )
+			return;
+
+		// Indexing
+		std::size_t outputVerts = 0, outputIndices = 0, split = 0, splitMeshes = 0;
+		for( auto const& rep : aReports )
+		{
+			if( rep.cached )
+				continue;
+
+			outputVerts += rep.indexedVertices;
+			outputIndices += rep.indexedIndices;
+
+			if( rep.outputMeshes > 1 )
+				++split;
+			splitMeshes += rep.outputMeshes;
+		}
+
+		batch_printf( " - indexed with %zu worker(s), weld tolerance %g\n", aOptions.workerCount, double(aOptions.weldTolerance) );
+		batch_printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+
+		std::size_t generated = 0, generatedMeshes = 0;
+		for( auto const& rep : aReports )
+		{
+			if( !rep.cached && rep.generatedNormals )
+			{
+				generated += rep.generatedNormals;
+				++generatedMeshes;
+			}
+		}
+
+		if( generated )
+			batch_printf( " - generated normals: %zu vertices in %zu mesh(es), crease angle %g\n", generated, generatedMeshes, double(aOptions.creaseAngle) );
+
+		if( split )
+			batch_printf( " - split %zu mesh(es) for 16-bit indices => %zu meshes\n", split, splitMeshes );
+
+		// Optimization
+		bool const overdraw = aOptions.overdrawThreshold > 0.f;
+		if( aOptions.optimizeVertexCache || overdraw )
+		{
+			batch_printf( " - vertex cache optimization (FIFO, %zu entries)", kVertexCacheSize );
+			if( overdraw )
+				batch_printf( ", overdraw optimization (threshold %.2f)", double(aOptions.overdrawThreshold) );
+			batch_printf( ":\n" );
+
+			double missesBefore = 0.0, missesAfter = 0.0;
+			std::size_t triangles = 0;
+			for( std::size_t i = 0; i < aReports.size(); ++i )
+			{
+				if( aReports[i].cached )
+					continue;
+
+				for( auto const& rep : aReports[i].optimization )
+				{
+					batch_printf( "   - %-40s ACMR %.3f => %.3f, ATVR %.3f => %.3f", aReports[i].meshName.c_str(), rep.before.acmr, rep.after.acmr, rep.before.atvr, rep.after.atvr );
+					if( overdraw )
+						batch_printf( ", overdraw %.3f => %.3f", rep.overdrawBefore, rep.overdrawAfter );
+					batch_printf( "\n" );
+
+					missesBefore += double(rep.before.acmr) * rep.triangles;
+					missesAfter += double(rep.after.acmr) * rep.triangles;
+					triangles += rep.triangles;
+				}
+			}
+
+			if( triangles )
+				batch_printf( "   - overall: ACMR %.3f => %.3f\n", missesBefore/triangles, missesAfter/triangles );
+		}
+
+		// Meshlets, tangent space, levels of detail
+		std::size_t meshletCount = 0, tangentVerts = 0;
+		std::size_t levelTriangles[kMaxLodCount] = {};
+		std::size_t levelMeshes[kMaxLodCount] = {};
+		for( auto const& rep : aReports )
+		{
+			if( rep.cached )
+				continue;
+
+			meshletCount += rep.meshlets;
+			tangentVerts += rep.tangentVertices;
+
+			for( std::size_t i = 0; i < kMaxLodCount; ++i )
+			{
+				levelTriangles[i] += rep.lodTriangles[i];
+				levelMeshes[i] += rep.lodMeshes[i];
+			}
+		}
+
+		if( aOptions.buildMeshlets )
+			batch_printf( " - meshlets: %zu (max %zu vertices, %zu triangles)\n", meshletCount, kMeshletMaxVertices, kMeshletMaxTriangles );
+
+		batch_printf( " - tangent space: %zu vertices => %zu kB\n", tangentVerts, tangentVerts*(sizeof(glm::vec4)+sizeof(std::uint32_t))/1024 );
+
+		if( aOptions.lodCount > 1 )
+		{
+			batch_printf( " - levels of detail (max error %g):\n", double(aOptions.lodMaxError) );
+			for( std::size_t i = 0; i < kMaxLodCount && levelMeshes[i]; ++i )
+				batch_printf( "   - LOD %zu: %zu meshes, %zu triangles\n", i, levelMeshes[i], levelTriangles[i] );
+		}
+	}
+
+	void profile_meshes_( BakeProfile& aProfile, std::vector<MeshReport_> const& aReports )
+	{
+		std::size_t inputVerts = 0, indexedVerts = 0, outputMeshes = 0, cached = 0;
+		double missesBefore = 0.0, missesAfter = 0.0;
+		std::size_t optimizedTriangles = 0;
+
+		for( auto const& rep : aReports )
+		{
+			ProfileMesh mesh;
+			mesh.name = rep.meshName;
+			mesh.cached = rep.cached;
+			mesh.bytesOut = rep.bytesOut;
+
+			if( rep.cached )
+			{
+				++cached;
+				aProfile.add_mesh( std::move(mesh) );
+				continue;
+			}
+
+			mesh.inputVertices = rep.inputVertices;
+			mesh.indexedVertices = rep.indexedVertices;
+			mesh.triangles = rep.indexedIndices/3;
+			mesh.outputMeshes = rep.outputMeshes;
+
+			// Weighted by triangles, as the overall ACMR in the report
+			std::size_t triangles = 0;
+			for( auto const& opt : rep.optimization )
+			{
+				mesh.acmrBefore += double(opt.before.acmr) * opt.triangles;
+				mesh.acmrAfter += double(opt.after.acmr) * opt.triangles;
+				triangles += opt.triangles;
+			}
+
+			missesBefore += mesh.acmrBefore;
+			missesAfter += mesh.acmrAfter;
+			optimizedTriangles += triangles;
+
+			if( triangles )
+			{
+				mesh.acmrBefore /= double(triangles);
+				mesh.acmrAfter /= double(triangles);
+			}
+
+			mesh.indexSeconds = rep.indexSeconds;
+			mesh.optimizeSeconds = rep.optimizeSeconds;
+			mesh.meshletSeconds = rep.meshletSeconds;
+			mesh.tangentSeconds = rep.tangentSeconds;
+			mesh.lodSeconds = rep.lodSeconds;
+			mesh.encodeSeconds = rep.encodeSeconds;
+
+			inputVerts += rep.inputVertices;
+			indexedVerts += rep.indexedVertices;
+			outputMeshes += rep.outputMeshes;
+
+			aProfile.add_mesh( std::move(mesh) );
+		}
+
+		// Only over the meshes that were processed, i.e., not cached
+		aProfile.set_metric( "cachedMeshes", double(cached) );
+		aProfile.set_metric( "inputVertices", double(inputVerts) );
+		aProfile.set_metric( "indexedVertices", double(indexedVerts) );
+		aProfile.set_metric( "weldRatio", inputVerts ? double(indexedVerts) / double(inputVerts) : 0.0 );
+		aProfile.set_metric( "outputMeshes", double(outputMeshes) );
+
+		if( optimizedTriangles )
+		{
+			aProfile.set_metric( "acmrBefore", missesBefore / double(optimizedTriangles) );
+			aProfile.set_metric( "acmrAfter", missesAfter / double(optimizedTriangles) );
+		}
+	}
+}
+
+namespace
+{
+	std::vector<OptimizationReport_> optimize_meshes_( std::vector<IndexedMesh>& aMeshes, BakeOptions_ const& aOptions, std::size_t aWorkerCount )
+	{
+		std::vector<OptimizationReport_> reports( aMeshes.size() );
+
+		lut::parallel_for( aMeshes.size(), aWorkerCount, [&] (std::size_t aMeshIndex) {
+			auto& mesh = aMeshes[aMeshIndex];
+			auto& report = reports[aMeshIndex];
+
+			report.before = analyze_vertex_cache( mesh.indices, mesh.vert.size() );
+			report.after = report.before;
+
+			// Tipsify is a heuristic. Keep the original triangle order in the
+			// (rare) case where it does not help.
+			if( aOptions.optimizeVertexCache )
+			{
+				auto const original = mesh.indices;
+				optimize_vertex_cache( mesh );
+
+				report.after = analyze_vertex_cache( mesh.indices, mesh.vert.size() );
+				if( report.after.acmr > report.before.acmr )
+				{
+					mesh.indices = original;
+					report.after = report.before;
+				}
+			}
+
+			// Reorder clusters for overdraw. As above, keep the previous order
+			// if the estimated overdraw does not improve.
+			if( aOptions.overdrawThreshold > 0.f )
+			{
+				report.overdrawBefore = report.overdrawAfter = analyze_overdraw( mesh );
+
+				auto const original = mesh.indices;
+				optimize_overdraw( mesh, aOptions.overdrawThreshold );
+
+				auto const overdraw = analyze_overdraw( mesh );
+				if( overdraw < report.overdrawBefore )
+				{
+					report.overdrawAfter = overdraw;
+					report.after = analyze_vertex_cache( mesh.indices, mesh.vert.size() );
+				}
+				else
+				{
+					mesh.indices = original;
+				}
+			}
+
+			// Vertex order does not affect the cache statistics
+			optimize_vertex_fetch( mesh );
+
+			report.triangles = mesh.indices.size()/3;
+		} );
+
+		return reports;
+	}
+
+	QuantizationBox quantization_box_( InputModel const& aModel )
+	{
+		// Box around all positions that are referenced by a mesh
+		QuantizationBox ret;
+		ret.min = glm::vec3( std::numeric_limits<float>::max() );
+		ret.max = glm::vec3( std::numeric_limits<float>::lowest() );
+
+		for( auto const& mesh : aModel.meshes )
+		{
+			for( std::size_t i = 0; i < mesh.vertexCount; ++i )
+			{
+				auto const& pos = aModel.positions[aModel.vertices[mesh.vertexStartIndex + i].position];
+				ret.min = glm::min( ret.min, pos );
+				ret.max = glm::max( ret.max, pos );
+			}
+		}
+
+		if( ret.min.x > ret.max.x ) // No vertices at all
+			ret.min = ret.max = glm::vec3( 0.f );
+
+		return ret;
+	}
+	std::uint64_t hash_options_( BakeOptions_ const& aOptions )
+	{
+		// Everything that affects the output, i.e., not the worker count
+		std::uint64_t ret = hash_bytes( lut::kMeshFileVariant, sizeof(lut::kMeshFileVariant), kBakeCacheVersion );
+		ret = hash_bytes( &aOptions.weldTolerance, sizeof(float), ret );
+		ret = hash_bytes( &aOptions.creaseAngle, sizeof(float), ret );
+		ret = hash_bytes( &aOptions.optimizeVertexCache, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.overdrawThreshold, sizeof(float), ret );
+		ret = hash_bytes( &aOptions.buildMeshlets, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.lodCount, sizeof(std::size_t), ret );
+		ret = hash_bytes( &aOptions.lodMaxError, sizeof(float), ret );
+		ret = hash_bytes( &aOptions.quantize, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.index16, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.mergeByMaterial, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.compressTextures, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.packOrm, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.compressGeometry, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.streamObj, sizeof(bool), ret );
+		ret = hash_bytes( &aOptions.staticTransform, sizeof(glm::mat4x4), ret );
+		return ret;
+	}
+
+	std::uint64_t hash_mesh_( InputModel const& aModel, std::size_t aMeshIndex, BakeOptions_ const& aOptions )
+	{
+		// Options that affect the processing of individual meshes. The static
+		// transform is already part of the vertex data.
+		std::uint64_t seed = hash_bytes( &kBakeCacheVersion, sizeof(kBakeCacheVersion), 0 );
+		seed = hash_bytes( &aOptions.weldTolerance, sizeof(float), seed );
+		seed = hash_bytes( &aOptions.creaseAngle, sizeof(float), seed );
+		seed = hash_bytes( &aOptions.optimizeVertexCache, sizeof(bool), seed );
+		seed = hash_bytes( &aOptions.overdrawThreshold, sizeof(float), seed );
+		seed = hash_bytes( &aOptions.buildMeshlets, sizeof(bool), seed );
+		seed = hash_bytes( &aOptions.lodCount, sizeof(std::size_t), seed );
+		seed = hash_bytes( &aOptions.lodMaxError, sizeof(float), seed );
+		seed = hash_bytes( &aOptions.index16, sizeof(bool), seed );
+
+		// Hash the resolved attributes of each vertex, in batches
+		struct Resolved_
+		{
+			glm::vec3 position, normal;
+			glm::vec2 texcoord;
+			std::uint32_t present; // bit 0: normal, bit 1: texture coordinate
+		};
+
+		constexpr std::size_t kBatchSize = 4096;
+
+		auto const& mesh = aModel.meshes[aMeshIndex];
+
+		std::vector<Resolved_> batch;
+		batch.reserve( kBatchSize );
+
+		std::uint64_t hash = hash_bytes( &mesh.vertexCount, sizeof(std::size_t), seed );
+		for( std::size_t i = 0; i < mesh.vertexCount; ++i )
+		{
+			auto const& v = aModel.vertices[mesh.vertexStartIndex + i];
+
+			Resolved_ res{};
+			res.position = aModel.positions[v.position];
+			if( kNoInputAttribute != v.normal )
+			{
+				res.normal = aModel.normals[v.normal];
+				res.present |= 1u;
+			}
+			if( kNoInputAttribute != v.texcoord )
+			{
+				res.texcoord = aModel.texcoords[v.texcoord];
+				res.present |= 2u;
+			}
+
+			batch.emplace_back( res );
+			if( kBatchSize == batch.size() )
+			{
+				hash = hash_bytes( batch.data(), batch.size()*sizeof(Resolved_), hash );
+				batch.clear();
+			}
+		}
+
+		return hash_bytes( batch.data(), batch.size()*sizeof(Resolved_), hash );
+	}
+
+	std::size_t bake_textures_( std::vector<TextureJob_> const& aTextures, std::filesystem::path const& aRootDir, BakeCacheState const& aOld, BakeCacheState& aNew, BakeOptions_ const& aOptions )
+	{
+		auto const workerCount = aOptions.workerCount;
+
+		// Include the options that determine the output format in the hash,
+		// such that changing them causes the textures to be baked again.
+		std::uint64_t const seed = hash_bytes( &aOptions.compressTextures, sizeof(bool), kBakeCacheVersion );
+
+		enum class Result_ { baked, unchanged, failed };
+		std::vector<Result_> results( aTextures.size() );
+		std::vector<BakeCacheState::Texture> states( aTextures.size() );
+
+		// Error messages of failed textures. They are printed by this thread
+		// once all textures are done, so that they end up in the job's output
+		// with batch_printf() (which only collects on this thread).
+		std::vector<std::string> messages( aTextures.size() );
+
+		// Textures are baked concurrently; remaining workers go to the rows
+		// of each texture's mip chain.
+		auto const innerWorkers = std::max( std::size_t(1), workerCount / std::max( std::size_t(1), aTextures.size() ) );
+
+		std::vector<lut::TextureFileFormat> formats( aTextures.size() );
+
+		lut::parallel_for( aTextures.size(), workerCount, [&] (std::size_t aIndex) {
+			auto const& tex = aTextures[aIndex];
+			auto const dest = aRootDir / tex.destination;
+
+			try
+			{
+				auto hash = hash_bytes( &tex.usage, sizeof(tex.usage), seed );
+				if( TextureUsage::packed == tex.usage )
+				{
+					for( auto const& source : split_pack_key_( tex.source ) )
+					{
+						if( !source.empty() && '=' == source[0] )
+							hash = hash_bytes( source.data(), source.size(), hash );
+						else
+							hash = hash_file( source, hash );
+					}
+				}
+				else
+				{
+					hash = hash_file( tex.source, hash );
+				}
+
+				states[aIndex] = BakeCacheState::Texture{ hash, std::uint32_t(tex.usage), tex.source };
+
+				auto const it = aOld.textures.find( tex.destination );
+				if( aOld.textures.end() != it && hash == it->second.hash && tex.source == it->second.source && std::filesystem::exists( dest ) )
+				{
+					results[aIndex] = Result_::unchanged;
+					return;
+				}
+
+				std::filesystem::create_directories( dest.parent_path() );
+				if( TextureUsage::packed == tex.usage )
+				{
+					auto const sources = split_pack_key_( tex.source );
+					if( 2 != sources.size() )
+						throw lut::Error( "expected two channel sources, got %zu", sources.size() );
+
+					TextureChannelSource channels[2];
+					for( std::size_t c = 0; c < 2; ++c )
+					{
+						if( !sources[c].empty() && '=' == sources[c][0] )
+							channels[c] = TextureChannelSource{ {}, std::strtof( sources[c].c_str()+1, nullptr ) };
+						else
+							channels[c] = TextureChannelSource{ sources[c], 0.f };
+					}
+
+					formats[aIndex] = bake_packed_texture( channels, dest, aOptions.compressTextures, innerWorkers );
+				}
+				else
+				{
+					formats[aIndex] = bake_texture( tex.source, dest, tex.usage, aOptions.compressTextures, innerWorkers );
+				}
+
+				results[aIndex] = Result_::baked;
+			}
+			catch( std::exception const& eErr )
+			{
+				results[aIndex] = Result_::failed;
+				messages[aIndex] = eErr.what();
+			}
+		} );
+
+		std::size_t baked = 0, unchanged = 0, errors = 0;
+		std::size_t formatCounts[std::size_t(lut::TextureFileFormat::count)] = {};
+		for( std::size_t i = 0; i < aTextures.size(); ++i )
+		{
+			switch( results[i] )
+			{
+				case Result_::baked:
+					++baked;
+					assert( formats[i] < lut::TextureFileFormat::count );
+					++formatCounts[std::size_t(formats[i])];
+					break;
+				case Result_::unchanged: ++unchanged; break;
+				case Result_::failed: ++errors; continue;
+			}
+
+			aNew.textures[aTextures[i].destination] = states[i];
+		}
+
+		batch_printf( "Textures: %zu baked, %zu unchanged, %zu failed.\n", baked, unchanged, errors );
+
+		for( std::size_t i = 0; i < aTextures.size(); ++i )
+		{
+			if( Result_::failed == results[i] )
+				batch_printf( " - failed: %s: %s\n", aTextures[i].destination.c_str(), messages[i].c_str() );
+		}
+
+		if( baked )
+		{
+			using F_ = lut::TextureFileFormat;
+			batch_printf( " - formats: %zu BC1, %zu BC3, %zu BC4, %zu BC5, %zu RGBA8\n",
+				formatCounts[std::size_t(F_::bc1_srgb)] + formatCounts[std::size_t(F_::bc1_unorm)],
+				formatCounts[std::size_t(F_::bc3_srgb)],
+				formatCounts[std::size_t(F_::bc4_unorm)],
+				formatCounts[std::size_t(F_::bc5_unorm)],
+				formatCounts[std::size_t(F_::rgba8_srgb)] + formatCounts[std::size_t(F_::rgba8_unorm)]
+			);
+		}
+		return errors;
+	}
+
+	BakeOptions_ parse_options_( int aArgc, char* aArgv[], std::vector<BatchJob>& aJobs, BatchSettings& aBatch )
+	{
+		// Usage: cw2-bake [-j N | --jobs N] [--weld-tolerance T] [--crease-angle DEG] [--no-vertex-cache] [--overdraw A] [--no-meshlets] [--lods N] [--lod-error E] [--no-quantize] [--no-index16] [--no-merge] [--scale X Y Z] [--rotate X Y Z] [--translate X Y Z] [--no-cache] [--no-compress-textures] [--no-pack-orm] [--compress-geometry] [--stream-obj] [--no-profile] [--model-jobs N] [--memory-budget MB] [--manifest FILE] [INPUT.obj OUTPUT.comp5822mesh]...
+		// Without -j, all hardware threads are used. -j 1 processes the
+		// meshes serially on the main thread. --weld-tolerance 0 disables
+		// welding; only vertices with identical OBJ indices are merged then.
+		// --crease-angle DEG sets the angle above which generated normals are
+		// not smoothed across an edge (default 180, i.e., all edges); it only
+		// applies to meshes without normals.
+		// --no-vertex-cache keeps the triangle and vertex order as indexed.
+		// --overdraw A enables the overdraw pass, allowing cluster ACMR to
+		// grow by a factor of A (e.g. 1.05). --no-meshlets omits the meshlet
+		// section from the output. --lods N sets the maximum number of levels
+		// of detail per mesh (1 disables simplification), and --lod-error E
+		// the maximum error per level relative to the mesh size.
+		// --no-quantize stores positions, normals and texture coordinates as
+		// 32-bit floats. --no-index16 stores 32-bit indices and leaves large
+		// meshes in one piece. --no-merge keeps each OBJ shape (per material)
+		// in a separate mesh. --scale, --rotate (Euler angles in degrees,
+		// applied in X, Y, Z order) and --translate define the static
+		// transform; they are applied in that order. --no-cache neither reads
+		// nor updates the bake cache. --no-compress-textures stores textures
+		// as uncompressed RGBA8. --no-pack-orm keeps separate roughness and
+		// metalness textures. --compress-geometry compresses the vertex and
+		// index data (off by default). --stream-obj reads and bakes the OBJ one shape at
+		// a time, such that only the attribute data and the current shape are
+		// kept in memory (see ObjStream); meshes are then only merged by
+		// material within each shape. --no-profile skips writing the profile
+		// (NAME-profile.json next to the output; see BakeProfile).
+		//
+		// Note that the defaults do not produce the original file layout: a
+		// plain run writes meshlets, four levels of detail, quantized
+		// attributes, 16-bit indices, meshes merged by material, BCn
+		// textures and packed roughness/metalness textures (each recorded in
+		// the feature flags; see cw2/baked_model.hpp). --no-meshlets --lods 1
+		// --no-quantize --no-index16 --no-merge --no-compress-textures
+		// --no-pack-orm turns all of these off.
+		//
+		// Models are given as pairs of input and output paths, and/or listed
+		// in manifests (see load_batch_manifest()). Without any, the Sponza
+		// model is baked. All models use the same options. --model-jobs N
+		// bakes up to N models at the same time (default: the worker count),
+		// sharing the workers between them. --memory-budget MB limits the
+		// estimated memory use of the models that are baked at the same time;
+		// see batch.hpp.
+		BakeOptions_ options;
+		options.workerCount = lut::default_worker_count();
+
+		aBatch.maxConcurrent = 0; // default: worker count
+		aBatch.memoryBudget = 0;
+
+
+		glm::vec3 scale( 1.f ), rotation( 0.f ), translation( 0.f );
+
+		auto const read_vec3_ = [&] (int& aI, glm::vec3& aOut) {
+			if( aI+3 >= aArgc )
+				throw lut::Error( "%s: expected three values", aArgv[aI] );
+
+			for( int k = 0; k < 3; ++k )
+			{
+				char* end = nullptr;
+				aOut[k] = std::strtof( aArgv[aI+1+k], &end );
+				if( !end || *end || !std::isfinite( aOut[k] ) )
+					throw lut::Error( "%s: invalid value '%s'", aArgv[aI], aArgv[aI+1+k] );
+			}
+
+			aI += 3;
+		};
+
+		for( int i = 1; i < aArgc; ++i )
+		{
+			if( 0 == std::strcmp( aArgv[i], "-j" ) || 0 == std::strcmp( aArgv[i], "--jobs" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected worker count", aArgv[i] );
+
+				char* end = nullptr;
+				auto const count = std::strtoul( aArgv[i+1], &end, 10 );
+				if( !end || *end || 0 == count )
+					throw lut::Error( "%s: invalid worker count '%s'", aArgv[i], aArgv[i+1] );
+
+				options.workerCount = std::size_t(count);
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--weld-tolerance" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected tolerance", aArgv[i] );
+
+				char* end = nullptr;
+				auto const tolerance = std::strtof( aArgv[i+1], &end );
+				if( !end || *end || !(tolerance >= 0.f) )
+					throw lut::Error( "%s: invalid tolerance '%s'", aArgv[i], aArgv[i+1] );
+
+				options.weldTolerance = tolerance;
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--crease-angle" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected angle", aArgv[i] );
+
+				char* end = nullptr;
+				auto const angle = std::strtof( aArgv[i+1], &end );
+				if( !end || *end || !(angle >= 0.f && angle <= 180.f) )
+					throw lut::Error( "%s: invalid angle '%s' (expected 0 to 180 degrees)", aArgv[i], aArgv[i+1] );
+
+				options.creaseAngle = angle;
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-vertex-cache" ) )
+			{
+				options.optimizeVertexCache = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-meshlets" ) )
+			{
+				options.buildMeshlets = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-quantize" ) )
+			{
+				options.quantize = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-index16" ) )
+			{
+				options.index16 = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-merge" ) )
+			{
+				options.mergeByMaterial = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-cache" ) )
+			{
+				options.useCache = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-compress-textures" ) )
+			{
+				options.compressTextures = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-pack-orm" ) )
+			{
+				options.packOrm = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--compress-geometry" ) )
+			{
+				options.compressGeometry = true;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--stream-obj" ) )
+			{
+				options.streamObj = true;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-profile" ) )
+			{
+				options.writeProfile = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--scale" ) )
+			{
+				read_vec3_( i, scale );
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--rotate" ) )
+			{
+				read_vec3_( i, rotation );
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--translate" ) )
+			{
+				read_vec3_( i, translation );
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--lods" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected LOD count", aArgv[i] );
+
+				char* end = nullptr;
+				auto const count = std::strtoul( aArgv[i+1], &end, 10 );
+				if( !end || *end || 0 == count || count > kMaxLodCount )
+					throw lut::Error( "%s: invalid LOD count '%s' (must be between 1 and %zu)", aArgv[i], aArgv[i+1], kMaxLodCount );
+
+				options.lodCount = std::size_t(count);
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--lod-error" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected error", aArgv[i] );
+
+				char* end = nullptr;
+				auto const error = std::strtof( aArgv[i+1], &end );
+				if( !end || *end || !(error > 0.f) )
+					throw lut::Error( "%s: invalid error '%s'", aArgv[i], aArgv[i+1] );
+
+				options.lodMaxError = error;
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--overdraw" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected ACMR threshold", aArgv[i] );
+
+				char* end = nullptr;
+				auto const threshold = std::strtof( aArgv[i+1], &end );
+				if( !end || *end || !(threshold >= 1.f) )
+					throw lut::Error( "%s: invalid ACMR threshold '%s' (must be at least 1)", aArgv[i], aArgv[i+1] );
+
+				options.overdrawThreshold = threshold;
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--model-jobs" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected model count", aArgv[i] );
+
+				char* end = nullptr;
+				auto const count = std::strtoul( aArgv[i+1], &end, 10 );
+				if( !end || *end || 0 == count )
+					throw lut::Error( "%s: invalid model count '%s'", aArgv[i], aArgv[i+1] );
+
+				aBatch.maxConcurrent = std::size_t(count);
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--memory-budget" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected budget in MB", aArgv[i] );
+
+				char* end = nullptr;
+				auto const megabytes = std::strtoull( aArgv[i+1], &end, 10 );
+				if( !end || *end || 0 == megabytes )
+					throw lut::Error( "%s: invalid budget '%s'", aArgv[i], aArgv[i+1] );
+
+				aBatch.memoryBudget = std::uint64_t(megabytes) << 20;
+				++i;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--manifest" ) )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected manifest path", aArgv[i] );
+
+				auto manifest = load_batch_manifest( aArgv[i+1] );
+				aJobs.insert( aJobs.end(), std::make_move_iterator( manifest.begin() ), std::make_move_iterator( manifest.end() ) );
+				++i;
+			}
+			else if( '-' != aArgv[i][0] )
+			{
+				if( i+1 >= aArgc )
+					throw lut::Error( "%s: expected an output path", aArgv[i] );
+
+				aJobs.emplace_back( BatchJob{ aArgv[i], aArgv[i+1] } );
+				++i;
+			}
+			else
+			{
+				throw lut::Error( "Unknown argument '%s'\nUsage: %s [-j N | --jobs N] [--weld-tolerance T] [--crease-angle DEG] [--no-vertex-cache] [--overdraw A] [--no-meshlets] [--lods N] [--lod-error E] [--no-quantize] [--no-index16] [--no-merge] [--scale X Y Z] [--rotate X Y Z] [--translate X Y Z] [--no-cache] [--no-compress-textures] [--no-pack-orm] [--compress-geometry] [--stream-obj] [--no-profile] [--model-jobs N] [--memory-budget MB] [--manifest FILE] [INPUT.obj OUTPUT.comp5822mesh]...", aArgv[i], aArgv[0] );
+			}
+		}
+
+		auto transform = glm::translate( glm::mat4( 1.f ), translation );
+		transform = glm::rotate( transform, glm::radians( rotation.z ), glm::vec3( 0.f, 0.f, 1.f ) );
+		transform = glm::rotate( transform, glm::radians( rotation.y ), glm::vec3( 0.f, 1.f, 0.f ) );
+		transform = glm::rotate( transform, glm::radians( rotation.x ), glm::vec3( 1.f, 0.f, 0.f ) );
+		options.staticTransform = glm::scale( transform, scale );
+
+		aBatch.workerCount = options.workerCount;
+		if( 0 == aBatch.maxConcurrent )
+			aBatch.maxConcurrent = options.workerCount;
+
+		return options;
+	}
+
+	std::uint64_t estimate_bake_memory_( std::string const& aInputOBJ, BakeOptions_ const& aOptions )
+	{
+		// Rough estimate: the loaded attributes and vertices, the indexed
+		// meshes with their LODs, and the cached/quantized copies all scale
+		// with the size of the OBJ. Materials and textures are not included.
+		// A missing file fails when loading anyway
+		return file_size_or_zero_( aInputOBJ ) * (aOptions.streamObj ? kStreamMemoryPerObjByte : kBakeMemoryPerObjByte);
+	}
+
+	std::uint64_t file_size_or_zero_( std::filesystem::path const& aPath )
+	{
+		std::error_code ec;
+		auto const size = std::filesystem::file_size( aPath, ec );
+		return ec ? 0 : std::uint64_t(size);
+	}
+
+	double seconds_since_( std::chrono::steady_clock::time_point aStart )
+	{
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - aStart ).count();
+	}
+}
+
+namespace
+{
+	std::string packed_orm_key_( InputMaterialInfo const& aMaterial )
+	{
+		if( aMaterial.roughnessTexturePath.empty() && aMaterial.metalnessTexturePath.empty() )
+			return {};
+
+		// Channels without a texture use the material's constant. The input
+		// materials have no occlusion maps, so occlusion is not stored.
+		auto const source_ = [] (std::string const& aPath, float aValue) {
+			if( !aPath.empty() )
+				return aPath;
+
+			char value[32];
+			std::snprintf( value, sizeof(value), "=%.9g", aValue );
+			return std::string( value );
+		};
+
+		std::string ret = source_( aMaterial.roughnessTexturePath, aMaterial.baseRoughness );
+		ret += kPackSeparator;
+		ret += source_( aMaterial.metalnessTexturePath, aMaterial.baseMetalness );
+		return ret;
+	}
+
+	std::vector<std::string> split_pack_key_( std::string const& aKey )
+	{
+		std::vector<std::string> ret;
+
+		std::size_t beg = 0;
+		for( auto end = aKey.find( kPackSeparator ); std::string::npos != end; end = aKey.find( kPackSeparator, beg ) )
+		{
+			ret.emplace_back( aKey.substr( beg, end-beg ) );
+			beg = end+1;
+		}
+
+		ret.emplace_back( aKey.substr( beg ) );
+		return ret;
+	}
+
+	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel, bool aPackOrm )
+	{
+		std::unordered_map<std::string,TextureInfo_> unique;
+
+		std::uint32_t texid = 0;
+		auto const add_unique_ = [&] (std::string const& aPath, std::uint8_t aChannels, TextureUsage aUsage)
+		{
+			if( aPath.empty() )
+				return;
+
+			// If a texture is used in several ways, the first one wins
+			TextureInfo_ info{};
+			info.uniqueId = texid;
+			info.channels = aChannels;
+			info.usage = aUsage;
+
+			auto const [it, isNew] = unique.emplace( std::make_pair(aPath,info) );
+
+			if( isNew )
+				++texid;
+		};
+
+		for( auto const& mat : aModel.materials )
+		{
+			add_unique_( mat.baseColorTexturePath, 4, TextureUsage::color );
+			if( aPackOrm )
+			{
+				add_unique_( packed_orm_key_( mat ), 2, TextureUsage::packed );
+			}
+			else
+			{
+				add_unique_( mat.roughnessTexturePath, 1, TextureUsage::scalar ); 
+				add_unique_( mat.metalnessTexturePath, 1, TextureUsage::scalar ); 
+			}
+			add_unique_( mat.alphaMaskTexturePath, 4, TextureUsage::color );  // assume == baseColor
+			add_unique_( mat.normalMapTexturePath, 4, TextureUsage::normal );  // eh...
+		}
+
+		return unique;
+	}
+
+	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir )
+	{
+		for( auto& entry : aTextures )
+		{
+			auto& info = entry.second;
+
+			// Packed textures have no single source; name them by their key
+			if( TextureUsage::packed == info.usage )
+			{
+				char name[64];
+				std::snprintf( name, sizeof(name), "orm-%016llx.comp5822tex", static_cast<unsigned long long>(hash_bytes( entry.first.data(), entry.first.size() )) );
+				info.newPath = (aTexDir / name).string();
+				continue;
+			}
+
+			// Keep the original extension, so that e.g. foo.png and foo.jpg
+			// do not end up in the same file, and add a hash of the full
+			// source path, so that a/foo.png and b/foo.png do not either.
+			// (The textures are baked in parallel, so a shared name would
+			// also race on the temporary file.)
 			std::filesystem::path const originalPath( entry.first );
-			auto const filename = originalPath.filename();
+
+			char suffix[32];
+			std::snprintf( suffix, sizeof(suffix), "-%016llx", static_cast<unsigned long long>(hash_bytes( entry.first.data(), entry.first.size() )) );
+
+			auto filename = originalPath.stem();
+			filename += suffix;
+			filename += originalPath.extension();
+			filename += ".comp5822tex";
 			auto const newpath = aTexDir / filename;
 		
-			auto& info = entry.second;
 			info.newPath = newpath.string();
 		}
 
@@ -0,0 +1,115 @@
+#include "merge_model.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cassert>
+
+namespace
+{
+	constexpr std::size_t kNoMaterial_ = ~std::size_t(0);
+}
+
+//--    deduplicate_materials()         ///{{{2///////////////////////////////
+std::size_t deduplicate_materials( InputModel& aModel, std::vector<std::size_t>* aRemap )
+{
+	// Key: the texture paths, separated by \0 (which cannot appear in them)
+	auto const key_ = [] (InputMaterialInfo const& aMat) {
+		std::string ret;
+		for( auto const* path : { &aMat.baseColorTexturePath, &aMat.roughnessTexturePath, &aMat.metalnessTexturePath, &aMat.alphaMaskTexturePath, &aMat.normalMapTexturePath } )
+		{
+			ret += *path;
+			ret += '\0';
+		}
+		return ret;
+	};
+
+	std::unordered_map<std::string,std::size_t> unique;
+	std::vector<std::size_t> remap( aModel.materials.size() );
+	std::vector<InputMaterialInfo> materials;
+
+	for( std::size_t i = 0; i < aModel.materials.size(); ++i )
+	{
+		auto const [it, inserted] = unique.emplace( key_( aModel.materials[i] ), materials.size() );
+		if( inserted )
+			materials.emplace_back( std::move(aModel.materials[i]) );
+
+		remap[i] = it->second;
+	}
+
+	for( auto& mesh : aModel.meshes )
+	{
+		assert( mesh.materialIndex < remap.size() );
+		mesh.materialIndex = remap[mesh.materialIndex];
+	}
+
+	std::size_t const removed = aModel.materials.size() - materials.size();
+	aModel.materials = std::move(materials);
+
+	if( aRemap )
+		*aRemap = std::move(remap);
+
+	return removed;
+}
+
+//--    merge_meshes_by_material()      ///{{{2///////////////////////////////
+std::size_t merge_meshes_by_material( InputModel& aModel )
+{
+	// Assign merged meshes in order of first use, and count their vertices
+	std::vector<std::size_t> merged( aModel.materials.size(), kNoMaterial_ );
+	std::vector<InputMeshInfo> meshes;
+	std::vector<std::size_t> sourceCounts; // number of input meshes per merged mesh
+
+	for( auto const& mesh : aModel.meshes )
+	{
+		assert( mesh.materialIndex < merged.size() );
+
+		auto& target = merged[mesh.materialIndex];
+		if( kNoMaterial_ == target )
+		{
+			target = meshes.size();
+			meshes.emplace_back( InputMeshInfo{ mesh.meshName, mesh.materialIndex, 0, 0 } );
+			sourceCounts.emplace_back( 0 );
+		}
+
+		meshes[target].vertexCount += mesh.vertexCount;
+		++sourceCounts[target];
+	}
+
+	if( meshes.size() == aModel.meshes.size() )
+		return 0;
+
+	// Lay out the merged meshes back to back
+	std::size_t offset = 0;
+	for( std::size_t i = 0; i < meshes.size(); ++i )
+	{
+		auto& mesh = meshes[i];
+		mesh.vertexStartIndex = offset;
+		offset += mesh.vertexCount;
+
+		mesh.vertexCount = 0; // Counted again below
+
+		if( sourceCounts[i] > 1 )
+			mesh.meshName = aModel.materials[mesh.materialIndex].materialName + " (" + std::to_string( sourceCounts[i] ) + " meshes)";
+	}
+
+	// Scatter vertices
+	std::vector<InputVertex> vertices( offset );
+	for( auto const& mesh : aModel.meshes )
+	{
+		auto& target = meshes[merged[mesh.materialIndex]];
+
+		auto const* src = aModel.vertices.data() + mesh.vertexStartIndex;
+		std::copy( src, src + mesh.vertexCount, vertices.data() + target.vertexStartIndex + target.vertexCount );
+		target.vertexCount += mesh.vertexCount;
+	}
+
+	std::size_t const removed = aModel.meshes.size() - meshes.size();
+	aModel.vertices = std::move(vertices);
+	aModel.meshes = std::move(meshes);
+	return removed;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
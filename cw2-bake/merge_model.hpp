@@ -0,0 +1,35 @@
+#ifndef MERGE_MODEL_HPP_3E7A95D1_C04B_4F26_8A1D_9B52E6F07C34
+#define MERGE_MODEL_HPP_3E7A95D1_C04B_4F26_8A1D_9B52E6F07C34
+
+#include <vector>
+
+#include <cstddef>
+
+#include "input_model.hpp"
+
+/* Remove duplicate materials, i.e., materials that reference the same set of
+ * textures (base color, roughness, metalness, alpha mask and normal map).
+ * Only the textures end up in the baked file, so such materials render
+ * identically. Meshes are updated to reference the remaining material; the
+ * first of each set of duplicates is kept. If aRemap is given, it receives
+ * the new index of each original material (e.g., for meshes that are not
+ * part of the model yet; see ObjStream).
+ *
+ * Returns the number of removed materials.
+ */
+std::size_t deduplicate_materials(
+	InputModel&,
+	std::vector<std::size_t>* aRemap = nullptr
+);
+
+/* Merge all meshes that use the same material into a single mesh. This
+ * reorders InputModel::vertices such that each material's vertices are
+ * contiguous; the attribute data is not touched. Materials are ordered by
+ * their first use, and the vertices of each material keep their original
+ * order.
+ *
+ * Returns the number of meshes that were merged away.
+ */
+std::size_t merge_meshes_by_material( InputModel& );
+
+#endif // MERGE_MODEL_HPP_3E7A95D1_C04B_4F26_8A1D_9B52E6F07C34
@@ -0,0 +1,196 @@
+#include "mesh_writer.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#include "../labutils/mesh_file.hpp"
+#include "../labutils/geometry_codec.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Calls aFunc( data, count, elementSize, componentSize, isIndices ) for
+	// each vertex and index stream of the mesh, in file order.
+	template< typename tFunc >
+	void for_each_stream_( IndexedMesh const& aMesh, QuantizedMesh const* aQuantized, std::uint32_t aFeatures, tFunc&& aFunc )
+	{
+		std::size_t const vertexCount = aMesh.vert.size();
+
+		bool const quantized = aFeatures & lut::kMeshFeatureQuantized;
+		assert( !quantized || aQuantized );
+		assert( aMesh.tangent.size() == vertexCount && aMesh.packedTbn.size() == vertexCount );
+
+		std::vector<std::uint16_t> indices16;
+		if( aFeatures & lut::kMeshFeatureIndex16 )
+			indices16.assign( aMesh.indices.begin(), aMesh.indices.end() );
+
+		// Streams in file order; see labutils/mesh_file.hpp
+		for( std::size_t i = 0; i < lut::kMeshFileStreamCount; ++i )
+		{
+			auto const layout = lut::mesh_file_stream( aFeatures, i );
+
+			void const* data = nullptr;
+			std::size_t count = vertexCount;
+			switch( layout.stream )
+			{
+				case lut::MeshFileStream::position:
+					data = quantized ? static_cast<void const*>(aQuantized->positions.data()) : aMesh.vert.data();
+					break;
+				case lut::MeshFileStream::normal:
+					data = quantized ? static_cast<void const*>(aQuantized->normals.data()) : aMesh.norm.data();
+					break;
+				case lut::MeshFileStream::texcoord:
+					data = quantized ? static_cast<void const*>(aQuantized->texcoords.data()) : aMesh.text.data();
+					break;
+				case lut::MeshFileStream::tangent:
+					data = aMesh.tangent.data();
+					break;
+				case lut::MeshFileStream::packedTbn:
+					data = aMesh.packedTbn.data();
+					break;
+				case lut::MeshFileStream::indices:
+					data = indices16.empty() ? static_cast<void const*>(aMesh.indices.data()) : indices16.data();
+					count = aMesh.indices.size();
+					break;
+			}
+
+			aFunc( data, count, std::size_t(layout.elementSize), std::size_t(layout.componentSize), lut::MeshFileStream::indices == layout.stream );
+		}
+	}
+}
+
+//--    quantization_box()              ///{{{2///////////////////////////////
+QuantizationBox quantization_box( std::vector<glm::vec3> const& aPositions )
+{
+	QuantizationBox ret;
+	ret.min = glm::vec3( std::numeric_limits<float>::max() );
+	ret.max = glm::vec3( std::numeric_limits<float>::lowest() );
+
+	for( auto const& pos : aPositions )
+	{
+		ret.min = glm::min( ret.min, pos );
+		ret.max = glm::max( ret.max, pos );
+	}
+
+	if( ret.min.x > ret.max.x )
+		ret.min = ret.max = glm::vec3( 0.f );
+
+	return ret;
+}
+
+//--    quantize_mesh()                 ///{{{2///////////////////////////////
+QuantizedMesh quantize_mesh( IndexedMesh const& aMesh, QuantizationBox const& aBox )
+{
+	auto const extent = aBox.max - aBox.min;
+	auto const safe_inverse_ = [] (float aX) { return aX > 0.f ? 1.f / aX : 0.f; };
+	glm::vec3 const scale( safe_inverse_( extent.x ), safe_inverse_( extent.y ), safe_inverse_( extent.z ) );
+
+	QuantizedMesh qmesh;
+
+	std::size_t const vertexCount = aMesh.vert.size();
+	qmesh.positions.resize( vertexCount*4 );
+	qmesh.normals.resize( vertexCount );
+	qmesh.texcoords.resize( vertexCount*2 );
+
+	for( std::size_t i = 0; i < vertexCount; ++i )
+	{
+		auto const rel = (aMesh.vert[i] - aBox.min) * scale;
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			auto const q = quantize_unorm16( rel[int(k)] );
+			qmesh.positions[i*4+k] = q;
+
+			float const deq = aBox.min[int(k)] + float(q) / 65535.f * extent[int(k)];
+			qmesh.maxPositionError = std::max( qmesh.maxPositionError, std::abs( deq - aMesh.vert[i][int(k)] ) );
+		}
+		qmesh.positions[i*4+3] = 0;
+
+		auto const n = glm::normalize( aMesh.norm[i] );
+		qmesh.normals[i] = encode_octahedral( n );
+		qmesh.minNormalDot = std::min( qmesh.minNormalDot, glm::dot( decode_octahedral( qmesh.normals[i] ), n ) );
+
+		for( std::size_t k = 0; k < 2; ++k )
+		{
+			auto const h = encode16_half( aMesh.text[i][int(k)] );
+			qmesh.texcoords[i*2+k] = h;
+			qmesh.maxTexcoordError = std::max( qmesh.maxTexcoordError, std::abs( decode16_half( h ) - aMesh.text[i][int(k)] ) );
+		}
+	}
+
+	qmesh.minNormalDot = std::min( 1.f, qmesh.minNormalDot );
+	return qmesh;
+}
+
+//--    compress_mesh_streams()         ///{{{2///////////////////////////////
+std::vector<std::uint8_t> compress_mesh_streams( IndexedMesh const& aMesh, QuantizedMesh const* aQuantized, std::uint32_t aFeatures )
+{
+	std::vector<std::uint8_t> ret;
+	for_each_stream_( aMesh, aQuantized, aFeatures, [&] (void const* aData, std::size_t aCount, std::size_t aElementSize, std::size_t aComponentSize, bool aIsIndices) {
+		auto const start = ret.size();
+		ret.resize( start + sizeof(std::uint32_t) );
+
+		if( aIsIndices )
+			lut::encode_index_stream( ret, aData, aCount, aElementSize );
+		else
+			lut::encode_geometry_stream( ret, aData, aCount, aElementSize, aComponentSize );
+
+		std::uint32_t const size = std::uint32_t(ret.size() - start - sizeof(std::uint32_t));
+		std::memcpy( ret.data() + start, &size, sizeof(size) );
+	} );
+
+	return ret;
+}
+
+//--    write_mesh()                    ///{{{2///////////////////////////////
+void write_mesh( OutputFile& aOut, std::uint32_t aMaterialIndex, IndexedMesh const& aMesh, std::vector<MeshLod> const& aLods, QuantizedMesh const* aQuantized, std::vector<std::uint8_t> const* aCompressed, std::uint32_t aFeatures )
+{
+	assert( aMesh.norm.size() == aMesh.vert.size() );
+	assert( !(aFeatures & lut::kMeshFeatureIndex16) || aMesh.vert.size() <= (std::size_t(1) << 16) );
+
+	aOut.write( sizeof(aMaterialIndex), &aMaterialIndex );
+
+	std::uint32_t vertexCount = std::uint32_t(aMesh.vert.size());
+	aOut.write( sizeof(vertexCount), &vertexCount );
+	std::uint32_t indexCount = std::uint32_t(aMesh.indices.size());
+	aOut.write( sizeof(indexCount), &indexCount );
+
+	if( aFeatures & lut::kMeshFeatureQuantized )
+	{
+		aOut.write( sizeof(glm::vec3), &aMesh.aabbMin );
+		aOut.write( sizeof(glm::vec3), &aMesh.aabbMax );
+	}
+
+	// Vertex and index data
+	if( aFeatures & lut::kMeshFeatureCompressed )
+	{
+		if( aCompressed )
+			aOut.write( aCompressed->size(), aCompressed->data() );
+		else
+		{
+			auto const compressed = compress_mesh_streams( aMesh, aQuantized, aFeatures );
+			aOut.write( compressed.size(), compressed.data() );
+		}
+	}
+	else
+	{
+		for_each_stream_( aMesh, aQuantized, aFeatures, [&] (void const* aData, std::size_t aCount, std::size_t aElementSize, std::size_t, bool) {
+			aOut.write( aCount*aElementSize, aData );
+		} );
+	}
+
+	if( aFeatures & lut::kMeshFeatureLods )
+	{
+		std::uint32_t lodCount = std::uint32_t(aLods.size());
+		aOut.write( sizeof(lodCount), &lodCount );
+
+		aOut.write( sizeof(MeshLod)*lodCount, aLods.data() );
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
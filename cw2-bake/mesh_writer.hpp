@@ -0,0 +1,81 @@
+#ifndef MESH_WRITER_HPP_F445E075_4C66_4454_9E96_6B2A1FB9E386
+#define MESH_WRITER_HPP_F445E075_4C66_4454_9E96_6B2A1FB9E386
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "index_mesh.hpp"
+#include "quantize.hpp"
+#include "simplify_mesh.hpp"
+#include "output_file.hpp"
+
+/* Writing the meshes of a baked model (see labutils/mesh_file.hpp for the
+ * streams of each mesh, and begin_meshes_() in main.cpp for the layout of
+ * the mesh section). Used by cw2-bake and by the synthetic models of
+ * cw2-bench, so that both write the same format.
+ */
+
+// Box around all positions of the model. Quantized positions are relative
+// to this box, such that a single dequantization matrix applies to all
+// meshes.
+struct QuantizationBox
+{
+	glm::vec3 min, max;
+};
+
+// Quantized vertex attributes of a mesh (kMeshFeatureQuantized), along with
+// the largest errors introduced by the quantization.
+struct QuantizedMesh
+{
+	std::vector<std::uint16_t> positions; // 4 per vertex (w = 0)
+	std::vector<OctahedralNormal> normals;
+	std::vector<std::uint16_t> texcoords; // 2 per vertex, half floats
+
+	float maxPositionError = 0.f;
+	float minNormalDot = 1.f;
+	float maxTexcoordError = 0.f;
+};
+
+// Box around aPositions; all zero if there are none.
+QuantizationBox quantization_box(
+	std::vector<glm::vec3> const& aPositions
+);
+
+QuantizedMesh quantize_mesh(
+	IndexedMesh const&,
+	QuantizationBox const&
+);
+
+// Vertex and index streams of a mesh, encoded as they are stored with
+// kMeshFeatureCompressed (each prefixed with its size in bytes).
+// aQuantized must not be null if aFeatures includes kMeshFeatureQuantized.
+std::vector<std::uint8_t> compress_mesh_streams(
+	IndexedMesh const&,
+	QuantizedMesh const* aQuantized,
+	std::uint32_t aFeatures
+);
+
+/* Write one mesh of the mesh section: material index, counts, bounding box
+ * (if quantized), the vertex and index streams, and the levels of detail (if
+ * kMeshFeatureLods). With kMeshFeatureCompressed, aCompressed holds the
+ * result of compress_mesh_streams(); if null, the streams are compressed
+ * here.
+ *
+ * The mesh must have normals and a tangent space, and at most 65536 vertices
+ * with kMeshFeatureIndex16.
+ */
+void write_mesh(
+	OutputFile&,
+	std::uint32_t aMaterialIndex,
+	IndexedMesh const&,
+	std::vector<MeshLod> const& aLods,
+	QuantizedMesh const* aQuantized, // null if not quantized
+	std::vector<std::uint8_t> const* aCompressed,
+	std::uint32_t aFeatures
+);
+
+#endif // MESH_WRITER_HPP_F445E075_4C66_4454_9E96_6B2A1FB9E386
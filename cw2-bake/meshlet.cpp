@@ -0,0 +1,177 @@
+#include "meshlet.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Below this, the normal cone covers (nearly) a half-space or more, and
+	// cone culling would rarely succeed.
+	constexpr float kMinConeDot_ = 0.1f;
+
+	void compute_bounds_( Meshlet&, IndexedMesh const&, std::vector<std::uint32_t> const& aVertices );
+}
+
+//--    build_meshlets()                ///{{{2///////////////////////////////
+std::vector<Meshlet> build_meshlets( IndexedMesh const& aMesh, std::size_t aMaxVertices, std::size_t aMaxTriangles )
+{
+	assert( aMaxVertices >= 3 && aMaxTriangles >= 1 );
+
+	std::vector<Meshlet> ret;
+
+	std::size_t const triangleCount = aMesh.indices.size()/3;
+	if( 0 == triangleCount )
+		return ret;
+
+	// Per-vertex marker: the meshlet that last used the vertex.
+	constexpr auto kNone = ~std::uint32_t(0);
+	std::vector<std::uint32_t> lastMeshlet( aMesh.vert.size(), kNone );
+
+	std::vector<std::uint32_t> vertices;
+	vertices.reserve( aMaxVertices );
+
+	std::size_t begin = 0;
+	while( begin < triangleCount )
+	{
+		auto const id = std::uint32_t(ret.size());
+
+		vertices.clear();
+
+		std::size_t end = begin;
+		for( ; end < triangleCount && end-begin < aMaxTriangles; ++end )
+		{
+			// Count new vertices of this triangle
+			auto const a = aMesh.indices[end*3+0];
+			auto const b = aMesh.indices[end*3+1];
+			auto const c = aMesh.indices[end*3+2];
+
+			std::size_t const added = std::size_t(id != lastMeshlet[a])
+				+ std::size_t(id != lastMeshlet[b] && b != a)
+				+ std::size_t(id != lastMeshlet[c] && c != a && c != b)
+			;
+
+			if( vertices.size() + added > aMaxVertices )
+				break;
+
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const v = aMesh.indices[end*3+k];
+				if( id != lastMeshlet[v] )
+				{
+					lastMeshlet[v] = id;
+					vertices.emplace_back( v );
+				}
+			}
+		}
+
+		assert( end > begin );
+
+		Meshlet meshlet{};
+		meshlet.firstIndex = std::uint32_t(begin*3);
+		meshlet.indexCount = std::uint32_t((end-begin)*3);
+		compute_bounds_( meshlet, aMesh, vertices );
+
+		ret.emplace_back( meshlet );
+		begin = end;
+	}
+
+	return ret;
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	void compute_bounds_( Meshlet& aMeshlet, IndexedMesh const& aMesh, std::vector<std::uint32_t> const& aVertices )
+	{
+		// Bounding sphere: center of the bounding box, radius to the farthest
+		// vertex. Not minimal, but tight enough for culling.
+		glm::vec3 bmin( std::numeric_limits<float>::max() );
+		glm::vec3 bmax( std::numeric_limits<float>::lowest() );
+		for( auto const v : aVertices )
+		{
+			bmin = min( bmin, aMesh.vert[v] );
+			bmax = max( bmax, aMesh.vert[v] );
+		}
+
+		auto const center = (bmin+bmax) * .5f;
+
+		float radius2 = 0.f;
+		for( auto const v : aVertices )
+		{
+			auto const d = aMesh.vert[v] - center;
+			radius2 = std::max( radius2, dot( d, d ) );
+		}
+
+		aMeshlet.center = center;
+		aMeshlet.radius = std::sqrt( radius2 );
+
+		// Normal cone from the (unit) face normals. Degenerate triangles are
+		// ignored.
+		std::vector<glm::vec3> normals;
+		normals.reserve( aMeshlet.indexCount/3 );
+
+		std::vector<std::uint32_t> corners;
+		corners.reserve( aMeshlet.indexCount/3 );
+
+		glm::vec3 axis( 0.f );
+		for( std::uint32_t i = 0; i < aMeshlet.indexCount; i += 3 )
+		{
+			auto const& p0 = aMesh.vert[aMesh.indices[aMeshlet.firstIndex+i+0]];
+			auto const& p1 = aMesh.vert[aMesh.indices[aMeshlet.firstIndex+i+1]];
+			auto const& p2 = aMesh.vert[aMesh.indices[aMeshlet.firstIndex+i+2]];
+
+			auto const n = cross( p1-p0, p2-p0 );
+			float const len = length( n );
+			if( !(len > 0.f) )
+				continue;
+
+			normals.emplace_back( n / len );
+			corners.emplace_back( aMesh.indices[aMeshlet.firstIndex+i] );
+			axis += normals.back();
+		}
+
+		aMeshlet.coneApex = center;
+		aMeshlet.coneAxis = glm::vec3( 0.f );
+		aMeshlet.coneCutoff = 1.f;
+
+		float const axisLength = length( axis );
+		if( normals.empty() || !(axisLength > 0.f) )
+			return;
+
+		axis /= axisLength;
+
+		float minDot = 1.f;
+		for( auto const& n : normals )
+			minDot = std::min( minDot, dot( axis, n ) );
+
+		if( minDot < kMinConeDot_ )
+			return;
+
+		// Move the apex back along the axis such that every triangle's plane
+		// lies in front of it: for each triangle, find t such that the point
+		// center - t*axis lies on the triangle's plane, and take the largest.
+		float maxT = 0.f;
+		for( std::size_t i = 0; i < normals.size(); ++i )
+		{
+			float const dc = dot( center - aMesh.vert[corners[i]], normals[i] );
+			float const dn = dot( axis, normals[i] );
+
+			assert( dn > 0.f );
+			maxT = std::max( maxT, dc / dn );
+		}
+
+		aMeshlet.coneApex = center - axis * maxT;
+		aMeshlet.coneAxis = axis;
+
+		// Cull when the view direction is within (90 degrees - cone angle) of
+		// the axis, i.e., cutoff = cos(90 - angle) = sin(angle).
+		aMeshlet.coneCutoff = std::sqrt( 1.f - minDot*minDot );
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab: 
@@ -0,0 +1,54 @@
+#ifndef MESHLET_HPP_E4A1C7D2_58B3_4F9E_8C16_2D7B90A3E5F4
+#define MESHLET_HPP_E4A1C7D2_58B3_4F9E_8C16_2D7B90A3E5F4
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "index_mesh.hpp"
+
+// Limits for meshlet sizes. These match the common limits for mesh shaders
+// (64 vertices, 126 triangles), with the triangle count rounded down to a
+// multiple of four.
+constexpr std::size_t kMeshletMaxVertices = 64;
+constexpr std::size_t kMeshletMaxTriangles = 124;
+
+/* Meshlet: a cluster of triangles that is contiguous in the mesh's index
+ * buffer, along with bounds for culling.
+ *
+ * This is written to the baked file as-is. Keep it in sync with BakedMeshlet
+ * in cw2/baked_model.hpp.
+ */
+struct Meshlet
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+
+	// Bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	// Normal cone. All triangles are back-facing for a viewer at position P
+	// if dot( normalize(coneApex - P), coneAxis ) >= coneCutoff. Meshlets
+	// whose triangles face in too many different directions have a zero axis
+	// and a cutoff of one, which never culls.
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+static_assert( sizeof(Meshlet) == 2*sizeof(std::uint32_t) + 11*sizeof(float) );
+
+// Split a mesh into meshlets. Triangles are assigned to meshlets in index
+// buffer order, so this does not change the mesh; run it after the vertex
+// cache optimization to get spatially coherent meshlets.
+std::vector<Meshlet> build_meshlets(
+	IndexedMesh const&,
+	std::size_t aMaxVertices = kMeshletMaxVertices,
+	std::size_t aMaxTriangles = kMeshletMaxTriangles
+);
+
+#endif // MESHLET_HPP_E4A1C7D2_58B3_4F9E_8C16_2D7B90A3E5F4
@@ -0,0 +1,477 @@
+#include "optimize_mesh.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	constexpr auto kNoVertex_ = ~std::uint32_t(0);
+
+	template< typename tType >
+	void permute_( std::vector<tType>& aData, std::vector<std::uint32_t> const& aNewToOld )
+	{
+		if( aData.empty() )
+			return;
+
+		std::vector<tType> ret;
+		ret.reserve( aNewToOld.size() );
+
+		for( auto const old : aNewToOld )
+			ret.emplace_back( aData[old] );
+
+		aData = std::move(ret);
+	}
+}
+
+//--    analyze_vertex_cache()          ///{{{2///////////////////////////////
+VertexCacheStats analyze_vertex_cache( std::vector<std::uint32_t> const& aIndices, std::size_t aVertexCount, std::size_t aCacheSize )
+{
+	assert( aCacheSize > 0 );
+
+	// A vertex is in the FIFO if fewer than aCacheSize vertices were inserted
+	// after it. Starting the clock at aCacheSize+1 makes all vertices miss
+	// initially.
+	std::vector<std::size_t> insertedAt( aVertexCount, 0 );
+	std::size_t time = aCacheSize+1;
+
+	std::size_t misses = 0;
+	for( auto const index : aIndices )
+	{
+		assert( index < aVertexCount );
+		if( time - insertedAt[index] > aCacheSize )
+		{
+			insertedAt[index] = time++;
+			++misses;
+		}
+	}
+
+	VertexCacheStats ret{};
+	if( auto const triangles = aIndices.size()/3 )
+		ret.acmr = float(misses) / triangles;
+	if( aVertexCount )
+		ret.atvr = float(misses) / aVertexCount;
+
+	return ret;
+}
+
+//--    optimize_vertex_cache()         ///{{{2///////////////////////////////
+void optimize_vertex_cache( IndexedMesh& aMesh, std::size_t aCacheSize )
+{
+	optimize_vertex_cache( aMesh.indices, aMesh.vert.size(), aCacheSize );
+}
+
+void optimize_vertex_cache( std::vector<std::uint32_t>& aIndices, std::size_t aVertexCount, std::size_t aCacheSize )
+{
+	auto const& indices = aIndices;
+	std::size_t const triangleCount = indices.size()/3;
+	std::size_t const vertexCount = aVertexCount;
+
+	if( 0 == triangleCount )
+		return;
+
+	// Build vertex-to-triangle adjacency
+	std::vector<std::uint32_t> adjacencyStart( vertexCount+1, 0 );
+	for( auto const index : indices )
+	{
+		assert( index < vertexCount );
+		++adjacencyStart[index+1];
+	}
+
+	for( std::size_t i = 0; i < vertexCount; ++i )
+		adjacencyStart[i+1] += adjacencyStart[i];
+
+	std::vector<std::uint32_t> adjacency( indices.size() );
+	{
+		std::vector<std::uint32_t> cursor( adjacencyStart.begin(), adjacencyStart.end()-1 );
+		for( std::size_t i = 0; i < triangleCount*3; ++i )
+			adjacency[cursor[indices[i]]++] = std::uint32_t(i/3);
+	}
+
+	// Number of triangles that still need to be emitted, per vertex
+	std::vector<std::uint32_t> live( vertexCount );
+	for( std::size_t i = 0; i < vertexCount; ++i )
+		live[i] = adjacencyStart[i+1] - adjacencyStart[i];
+
+	// Tipsify. Emit all triangles around a "fanning" vertex, then pick the
+	// next fanning vertex among the vertices of the emitted triangles,
+	// preferring vertices that will still be in the cache after their
+	// remaining triangles have been emitted.
+	std::vector<std::size_t> cacheTime( vertexCount, 0 );
+	std::vector<std::uint8_t> emitted( triangleCount, 0 );
+
+	std::vector<std::uint32_t> deadEnd;
+	std::vector<std::uint32_t> candidates;
+
+	std::vector<std::uint32_t> output;
+	output.reserve( triangleCount*3 );
+
+	std::size_t time = aCacheSize+1;
+	std::size_t cursor = 0;
+
+	auto const next_live_vertex_ = [&] () -> std::uint32_t {
+		// Dead end: first try recently emitted vertices, then fall back
+		// to the next vertex in input order.
+		while( !deadEnd.empty() )
+		{
+			auto const vertex = deadEnd.back();
+			deadEnd.pop_back();
+
+			if( live[vertex] > 0 )
+				return vertex;
+		}
+
+		for( ; cursor < vertexCount; ++cursor )
+		{
+			if( live[cursor] > 0 )
+				return std::uint32_t(cursor);
+		}
+
+		return kNoVertex_;
+	};
+
+	std::uint32_t fanning = next_live_vertex_();
+	while( kNoVertex_ != fanning )
+	{
+		candidates.clear();
+
+		for( auto a = adjacencyStart[fanning]; a < adjacencyStart[fanning+1]; ++a )
+		{
+			auto const triangle = adjacency[a];
+			if( emitted[triangle] )
+				continue;
+
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const vertex = indices[triangle*3+k];
+
+				output.emplace_back( vertex );
+				deadEnd.emplace_back( vertex );
+				candidates.emplace_back( vertex );
+
+				--live[vertex];
+
+				if( time - cacheTime[vertex] > aCacheSize )
+					cacheTime[vertex] = time++;
+			}
+
+			emitted[triangle] = 1;
+		}
+
+		// Pick the next fanning vertex. Candidates that would leave the
+		// cache (priority zero) are never picked; if there are no others,
+		// continue from the dead-end stack instead.
+		std::uint32_t best = kNoVertex_;
+		std::size_t bestPriority = 0;
+
+		for( auto const vertex : candidates )
+		{
+			if( 0 == live[vertex] )
+				continue;
+
+			// Priority is the vertex' age in the cache if it stays in the
+			// cache while fanning around it, and zero otherwise.
+			std::size_t priority = 0;
+			if( time - cacheTime[vertex] + 2*live[vertex] <= aCacheSize )
+				priority = time - cacheTime[vertex];
+
+			if( priority > bestPriority )
+			{
+				best = vertex;
+				bestPriority = priority;
+			}
+		}
+
+		fanning = kNoVertex_ != best ? best : next_live_vertex_();
+	}
+
+	assert( output.size() == triangleCount*3 );
+	aIndices = std::move(output);
+}
+
+//--    optimize_overdraw()             ///{{{2///////////////////////////////
+void optimize_overdraw( IndexedMesh& aMesh, float aThreshold, std::size_t aCacheSize )
+{
+	auto const& indices = aMesh.indices;
+	std::size_t const triangleCount = indices.size()/3;
+
+	if( triangleCount < 2 )
+		return;
+
+	// FIFO cache simulation; returns the number of misses for a triangle.
+	// Flushing the cache is done by advancing the clock past the cache size.
+	std::vector<std::size_t> insertedAt( aMesh.vert.size(), 0 );
+	std::size_t time = aCacheSize+1;
+
+	auto const simulate_ = [&] (std::size_t aTriangle) {
+		std::size_t misses = 0;
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			auto const vertex = indices[aTriangle*3+k];
+			if( time - insertedAt[vertex] > aCacheSize )
+			{
+				insertedAt[vertex] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	};
+	auto const flush_ = [&] {
+		time += aCacheSize+1;
+	};
+
+	// Hard boundaries: triangles where all three vertices miss the cache.
+	// Reordering at these points does not change the ACMR.
+	std::vector<std::size_t> hard;
+	for( std::size_t t = 0; t < triangleCount; ++t )
+	{
+		if( 3 == simulate_( t ) )
+			hard.emplace_back( t );
+	}
+
+	if( hard.empty() || 0 != hard.front() )
+		hard.insert( hard.begin(), 0 );
+
+	// Soft boundaries: split each hard cluster as soon as the running ACMR
+	// of the current cluster is within the threshold of the hard cluster's
+	// ACMR.
+	std::vector<std::size_t> clusters;
+	for( std::size_t h = 0; h < hard.size(); ++h )
+	{
+		auto const begin = hard[h];
+		auto const end = h+1 < hard.size() ? hard[h+1] : triangleCount;
+
+		flush_();
+
+		std::size_t misses = 0;
+		for( auto t = begin; t < end; ++t )
+			misses += simulate_( t );
+
+		float const target = aThreshold * float(misses) / float(end-begin);
+
+		clusters.emplace_back( begin );
+
+		flush_();
+
+		std::size_t runningMisses = 0, runningTriangles = 0;
+		for( auto t = begin; t < end; ++t )
+		{
+			runningMisses += simulate_( t );
+			++runningTriangles;
+
+			if( t+1 < end && float(runningMisses) <= target * float(runningTriangles) )
+			{
+				clusters.emplace_back( t+1 );
+
+				flush_();
+				runningMisses = runningTriangles = 0;
+			}
+		}
+	}
+
+	std::size_t const clusterCount = clusters.size();
+	clusters.emplace_back( triangleCount );
+
+	if( clusterCount < 2 )
+		return;
+
+	// Occlusion potential. Area-weighted centroid and normal for each
+	// cluster; clusters whose normal points away from the mesh centroid are
+	// likely on the outside.
+	std::vector<glm::vec3> clusterCentroid( clusterCount, glm::vec3( 0.f ) );
+	std::vector<glm::vec3> clusterNormal( clusterCount, glm::vec3( 0.f ) );
+	std::vector<float> clusterArea( clusterCount, 0.f );
+
+	glm::vec3 meshCentroid( 0.f );
+	float meshArea = 0.f;
+
+	for( std::size_t c = 0; c < clusterCount; ++c )
+	{
+		for( auto t = clusters[c]; t < clusters[c+1]; ++t )
+		{
+			auto const& p0 = aMesh.vert[indices[t*3+0]];
+			auto const& p1 = aMesh.vert[indices[t*3+1]];
+			auto const& p2 = aMesh.vert[indices[t*3+2]];
+
+			auto const n = cross( p1-p0, p2-p0 );
+			float const area = length( n );
+
+			clusterCentroid[c] += (p0+p1+p2) * (area/3.f);
+			clusterNormal[c] += n;
+			clusterArea[c] += area;
+		}
+
+		meshCentroid += clusterCentroid[c];
+		meshArea += clusterArea[c];
+	}
+
+	if( meshArea > 0.f )
+		meshCentroid /= meshArea;
+
+	std::vector<float> potential( clusterCount, 0.f );
+	for( std::size_t c = 0; c < clusterCount; ++c )
+	{
+		if( clusterArea[c] <= 0.f )
+			continue;
+
+		auto const centroid = clusterCentroid[c] / clusterArea[c];
+		float const normalLength = length( clusterNormal[c] );
+
+		if( normalLength > 0.f )
+			potential[c] = dot( centroid - meshCentroid, clusterNormal[c] / normalLength );
+	}
+
+	std::vector<std::size_t> order( clusterCount );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+	std::stable_sort( order.begin(), order.end(), [&] (std::size_t aA, std::size_t aB) {
+		return potential[aA] > potential[aB];
+	} );
+
+	// Emit clusters
+	std::vector<std::uint32_t> output;
+	output.reserve( indices.size() );
+
+	for( auto const c : order )
+		output.insert( output.end(), indices.begin() + clusters[c]*3, indices.begin() + clusters[c+1]*3 );
+
+	aMesh.indices = std::move(output);
+}
+
+//--    analyze_overdraw()              ///{{{2///////////////////////////////
+float analyze_overdraw( IndexedMesh const& aMesh, std::size_t aResolution )
+{
+	auto const& indices = aMesh.indices;
+	if( indices.empty() || aMesh.vert.empty() )
+		return 0.f;
+
+	glm::vec3 bmin( std::numeric_limits<float>::max() );
+	glm::vec3 bmax( std::numeric_limits<float>::lowest() );
+	for( auto const& pos : aMesh.vert )
+	{
+		bmin = min( bmin, pos );
+		bmax = max( bmax, pos );
+	}
+
+	auto const extent = bmax - bmin;
+	float const maxExtent = std::max( extent.x, std::max( extent.y, extent.z ) );
+	if( !(maxExtent > 0.f) )
+		return 0.f;
+
+	float const scale = float(aResolution) / maxExtent;
+	auto const res = int(aResolution);
+
+	std::vector<float> depth( aResolution*aResolution );
+
+	std::size_t shaded = 0, covered = 0;
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		int const uAxis = (axis+1) % 3;
+		int const vAxis = (axis+2) % 3;
+
+		for( float const sign : { 1.f, -1.f } )
+		{
+			std::fill( depth.begin(), depth.end(), std::numeric_limits<float>::max() );
+
+			// Looking along sign*axis; depth increases away from the viewer.
+			auto const project_ = [&] (glm::vec3 const& aPos) {
+				return glm::vec3(
+					(aPos[uAxis] - bmin[uAxis]) * scale,
+					(aPos[vAxis] - bmin[vAxis]) * scale,
+					sign * (aPos[axis] - bmin[axis])
+				);
+			};
+
+			for( std::size_t t = 0; t < indices.size()/3; ++t )
+			{
+				auto const& p0 = aMesh.vert[indices[t*3+0]];
+				auto const& p1 = aMesh.vert[indices[t*3+1]];
+				auto const& p2 = aMesh.vert[indices[t*3+2]];
+
+				// Back-face culling
+				auto const n = cross( p1-p0, p2-p0 );
+				if( sign * n[axis] >= 0.f )
+					continue;
+
+				auto const a = project_( p0 );
+				auto const b = project_( p1 );
+				auto const c = project_( p2 );
+
+				float area = (b.x-a.x)*(c.y-a.y) - (b.y-a.y)*(c.x-a.x);
+				if( 0.f == area )
+					continue;
+
+				// Sample at pixel centers
+				int const x0 = std::max( 0, int(std::ceil( std::min( a.x, std::min( b.x, c.x ) ) - .5f )) );
+				int const x1 = std::min( res-1, int(std::floor( std::max( a.x, std::max( b.x, c.x ) ) - .5f )) );
+				int const y0 = std::max( 0, int(std::ceil( std::min( a.y, std::min( b.y, c.y ) ) - .5f )) );
+				int const y1 = std::min( res-1, int(std::floor( std::max( a.y, std::max( b.y, c.y ) ) - .5f )) );
+
+				float const invArea = 1.f / area;
+				for( int y = y0; y <= y1; ++y )
+				{
+					for( int x = x0; x <= x1; ++x )
+					{
+						float const px = x + .5f, py = y + .5f;
+
+						float const w0 = ((b.x-px)*(c.y-py) - (b.y-py)*(c.x-px)) * invArea;
+						float const w1 = ((c.x-px)*(a.y-py) - (c.y-py)*(a.x-px)) * invArea;
+						float const w2 = 1.f - w0 - w1;
+
+						if( w0 < 0.f || w1 < 0.f || w2 < 0.f )
+							continue;
+
+						float const z = w0*a.z + w1*b.z + w2*c.z;
+
+						auto& d = depth[std::size_t(y)*aResolution + x];
+						if( z < d )
+						{
+							d = z;
+							++shaded;
+						}
+					}
+				}
+			}
+
+			for( auto const d : depth )
+			{
+				if( d != std::numeric_limits<float>::max() )
+					++covered;
+			}
+		}
+	}
+
+	return covered ? float(shaded) / float(covered) : 0.f;
+}
+
+//--    optimize_vertex_fetch()         ///{{{2///////////////////////////////
+void optimize_vertex_fetch( IndexedMesh& aMesh )
+{
+	std::vector<std::uint32_t> oldToNew( aMesh.vert.size(), kNoVertex_ );
+	std::vector<std::uint32_t> newToOld;
+	newToOld.reserve( aMesh.vert.size() );
+
+	for( auto& index : aMesh.indices )
+	{
+		assert( index < oldToNew.size() );
+		if( kNoVertex_ == oldToNew[index] )
+		{
+			oldToNew[index] = std::uint32_t(newToOld.size());
+			newToOld.emplace_back( index );
+		}
+
+		index = oldToNew[index];
+	}
+
+	permute_( aMesh.vert, newToOld );
+	permute_( aMesh.norm, newToOld );
+	permute_( aMesh.text, newToOld );
+	permute_( aMesh.tangent, newToOld );
+	permute_( aMesh.packedTbn, newToOld );
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab: 
@@ -0,0 +1,79 @@
+#ifndef OPTIMIZE_MESH_HPP_3B6E4D29_A7F1_4C08_9D52_E81C0B7A4F63
+#define OPTIMIZE_MESH_HPP_3B6E4D29_A7F1_4C08_9D52_E81C0B7A4F63
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+// Size of the simulated post-transform vertex cache. The exact size on real
+// hardware varies (and many GPUs do not use a strict FIFO), but orderings
+// that are good for a 16-entry FIFO tend to be good elsewhere too.
+constexpr std::size_t kVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+	// Average cache miss ratio: vertex shader invocations per triangle. Lower
+	// is better; values range from 3 (no reuse) down to ~0.5 for large
+	// regular meshes.
+	float acmr;
+
+	// Average transform to vertex ratio: vertex shader invocations per
+	// (unique) vertex. The optimum is 1.
+	float atvr;
+};
+
+// Simulate a FIFO post-transform cache with aCacheSize entries.
+VertexCacheStats analyze_vertex_cache(
+	std::vector<std::uint32_t> const& aIndices,
+	std::size_t aVertexCount,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+// Reorder triangles for post-transform vertex cache reuse. Uses the linear
+// "Tipsify" algorithm by Sander et al. (Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw, 2007).
+void optimize_vertex_cache(
+	IndexedMesh&,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+// As above, but for a list of triangles that references aVertexCount
+// vertices. Used for index buffers that do not make up a complete mesh, such
+// as simplified levels of detail.
+void optimize_vertex_cache(
+	std::vector<std::uint32_t>& aIndices,
+	std::size_t aVertexCount,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+// Reorder clusters of triangles to reduce overdraw. The (cache-optimized)
+// triangle order is split into clusters such that the ACMR within each
+// cluster is at most aThreshold times the ACMR of the original order. The
+// clusters are then sorted such that clusters facing away from the mesh's
+// center are drawn first, as these are more likely to occlude other parts of
+// the mesh. See Sander et al. (2007), section 4.
+void optimize_overdraw(
+	IndexedMesh&,
+	float aThreshold = 1.05f,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+// Estimate overdraw: the average number of times that each covered pixel is
+// shaded, with early depth testing and back-face culling. The mesh is
+// rasterized orthographically from the six axis directions at
+// aResolution x aResolution pixels.
+constexpr std::size_t kOverdrawResolution = 256;
+
+float analyze_overdraw(
+	IndexedMesh const&,
+	std::size_t aResolution = kOverdrawResolution
+);
+
+// Reorder vertices into the order in which they are first referenced by the
+// index buffer. Vertices that are not referenced are removed.
+void optimize_vertex_fetch( IndexedMesh& );
+
+#endif // OPTIMIZE_MESH_HPP_3B6E4D29_A7F1_4C08_9D52_E81C0B7A4F63
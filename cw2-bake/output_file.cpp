@@ -0,0 +1,133 @@
+#include "output_file.hpp"
+
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <system_error>
+
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+//--    OutputFile                      ///{{{2///////////////////////////////
+OutputFile::OutputFile( std::filesystem::path aDest, std::size_t aBufferSize )
+	: mDest( std::move(aDest) )
+	, mBufferSize( std::max( kBufferAlignment, aBufferSize ) )
+{
+	mBuffer.reset( static_cast<std::byte*>(::operator new[]( mBufferSize, std::align_val_t( kBufferAlignment ) )) );
+
+	mTemp = mDest;
+	mTemp += ".tmp";
+
+	mFile = std::fopen( mTemp.string().c_str(), "wb" );
+	if( !mFile )
+		throw lut::Error( "Unable to open '%s' for writing", mTemp.string().c_str() );
+
+	// All writes are already batched in mBuffer
+	std::setvbuf( mFile, nullptr, _IONBF, 0 );
+}
+
+OutputFile::~OutputFile()
+{
+	if( mFile )
+	{
+		std::fclose( mFile );
+
+		std::error_code ec;
+		std::filesystem::remove( mTemp, ec );
+	}
+}
+
+void OutputFile::write( std::size_t aBytes, void const* aData )
+{
+	auto const* bytes = static_cast<std::byte const*>(aData);
+
+	if( mBuffered + aBytes > mBufferSize )
+	{
+		flush_();
+
+		// Large payloads go straight to the file
+		if( aBytes >= mBufferSize )
+		{
+			auto const ret = std::fwrite( bytes, 1, aBytes, mFile );
+			if( ret != aBytes )
+				throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+
+			mFlushed += aBytes;
+			return;
+		}
+	}
+
+	if( aBytes )
+		std::memcpy( mBuffer.get() + mBuffered, bytes, aBytes );
+	mBuffered += aBytes;
+}
+
+void OutputFile::patch( std::uint64_t aOffset, std::size_t aBytes, void const* aData )
+{
+	if( aOffset + aBytes > offset() )
+		throw lut::Error( "Patch at %llu (%zu bytes) is past the end of the data", static_cast<unsigned long long>(aOffset), aBytes );
+
+	// Still in the buffer?
+	if( aOffset >= mFlushed )
+	{
+		std::memcpy( mBuffer.get() + (aOffset - mFlushed), aData, aBytes );
+		return;
+	}
+
+	auto const* bytes = static_cast<std::byte const*>(aData);
+	mPatches.emplace_back( Patch_{ aOffset, std::vector<std::byte>( bytes, bytes+aBytes ) } );
+}
+
+std::uint64_t OutputFile::offset() const noexcept
+{
+	return mFlushed + mBuffered;
+}
+
+void OutputFile::commit()
+{
+	flush_();
+
+	for( auto const& patch : mPatches )
+	{
+		if( patch.offset > std::uint64_t(std::numeric_limits<long>::max()) )
+			throw lut::Error( "Patch offset %llu is out of range", static_cast<unsigned long long>(patch.offset) );
+
+		if( 0 != std::fseek( mFile, long(patch.offset), SEEK_SET ) )
+			throw lut::Error( "fseek() failed" );
+
+		auto const ret = std::fwrite( patch.data.data(), 1, patch.data.size(), mFile );
+		if( ret != patch.data.size() )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, patch.data.size() );
+	}
+
+	mPatches.clear();
+
+	auto const closed = std::fclose( mFile );
+	mFile = nullptr;
+
+	if( 0 != closed )
+	{
+		std::error_code ec;
+		std::filesystem::remove( mTemp, ec );
+		throw lut::Error( "Unable to write '%s'", mTemp.string().c_str() );
+	}
+
+	std::filesystem::rename( mTemp, mDest );
+}
+
+void OutputFile::flush_()
+{
+	if( !mBuffered )
+		return;
+
+	auto const ret = std::fwrite( mBuffer.get(), 1, mBuffered, mFile );
+	if( ret != mBuffered )
+		throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, mBuffered );
+
+	mFlushed += mBuffered;
+	mBuffered = 0;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,84 @@
+#ifndef OUTPUT_FILE_HPP_3F9A61C2_7D04_4E8B_A1C5_92E6B0D4F873
+#define OUTPUT_FILE_HPP_3F9A61C2_7D04_4E8B_A1C5_92E6B0D4F873
+
+#include <memory>
+#include <vector>
+#include <new>
+#include <filesystem>
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+/* Buffered output file. Writes are collected in a large, page-aligned buffer,
+ * which goes to disk in one fwrite() once it fills up (stdio's own buffering
+ * is disabled). Payloads that are larger than the buffer skip it.
+ *
+ * Data is written to a temporary file next to the destination, which replaces
+ * the destination in commit(). If the OutputFile is destroyed without a
+ * commit() (e.g., because an exception was thrown), the temporary file is
+ * removed, and an existing destination is left untouched.
+ *
+ * Values that are only known at the end (counts, offsets) can be written as
+ * placeholders and filled in later with patch().
+ *
+ * Errors throw lut::Error. Not thread safe.
+ */
+class OutputFile final
+{
+	public:
+		explicit OutputFile(
+			std::filesystem::path aDest,
+			std::size_t aBufferSize = kDefaultBufferSize
+		);
+		~OutputFile();
+
+		OutputFile( OutputFile const& ) = delete;
+		OutputFile& operator= (OutputFile const&) = delete;
+
+	public:
+		void write( std::size_t aBytes, void const* aData );
+
+		// Overwrite aBytes at aOffset, which must have been written before.
+		// Applied in commit().
+		void patch( std::uint64_t aOffset, std::size_t aBytes, void const* aData );
+
+		// Number of bytes written so far
+		std::uint64_t offset() const noexcept;
+
+		// Flush, apply patches, and move the file to its destination.
+		void commit();
+
+	public:
+		static constexpr std::size_t kDefaultBufferSize = std::size_t(8) << 20;
+		static constexpr std::size_t kBufferAlignment = 4096;
+
+	private:
+		void flush_();
+
+		struct Patch_
+		{
+			std::uint64_t offset;
+			std::vector<std::byte> data;
+		};
+
+		std::filesystem::path mDest, mTemp;
+		FILE* mFile = nullptr;
+
+		struct AlignedDelete_
+		{
+			void operator()( std::byte* aPtr ) const noexcept
+			{
+				::operator delete[]( aPtr, std::align_val_t( kBufferAlignment ) );
+			}
+		};
+
+		std::unique_ptr<std::byte[],AlignedDelete_> mBuffer;
+		std::size_t mBufferSize;
+		std::size_t mBuffered = 0;
+		std::uint64_t mFlushed = 0;
+
+		std::vector<Patch_> mPatches;
+};
+
+#endif // OUTPUT_FILE_HPP_3F9A61C2_7D04_4E8B_A1C5_92E6B0D4F873
@@ -0,0 +1,177 @@
+#include "quantize.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	std::int16_t quantize_snorm16_( float aValue )
+	{
+		float const v = std::clamp( aValue, -1.f, 1.f );
+		return std::int16_t( std::lround( v * 32767.f ) );
+	}
+
+	float dequantize_snorm16_( std::int16_t aValue )
+	{
+		return std::max( float(aValue) / 32767.f, -1.f );
+	}
+}
+
+//--    quantize_unorm16()              ///{{{2///////////////////////////////
+std::uint16_t quantize_unorm16( float aValue )
+{
+	float const v = std::clamp( aValue, 0.f, 1.f );
+	return std::uint16_t( std::lround( v * 65535.f ) );
+}
+
+//--    encode_octahedral()             ///{{{2///////////////////////////////
+OctahedralNormal encode_octahedral( glm::vec3 const& aNormal )
+{
+	// Project onto the octahedron |x|+|y|+|z| = 1, and fold the lower
+	// hemisphere over the diagonals.
+	float const l1 = std::abs( aNormal.x ) + std::abs( aNormal.y ) + std::abs( aNormal.z );
+	if( !(l1 > 0.f) )
+		return OctahedralNormal{ 0, 0 };
+
+	float x = aNormal.x / l1, y = aNormal.y / l1;
+	if( aNormal.z < 0.f )
+	{
+		float const fx = (1.f - std::abs( y )) * (x >= 0.f ? 1.f : -1.f);
+		float const fy = (1.f - std::abs( x )) * (y >= 0.f ? 1.f : -1.f);
+		x = fx;
+		y = fy;
+	}
+
+	// Rounding to the nearest grid point is not necessarily optimal. Test the
+	// four grid points around the exact position.
+	auto const n = glm::normalize( aNormal );
+
+	OctahedralNormal best{ quantize_snorm16_( x ), quantize_snorm16_( y ) };
+	float bestDot = glm::dot( decode_octahedral( best ), n );
+
+	float const fx = std::floor( std::clamp( x, -1.f, 1.f ) * 32767.f );
+	float const fy = std::floor( std::clamp( y, -1.f, 1.f ) * 32767.f );
+	for( int dy = 0; dy < 2; ++dy )
+	{
+		for( int dx = 0; dx < 2; ++dx )
+		{
+			OctahedralNormal const cand{
+				std::int16_t( std::clamp( fx + float(dx), -32767.f, 32767.f ) ),
+				std::int16_t( std::clamp( fy + float(dy), -32767.f, 32767.f ) )
+			};
+
+			float const d = glm::dot( decode_octahedral( cand ), n );
+			if( d > bestDot )
+			{
+				best = cand;
+				bestDot = d;
+			}
+		}
+	}
+
+	return best;
+}
+
+//--    decode_octahedral()             ///{{{2///////////////////////////////
+glm::vec3 decode_octahedral( OctahedralNormal aNormal )
+{
+	// Must match oct_decode() in cw2/shaders/default.vert
+	glm::vec3 n( dequantize_snorm16_( aNormal.x ), dequantize_snorm16_( aNormal.y ), 0.f );
+	n.z = 1.f - std::abs( n.x ) - std::abs( n.y );
+
+	float const t = std::max( -n.z, 0.f );
+	n.x += n.x >= 0.f ? -t : t;
+	n.y += n.y >= 0.f ? -t : t;
+
+	return glm::normalize( n );
+}
+
+//--    encode16_half()                 ///{{{2///////////////////////////////
+std::uint16_t encode16_half( float aValue )
+{
+	// Based on the ISPC reference code
+	std::uint32_t bits;
+	std::memcpy( &bits, &aValue, sizeof(bits) );
+
+	std::uint32_t const sign = bits >> 31;
+	std::uint32_t const exponent = (bits >> 23) & 0xff;
+	std::uint32_t const mantissa = bits & 0x7fffff;
+
+	std::uint32_t ret = 0;
+	if( 0 == exponent )
+	{
+		// Signed zero or denormal (which underflows)
+		ret = 0;
+	}
+	else if( 255 == exponent )
+	{
+		// Inf or NaN; NaN becomes a quiet NaN
+		ret = 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+	else
+	{
+		// Normalized number. Unbias the single exponent, then bias the half
+		int const newExponent = int(exponent) - 127 + 15;
+		if( newExponent >= 31 )
+		{
+			// Overflow, return signed infinity
+			ret = 0x7c00;
+		}
+		else if( newExponent <= 0 )
+		{
+			// Underflow; the result may still be a denormal half
+			if( 14 - newExponent <= 24 )
+			{
+				std::uint32_t const mant = mantissa | 0x800000; // Hidden 1 bit
+				ret = mant >> (14 - newExponent);
+
+				// Round, which may overflow into the exponent (this is OK)
+				if( (mant >> (13 - newExponent)) & 1 )
+					++ret;
+			}
+		}
+		else
+		{
+			ret = (std::uint32_t(newExponent) << 10) | (mantissa >> 13);
+
+			// Round, which may overflow to infinity (this is OK)
+			if( mantissa & 0x1000 )
+				++ret;
+		}
+	}
+
+	return std::uint16_t( (sign << 15) | ret );
+}
+
+//--    decode16_half()                 ///{{{2///////////////////////////////
+float decode16_half( std::uint16_t aValue )
+{
+	std::uint32_t const sign = std::uint32_t(aValue >> 15) << 31;
+	std::uint32_t const exponent = (aValue >> 10) & 0x1f;
+	std::uint32_t const mantissa = aValue & 0x3ff;
+
+	float ret;
+	if( 0 == exponent )
+	{
+		// Zero or denormal: mantissa * 2^-24
+		ret = std::ldexp( float(mantissa), -24 );
+		if( sign )
+			ret = -ret;
+		return ret;
+	}
+
+	std::uint32_t bits;
+	if( 31 == exponent )
+		bits = sign | 0x7f800000u | (mantissa << 13);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	std::memcpy( &ret, &bits, sizeof(ret) );
+	return ret;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,33 @@
+#ifndef QUANTIZE_HPP_B81E4F07_2C9A_4D63_9E15_7A40C3D6F258
+#define QUANTIZE_HPP_B81E4F07_2C9A_4D63_9E15_7A40C3D6F258
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+// Quantize a value in [0,1] to a 16-bit unsigned normalized integer
+// (VK_FORMAT_R16_UNORM and friends). Values outside of the range are clamped.
+std::uint16_t quantize_unorm16( float );
+
+/* Octahedral normal encoding (Meyer et al., On Floating-Point Normal Vectors,
+ * 2010): the unit sphere is projected onto an octahedron, which is unfolded
+ * into the [-1,1]^2 square. The two components are stored as 16-bit signed
+ * normalized integers (VK_FORMAT_R16G16_SNORM).
+ *
+ * The encoder tests the neighbouring grid points, and picks the one that
+ * decodes to the closest direction.
+ */
+struct OctahedralNormal
+{
+	std::int16_t x, y;
+};
+
+OctahedralNormal encode_octahedral( glm::vec3 const& );
+glm::vec3 decode_octahedral( OctahedralNormal );
+
+// Convert a float to a IEEE 754 half-precision float (round to nearest), and
+// back.
+std::uint16_t encode16_half( float );
+float decode16_half( std::uint16_t );
+
+#endif // QUANTIZE_HPP_B81E4F07_2C9A_4D63_9E15_7A40C3D6F258
@@ -0,0 +1,604 @@
+#include "simplify_mesh.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cmath>
+#include <cassert>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "optimize_mesh.hpp"
+
+namespace
+{
+	constexpr auto kNone_ = ~std::uint32_t(0);
+	constexpr auto kMultiple_ = ~std::uint32_t(0) - 1;
+
+	// Weight of the planes that keep border and seam edges in place, relative
+	// to the (area weighted) planes of the triangles.
+	constexpr double kEdgeWeight_ = 10.0;
+
+	// Each pass performs the cheapest collapses, up to this factor times the
+	// error of the collapse that would (approximately) reach the target.
+	// Larger values mean fewer passes but a less strict ordering.
+	constexpr double kPassErrorSlack_ = 1.5;
+
+	// A level of detail must remove at least this fraction of the triangles of
+	// the previous level. Otherwise it is not worth the memory.
+	constexpr float kMinLodReduction_ = 0.1f;
+
+	enum class EVertexKind_ : std::uint8_t
+	{
+		manifold, // Interior vertex; can collapse onto any neighbour
+		border,   // On an open border; moves along the border
+		seam,     // On an attribute seam; moves along the seam with its sibling
+		locked    // Never moves
+	};
+
+	// Symmetric 4x4 matrix Q = [A b; b^T c], such that the error of a point
+	// p is p^T A p + 2 b^T p + c. Accumulated in double precision, as the
+	// error is the (small) difference of large terms.
+	struct Quadric_
+	{
+		double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+		double a01 = 0.0, a02 = 0.0, a12 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+	};
+
+	// Outgoing (directed) edges of each vertex, in CSR form
+	struct EdgeAdjacency_
+	{
+		std::vector<std::uint32_t> offsets;
+		std::vector<std::uint32_t> targets;
+	};
+
+	struct Collapse_
+	{
+		std::uint32_t source, target;
+		double error;
+	};
+
+	void add_plane_( Quadric_&, glm::vec3 const& aNormal, float aOffset, double aWeight );
+	void add_( Quadric_&, Quadric_ const& );
+	double evaluate_( Quadric_ const&, glm::vec3 const& );
+
+	void build_edges_( EdgeAdjacency_&, std::vector<std::uint32_t> const& aIndices, std::size_t aVertexCount );
+	bool has_edge_( EdgeAdjacency_ const&, std::uint32_t aFrom, std::uint32_t aTo );
+
+	void find_open_edges_(
+		EdgeAdjacency_ const&,
+		std::vector<std::uint32_t>& aOpenOut,
+		std::vector<std::uint32_t>& aOpenIn
+	);
+
+	std::vector<EVertexKind_> classify_vertices_(
+		std::vector<std::uint32_t> const& aRemap,
+		std::vector<std::uint32_t> const& aSibling,
+		std::vector<std::uint32_t> const& aOpenOut,
+		std::vector<std::uint32_t> const& aOpenIn
+	);
+
+	bool is_single_( std::uint32_t aVertex )
+	{
+		return kNone_ != aVertex && kMultiple_ != aVertex;
+	}
+}
+
+//--    simplify_mesh()                 ///{{{2///////////////////////////////
+std::vector<std::uint32_t> simplify_mesh( IndexedMesh const& aMesh, std::vector<std::uint32_t> const& aIndices, std::size_t aTargetIndexCount, float aMaxError, float* aResultError )
+{
+	assert( aIndices.size() % 3 == 0 );
+
+	if( aResultError )
+		*aResultError = 0.f;
+
+	std::vector<std::uint32_t> indices = aIndices;
+
+	std::size_t const vertexCount = aMesh.vert.size();
+	if( indices.size() <= aTargetIndexCount || 0 == vertexCount )
+		return indices;
+
+	// Work on positions scaled to the unit cube, so that the error limit is
+	// independent of the mesh's size.
+	glm::vec3 bmin( std::numeric_limits<float>::max() );
+	glm::vec3 bmax( std::numeric_limits<float>::lowest() );
+	for( auto const index : indices )
+	{
+		bmin = glm::min( bmin, aMesh.vert[index] );
+		bmax = glm::max( bmax, aMesh.vert[index] );
+	}
+
+	auto const ext = bmax - bmin;
+	float const extent = std::max( ext.x, std::max( ext.y, ext.z ) );
+	float const scale = extent > 0.f ? 1.f / extent : 1.f;
+
+	std::vector<glm::vec3> pos( vertexCount );
+	for( std::size_t i = 0; i < vertexCount; ++i )
+		pos[i] = (aMesh.vert[i] - bmin) * scale;
+
+	// Vertices that share a position (but differ in other attributes) are
+	// linked in a circular list of siblings.
+	auto const remap = position_remap( aMesh.vert );
+
+	std::vector<std::uint32_t> sibling( vertexCount );
+	{
+		std::vector<std::uint32_t> last( vertexCount, kNone_ );
+		for( std::uint32_t v = 0; v < vertexCount; ++v )
+		{
+			auto const r = remap[v];
+			if( kNone_ == last[r] )
+			{
+				sibling[v] = v;
+			}
+			else
+			{
+				sibling[v] = sibling[last[r]];
+				sibling[last[r]] = v;
+			}
+
+			last[r] = v;
+		}
+	}
+
+	EdgeAdjacency_ edges;
+	build_edges_( edges, indices, vertexCount );
+
+	std::vector<std::uint32_t> openOut, openIn;
+	find_open_edges_( edges, openOut, openIn );
+
+	auto kind = classify_vertices_( remap, sibling, openOut, openIn );
+
+	// Quadrics are shared by all vertices with the same position
+	std::vector<Quadric_> quadrics( vertexCount );
+	for( std::size_t i = 0; i < indices.size(); i += 3 )
+	{
+		std::uint32_t const tri[3] = { indices[i+0], indices[i+1], indices[i+2] };
+
+		auto normal = glm::cross( pos[tri[1]] - pos[tri[0]], pos[tri[2]] - pos[tri[0]] );
+		float const area2 = glm::length( normal );
+		if( !(area2 > 0.f) )
+			continue;
+
+		normal /= area2;
+
+		float const offset = -glm::dot( normal, pos[tri[0]] );
+		for( auto const v : tri )
+			add_plane_( quadrics[remap[v]], normal, offset, 0.5 * area2 );
+
+		// Keep open edges (borders and seams) in place with a plane through
+		// the edge that is perpendicular to the triangle.
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			auto const a = tri[k], b = tri[(k+1)%3];
+			if( has_edge_( edges, b, a ) )
+				continue;
+
+			auto const edge = pos[b] - pos[a];
+			float const length = glm::length( edge );
+			if( !(length > 0.f) )
+				continue;
+
+			auto const perp = glm::normalize( glm::cross( edge, normal ) );
+			float const perpOffset = -glm::dot( perp, pos[a] );
+
+			double const weight = kEdgeWeight_ * double(length) * length;
+			add_plane_( quadrics[remap[a]], perp, perpOffset, weight );
+			add_plane_( quadrics[remap[b]], perp, perpOffset, weight );
+		}
+	}
+
+	// Collapse edges in passes. Each pass collapses a set of independent
+	// edges: a vertex is moved or used as a target at most once per pass.
+	double const maxError = double(aMaxError) * aMaxError;
+	double resultError = 0.0;
+
+	std::vector<std::uint32_t> collapseRemap( vertexCount );
+	std::vector<std::uint8_t> locked( vertexCount );
+
+	std::vector<std::uint32_t> triOffsets, triList;
+	std::vector<Collapse_> candidates;
+
+	bool firstPass = true;
+	while( indices.size() > aTargetIndexCount )
+	{
+		std::size_t const triangleCount = indices.size()/3;
+
+		// The first pass reuses the edges from above. Collapses can open new
+		// borders and seams, so the vertices are classified again with the
+		// open edges.
+		if( !firstPass )
+		{
+			build_edges_( edges, indices, vertexCount );
+			find_open_edges_( edges, openOut, openIn );
+			kind = classify_vertices_( remap, sibling, openOut, openIn );
+		}
+
+		firstPass = false;
+
+		// Triangles around each vertex
+		triOffsets.assign( vertexCount+1, 0 );
+		for( auto const index : indices )
+			++triOffsets[index+1];
+		std::partial_sum( triOffsets.begin(), triOffsets.end(), triOffsets.begin() );
+
+		triList.resize( indices.size() );
+		{
+			auto fill = triOffsets;
+			for( std::size_t i = 0; i < indices.size(); ++i )
+				triList[fill[indices[i]]++] = std::uint32_t(i/3);
+		}
+
+		// For a seam vertex, find the sibling and the sibling's target, such
+		// that both sides of the seam collapse along the same edge.
+		auto const seam_partner_ = [&] (std::uint32_t aSource, std::uint32_t aTarget, std::uint32_t& aSiblingTarget) {
+			auto const s = sibling[aSource];
+			aSiblingTarget = aTarget == openOut[aSource] ? openIn[s] : openOut[s];
+			if( !is_single_( aSiblingTarget ) || remap[aSiblingTarget] != remap[aTarget] )
+				return kNone_;
+			return s;
+		};
+
+		// Find candidates
+		candidates.clear();
+		for( std::size_t i = 0; i < indices.size(); i += 3 )
+		{
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				for( std::size_t dir = 0; dir < 2; ++dir )
+				{
+					auto const v = indices[i + (dir ? (k+1)%3 : k)];
+					auto const t = indices[i + (dir ? k : (k+1)%3)];
+
+					if( remap[v] == remap[t] )
+						continue;
+
+					switch( kind[v] )
+					{
+						case EVertexKind_::manifold:
+							break;
+
+						case EVertexKind_::border:
+							if( t != openOut[v] && t != openIn[v] )
+								continue;
+							break;
+
+						case EVertexKind_::seam:
+						{
+							if( t != openOut[v] && t != openIn[v] )
+								continue;
+
+							std::uint32_t t2;
+							if( kNone_ == seam_partner_( v, t, t2 ) )
+								continue;
+						} break;
+
+						case EVertexKind_::locked:
+							continue;
+					}
+
+					auto const& q = quadrics[remap[v]];
+					double const error = q.weight > 0.0 ? evaluate_( q, pos[t] ) / q.weight : 0.0;
+
+					candidates.emplace_back( Collapse_{ v, t, error } );
+				}
+			}
+		}
+
+		if( candidates.empty() )
+			break;
+
+		std::sort( candidates.begin(), candidates.end(), [] (Collapse_ const& aX, Collapse_ const& aY) {
+			if( aX.error != aY.error )
+				return aX.error < aY.error;
+			if( aX.source != aY.source )
+				return aX.source < aY.source;
+			return aX.target < aY.target;
+		} );
+
+		// Each collapse of an interior edge removes two triangles
+		std::size_t const toRemove = triangleCount - aTargetIndexCount/3;
+		std::size_t const estimate = std::min( candidates.size()-1, toRemove/2 );
+		double const passLimit = std::min( maxError, candidates[estimate].error * kPassErrorSlack_ );
+
+		std::iota( collapseRemap.begin(), collapseRemap.end(), 0u );
+		std::fill( locked.begin(), locked.end(), std::uint8_t(0) );
+
+		// Check that moving aSource to aTarget does not flip any of the
+		// surrounding triangles. Returns the number of triangles that become
+		// degenerate, or kNone_ if the collapse is not possible.
+		auto const check_collapse_ = [&] (std::uint32_t aSource, std::uint32_t aTarget) {
+			bool const seam = EVertexKind_::seam == kind[aSource];
+
+			std::uint32_t degenerate = 0;
+			for( auto j = triOffsets[aSource]; j < triOffsets[aSource+1]; ++j )
+			{
+				auto const tri = triList[j];
+
+				std::uint32_t corner[3];
+				for( std::size_t k = 0; k < 3; ++k )
+					corner[k] = collapseRemap[indices[tri*3+k]];
+
+				auto const rt = remap[aTarget];
+				if( remap[corner[0]] == rt || remap[corner[1]] == rt || remap[corner[2]] == rt )
+				{
+					// If the triangle references a sibling of the target
+					// instead, the source is the end point of a seam. Moving it
+					// would drag the attributes of one side across the seam.
+					// (Seam vertices are handled together with their sibling.)
+					if( !seam && aTarget != corner[0] && aTarget != corner[1] && aTarget != corner[2] )
+						return kNone_;
+
+					++degenerate;
+					continue;
+				}
+
+				auto const n0 = glm::cross( pos[corner[1]] - pos[corner[0]], pos[corner[2]] - pos[corner[0]] );
+				for( auto& c : corner )
+				{
+					if( c == aSource )
+						c = aTarget;
+				}
+				auto const n1 = glm::cross( pos[corner[1]] - pos[corner[0]], pos[corner[2]] - pos[corner[0]] );
+
+				if( glm::dot( n0, n1 ) <= 0.f )
+					return kNone_;
+			}
+
+			return degenerate;
+		};
+
+		std::size_t removed = 0, collapses = 0;
+		for( auto const& cand : candidates )
+		{
+			if( cand.error > passLimit || removed >= toRemove )
+				break;
+
+			auto const v = cand.source, t = cand.target;
+			if( locked[remap[v]] || locked[remap[t]] )
+				continue;
+
+			std::uint32_t s = kNone_, t2 = kNone_;
+			if( EVertexKind_::seam == kind[v] )
+			{
+				s = seam_partner_( v, t, t2 );
+				assert( kNone_ != s );
+			}
+
+			auto const removedV = check_collapse_( v, t );
+			if( kNone_ == removedV )
+				continue;
+
+			std::uint32_t removedS = 0;
+			if( kNone_ != s )
+			{
+				removedS = check_collapse_( s, t2 );
+				if( kNone_ == removedS )
+					continue;
+			}
+
+			collapseRemap[v] = t;
+			if( kNone_ != s )
+				collapseRemap[s] = t2;
+
+			add_( quadrics[remap[t]], quadrics[remap[v]] );
+
+			locked[remap[v]] = 1;
+			locked[remap[t]] = 1;
+
+			removed += removedV + removedS;
+			resultError = std::max( resultError, cand.error );
+			++collapses;
+		}
+
+		if( 0 == collapses )
+			break;
+
+		// Apply collapses and remove degenerate triangles
+		std::size_t out = 0;
+		for( std::size_t i = 0; i < indices.size(); i += 3 )
+		{
+			auto const a = collapseRemap[indices[i+0]];
+			auto const b = collapseRemap[indices[i+1]];
+			auto const c = collapseRemap[indices[i+2]];
+
+			if( remap[a] == remap[b] || remap[a] == remap[c] || remap[b] == remap[c] )
+				continue;
+
+			indices[out++] = a;
+			indices[out++] = b;
+			indices[out++] = c;
+		}
+
+		indices.resize( out );
+	}
+
+	if( aResultError )
+		*aResultError = float(std::sqrt( resultError )) * extent;
+
+	return indices;
+}
+
+//--    build_lod_chain()               ///{{{2///////////////////////////////
+std::vector<MeshLod> build_lod_chain( IndexedMesh& aMesh, std::size_t aMaxLods, float aMaxError, float aReduction )
+{
+	assert( aReduction > 0.f && aReduction < 1.f );
+
+	std::vector<MeshLod> ret;
+	ret.emplace_back( MeshLod{ 0, std::uint32_t(aMesh.indices.size()), 0.f } );
+
+	std::size_t const maxLods = std::min( aMaxLods, kMaxLodCount );
+
+	std::vector<std::uint32_t> previous = aMesh.indices;
+	float error = 0.f;
+
+	while( ret.size() < maxLods )
+	{
+		std::size_t const target = std::size_t( float(previous.size()/3) * aReduction ) * 3;
+
+		float levelError = 0.f;
+		auto simplified = simplify_mesh( aMesh, previous, target, aMaxError, &levelError );
+
+		if( simplified.empty() || float(simplified.size()) > float(previous.size()) * (1.f - kMinLodReduction_) )
+			break;
+
+		optimize_vertex_cache( simplified, aMesh.vert.size() );
+
+		// Each level is simplified from the previous one, so the errors add
+		// up (in the worst case).
+		error += levelError;
+
+		ret.emplace_back( MeshLod{ std::uint32_t(aMesh.indices.size()), std::uint32_t(simplified.size()), error } );
+		aMesh.indices.insert( aMesh.indices.end(), simplified.begin(), simplified.end() );
+
+		previous = std::move(simplified);
+	}
+
+	return ret;
+}
+
+//--    $ local                         ///{{{2///////////////////////////////
+namespace
+{
+	void add_plane_( Quadric_& aQuadric, glm::vec3 const& aNormal, float aOffset, double aWeight )
+	{
+		double const x = aNormal.x, y = aNormal.y, z = aNormal.z, d = aOffset;
+
+		aQuadric.a00 += aWeight * x * x;
+		aQuadric.a11 += aWeight * y * y;
+		aQuadric.a22 += aWeight * z * z;
+		aQuadric.a01 += aWeight * x * y;
+		aQuadric.a02 += aWeight * x * z;
+		aQuadric.a12 += aWeight * y * z;
+		aQuadric.b0 += aWeight * x * d;
+		aQuadric.b1 += aWeight * y * d;
+		aQuadric.b2 += aWeight * z * d;
+		aQuadric.c += aWeight * d * d;
+		aQuadric.weight += aWeight;
+	}
+
+	void add_( Quadric_& aQuadric, Quadric_ const& aOther )
+	{
+		aQuadric.a00 += aOther.a00;
+		aQuadric.a11 += aOther.a11;
+		aQuadric.a22 += aOther.a22;
+		aQuadric.a01 += aOther.a01;
+		aQuadric.a02 += aOther.a02;
+		aQuadric.a12 += aOther.a12;
+		aQuadric.b0 += aOther.b0;
+		aQuadric.b1 += aOther.b1;
+		aQuadric.b2 += aOther.b2;
+		aQuadric.c += aOther.c;
+		aQuadric.weight += aOther.weight;
+	}
+
+	double evaluate_( Quadric_ const& aQ, glm::vec3 const& aPoint )
+	{
+		double const x = aPoint.x, y = aPoint.y, z = aPoint.z;
+
+		double const rx = aQ.a00*x + aQ.a01*y + aQ.a02*z;
+		double const ry = aQ.a01*x + aQ.a11*y + aQ.a12*z;
+		double const rz = aQ.a02*x + aQ.a12*y + aQ.a22*z;
+
+		double const error = x*rx + y*ry + z*rz + 2.0*(aQ.b0*x + aQ.b1*y + aQ.b2*z) + aQ.c;
+
+		// Rounding may produce slightly negative values
+		return std::abs( error );
+	}
+
+	void build_edges_( EdgeAdjacency_& aEdges, std::vector<std::uint32_t> const& aIndices, std::size_t aVertexCount )
+	{
+		aEdges.offsets.assign( aVertexCount+1, 0 );
+		for( auto const index : aIndices )
+			++aEdges.offsets[index+1];
+		std::partial_sum( aEdges.offsets.begin(), aEdges.offsets.end(), aEdges.offsets.begin() );
+
+		aEdges.targets.resize( aIndices.size() );
+
+		auto fill = aEdges.offsets;
+		for( std::size_t i = 0; i < aIndices.size(); i += 3 )
+		{
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const a = aIndices[i+k], b = aIndices[i+(k+1)%3];
+				aEdges.targets[fill[a]++] = b;
+			}
+		}
+	}
+
+	bool has_edge_( EdgeAdjacency_ const& aEdges, std::uint32_t aFrom, std::uint32_t aTo )
+	{
+		for( auto j = aEdges.offsets[aFrom]; j < aEdges.offsets[aFrom+1]; ++j )
+		{
+			if( aTo == aEdges.targets[j] )
+				return true;
+		}
+
+		return false;
+	}
+
+	void find_open_edges_( EdgeAdjacency_ const& aEdges, std::vector<std::uint32_t>& aOpenOut, std::vector<std::uint32_t>& aOpenIn )
+	{
+		// An edge a->b is open if there is no opposite edge b->a. Record the
+		// open edge of each vertex, or kMultiple_ if there are several.
+		std::size_t const vertexCount = aEdges.offsets.size()-1;
+
+		aOpenOut.assign( vertexCount, kNone_ );
+		aOpenIn.assign( vertexCount, kNone_ );
+
+		for( std::uint32_t a = 0; a < vertexCount; ++a )
+		{
+			for( auto j = aEdges.offsets[a]; j < aEdges.offsets[a+1]; ++j )
+			{
+				auto const b = aEdges.targets[j];
+				if( has_edge_( aEdges, b, a ) )
+					continue;
+
+				aOpenOut[a] = kNone_ == aOpenOut[a] ? b : kMultiple_;
+				aOpenIn[b] = kNone_ == aOpenIn[b] ? a : kMultiple_;
+			}
+		}
+	}
+
+	std::vector<EVertexKind_> classify_vertices_( std::vector<std::uint32_t> const& aRemap, std::vector<std::uint32_t> const& aSibling, std::vector<std::uint32_t> const& aOpenOut, std::vector<std::uint32_t> const& aOpenIn )
+	{
+		std::size_t const vertexCount = aRemap.size();
+		std::vector<EVertexKind_> ret( vertexCount, EVertexKind_::locked );
+
+		for( std::uint32_t v = 0; v < vertexCount; ++v )
+		{
+			auto const s = aSibling[v];
+			if( s == v )
+			{
+				// No siblings: interior vertex, or on a simple border
+				if( kNone_ == aOpenOut[v] && kNone_ == aOpenIn[v] )
+					ret[v] = EVertexKind_::manifold;
+				else if( is_single_( aOpenOut[v] ) && is_single_( aOpenIn[v] ) )
+					ret[v] = EVertexKind_::border;
+			}
+			else if( aSibling[s] == v )
+			{
+				// Exactly one sibling. This is a seam if the two sides have
+				// opposite open edges, i.e. the surface is closed in terms of
+				// positions.
+				if( is_single_( aOpenOut[v] ) && is_single_( aOpenIn[v] )
+					&& is_single_( aOpenOut[s] ) && is_single_( aOpenIn[s] )
+					&& aRemap[aOpenOut[v]] == aRemap[aOpenIn[s]]
+					&& aRemap[aOpenIn[v]] == aRemap[aOpenOut[s]]
+				)
+				{
+					ret[v] = EVertexKind_::seam;
+				}
+			}
+		}
+
+		return ret;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,71 @@
+#ifndef SIMPLIFY_MESH_HPP_61C8F0B2_9D47_4E3A_B5F1_0A7E3D92C4B8
+#define SIMPLIFY_MESH_HPP_61C8F0B2_9D47_4E3A_B5F1_0A7E3D92C4B8
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+/* Simplify the triangles in aIndices (which reference the vertices of aMesh)
+ * by collapsing edges, using quadric error metrics (Garland & Heckbert,
+ * Surface Simplification Using Quadric Error Metrics, 1997).
+ *
+ * Edges are collapsed onto one of their endpoints, so the result references a
+ * subset of the mesh's existing vertices; the vertex data is not changed.
+ * Vertices on open borders only move along the border. Vertices on attribute
+ * seams (where vertices with the same position have different normals or
+ * texture coordinates) only move along the seam, and are collapsed together
+ * with their counterpart on the other side, so that the seam does not tear.
+ * Vertices where the topology is more complicated are never moved.
+ *
+ * Simplification stops once the result has at most aTargetIndexCount indices,
+ * or if no further edge can be collapsed with an error below aMaxError.
+ * aMaxError is relative to the size of the mesh (the largest extent of its
+ * bounding box).
+ *
+ * If aResultError is non-null, it receives the error of the result as an
+ * absolute distance in the mesh's units.
+ */
+std::vector<std::uint32_t> simplify_mesh(
+	IndexedMesh const&,
+	std::vector<std::uint32_t> const& aIndices,
+	std::size_t aTargetIndexCount,
+	float aMaxError,
+	float* aResultError = nullptr
+);
+
+
+// Level of detail: a range in the mesh's index buffer, with the geometric
+// error of the simplified triangles relative to the original mesh (in the
+// mesh's units). LOD zero is the original mesh with an error of zero.
+struct MeshLod
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	float error;
+};
+
+static_assert( sizeof(MeshLod) == 3*sizeof(std::uint32_t) );
+
+// Maximum number of levels of detail per mesh, including the original mesh.
+constexpr std::size_t kMaxLodCount = 8;
+
+/* Build a chain of levels of detail. Each level targets aReduction times the
+ * triangles of the previous one, and is simplified from it. The simplified
+ * index lists are optimized for the vertex cache and appended to
+ * aMesh.indices, behind the original triangles (which are not modified).
+ *
+ * The chain ends after aMaxLods levels, when simplification would exceed
+ * aMaxError (relative, see simplify_mesh()), or when a level no longer
+ * removes a significant number of triangles.
+ */
+std::vector<MeshLod> build_lod_chain(
+	IndexedMesh&,
+	std::size_t aMaxLods,
+	float aMaxError,
+	float aReduction = 0.5f
+);
+
+#endif // SIMPLIFY_MESH_HPP_61C8F0B2_9D47_4E3A_B5F1_0A7E3D92C4B8
@@ -0,0 +1,139 @@
+#include "static_transform.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/parallel.hpp"
+namespace lut = labutils;
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <immintrin.h>
+#	define STATIC_TRANSFORM_SIMD_ 1
+#endif
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kBlockSize_ = 64*1024; // vertices per parallel job
+
+	static_assert( sizeof(glm::vec3) == 3*sizeof(float) );
+
+	// Transform aCount vectors in place: v' = M * v + aW * t, where M is the
+	// upper 3x3 part of aMatrix and t its translation. Optionally normalizes
+	// the results; zero-length results are left at zero.
+	void transform_vectors_( glm::vec3* aData, std::size_t aCount, glm::mat4 const& aMatrix, float aW, bool aNormalize );
+}
+
+//--    apply_static_transform()        ///{{{2///////////////////////////////
+void apply_static_transform( InputModel& aModel, glm::mat4 const& aTransform, std::size_t aWorkerCount )
+{
+	glm::mat3 const linear( aTransform );
+	float const det = glm::determinant( linear );
+
+	if( !(std::abs( det ) > 0.f) || !std::isfinite( det ) )
+		throw lut::Error( "apply_static_transform(): transform is singular (determinant %g)", double(det) );
+
+	glm::mat4 const normalMatrix( glm::transpose( glm::inverse( linear ) ) );
+
+	// Positions and normals are independent arrays; split both into blocks
+	// and process all of them in one go.
+	std::size_t const positionBlocks = (aModel.positions.size() + kBlockSize_-1) / kBlockSize_;
+	std::size_t const normalBlocks = (aModel.normals.size() + kBlockSize_-1) / kBlockSize_;
+
+	lut::parallel_for( positionBlocks + normalBlocks, aWorkerCount, [&] (std::size_t aBlock) {
+		bool const normals = aBlock >= positionBlocks;
+		auto& data = normals ? aModel.normals : aModel.positions;
+
+		std::size_t const begin = (normals ? aBlock - positionBlocks : aBlock) * kBlockSize_;
+		std::size_t const count = std::min( kBlockSize_, data.size() - begin );
+
+		if( normals )
+			transform_vectors_( data.data() + begin, count, normalMatrix, 0.f, true );
+		else
+			transform_vectors_( data.data() + begin, count, aTransform, 1.f, false );
+	} );
+
+	// Mirroring transforms invert the winding. Swap two corners of each
+	// triangle to restore it.
+	if( det < 0.f )
+	{
+		assert( 0 == aModel.vertices.size() % 3 );
+		for( std::size_t i = 0; i+2 < aModel.vertices.size(); i += 3 )
+			std::swap( aModel.vertices[i+1], aModel.vertices[i+2] );
+	}
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	void transform_vectors_( glm::vec3* aData, std::size_t aCount, glm::mat4 const& aMatrix, float aW, bool aNormalize )
+	{
+		std::size_t i = 0;
+
+#		if defined(STATIC_TRANSFORM_SIMD_)
+		// Four vectors (12 floats) per iteration. They are transposed into
+		// SoA form (xxxx, yyyy, zzzz) in registers, transformed, and
+		// transposed back.
+		__m128 const m00 = _mm_set1_ps( aMatrix[0][0] ), m01 = _mm_set1_ps( aMatrix[0][1] ), m02 = _mm_set1_ps( aMatrix[0][2] );
+		__m128 const m10 = _mm_set1_ps( aMatrix[1][0] ), m11 = _mm_set1_ps( aMatrix[1][1] ), m12 = _mm_set1_ps( aMatrix[1][2] );
+		__m128 const m20 = _mm_set1_ps( aMatrix[2][0] ), m21 = _mm_set1_ps( aMatrix[2][1] ), m22 = _mm_set1_ps( aMatrix[2][2] );
+		__m128 const tx = _mm_set1_ps( aW * aMatrix[3][0] ), ty = _mm_set1_ps( aW * aMatrix[3][1] ), tz = _mm_set1_ps( aW * aMatrix[3][2] );
+
+		float* ptr = &aData[0].x;
+		for( ; i+4 <= aCount; i += 4, ptr += 12 )
+		{
+			// a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+			__m128 const a = _mm_loadu_ps( ptr+0 );
+			__m128 const b = _mm_loadu_ps( ptr+4 );
+			__m128 const c = _mm_loadu_ps( ptr+8 );
+
+			__m128 const x = _mm_shuffle_ps( a, _mm_shuffle_ps( b, c, _MM_SHUFFLE(1,1,2,2) ), _MM_SHUFFLE(2,0,3,0) );
+			__m128 const y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(0,0,1,1) ), _mm_shuffle_ps( b, c, _MM_SHUFFLE(2,2,3,3) ), _MM_SHUFFLE(2,0,2,0) );
+			__m128 const z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE(1,1,2,2) ), _mm_shuffle_ps( c, c, _MM_SHUFFLE(3,3,0,0) ), _MM_SHUFFLE(2,0,2,0) );
+
+			__m128 rx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m00, x ), _mm_mul_ps( m10, y ) ), _mm_add_ps( _mm_mul_ps( m20, z ), tx ) );
+			__m128 ry = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m01, x ), _mm_mul_ps( m11, y ) ), _mm_add_ps( _mm_mul_ps( m21, z ), ty ) );
+			__m128 rz = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m02, x ), _mm_mul_ps( m12, y ) ), _mm_add_ps( _mm_mul_ps( m22, z ), tz ) );
+
+			if( aNormalize )
+			{
+				__m128 const len2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( rx, rx ), _mm_mul_ps( ry, ry ) ), _mm_mul_ps( rz, rz ) );
+				__m128 const nonzero = _mm_cmpgt_ps( len2, _mm_setzero_ps() );
+				__m128 const inv = _mm_and_ps( nonzero, _mm_div_ps( _mm_set1_ps( 1.f ), _mm_sqrt_ps( len2 ) ) );
+
+				rx = _mm_mul_ps( rx, inv );
+				ry = _mm_mul_ps( ry, inv );
+				rz = _mm_mul_ps( rz, inv );
+			}
+
+			_mm_storeu_ps( ptr+0, _mm_shuffle_ps( _mm_shuffle_ps( rx, ry, _MM_SHUFFLE(0,0,0,0) ), _mm_shuffle_ps( rz, rx, _MM_SHUFFLE(1,1,0,0) ), _MM_SHUFFLE(2,0,2,0) ) );
+			_mm_storeu_ps( ptr+4, _mm_shuffle_ps( _mm_shuffle_ps( ry, rz, _MM_SHUFFLE(1,1,1,1) ), _mm_shuffle_ps( rx, ry, _MM_SHUFFLE(2,2,2,2) ), _MM_SHUFFLE(2,0,2,0) ) );
+			_mm_storeu_ps( ptr+8, _mm_shuffle_ps( _mm_shuffle_ps( rz, rx, _MM_SHUFFLE(3,3,2,2) ), _mm_shuffle_ps( ry, rz, _MM_SHUFFLE(3,3,3,3) ), _MM_SHUFFLE(2,0,2,0) ) );
+		}
+#		endif // ~ STATIC_TRANSFORM_SIMD_
+
+		// Remainder (or everything, without SIMD)
+		glm::mat3 const linear( aMatrix );
+		glm::vec3 const translation = aW * glm::vec3( aMatrix[3] );
+
+		for( ; i < aCount; ++i )
+		{
+			auto v = linear * aData[i] + translation;
+
+			if( aNormalize )
+			{
+				float const len2 = glm::dot( v, v );
+				v = len2 > 0.f ? v / std::sqrt( len2 ) : glm::vec3( 0.f );
+			}
+
+			aData[i] = v;
+		}
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,27 @@
+#ifndef STATIC_TRANSFORM_HPP_94D2B6E8_7A1F_4C05_B3E9_58C1F0A2D7B6
+#define STATIC_TRANSFORM_HPP_94D2B6E8_7A1F_4C05_B3E9_58C1F0A2D7B6
+
+#include <cstddef>
+
+#include <glm/mat4x4.hpp>
+
+#include "input_model.hpp"
+
+/* Apply a static (affine) transform to a model: positions are transformed by
+ * aTransform, and normals by the inverse transpose of its upper 3x3 part (and
+ * renormalized). If the transform mirrors the model (negative determinant),
+ * the winding of all triangles is flipped, so that front faces remain front
+ * faces.
+ *
+ * The attribute arrays are processed in blocks spread over aWorkerCount
+ * threads, four vertices at a time with SSE where available.
+ *
+ * Throws if the transform is singular.
+ */
+void apply_static_transform(
+	InputModel&,
+	glm::mat4 const& aTransform,
+	std::size_t aWorkerCount
+);
+
+#endif // STATIC_TRANSFORM_HPP_94D2B6E8_7A1F_4C05_B3E9_58C1F0A2D7B6
@@ -0,0 +1,125 @@
+#include "tangent_space.hpp"
+
+#include <vector>
+
+#include <cmath>
+#include <cassert>
+
+#include <tgen.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace
+{
+	float remap_( float aX, float aMin1, float aMax1, float aMin2, float aMax2 )
+	{
+		return (((aX - aMin1) / (aMax1 - aMin1)) * (aMax2 - aMin2)) + aMin2;
+	}
+
+	template< unsigned tBits >
+	std::uint32_t encode_unorm_( float aX )
+	{
+		return std::uint32_t( int(aX * ((1u << tBits)-1) + 0.5f) );
+	}
+
+	// Sign in the lowest bit, magnitude in the remaining tBits-1 bits
+	template< unsigned tBits >
+	std::uint32_t encode_snorm_( float aX )
+	{
+		return std::uint32_t(aX < 0.f) | (encode_unorm_<tBits-1>( aX < 0.f ? -aX : aX ) << 1);
+	}
+}
+
+//--    compute_tangent_space()         ///{{{2///////////////////////////////
+void compute_tangent_space( IndexedMesh& aMesh, std::size_t aIndexCount )
+{
+	std::size_t const vertexCount = aMesh.vert.size();
+
+	assert( aIndexCount <= aMesh.indices.size() );
+	assert( aMesh.norm.size() == vertexCount && aMesh.text.size() == vertexCount );
+
+	// TGen works on flat arrays of doubles
+	std::vector<tgen::VIndexT> const indices( aMesh.indices.begin(), aMesh.indices.begin() + aIndexCount );
+
+	std::vector<tgen::RealT> positions( vertexCount*3 ), normals( vertexCount*3 ), texcoords( vertexCount*2 );
+	for( std::size_t i = 0; i < vertexCount; ++i )
+	{
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			positions[i*3+k] = aMesh.vert[i][int(k)];
+			normals[i*3+k] = aMesh.norm[i][int(k)];
+		}
+
+		texcoords[i*2+0] = aMesh.text[i].x;
+		texcoords[i*2+1] = aMesh.text[i].y;
+	}
+
+	std::vector<tgen::RealT> cornerTangents, cornerBitangents;
+	tgen::computeCornerTSpace( indices, indices, positions, texcoords, cornerTangents, cornerBitangents );
+
+	std::vector<tgen::RealT> tangents, bitangents;
+	tgen::computeVertexTSpace( indices, cornerTangents, cornerBitangents, vertexCount, tangents, bitangents );
+	tgen::orthogonalizeTSpace( normals, tangents, bitangents );
+
+	std::vector<tgen::RealT> tangents4;
+	tgen::computeTangent4D( normals, tangents, bitangents, tangents4 );
+
+	aMesh.tangent.resize( vertexCount );
+	aMesh.packedTbn.resize( vertexCount );
+
+	for( std::size_t i = 0; i < vertexCount; ++i )
+	{
+		auto const& t4 = aMesh.tangent[i] = glm::vec4(
+			float(tangents4[i*4+0]),
+			float(tangents4[i*4+1]),
+			float(tangents4[i*4+2]),
+			float(tangents4[i*4+3])
+		);
+
+		// A quaternion can only represent a rotation, so the frame is made
+		// right-handed here. The handedness remains available in the w
+		// component of the tangent.
+		auto const n = glm::normalize( aMesh.norm[i] );
+		auto const t = glm::vec3( t4 );
+		auto const b = glm::cross( n, t );
+
+		auto const q = glm::normalize( glm::quat_cast( glm::mat3( t, b, n ) ) );
+		aMesh.packedTbn[i] = encode_quat( q.x, q.y, q.z, q.w );
+	}
+}
+
+//--    encode_quat()                   ///{{{2///////////////////////////////
+std::uint32_t encode_quat( float aX, float aY, float aZ, float aW )
+{
+	float const rmax = 1.f / std::sqrt( 2.f ), rmin = -rmax;
+
+	float const comp[4] = { aX, aY, aZ, aW };
+
+	std::uint32_t largest = 0;
+	for( std::uint32_t i = 1; i < 4; ++i )
+	{
+		if( comp[i]*comp[i] > comp[largest]*comp[largest] )
+			largest = i;
+	}
+
+	// q and -q are the same rotation. Flip the sign such that the dropped
+	// component is positive; the decoder reconstructs it as such.
+	float const sign = comp[largest] >= 0.f ? 1.f : -1.f;
+
+	std::uint32_t ret = largest << 30;
+	std::uint32_t shift = 20;
+	for( std::uint32_t i = 0; i < 4; ++i )
+	{
+		if( i == largest )
+			continue;
+
+		float const value = remap_( sign * comp[i], rmin, rmax, -1.f, 1.f );
+		ret |= encode_snorm_<10>( value ) << shift;
+		shift -= 10;
+	}
+
+	return ret;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
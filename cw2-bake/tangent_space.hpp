@@ -0,0 +1,31 @@
+#ifndef TANGENT_SPACE_HPP_2F9B6C31_84DA_4E07_A1C5_6D3E8B0F7A92
+#define TANGENT_SPACE_HPP_2F9B6C31_84DA_4E07_A1C5_6D3E8B0F7A92
+
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+/* Compute the tangent space of each vertex with TGen (see third_party/tgen).
+ * Fills IndexedMesh::tangent with the tangent in xyz and the sign of the
+ * bitangent (handedness) in w, and IndexedMesh::packedTbn with the tangent
+ * frame as a quaternion, packed into 32 bits with encode_quat().
+ *
+ * Only the first aIndexCount indices are considered. This excludes the
+ * simplified levels of detail, which reuse the same vertices.
+ *
+ * Requires normals and texture coordinates.
+ */
+void compute_tangent_space(
+	IndexedMesh&,
+	std::size_t aIndexCount
+);
+
+/* Pack a unit quaternion into 32 bits ("smallest three"). The two top bits
+ * hold the index of the component with the largest magnitude; the remaining
+ * three components are stored as 10-bit sign-magnitude values, remapped from
+ * [-1/sqrt(2), 1/sqrt(2)] to [-1,1]. The sign of the quaternion is chosen
+ * such that the dropped component is positive.
+ */
+std::uint32_t encode_quat( float aX, float aY, float aZ, float aW );
+
+#endif // TANGENT_SPACE_HPP_2F9B6C31_84DA_4E07_A1C5_6D3E8B0F7A92
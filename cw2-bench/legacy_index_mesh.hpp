@@ -0,0 +1,14 @@
+#ifndef LEGACY_INDEX_MESH_HPP_2F0B8E61_94C4_4D7A_B1E3_6A0C52D87F19
+#define LEGACY_INDEX_MESH_HPP_2F0B8E61_94C4_4D7A_B1E3_6A0C52D87F19
+
+#include "../cw2-bake/index_mesh.hpp"
+
+// Reference implementation of make_indexed_mesh() using the original
+// unordered_multimap-based vicinity map. Produces the same output as
+// make_indexed_mesh().
+IndexedMesh make_indexed_mesh_legacy(
+	TriangleSoup const&,
+	float aErrorTol = 1e-6f
+);
+
+#endif // LEGACY_INDEX_MESH_HPP_2F0B8E61_94C4_4D7A_B1E3_6A0C52D87F19
@@ -0,0 +1,749 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <utility>
+#include <typeinfo>
+#include <exception>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+
+#include <tgen.h>
+
+#include <glm/glm.hpp>
+
+#include "synthetic.hpp"
+#include "legacy_index_mesh.hpp"
+
+#include "../cw2/baked_model.hpp"
+
+#include "../cw2-bake/quantize.hpp"
+#include "../cw2-bake/index_mesh.hpp"
+#include "../cw2-bake/tangent_space.hpp"
+#include "../cw2-bake/load_model_obj.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/parallel.hpp"
+#include "../labutils/mesh_file.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Same tolerance as used by cw2-bake
+	constexpr float kErrorTolerance = 1e-5f;
+
+	// Tolerances for the sweep; zero only merges identical vertices
+	constexpr float kToleranceSweep[] = { 0.f, 1e-6f, 1e-5f, 1e-4f, 1e-3f };
+
+	// Roughly the size of the Sponza model, after merging by material
+	constexpr std::size_t kSceneTriangles = 262144;
+	constexpr std::size_t kSceneMeshes = 25;
+
+	// Values per encoder run, and per parallel work item
+	constexpr std::size_t kEncodeCount = std::size_t(1) << 22;
+	constexpr std::size_t kEncodeChunk = std::size_t(1) << 16;
+
+	// Position, normal and texture coordinate, as floats
+	constexpr std::size_t kVertexBytes = sizeof(float)*(3+3+2);
+
+	struct Options_
+	{
+		std::size_t repeat = 3;
+		bool legacy = true;
+
+		std::vector<std::size_t> threads; // thread counts for the sweeps
+		std::vector<std::string> only; // benchmark groups; empty runs all
+	};
+
+	struct Case_
+	{
+		char const* name;
+		std::function<TriangleSoup()> make;
+	};
+
+	// Removes the directory and its contents when going out of scope
+	struct TempDir_
+	{
+		std::filesystem::path path;
+		~TempDir_() { std::error_code ec; std::filesystem::remove_all( path, ec ); }
+	};
+
+	// New directory with a random name in the system's temporary directory,
+	// removed again on exit. Throws if the directory exists already, so that
+	// concurrent runs never share (and delete) each other's files.
+	TempDir_ make_temp_dir_();
+
+	Options_ parse_options_( int aArgc, char* aArgv[] );
+	bool enabled_( Options_ const&, char const* aGroup );
+
+	template< typename tFunc >
+	double time_best_ms_( std::size_t aRepeat, tFunc&& aFunc );
+
+	// Benchmark groups. bench_index_() returns false if the results differ
+	// from the reference implementation.
+	bool bench_index_( Options_ const& );
+	void bench_normals_( Options_ const& );
+	void bench_tangents_( Options_ const& );
+	void bench_encode_( Options_ const& );
+	void bench_load_baked_( Options_ const&, std::filesystem::path const& aTempDir );
+	void bench_load_obj_( Options_ const&, std::filesystem::path const& aTempDir );
+
+	void print_throughput_header_( char const* aTitle, char const* aSecondColumn );
+	void print_throughput_( char const* aName, char const* aSecond, std::size_t aVertices, std::uint64_t aBytes, double aMs );
+
+	// Scene of kSceneMeshes meshes, indexed with kErrorTolerance, without
+	// tangent space
+	std::vector<IndexedMesh> make_scene_meshes_();
+
+	bool same_mesh_( IndexedMesh const&, IndexedMesh const& );
+
+	// Throws if the loaded model does not hold the meshes that were written.
+	// Quantized attributes are compared with the precision of their encoding;
+	// triangles may be rotated by the index codec.
+	void check_baked_round_trip_( char const* aName, BakedModel const&, std::vector<IndexedMesh> const& );
+}
+
+int main( int aArgc, char* aArgv[] ) try
+{
+	auto const opts = parse_options_( aArgc, aArgv );
+
+	std::printf( "Best of %zu run(s); thread sweep:", opts.repeat );
+	for( auto const threads : opts.threads )
+		std::printf( " %zu", threads );
+	std::printf( "\n" );
+
+	TempDir_ const temp = make_temp_dir_();
+
+	bool allSame = true;
+	if( enabled_( opts, "index" ) )
+		allSame = bench_index_( opts );
+	if( enabled_( opts, "normals" ) )
+		bench_normals_( opts );
+	if( enabled_( opts, "tangents" ) )
+		bench_tangents_( opts );
+	if( enabled_( opts, "encode" ) )
+		bench_encode_( opts );
+	if( enabled_( opts, "load-baked" ) )
+		bench_load_baked_( opts, temp.path );
+	if( enabled_( opts, "load-obj" ) )
+		bench_load_obj_( opts, temp.path );
+
+	if( !allSame )
+	{
+		std::fprintf( stderr, "Results of make_indexed_mesh() differ from the reference implementation!\n" );
+		return 1;
+	}
+
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level exception [%s]:\n%s\nBye.\n", typeid(eErr).name(), eErr.what() );
+	return 1;
+}
+
+namespace
+{
+	bool bench_index_( Options_ const& aOpts )
+	{
+		Case_ const cases[] = {
+			{ "grid-512x512", [] { return make_grid_soup( 512, 512 ); } },
+			{ "grid-512x512-nonormals", [] { return make_grid_soup( 512, 512, false ); } },
+			{ "sphere-256x128", [] { return make_sphere_soup( 256, 128 ); } },
+			{ "sphere-256x128-noisy", [] {
+				auto soup = make_sphere_soup( 256, 128 );
+				add_noise( soup, 0.25f * kErrorTolerance );
+				return soup;
+			} },
+			{ "grid-256x256-x12", [] { return replicate_soup( make_grid_soup( 256, 256 ), 12, 300.f ); } },
+		};
+
+		std::printf( "\nmake_indexed_mesh(), tolerance %g\n", double(kErrorTolerance) );
+		std::printf( "%-24s %10s %10s %12s %12s %8s\n", "case", "soup", "indexed", "legacy", "grid", "speedup" );
+
+		bool allSame = true;
+		for( auto const& c : cases )
+		{
+			auto const soup = c.make();
+
+			IndexedMesh current;
+			double const currentMs = time_best_ms_( aOpts.repeat, [&] { current = make_indexed_mesh( soup, kErrorTolerance ); } );
+
+			if( aOpts.legacy )
+			{
+				IndexedMesh legacy;
+				double const legacyMs = time_best_ms_( aOpts.repeat, [&] { legacy = make_indexed_mesh_legacy( soup, kErrorTolerance ); } );
+
+				bool const same = same_mesh_( current, legacy );
+				allSame = allSame && same;
+
+				std::printf( "%-24s %10zu %10zu %9.2f ms %9.2f ms %7.2fx%s\n", c.name, soup.vert.size(), current.vert.size(), legacyMs, currentMs, legacyMs/currentMs, same ? "" : "  MISMATCH" );
+			}
+			else
+			{
+				std::printf( "%-24s %10zu %10zu %12s %9.2f ms %8s\n", c.name, soup.vert.size(), current.vert.size(), "-", currentMs, "-" );
+			}
+		}
+
+		// Indexing from OBJ index triples vs. expanding to a soup first
+		std::printf( "\nOBJ input: soup expansion + weld vs. index triples + weld\n" );
+		std::printf( "%-24s %10s %10s %12s %12s %8s\n", "case", "input", "indexed", "soup", "triples", "speedup" );
+
+		{
+			auto const model = make_grid_model( 1024, 1024 );
+			auto const& mesh = model.meshes[0];
+
+			IndexedMesh fromSoup, fromTriples;
+			double const soupMs = time_best_ms_( aOpts.repeat, [&] { fromSoup = make_indexed_mesh( expand_to_soup( model, mesh ), kErrorTolerance ); } );
+			double const triplesMs = time_best_ms_( aOpts.repeat, [&] { fromTriples = make_indexed_mesh( model, mesh, kErrorTolerance ); } );
+
+			bool const same = same_mesh_( fromSoup, fromTriples );
+			allSame = allSame && same;
+
+			std::printf( "%-24s %10zu %10zu %9.2f ms %9.2f ms %7.2fx%s\n", "grid-1024x1024", mesh.vertexCount, fromTriples.vert.size(), soupMs, triplesMs, soupMs/triplesMs, same ? "" : "  MISMATCH" );
+		}
+
+		// Tolerance sweep. The noisy grid only welds once the tolerance
+		// exceeds the noise.
+		Case_ const sweepCases[] = {
+			{ "grid-512x512", [] { return make_grid_soup( 512, 512 ); } },
+			{ "sphere-256x128-noisy", [] {
+				auto soup = make_sphere_soup( 256, 128 );
+				add_noise( soup, 0.25f * kErrorTolerance );
+				return soup;
+			} },
+			{ "grid-256x256-noisy", [] {
+				auto soup = make_grid_soup( 256, 256 );
+				add_noise( soup, 5e-5f );
+				return soup;
+			} },
+		};
+
+		print_throughput_header_( "make_indexed_mesh(), tolerance sweep", "tolerance" );
+		for( auto const& c : sweepCases )
+		{
+			auto const soup = c.make();
+
+			for( auto const tolerance : kToleranceSweep )
+			{
+				IndexedMesh result;
+				double const ms = time_best_ms_( aOpts.repeat, [&] { result = make_indexed_mesh( soup, tolerance ); } );
+
+				char name[64], second[32];
+				std::snprintf( name, sizeof(name), "%s => %zu", c.name, result.vert.size() );
+				std::snprintf( second, sizeof(second), "%g", double(tolerance) );
+				print_throughput_( name, second, soup.vert.size(), soup.vert.size()*kVertexBytes, ms );
+			}
+		}
+
+		// Thread sweep over a scene, one mesh per work item (as in cw2-bake)
+		auto const scene = make_scene_soups( kSceneMeshes, kSceneTriangles );
+
+		std::size_t sceneVerts = 0;
+		for( auto const& soup : scene )
+			sceneVerts += soup.vert.size();
+
+		print_throughput_header_( "make_indexed_mesh(), scene", "threads" );
+		for( auto const threads : aOpts.threads )
+		{
+			std::vector<IndexedMesh> results( scene.size() );
+			double const ms = time_best_ms_( aOpts.repeat, [&] {
+				lut::parallel_for( scene.size(), threads, [&] (std::size_t aI) {
+					results[aI] = make_indexed_mesh( scene[aI], kErrorTolerance );
+				} );
+			} );
+
+			print_throughput_( "scene", std::to_string( threads ).c_str(), sceneVerts, sceneVerts*kVertexBytes, ms );
+		}
+
+		return allSame;
+	}
+
+	void bench_normals_( Options_ const& aOpts )
+	{
+		// Meshes without normals, as from a scanner. ensure_normals() works
+		// in place, so each run gets its own copy, made before timing.
+		struct NormalCase_
+		{
+			char const* name;
+			IndexedMesh mesh;
+		};
+
+		NormalCase_ const cases[] = {
+			{ "sphere 1024x512", make_indexed_mesh( make_sphere_soup( 1024, 512, false ), kErrorTolerance ) },
+			{ "grid 1024x1024", make_indexed_mesh( make_grid_soup( 1024, 1024, false ), kErrorTolerance ) }
+		};
+
+		// Crease angles in degrees; 180 smooths across all edges
+		constexpr float kCreaseAngles[] = { 180.f, 30.f };
+
+		print_throughput_header_( "Normal generation", "threads" );
+
+		for( auto const& c : cases )
+		{
+			for( auto const crease : kCreaseAngles )
+			{
+				std::string const name = std::string( c.name ) + ", crease " + std::to_string( int(crease) );
+
+				for( auto const threads : aOpts.threads )
+				{
+					std::vector<IndexedMesh> copies( aOpts.repeat, c.mesh );
+
+					std::size_t run = 0;
+					double const ms = time_best_ms_( aOpts.repeat, [&] {
+						ensure_normals( copies[run++], glm::radians( crease ), threads );
+					} );
+
+					auto const verts = c.mesh.vert.size();
+					print_throughput_( name.c_str(), std::to_string( threads ).c_str(), verts, verts*kVertexBytes, ms );
+				}
+			}
+		}
+	}
+
+	void bench_tangents_( Options_ const& aOpts )
+	{
+		auto const scene = make_scene_meshes_();
+
+		std::size_t sceneVerts = 0;
+		for( auto const& mesh : scene )
+			sceneVerts += mesh.vert.size();
+
+		// The individual TGen steps, serially over all meshes. The inputs are
+		// prepared once, in the layout that compute_tangent_space() uses.
+		struct TGenMesh_
+		{
+			std::vector<tgen::VIndexT> indices;
+			std::vector<tgen::RealT> positions, normals, texcoords;
+			std::vector<tgen::RealT> cornerTangents, cornerBitangents;
+			std::vector<tgen::RealT> tangents, bitangents, tangents4;
+		};
+
+		std::vector<TGenMesh_> tmeshes( scene.size() );
+		for( std::size_t i = 0; i < scene.size(); ++i )
+		{
+			auto const& mesh = scene[i];
+			auto& tm = tmeshes[i];
+
+			tm.indices.assign( mesh.indices.begin(), mesh.indices.end() );
+			for( std::size_t v = 0; v < mesh.vert.size(); ++v )
+			{
+				for( int k = 0; k < 3; ++k )
+				{
+					tm.positions.emplace_back( mesh.vert[v][k] );
+					tm.normals.emplace_back( mesh.norm[v][k] );
+				}
+
+				tm.texcoords.emplace_back( mesh.text[v].x );
+				tm.texcoords.emplace_back( mesh.text[v].y );
+			}
+		}
+
+		print_throughput_header_( "Tangent space, scene", "threads" );
+
+		auto const tgen_step_ = [&] (char const* aName, auto&& aStep) {
+			double const ms = time_best_ms_( aOpts.repeat, [&] {
+				for( auto& tm : tmeshes )
+					aStep( tm );
+			} );
+			print_throughput_( aName, "1", sceneVerts, sceneVerts*kVertexBytes, ms );
+		};
+
+		tgen_step_( "tgen::computeCornerTSpace", [] (TGenMesh_& aM) {
+			tgen::computeCornerTSpace( aM.indices, aM.indices, aM.positions, aM.texcoords, aM.cornerTangents, aM.cornerBitangents );
+		} );
+		tgen_step_( "tgen::computeVertexTSpace", [] (TGenMesh_& aM) {
+			tgen::computeVertexTSpace( aM.indices, aM.cornerTangents, aM.cornerBitangents, aM.positions.size()/3, aM.tangents, aM.bitangents );
+		} );
+		tgen_step_( "tgen::orthogonalizeTSpace", [] (TGenMesh_& aM) {
+			// Works in place; repeated runs see already orthogonal input
+			tgen::orthogonalizeTSpace( aM.normals, aM.tangents, aM.bitangents );
+		} );
+		tgen_step_( "tgen::computeTangent4D", [] (TGenMesh_& aM) {
+			tgen::computeTangent4D( aM.normals, aM.tangents, aM.bitangents, aM.tangents4 );
+		} );
+
+		// All steps, including the conversions and packing, one mesh per work
+		// item (as in cw2-bake)
+		for( auto const threads : aOpts.threads )
+		{
+			auto meshes = scene;
+			double const ms = time_best_ms_( aOpts.repeat, [&] {
+				lut::parallel_for( meshes.size(), threads, [&] (std::size_t aI) {
+					compute_tangent_space( meshes[aI], meshes[aI].indices.size() );
+				} );
+			} );
+
+			print_throughput_( "compute_tangent_space", std::to_string( threads ).c_str(), sceneVerts, sceneVerts*kVertexBytes, ms );
+		}
+	}
+
+	void bench_encode_( Options_ const& aOpts )
+	{
+		// Deterministic inputs; see add_noise() for the random numbers
+		std::mt19937 rng( 1 );
+		auto const rand_ = [&] (float aMin, float aMax) {
+			float const unit = (rng() >> 8) * (1.f / float(1u << 24));
+			return aMin + unit*(aMax - aMin);
+		};
+
+		std::vector<glm::vec4> quats( kEncodeCount );
+		for( auto& q : quats )
+		{
+			glm::vec4 const v( rand_( -1.f, 1.f ), rand_( -1.f, 1.f ), rand_( -1.f, 1.f ), rand_( -1.f, 1.f ) );
+			q = glm::dot( v, v ) > 1e-6f ? glm::normalize( v ) : glm::vec4( 0.f, 0.f, 0.f, 1.f );
+		}
+
+		std::vector<glm::vec3> normals( kEncodeCount );
+		for( std::size_t i = 0; i < kEncodeCount; ++i )
+			normals[i] = glm::normalize( glm::vec3( quats[i] ) + glm::vec3( 0.f, 0.f, 1e-3f ) );
+
+		// Texture coordinates, including some outside of [0,1]
+		std::vector<float> values( kEncodeCount );
+		for( auto& x : values )
+			x = rand_( -2.f, 4.f );
+
+		std::vector<std::uint32_t> packed( kEncodeCount );
+		std::vector<std::uint16_t> halfs( kEncodeCount );
+		std::vector<OctahedralNormal> octs( kEncodeCount );
+
+		std::size_t const chunks = (kEncodeCount + kEncodeChunk-1) / kEncodeChunk;
+		auto const run_ = [&] (std::size_t aThreads, auto&& aFunc) {
+			return time_best_ms_( aOpts.repeat, [&] {
+				lut::parallel_for( chunks, aThreads, [&] (std::size_t aChunk) {
+					auto const end = std::min( kEncodeCount, (aChunk+1)*kEncodeChunk );
+					for( std::size_t i = aChunk*kEncodeChunk; i < end; ++i )
+						aFunc( i );
+				} );
+			} );
+		};
+
+		print_throughput_header_( "Vertex attribute encoding", "threads" );
+		for( auto const threads : aOpts.threads )
+		{
+			auto const t = std::to_string( threads );
+
+			double const quatMs = run_( threads, [&] (std::size_t aI) {
+				auto const& q = quats[aI];
+				packed[aI] = encode_quat( q.x, q.y, q.z, q.w );
+			} );
+			print_throughput_( "encode_quat", t.c_str(), kEncodeCount, kEncodeCount*sizeof(glm::vec4), quatMs );
+
+			double const halfMs = run_( threads, [&] (std::size_t aI) {
+				halfs[aI] = encode16_half( values[aI] );
+			} );
+			print_throughput_( "encode16_half", t.c_str(), kEncodeCount, kEncodeCount*sizeof(float), halfMs );
+
+			double const octMs = run_( threads, [&] (std::size_t aI) {
+				octs[aI] = encode_octahedral( normals[aI] );
+			} );
+			print_throughput_( "encode_octahedral", t.c_str(), kEncodeCount, kEncodeCount*sizeof(glm::vec3), octMs );
+		}
+
+		// Keep the results alive
+		std::uint32_t check = 0;
+		for( std::size_t i = 0; i < kEncodeCount; ++i )
+			check ^= packed[i] ^ halfs[i] ^ std::uint16_t(octs[i].x);
+		std::printf( "(checksum %08x)\n", unsigned(check) );
+	}
+
+	void check_baked_round_trip_( char const* aName, BakedModel const& aModel, std::vector<IndexedMesh> const& aScene )
+	{
+		if( aModel.meshes.size() != aScene.size() )
+			throw lut::Error( "%s: loaded %zu meshes, expected %zu", aName, aModel.meshes.size(), aScene.size() );
+
+		for( std::size_t m = 0; m < aScene.size(); ++m )
+		{
+			auto const& expected = aScene[m];
+			auto const& loaded = aModel.meshes[m];
+
+			std::size_t const V = expected.vert.size();
+			if( loaded.tangents.size() != V || loaded.packedTBN.size() != V || loaded.indexCount != expected.indices.size() )
+				throw lut::Error( "%s: mesh %zu has %zu vertices and %u indices, expected %zu and %zu", aName, m, loaded.tangents.size(), unsigned(loaded.indexCount), V, expected.indices.size() );
+
+			auto const fail_ = [&] (char const* aWhat, std::size_t aIndex) {
+				throw lut::Error( "%s: mesh %zu: %s %zu differs after the round trip", aName, m, aWhat, aIndex );
+			};
+
+			auto const index_ = [&] (std::size_t aI) -> std::uint32_t {
+				return loaded.indices16.empty() ? loaded.indices[aI] : loaded.indices16[aI];
+			};
+
+			for( std::size_t t = 0; t+2 < expected.indices.size(); t += 3 )
+			{
+				bool match = false;
+				for( std::size_t r = 0; r < 3 && !match; ++r )
+				{
+					match = index_( t+r ) == expected.indices[t]
+						&& index_( t+(r+1)%3 ) == expected.indices[t+1]
+						&& index_( t+(r+2)%3 ) == expected.indices[t+2];
+				}
+
+				if( !match )
+					fail_( "triangle", t/3 );
+			}
+
+			for( std::size_t i = 0; i < V; ++i )
+			{
+				if( loaded.tangents[i] != expected.tangent[i] || loaded.packedTBN[i] != expected.packedTbn[i] )
+					fail_( "tangent space of vertex", i );
+
+				if( !aModel.quantized )
+				{
+					if( loaded.positions[i] != expected.vert[i] || loaded.normals[i] != expected.norm[i] || loaded.texcoords[i] != expected.text[i] )
+						fail_( "vertex", i );
+
+					continue;
+				}
+
+				// Positions are within one quantization step, normals and
+				// texture coordinates within the precision of their encoding
+				glm::vec4 const q(
+					loaded.quantizedPositions[i*4+0] / 65535.f,
+					loaded.quantizedPositions[i*4+1] / 65535.f,
+					loaded.quantizedPositions[i*4+2] / 65535.f,
+					1.f
+				);
+				glm::vec3 const pos( aModel.dequantize * q );
+				glm::vec3 const step = glm::vec3( aModel.dequantize[0][0], aModel.dequantize[1][1], aModel.dequantize[2][2] ) / 65535.f;
+				auto const perr = glm::abs( pos - expected.vert[i] );
+				if( perr.x > step.x || perr.y > step.y || perr.z > step.z )
+					fail_( "position", i );
+
+				OctahedralNormal const oct{ loaded.octahedralNormals[i*2+0], loaded.octahedralNormals[i*2+1] };
+				if( glm::dot( decode_octahedral( oct ), glm::normalize( expected.norm[i] ) ) < 0.999f )
+					fail_( "normal", i );
+
+				for( std::size_t k = 0; k < 2; ++k )
+				{
+					float const uv = decode16_half( loaded.halfTexcoords[i*2+k] );
+					float const ref = expected.text[i][int(k)];
+					if( std::abs( uv - ref ) > 1e-3f * std::max( 1.f, std::abs( ref ) ) )
+						fail_( "texture coordinate", i );
+				}
+			}
+		}
+	}
+
+	void bench_load_baked_( Options_ const& aOpts, std::filesystem::path const& aTempDir )
+	{
+		auto scene = make_scene_meshes_();
+		for( auto& mesh : scene )
+			compute_tangent_space( mesh, mesh.indices.size() );
+
+		std::size_t sceneVerts = 0;
+		for( auto const& mesh : scene )
+			sceneVerts += mesh.vert.size();
+
+		struct Variant_
+		{
+			char const* name;
+			std::uint32_t features;
+		};
+
+		Variant_ const variants[] = {
+			{ "float32", 0 },
+			{ "quantized+index16", lut::kMeshFeatureQuantized | lut::kMeshFeatureIndex16 },
+			{ "compressed", lut::kMeshFeatureQuantized | lut::kMeshFeatureIndex16 | lut::kMeshFeatureCompressed },
+		};
+
+		print_throughput_header_( "load_baked_model(), scene (file size as bytes)", "threads" );
+		for( auto const& variant : variants )
+		{
+			auto const path = aTempDir / (std::string( variant.name ) + ".comp5822mesh");
+			auto const bytes = write_synthetic_baked( path, scene, variant.features );
+
+			for( auto const threads : aOpts.threads )
+			{
+				BakedModel model;
+				double const ms = time_best_ms_( aOpts.repeat, [&] { model = load_baked_model( path.string().c_str(), threads ); } );
+
+				check_baked_round_trip_( variant.name, model, scene );
+				print_throughput_( variant.name, std::to_string( threads ).c_str(), sceneVerts, bytes, ms );
+			}
+		}
+	}
+
+	void bench_load_obj_( Options_ const& aOpts, std::filesystem::path const& aTempDir )
+	{
+		// Both have the same faces. With many materials that change every
+		// few triangles, the faces of each shape are spread over many meshes.
+		struct ObjCase_
+		{
+			char const* name;
+			std::size_t materials, runLength;
+		};
+
+		ObjCase_ const cases[] = {
+			{ "16-shapes-1-material", 1, 1 },
+			{ "16-shapes-256-materials", 256, 4 },
+		};
+
+		print_throughput_header_( "load_wavefront_obj() with bucketing (file size as bytes)", "threads" );
+		for( auto const& c : cases )
+		{
+			auto const path = aTempDir / (std::string( c.name ) + ".obj");
+			auto const soupVerts = write_synthetic_obj( path, 16, 128, c.materials, c.runLength );
+			auto const bytes = std::filesystem::file_size( path );
+
+			for( auto const threads : aOpts.threads )
+			{
+				InputModel model;
+				double const ms = time_best_ms_( aOpts.repeat, [&] { model = load_wavefront_obj( path.string().c_str(), threads ); } );
+
+				if( model.vertices.size() != soupVerts )
+					throw lut::Error( "%s: loaded %zu vertices, expected %zu", c.name, model.vertices.size(), soupVerts );
+
+				print_throughput_( c.name, std::to_string( threads ).c_str(), soupVerts, bytes, ms );
+			}
+		}
+	}
+}
+
+namespace
+{
+	TempDir_ make_temp_dir_()
+	{
+		std::random_device rd;
+		std::uint64_t const tag = (std::uint64_t(rd()) << 32) ^ std::uint64_t(rd());
+
+		char name[32];
+		std::snprintf( name, sizeof(name), "cw2-bench-%016" PRIx64, tag );
+
+		auto path = std::filesystem::temp_directory_path() / name;
+		if( !std::filesystem::create_directory( path ) )
+			throw lut::Error( "Temporary directory '%s' exists already", path.string().c_str() );
+
+		return TempDir_{ std::move(path) };
+	}
+
+	Options_ parse_options_( int aArgc, char* aArgv[] )
+	{
+		// Usage: cw2-bench [--repeat N] [--no-legacy] [--threads N[,N...]] [--only GROUP]...
+		// Groups are index, normals, tangents, encode, load-baked and load-obj. By
+		// default, all groups run, and the thread sweeps use one thread and
+		// all hardware threads.
+		Options_ ret;
+
+		auto const parse_count_ = [&] (char const* aBeg, char const* aEnd) {
+			std::string const str( aBeg, aEnd );
+
+			char* end = nullptr;
+			auto const value = std::strtoul( str.c_str(), &end, 10 );
+			if( !end || *end != '\0' || 0 == value )
+				throw lut::Error( "Invalid count '%s'", str.c_str() );
+
+			return std::size_t(value);
+		};
+
+		for( int i = 1; i < aArgc; ++i )
+		{
+			if( 0 == std::strcmp( aArgv[i], "--repeat" ) && i+1 < aArgc )
+			{
+				++i;
+				ret.repeat = parse_count_( aArgv[i], aArgv[i] + std::strlen( aArgv[i] ) );
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--no-legacy" ) )
+			{
+				ret.legacy = false;
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--threads" ) && i+1 < aArgc )
+			{
+				char const* beg = aArgv[++i];
+				for( char const* end = std::strchr( beg, ',' ); end; end = std::strchr( beg, ',' ) )
+				{
+					ret.threads.emplace_back( parse_count_( beg, end ) );
+					beg = end+1;
+				}
+
+				ret.threads.emplace_back( parse_count_( beg, beg + std::strlen( beg ) ) );
+			}
+			else if( 0 == std::strcmp( aArgv[i], "--only" ) && i+1 < aArgc )
+			{
+				ret.only.emplace_back( aArgv[++i] );
+			}
+			else
+			{
+				throw lut::Error( "Unknown argument '%s'\nUsage: %s [--repeat N] [--no-legacy] [--threads N[,N...]] [--only GROUP]...", aArgv[i], aArgv[0] );
+			}
+		}
+
+		if( ret.threads.empty() )
+		{
+			ret.threads.emplace_back( 1 );
+			if( lut::default_worker_count() > 1 )
+				ret.threads.emplace_back( lut::default_worker_count() );
+		}
+
+		return ret;
+	}
+
+	bool enabled_( Options_ const& aOpts, char const* aGroup )
+	{
+		return aOpts.only.empty() || aOpts.only.end() != std::find( aOpts.only.begin(), aOpts.only.end(), aGroup );
+	}
+
+	template< typename tFunc >
+	double time_best_ms_( std::size_t aRepeat, tFunc&& aFunc )
+	{
+		using Clock_ = std::chrono::steady_clock;
+
+		double best = 0.0;
+		for( std::size_t i = 0; i < aRepeat; ++i )
+		{
+			auto const start = Clock_::now();
+			aFunc();
+			auto const end = Clock_::now();
+
+			double const ms = std::chrono::duration<double,std::milli>( end-start ).count();
+			if( 0 == i || ms < best )
+				best = ms;
+		}
+
+		return best;
+	}
+
+	void print_throughput_header_( char const* aTitle, char const* aSecondColumn )
+	{
+		std::printf( "\n%s\n", aTitle );
+		std::printf( "%-36s %10s %10s %12s %10s %10s\n", "case", aSecondColumn, "vertices", "time", "Mvert/s", "MB/s" );
+	}
+
+	void print_throughput_( char const* aName, char const* aSecond, std::size_t aVertices, std::uint64_t aBytes, double aMs )
+	{
+		double const seconds = aMs * 1e-3;
+		double const mverts = seconds > 0.0 ? double(aVertices) / seconds * 1e-6 : 0.0;
+		double const mbytes = seconds > 0.0 ? double(aBytes) / seconds * 1e-6 : 0.0;
+
+		std::printf( "%-36s %10s %10zu %9.2f ms %10.2f %10.2f\n", aName, aSecond, aVertices, aMs, mverts, mbytes );
+	}
+
+	std::vector<IndexedMesh> make_scene_meshes_()
+	{
+		auto const soups = make_scene_soups( kSceneMeshes, kSceneTriangles );
+
+		std::vector<IndexedMesh> ret;
+		for( auto const& soup : soups )
+			ret.emplace_back( make_indexed_mesh( soup, kErrorTolerance ) );
+
+		return ret;
+	}
+
+	bool same_mesh_( IndexedMesh const& aA, IndexedMesh const& aB )
+	{
+		return aA.vert == aB.vert
+			&& aA.norm == aB.norm
+			&& aA.text == aB.text
+			&& aA.indices == aB.indices
+		;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,364 @@
+#include "synthetic.hpp"
+
+#include <limits>
+#include <random>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#include "../cw2-bake/mesh_writer.hpp"
+#include "../cw2-bake/output_file.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/mesh_file.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	constexpr float kPi_ = 3.1415926f;
+
+	struct FileCloser_
+	{
+		FILE* file;
+		~FileCloser_() { if( file ) std::fclose( file ); }
+	};
+
+	FILE* open_for_writing_( std::filesystem::path const& aPath )
+	{
+		FILE* ret = std::fopen( aPath.string().c_str(), "wb" );
+		if( !ret )
+			throw lut::Error( "Unable to open '%s' for writing", aPath.string().c_str() );
+
+		return ret;
+	}
+}
+
+TriangleSoup make_grid_soup( std::size_t aQuadsX, std::size_t aQuadsY, bool aWithNormals )
+{
+	TriangleSoup ret;
+
+	std::size_t const verts = aQuadsX*aQuadsY*6;
+	ret.vert.reserve( verts );
+	ret.text.reserve( verts );
+	if( aWithNormals )
+		ret.norm.reserve( verts );
+
+	auto const emit = [&] (std::size_t aX, std::size_t aY) {
+		float const u = float(aX) / aQuadsX;
+		float const v = float(aY) / aQuadsY;
+
+		ret.vert.emplace_back( glm::vec3( u*aQuadsX, 0.f, v*aQuadsY ) );
+		ret.text.emplace_back( glm::vec2( u, v ) );
+		if( aWithNormals )
+			ret.norm.emplace_back( glm::vec3( 0.f, 1.f, 0.f ) );
+	};
+
+	for( std::size_t y = 0; y < aQuadsY; ++y )
+	{
+		for( std::size_t x = 0; x < aQuadsX; ++x )
+		{
+			emit( x, y ); emit( x, y+1 ); emit( x+1, y+1 );
+			emit( x, y ); emit( x+1, y+1 ); emit( x+1, y );
+		}
+	}
+
+	return ret;
+}
+
+TriangleSoup make_sphere_soup( std::size_t aSlices, std::size_t aStacks, bool aWithNormals )
+{
+	TriangleSoup ret;
+
+	std::size_t const verts = aSlices*aStacks*6;
+	ret.vert.reserve( verts );
+	ret.text.reserve( verts );
+	if( aWithNormals )
+		ret.norm.reserve( verts );
+
+	auto const emit = [&] (std::size_t aSlice, std::size_t aStack) {
+		float const u = float(aSlice) / aSlices;
+		float const v = float(aStack) / aStacks;
+
+		float const phi = u * 2.f * kPi_;
+		float const theta = v * kPi_;
+
+		glm::vec3 const n( std::sin(theta)*std::cos(phi), std::cos(theta), std::sin(theta)*std::sin(phi) );
+
+		ret.vert.emplace_back( n );
+		ret.text.emplace_back( glm::vec2( u, v ) );
+		if( aWithNormals )
+			ret.norm.emplace_back( n );
+	};
+
+	for( std::size_t j = 0; j < aStacks; ++j )
+	{
+		for( std::size_t i = 0; i < aSlices; ++i )
+		{
+			emit( i, j ); emit( i+1, j ); emit( i+1, j+1 );
+			emit( i, j ); emit( i+1, j+1 ); emit( i, j+1 );
+		}
+	}
+
+	return ret;
+}
+
+void add_noise( TriangleSoup& aSoup, float aAmplitude, std::uint32_t aSeed )
+{
+	// Not using std::uniform_real_distribution, as its output differs between
+	// standard library implementations.
+	std::mt19937 rng( aSeed );
+	auto const rand = [&] {
+		float const unit = (rng() >> 8) * (1.f / float(1u << 24));
+		return (2.f*unit - 1.f) * aAmplitude;
+	};
+
+	for( auto& v : aSoup.vert )
+		v += glm::vec3( rand(), rand(), rand() );
+	for( auto& n : aSoup.norm )
+		n += glm::vec3( rand(), rand(), rand() );
+	for( auto& t : aSoup.text )
+		t += glm::vec2( rand(), rand() );
+}
+
+TriangleSoup replicate_soup( TriangleSoup const& aSoup, std::size_t aCount, float aOffset )
+{
+	TriangleSoup ret;
+	ret.vert.reserve( aSoup.vert.size()*aCount );
+	ret.norm.reserve( aSoup.norm.size()*aCount );
+	ret.text.reserve( aSoup.text.size()*aCount );
+
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		glm::vec3 const offset( i*aOffset, 0.f, 0.f );
+		for( auto const& v : aSoup.vert )
+			ret.vert.emplace_back( v + offset );
+
+		ret.norm.insert( ret.norm.end(), aSoup.norm.begin(), aSoup.norm.end() );
+		ret.text.insert( ret.text.end(), aSoup.text.begin(), aSoup.text.end() );
+	}
+
+	return ret;
+}
+
+InputModel make_grid_model( std::size_t aQuadsX, std::size_t aQuadsY )
+{
+	InputModel ret;
+	ret.modelSourcePath = "<synthetic grid>";
+
+	for( std::size_t y = 0; y <= aQuadsY; ++y )
+	{
+		for( std::size_t x = 0; x <= aQuadsX; ++x )
+		{
+			float const u = float(x) / aQuadsX;
+			float const v = float(y) / aQuadsY;
+
+			ret.positions.emplace_back( glm::vec3( u*aQuadsX, 0.f, v*aQuadsY ) );
+			ret.texcoords.emplace_back( glm::vec2( u, v ) );
+		}
+	}
+
+	ret.normals.emplace_back( glm::vec3( 0.f, 1.f, 0.f ) );
+
+	auto const emit = [&] (std::size_t aX, std::size_t aY) {
+		auto const idx = std::uint32_t(aY*(aQuadsX+1) + aX);
+		ret.vertices.emplace_back( InputVertex{ idx, 0, idx } );
+	};
+
+	for( std::size_t y = 0; y < aQuadsY; ++y )
+	{
+		for( std::size_t x = 0; x < aQuadsX; ++x )
+		{
+			emit( x, y ); emit( x, y+1 ); emit( x+1, y+1 );
+			emit( x, y ); emit( x+1, y+1 ); emit( x+1, y );
+		}
+	}
+
+	ret.meshes.emplace_back( InputMeshInfo{ "grid", 0, 0, ret.vertices.size() } );
+	return ret;
+}
+
+TriangleSoup expand_to_soup( InputModel const& aModel, InputMeshInfo const& aMesh )
+{
+	TriangleSoup ret;
+	ret.vert.reserve( aMesh.vertexCount );
+	ret.norm.reserve( aMesh.vertexCount );
+	ret.text.reserve( aMesh.vertexCount );
+
+	for( std::size_t i = 0; i < aMesh.vertexCount; ++i )
+	{
+		auto const& v = aModel.vertices[aMesh.vertexStartIndex+i];
+		ret.vert.emplace_back( aModel.positions[v.position] );
+		ret.norm.emplace_back( aModel.normals[v.normal] );
+		ret.text.emplace_back( aModel.texcoords[v.texcoord] );
+	}
+
+	return ret;
+}
+
+std::vector<TriangleSoup> make_scene_soups( std::size_t aMeshCount, std::size_t aTriangles )
+{
+	std::vector<TriangleSoup> ret;
+
+	std::size_t const perMesh = std::max( std::size_t(8), aTriangles / std::max( std::size_t(1), aMeshCount ) );
+
+	float offset = 0.f;
+	for( std::size_t i = 0; i < aMeshCount; ++i )
+	{
+		// Spheres have 4*k*k triangles (2k slices, k stacks), grids 2*k*k
+		TriangleSoup soup;
+		if( i % 2 )
+		{
+			auto const k = std::max( std::size_t(2), std::size_t(std::sqrt( perMesh / 2.0 )) );
+			soup = make_grid_soup( k, k );
+		}
+		else
+		{
+			auto const k = std::max( std::size_t(2), std::size_t(std::sqrt( perMesh / 4.0 )) );
+			soup = make_sphere_soup( 2*k, k );
+		}
+
+		float maxX = 0.f;
+		for( auto& v : soup.vert )
+		{
+			v.x += offset;
+			maxX = std::max( maxX, v.x );
+		}
+
+		offset = maxX + 1.f;
+		ret.emplace_back( std::move(soup) );
+	}
+
+	return ret;
+}
+
+std::size_t write_synthetic_obj( std::filesystem::path const& aPath, std::size_t aShapes, std::size_t aQuads, std::size_t aMaterials, std::size_t aRunLength )
+{
+	assert( aMaterials > 0 && aRunLength > 0 );
+
+	auto mtlPath = aPath;
+	mtlPath.replace_extension( "mtl" );
+
+	{
+		FileCloser_ mtl{ open_for_writing_( mtlPath ) };
+		for( std::size_t i = 0; i < aMaterials; ++i )
+			std::fprintf( mtl.file, "newmtl mat%zu\nKd %.3f 0.5 0.5\n", i, double(i % 256) / 255.0 );
+	}
+
+	FileCloser_ obj{ open_for_writing_( aPath ) };
+	std::fprintf( obj.file, "mtllib %s\n", mtlPath.filename().string().c_str() );
+	std::fprintf( obj.file, "vn 0 1 0\n" );
+
+	std::size_t const side = aQuads+1;
+	std::size_t soupVertices = 0;
+
+	for( std::size_t s = 0; s < aShapes; ++s )
+	{
+		float const offset = float(s*(aQuads+2));
+
+		std::fprintf( obj.file, "o shape%zu\n", s );
+
+		for( std::size_t y = 0; y < side; ++y )
+		{
+			for( std::size_t x = 0; x < side; ++x )
+			{
+				std::fprintf( obj.file, "v %g 0 %g\n", double(offset + x), double(y) );
+				std::fprintf( obj.file, "vt %g %g\n", double(x) / aQuads, double(y) / aQuads );
+			}
+		}
+
+		// Positions and texture coordinates share (1-based) indices
+		std::size_t const base = s*side*side + 1;
+		auto const idx_ = [&] (std::size_t aX, std::size_t aY) { return base + aY*side + aX; };
+
+		std::size_t triangle = 0;
+		auto const face_ = [&] (std::size_t aA, std::size_t aB, std::size_t aC) {
+			if( 0 == triangle % aRunLength )
+				std::fprintf( obj.file, "usemtl mat%zu\n", (triangle / aRunLength) % aMaterials );
+
+			std::fprintf( obj.file, "f %zu/%zu/1 %zu/%zu/1 %zu/%zu/1\n", aA, aA, aB, aB, aC, aC );
+			++triangle;
+		};
+
+		for( std::size_t y = 0; y < aQuads; ++y )
+		{
+			for( std::size_t x = 0; x < aQuads; ++x )
+			{
+				face_( idx_( x, y ), idx_( x, y+1 ), idx_( x+1, y+1 ) );
+				face_( idx_( x, y ), idx_( x+1, y+1 ), idx_( x+1, y ) );
+			}
+		}
+
+		soupVertices += triangle*3;
+	}
+
+	if( std::ferror( obj.file ) )
+		throw lut::Error( "Error writing '%s'", aPath.string().c_str() );
+
+	return soupVertices;
+}
+
+std::uint64_t write_synthetic_baked( std::filesystem::path const& aPath, std::vector<IndexedMesh> const& aMeshes, std::uint32_t aFeatures )
+{
+	OutputFile out( aPath );
+
+	// Header, one texture, and one material using it
+	out.write( 16, lut::kMeshFileMagic );
+	out.write( 16, lut::kMeshFileVariant );
+	out.write( sizeof(aFeatures), &aFeatures );
+
+	char const texture[] = "synthetic.tex";
+	std::uint32_t const textureCount = 1, textureLength = sizeof(texture);
+	out.write( sizeof(textureCount), &textureCount );
+	out.write( sizeof(textureLength), &textureLength );
+	out.write( sizeof(texture), texture );
+
+	std::uint8_t const channels = 4;
+	out.write( sizeof(channels), &channels );
+
+	std::uint32_t const materialCount = 1;
+	std::uint32_t const material[] = { 0, 0, 0, 0xffffffff, 0xffffffff };
+	out.write( sizeof(materialCount), &materialCount );
+	out.write( sizeof(material), material );
+
+	// Meshes; written like cw2-bake does (see cw2-bake/mesh_writer.hpp)
+	bool const quantized = aFeatures & lut::kMeshFeatureQuantized;
+
+	QuantizationBox box{ glm::vec3( std::numeric_limits<float>::max() ), glm::vec3( std::numeric_limits<float>::lowest() ) };
+	for( auto const& mesh : aMeshes )
+	{
+		box.min = glm::min( box.min, mesh.aabbMin );
+		box.max = glm::max( box.max, mesh.aabbMax );
+	}
+
+	if( quantized )
+	{
+		out.write( sizeof(glm::vec3), &box.min );
+		out.write( sizeof(glm::vec3), &box.max );
+	}
+
+	std::uint32_t const meshCount = std::uint32_t(aMeshes.size());
+	out.write( sizeof(meshCount), &meshCount );
+
+	std::vector<MeshLod> const noLods;
+	for( auto const& mesh : aMeshes )
+	{
+		if( (aFeatures & lut::kMeshFeatureIndex16) && mesh.vert.size() > 65536 )
+			throw lut::Error( "Too many vertices (%zu) for 16-bit indices", mesh.vert.size() );
+
+		QuantizedMesh qmesh;
+		if( quantized )
+			qmesh = quantize_mesh( mesh, box );
+
+		write_mesh( out, 0, mesh, noLods, quantized ? &qmesh : nullptr, nullptr, aFeatures );
+	}
+
+	auto const size = out.offset();
+	out.commit();
+	return size;
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,78 @@
+#ifndef SYNTHETIC_HPP_7C3D9A12_5E8B_4F61_A0D4_3B9E1F26C845
+#define SYNTHETIC_HPP_7C3D9A12_5E8B_4F61_A0D4_3B9E1F26C845
+
+#include <vector>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../cw2-bake/index_mesh.hpp"
+#include "../cw2-bake/input_model.hpp"
+
+// Synthetic triangle soups for benchmarking. The soups are expanded the same
+// way the baker expands OBJ files, i.e., three vertices per triangle.
+
+// Flat grid of aQuadsX by aQuadsY quads (two triangles each) in the XZ plane.
+// Interior vertices are shared by six triangles.
+TriangleSoup make_grid_soup(
+	std::size_t aQuadsX,
+	std::size_t aQuadsY,
+	bool aWithNormals = true
+);
+
+// UV sphere with aSlices by aStacks quads. The texture seam and the poles
+// contain vertices that coincide in position but not in texture coordinates.
+TriangleSoup make_sphere_soup(
+	std::size_t aSlices,
+	std::size_t aStacks,
+	bool aWithNormals = true
+);
+
+// Displace all vertex attributes by a random amount in [-aAmplitude,
+// aAmplitude]. Deterministic for a given seed.
+void add_noise( TriangleSoup&, float aAmplitude, std::uint32_t aSeed = 1 );
+
+// Concatenate aCount copies of a soup, each shifted by aOffset along X.
+TriangleSoup replicate_soup( TriangleSoup const&, std::size_t aCount, float aOffset );
+
+// Single-mesh InputModel with the same grid as make_grid_soup(), referencing
+// shared attributes through OBJ-style index triples.
+InputModel make_grid_model( std::size_t aQuadsX, std::size_t aQuadsY );
+
+// Expand a mesh of an InputModel into a triangle soup, like the baker did
+// before indexing from OBJ index triples.
+TriangleSoup expand_to_soup( InputModel const&, InputMeshInfo const& );
+
+// Scene of aMeshCount meshes with about aTriangles triangles in total,
+// alternating between spheres and grids, each placed next to the previous
+// one. For example, the Sponza model has about 260k triangles in 25 meshes
+// (after merging by material).
+std::vector<TriangleSoup> make_scene_soups( std::size_t aMeshCount, std::size_t aTriangles );
+
+// Write an OBJ file with aShapes shapes ('o') of aQuads by aQuads quads each,
+// and a material library with aMaterials materials next to it (same name,
+// with the .mtl extension). Within each shape, the material changes every
+// aRunLength triangles, cycling through all materials. Returns the number of
+// triangle soup vertices, i.e., three per triangle.
+std::size_t write_synthetic_obj(
+	std::filesystem::path const&,
+	std::size_t aShapes,
+	std::size_t aQuads,
+	std::size_t aMaterials,
+	std::size_t aRunLength
+);
+
+// Write a baked model (see cw2/baked_model.hpp) with the meshes, which must
+// have a tangent space (see compute_tangent_space()). The model has a single
+// material and no levels of detail or meshlets. aFeatures is a combination of
+// the kMeshFeature* flags in labutils/mesh_file.hpp, without meshlets, LODs
+// or packed ORM. With kMeshFeatureIndex16, meshes may have at most 65536
+// vertices. Returns the size of the file in bytes.
+std::uint64_t write_synthetic_baked(
+	std::filesystem::path const&,
+	std::vector<IndexedMesh> const&,
+	std::uint32_t aFeatures
+);
+
+#endif // SYNTHETIC_HPP_7C3D9A12_5E8B_4F61_A0D4_3B9E1F26C845
@@ -1,25 +1,44 @@
 #include "baked_model.hpp"
 
+#include <limits>
+#include <algorithm>
+
 #include <cstdio>
+#include <cassert>
 #include <cstring>
-#include <glm/gtc/quaternion.hpp>
+#include <glm/glm.hpp>
 #include "../labutils/error.hpp"
-#include "compute.h"
+#include "../labutils/parallel.hpp"
+#include "../labutils/mesh_file.hpp"
+#include "../labutils/geometry_codec.hpp"
 namespace lut = labutils;
 
 namespace
 {
-	// See cw2-bake/main.cpp for more info
-	constexpr char kFileMagic[16] = "\0\0COMP5822Mmesh";
-	constexpr char kFileVariant[16] = "default";
+	// File magic, variant and feature flags: see labutils/mesh_file.hpp
+
+	// Sanity limit for the number of levels of detail per mesh
+	constexpr std::uint32_t kMaxLods = 64;
 
 	constexpr std::uint32_t kMaxString = 32*1024;
 
 	// functions
-	BakedModel load_baked_model_( FILE*, char const* );
+	BakedModel load_baked_model_( FILE*, char const*, std::size_t aWorkerCount, bool aDecodeStreams );
+
+	// Resize the attribute and index vectors of the mesh for its vertex and
+	// index counts
+	void resize_streams_( BakedMeshData&, std::uint32_t aFeatures );
+
+	// Data of stream aStream of the mesh, in the vectors sized by
+	// resize_streams_()
+	void* stream_data_( BakedMeshData&, std::uint32_t aFeatures, std::size_t aStream );
+
+	// Bounding sphere around the center of the bounding box, with the
+	// radius from the actual vertices
+	void compute_bounds_( BakedMeshData&, glm::vec3 const* aPositions, std::size_t aCount );
 }
 
-BakedModel load_baked_model( char const* aModelPath )
+BakedModel load_baked_model( char const* aModelPath, std::size_t aWorkerCount, bool aDecodeStreams )
 {
 	FILE* fin = std::fopen( aModelPath, "rb" );
 	if( !fin )
@@ -27,7 +46,7 @@ BakedModel load_baked_model( char const* aModelPath )
 
 	try
 	{
-		auto ret = load_baked_model_( fin, aModelPath );
+		auto ret = load_baked_model_( fin, aModelPath, aWorkerCount ? aWorkerCount : lut::default_worker_count(), aDecodeStreams );
 		std::fclose( fin );
 		return ret;
 	}
@@ -38,6 +57,42 @@ BakedModel load_baked_model( char const* aModelPath )
 	}
 }
 
+std::size_t baked_mesh_stream_bytes( BakedMeshData const& aMesh, std::uint32_t aFeatures, std::size_t aStream )
+{
+	auto const layout = lut::mesh_file_stream( aFeatures, aStream );
+	std::size_t const count = lut::MeshFileStream::indices == layout.stream ? aMesh.indexCount : aMesh.vertexCount;
+	return count * layout.elementSize;
+}
+
+void const* baked_mesh_stream( BakedMeshData const& aMesh, std::uint32_t aFeatures, std::size_t aStream )
+{
+	return stream_data_( const_cast<BakedMeshData&>(aMesh), aFeatures, aStream );
+}
+
+void decode_baked_mesh( BakedMeshData& aMesh, std::uint32_t aFeatures, void* const (&aDest)[lut::kMeshFileStreamCount], std::size_t aWorkerCount )
+{
+	assert( aMesh.encodedOffsets.size() == lut::kMeshFileStreamCount+1 );
+
+	lut::parallel_for( lut::kMeshFileStreamCount, aWorkerCount, [&] (std::size_t aStream) {
+		auto const layout = lut::mesh_file_stream( aFeatures, aStream );
+		auto const begin = aMesh.encodedOffsets[aStream], end = aMesh.encodedOffsets[aStream+1];
+
+		if( lut::MeshFileStream::indices == layout.stream )
+			lut::decode_index_stream( aDest[aStream], aMesh.indexCount, layout.elementSize, aMesh.vertexCount, aMesh.encoded.data() + begin, end - begin );
+		else
+		{
+			std::vector<std::uint8_t> scratch;
+			lut::decode_geometry_stream( aDest[aStream], aMesh.vertexCount, layout.elementSize, layout.componentSize, aMesh.encoded.data() + begin, end - begin, scratch );
+		}
+	} );
+
+	if( !(aFeatures & lut::kMeshFeatureQuantized) )
+	{
+		assert( lut::MeshFileStream::position == lut::mesh_file_stream( aFeatures, 0 ).stream );
+		compute_bounds_( aMesh, static_cast<glm::vec3 const*>(aDest[0]), aMesh.vertexCount );
+	}
+}
+
 namespace
 {
 	void checked_read_( FILE* aFin, std::size_t aBytes, void* aBuffer )
@@ -68,142 +123,7 @@ namespace
 		return ret;
 	}
 
-	float rsqrt(float x)
-	{
-		return 1/std::sqrt(x);
-	}
-
-	float remap(float x, float min1, float max1, float min2, float max2)
-	{
-		return (((x - min1) / (max1 - min1)) * (max2 - min2)) + min2;
-	}
-
-	 template<unsigned N>
-	uint16_t  encode_unorm( float x )
-	{
-		return uint16_t( int (x * ((1<<(N))-1) + 0.5f) );
-	}
-
-	template<unsigned N>
-	uint16_t  encode_snorm(float x)
-	{
-		return (x < 0) | (encode_unorm<N - 1>(x < 0 ? -x : x) << 1);
-	}
-
-	union FP32 {
-		uint32_t u;
-		float f;
-		struct {
-			uint32_t Mantissa : 23;
-			uint32_t Exponent : 8;
-			uint32_t Sign : 1;
-		};
-	};
-
-	union FP16 {
-		uint16_t u;
-		struct {
-			uint32_t Mantissa : 10;
-			uint32_t Exponent : 5;
-			uint32_t Sign : 1;
-		};
-	};
-
-	uint16_t encode16_half(float fl) {
-		FP16 o = { 0 };
-		FP32 f; f.f = fl;
-		// Based on ISPC reference code (with minor modifications)
-		if (f.Exponent == 0) {
-			// if Signed zero/denormal (which will underflow)
-			o.Exponent = 0;
-		}
-		else if (f.Exponent == 255) {
-			// if Inf or NaN (all exponent bits set)
-			o.Exponent = 31;
-			o.Mantissa = f.Mantissa ? 0x200 : 0; // NaN->qNaN and Inf->Inf
-		}
-		else {
-			// if Normalized number
-			// Exponent unbias the single, then bias the halfp
-			int newexp = f.Exponent - 127 + 15;
-			if (newexp >= 31) {
-				// if Overflow, return signed infinity
-				o.Exponent = 31;
-			}
-			else if (newexp <= 0) {
-				// if Underflow
-				if ((14 - newexp) <= 24) {
-					// Mantissa might be non-zero
-					uint32_t mant = f.Mantissa | 0x800000; // Hidden 1 bit
-					o.Mantissa = mant >> (14 - newexp);
-					// Check for rounding
-					if ((mant >> (13 - newexp)) & 1) {
-						// Round, might overflow into exp bit, but this is OK
-						o.u++;
-					}
-				}
-			}
-			else {
-				o.Exponent = newexp;
-				o.Mantissa = f.Mantissa >> 13;
-				// Check for rounding
-				if (f.Mantissa & 0x1000) {
-					// Round, might overflow to inf, this is OK
-					o.u++;
-				}
-			}
-		}
-		o.Sign = f.Sign;
-		return o.u;
-	}
-
-	template<unsigned N>
-	uint16_t  encode_half( float fl )
-	{
-		return encode16_half(fl) >> (16-N);
-	}
-
-
-	void encode_quat(uint32_t &out,float x, float y, float z,float w)
-	{
-		const float rmin = -rsqrt(2), rmax = rsqrt(2);
-		float x2 = x*x , y2 = y*y , z2 = z*z , w2 = w * w;
-		if (x2 >= y2 && x2 >= z2 && x2 >= w2)
-		{
-			y = remap(y, rmin, rmax, -1, 1);
-			z = remap(z, rmin, rmax, -1, 1);
-			w = remap(w, rmin, rmax, -1, 1);
-			out = x >= 0 ? static_cast<uint32_t>((0 << 30) | (encode_snorm<10>(y) << 20) | (encode_snorm<10>(z) << 10) | (encode_snorm<10>(w) << 0))
-				: static_cast<uint32_t>((0 << 30) | (encode_snorm<10>(-y) << 20) | (encode_snorm<10>(-z) << 10) | (encode_snorm<10>(-w) << 0));
-		}
-		else if (y2 >= z2 && y2 >= w2)
-		{
-			x = remap(x, rmin, rmax, -1, 1);
-			z = remap(z, rmin, rmax, -1, 1);
-			w = remap(w, rmin, rmax, -1, 1);
-			out = y >= 0 ? static_cast<uint32_t>((1 << 30) | (encode_snorm<10>(x) << 20) | (encode_snorm<10>(z) << 10) | (encode_snorm<10>(w) << 0))
-				: static_cast<uint32_t>((1 << 30) | (encode_snorm<10>(-x) << 20) | (encode_snorm<10>(-z) << 10) | (encode_snorm<10>(-w) << 0));
-		}
-		else if(z2 >= w2)
-		{
-			x = remap(x, rmin, rmax, -1, 1);
-			y = remap(y, rmin, rmax, -1, 1);
-			w = remap(w, rmin, rmax, -1, 1);
-			out = y >= 0 ? static_cast<uint32_t>((2 << 30) | (encode_snorm<10>(x) << 20) | (encode_snorm<10>(y) << 10) | (encode_snorm<10>(w) << 0))
-				: static_cast<uint32_t>((2 << 30) | (encode_snorm<10>(-x) << 20) | (encode_snorm<10>(-y) << 10) | (encode_snorm<10>(-w) << 0));
-		}
-		else
-		{
-			x = remap(x, rmin, rmax, -1, 1);
-			y = remap(y, rmin, rmax, -1, 1);
-			z = remap(z, rmin, rmax, -1, 1);
-			out = y >= 0 ? static_cast<uint32_t>((3 << 30) | (encode_snorm<10>(x) << 20) | (encode_snorm<10>(y) << 10) | (encode_snorm<10>(z) << 0))
-				: static_cast<uint32_t>((3 << 30) | (encode_snorm<10>(-x) << 20) | (encode_snorm<10>(-y) << 10) | (encode_snorm<10>(-z) << 0));
-		}
-	}
-
-
-	BakedModel load_baked_model_( FILE* aFin, char const* aInputName )
+	BakedModel load_baked_model_( FILE* aFin, char const* aInputName, std::size_t aWorkerCount, bool aDecodeStreams )
 	{
 		BakedModel ret;
 
@@ -220,14 +140,18 @@ namespace
 		char magic[16];
 		checked_read_( aFin, 16, magic );
 
-		if( 0 != std::memcmp( magic, kFileMagic, 16 ) )
+		if( 0 != std::memcmp( magic, lut::kMeshFileMagic, 16 ) )
 			throw lut::Error( "load_baked_model_(): %s: invalid file signature!", aInputName );
 
 		char variant[16];
 		checked_read_( aFin, 16, variant );
 
-		if( 0 != std::memcmp( variant, kFileVariant, 16 ) )
-			throw lut::Error( "load_baked_model_(): %s: file variant is '%s', expected '%s'", aInputName, variant, kFileVariant );
+		if( 0 != std::memcmp( variant, lut::kMeshFileVariant, 16 ) )
+			throw lut::Error( "load_baked_model_(): %s: file variant is '%s', expected '%s'", aInputName, variant, lut::kMeshFileVariant );
+
+		auto const features = read_uint32_( aFin );
+		if( features & ~lut::kMeshKnownFeatures )
+			throw lut::Error( "load_baked_model_(): %s: unsupported features (0x%x)", aInputName, features & ~lut::kMeshKnownFeatures );
 
 		// Read texture info
 		auto const textureCount = read_uint32_( aFin );
@@ -261,8 +185,30 @@ namespace
 			ret.materials.emplace_back( std::move(info) );
 		}
 
+		ret.features = features;
+		ret.packedOrm = 0 != (features & lut::kMeshFeaturePackedOrm);
+
 		// Read mesh data
+		ret.quantized = 0 != (features & lut::kMeshFeatureQuantized);
+		ret.dequantize = glm::mat4( 1.f );
+
+		if( ret.quantized )
+		{
+			glm::vec3 boxMin, boxMax;
+			checked_read_( aFin, sizeof(glm::vec3), &boxMin );
+			checked_read_( aFin, sizeof(glm::vec3), &boxMax );
+
+			// translate(boxMin) * scale(boxMax - boxMin)
+			auto const extent = boxMax - boxMin;
+			ret.dequantize[0][0] = extent.x;
+			ret.dequantize[1][1] = extent.y;
+			ret.dequantize[2][2] = extent.z;
+			ret.dequantize[3] = glm::vec4( boxMin, 1.f );
+		}
+
 		auto const meshCount = read_uint32_( aFin );
+		bool const compressed = 0 != (features & lut::kMeshFeatureCompressed);
+
 		for( std::uint32_t i = 0; i < meshCount; ++i )
 		{
 			BakedMeshData data;
@@ -272,114 +218,120 @@ namespace
 			auto const V = read_uint32_( aFin );
 			auto const I = read_uint32_( aFin );
 
-			data.positions.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
+			if( features & lut::kMeshFeatureIndex16 && V > 65536 )
+				throw lut::Error( "load_baked_model_(): %s: too many vertices (%u) for 16-bit indices", aInputName, V );
 
-			data.normals.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
+			if( ret.quantized )
+			{
+				// Bounding sphere around the center of the bounding box; used
+				// for LOD selection and culling. Quantized meshes only provide
+				// the box. Otherwise, see below.
+				glm::vec3 bmin, bmax;
+				checked_read_( aFin, sizeof(glm::vec3), &bmin );
+				checked_read_( aFin, sizeof(glm::vec3), &bmax );
 
-			data.texcoords.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
+				data.boundsCenter = V ? 0.5f * (bmin + bmax) : glm::vec3( 0.f );
+				data.boundsRadius = V ? 0.5f * glm::length( bmax - bmin ) : 0.f;
+			}
 
-			data.indices.resize( I );
-			checked_read_( aFin, I*sizeof(std::uint32_t), data.indices.data() );
+			data.vertexCount = V;
+			data.indexCount = I;
 
-			data.tangents.resize(V);
+			// Vertex and index data. Compressed streams are read as-is here;
+			// they are decoded in parallel once all meshes are known, or
+			// later by the caller (see decode_baked_mesh()).
+			if( compressed )
+			{
+				data.encodedOffsets.emplace_back( 0 );
+				for( std::size_t s = 0; s < lut::kMeshFileStreamCount; ++s )
+				{
+					auto const size = read_uint32_( aFin );
 
-			std::vector<double> positions3D(data.positions.size() * 3);
+					auto const offset = data.encoded.size();
+					data.encoded.resize( offset + size );
+					checked_read_( aFin, size, data.encoded.data() + offset );
 
-			for (std::size_t i = 0; i < data.positions.size(); ++i) {
-				positions3D[i * 3 + 0] = data.positions[i].x;
-				positions3D[i * 3 + 1] = data.positions[i].y;
-				positions3D[i * 3 + 2] = data.positions[i].z;
+					data.encodedOffsets.emplace_back( data.encoded.size() );
+				}
 			}
-
-			std::vector<double> uv2D(data.texcoords.size() * 2);
-
-			for (std::size_t i = 0; i < data.positions.size(); ++i) {
-				uv2D[i * 2 + 0] = data.texcoords[i].x;
-				uv2D[i * 2 + 1] = data.texcoords[i].y;
+			else
+			{
+				resize_streams_( data, features );
+				for( std::size_t s = 0; s < lut::kMeshFileStreamCount; ++s )
+					checked_read_( aFin, baked_mesh_stream_bytes( data, features, s ), stream_data_( data, features, s ) );
 			}
 
-			std::vector<double> normals3D(data.positions.size() * 3);
+			if( features & lut::kMeshFeatureLods )
+			{
+				auto const L = read_uint32_( aFin );
+				if( 0 == L || L > kMaxLods )
+					throw lut::Error( "load_baked_model_(): %s: invalid number of LODs (%u)", aInputName, L );
 
-			for (std::size_t i = 0; i < data.positions.size(); ++i) {
-				normals3D[i * 3 + 0] = data.normals[i].x;
-				normals3D[i * 3 + 1] = data.normals[i].y;
-				normals3D[i * 3 + 2] = data.normals[i].z;
-			}
+				data.lods.resize( L );
+				checked_read_( aFin, L*sizeof(BakedMeshLod), data.lods.data() );
 
-			std::vector<double> ctangents3d(V * 3);
-			std::vector<double> cbitangents3d(V * 3);
-			std::vector<double> tangents3d(V * 3);
-			std::vector<double> bitangents3d(V * 3);
-			std::vector<double> tangents4d(V * 4);
-
-			compute::computeCornerTSpace(
-				data.indices,
-				data.indices,
-				positions3D,
-				uv2D,
-				ctangents3d,
-				cbitangents3d
-			);
-
-			compute::computeVertexTSpace(
-				data.indices,
-				ctangents3d,
-				cbitangents3d,
-				V,
-				tangents3d,
-				bitangents3d
-			);
-
-			compute::orthogonalizeTSpace(
-				normals3D,
-				tangents3d,
-				bitangents3d
-			);
-
-			compute::computeTangent4D(
-				normals3D,
-				tangents3d,
-				bitangents3d,
-				tangents4d
-			);
-
-			std::vector<glm::vec4> tangents(V);
-
-			for (std::size_t i = 0; i < V; ++i) {
-				tangents[i] = glm::vec4(tangents4d[i * 4], tangents4d[i * 4 + 1],
-					tangents4d[i * 4 + 2], tangents4d[i * 4 + 3]);
+				for( auto const& lod : data.lods )
+				{
+					if( std::size_t(lod.firstIndex) + lod.indexCount > I )
+						throw lut::Error( "load_baked_model_(): %s: LOD index range out of bounds", aInputName );
+				}
+			}
+			else
+			{
+				data.lods.emplace_back( BakedMeshLod{ 0, I, 0.f } );
 			}
 
-			data.tangents = tangents;
+			ret.meshes.emplace_back( std::move(data) );
+		}
+
+		// Decode compressed streams into the mesh data, and compute the
+		// bounds of meshes that are not quantized. Meshes are independent, so
+		// this runs in parallel.
+		lut::parallel_for( ret.meshes.size(), aWorkerCount, [&] (std::size_t aMeshIndex) {
+			auto& data = ret.meshes[aMeshIndex];
 
-			std::vector<glm::vec3> bitangents;
-			for (size_t i = 0; i < tangents.size(); ++i) {
-				glm::vec3 bitangent = abs(glm::normalize(glm::cross(data.normals[i], glm::vec3(tangents[i]))));
-				bitangents.push_back(bitangent);
+			if( !compressed )
+			{
+				if( !ret.quantized )
+					compute_bounds_( data, data.positions.data(), data.positions.size() );
 			}
+			else if( aDecodeStreams )
+			{
+				resize_streams_( data, features );
 
-			std::vector<glm::quat> tbnQuaternions;
-			tbnQuaternions.reserve(data.normals.size());
+				void* dest[lut::kMeshFileStreamCount];
+				for( std::size_t s = 0; s < lut::kMeshFileStreamCount; ++s )
+					dest[s] = stream_data_( data, features, s );
 
-			for (size_t i = 0; i < data.normals.size(); ++i) {
-				glm::mat3 tbnMatrix(tangents[i], bitangents[i], data.normals[i]);
-				glm::quat tbnQuaternion = glm::normalize(glm::quat_cast(tbnMatrix));
-				tbnQuaternions.push_back(tbnQuaternion);
-			}
+				decode_baked_mesh( data, features, dest );
 
-			std::vector<glm::uint32> encodedtbnQuaternions;
-			encodedtbnQuaternions.resize(data.normals.size());
-			for (size_t i = 0; i < data.normals.size(); ++i) {
-				 encode_quat(encodedtbnQuaternions[i],tbnQuaternions[i].x, tbnQuaternions[i].y, tbnQuaternions[i].z, tbnQuaternions[i].w );
+				data.encoded = std::vector<std::uint8_t>();
+				data.encodedOffsets.clear();
 			}
+			else if( !ret.quantized )
+			{
+				// Known once decoded
+				data.boundsCenter = glm::vec3( 0.f );
+				data.boundsRadius = 0.f;
+			}
+		} );
+
+		// Read meshlets
+		if( features & lut::kMeshFeatureMeshlets )
+		{
+			for( auto& mesh : ret.meshes )
+			{
+				auto const C = read_uint32_( aFin );
 
-			//tangents
-			data.packedTBN = encodedtbnQuaternions;
+				mesh.meshlets.resize( C );
+				checked_read_( aFin, C*sizeof(BakedMeshlet), mesh.meshlets.data() );
 
-			ret.meshes.emplace_back( std::move(data) );
+				for( auto const& meshlet : mesh.meshlets )
+				{
+					if( std::size_t(meshlet.firstIndex) + meshlet.indexCount > mesh.indexCount )
+						throw lut::Error( "load_baked_model_(): %s: meshlet index range out of bounds", aInputName );
+				}
+			}
 		}
 
 		// Check
@@ -391,4 +343,77 @@ namespace
 
 		return ret;
 	}
+
+	void resize_streams_( BakedMeshData& aData, std::uint32_t aFeatures )
+	{
+		std::size_t const V = aData.vertexCount;
+
+		if( aFeatures & lut::kMeshFeatureQuantized )
+		{
+			aData.quantizedPositions.resize( V*4 );
+			aData.octahedralNormals.resize( V*2 );
+			aData.halfTexcoords.resize( V*2 );
+		}
+		else
+		{
+			aData.positions.resize( V );
+			aData.normals.resize( V );
+			aData.texcoords.resize( V );
+		}
+
+		aData.tangents.resize( V );
+		aData.packedTBN.resize( V );
+
+		if( aFeatures & lut::kMeshFeatureIndex16 )
+			aData.indices16.resize( aData.indexCount );
+		else
+			aData.indices.resize( aData.indexCount );
+	}
+
+	void* stream_data_( BakedMeshData& aData, std::uint32_t aFeatures, std::size_t aStream )
+	{
+		bool const quantized = aFeatures & lut::kMeshFeatureQuantized;
+
+		switch( lut::mesh_file_stream( aFeatures, aStream ).stream )
+		{
+			case lut::MeshFileStream::position:
+				return quantized ? static_cast<void*>(aData.quantizedPositions.data()) : aData.positions.data();
+			case lut::MeshFileStream::normal:
+				return quantized ? static_cast<void*>(aData.octahedralNormals.data()) : aData.normals.data();
+			case lut::MeshFileStream::texcoord:
+				return quantized ? static_cast<void*>(aData.halfTexcoords.data()) : aData.texcoords.data();
+			case lut::MeshFileStream::tangent:
+				return aData.tangents.data();
+			case lut::MeshFileStream::packedTbn:
+				return aData.packedTBN.data();
+			case lut::MeshFileStream::indices:
+				return (aFeatures & lut::kMeshFeatureIndex16) ? static_cast<void*>(aData.indices16.data()) : aData.indices.data();
+		}
+
+		return nullptr;
+	}
+
+	void compute_bounds_( BakedMeshData& aData, glm::vec3 const* aPositions, std::size_t aCount )
+	{
+		if( 0 == aCount )
+		{
+			aData.boundsCenter = glm::vec3( 0.f );
+			aData.boundsRadius = 0.f;
+			return;
+		}
+
+		glm::vec3 bmin( std::numeric_limits<float>::max() );
+		glm::vec3 bmax( std::numeric_limits<float>::lowest() );
+
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			bmin = glm::min( bmin, aPositions[i] );
+			bmax = glm::max( bmax, aPositions[i] );
+		}
+
+		aData.boundsCenter = 0.5f * (bmin + bmax);
+		aData.boundsRadius = 0.f;
+		for( std::size_t i = 0; i < aCount; ++i )
+			aData.boundsRadius = std::max( aData.boundsRadius, glm::length( aPositions[i] - aData.boundsCenter ) );
+	}
 }
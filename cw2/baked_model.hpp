@@ -4,23 +4,28 @@
 #include <string>
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 
 #include "glm/vec4.hpp"
 
+#include "../labutils/mesh_file.hpp"
+
 /* Baked file format:
  *
  *  1. Header:
  *    - 16*char: file magic = "\0\0COMP5822Mmesh"
- *    - 16*char: variant = "default" (changes later)
+ *    - 16*char: variant = "cw2-ext-tbn"
+ *    - 1*uint32_t: feature flags; see kMeshFeature* in labutils/mesh_file.hpp
  *
  *  2. Textures
  *    - 1*uint32_t: U = number of (unique) textures
  *    - repeat U times:
- *      - string: path to texture
+ *      - string: path to baked texture; see labutils/texture_file.hpp
  *      - 1*uint8_t: number of channels in texture
  *
  *  3. Material information
@@ -28,27 +33,59 @@
  *    - repeat M times:
  *      - uint32_t: base color texture index
  *      - uint32_t: roughness texture index
- *      - uint32_t: metalness texture index
+ *      - uint32_t: metalness texture index; if the packed ORM feature flag is
+ *        set, this is the same texture as the roughness texture, holding
+ *        roughness (R) and metalness (G)
  *      - uint32_t: alpha mask texture index; set to 0xffffffff if not available
  *      - uint32_t: normal map texture index; set to 0xffffffff if not available
  *
  *  4. Mesh data
+ *    - if the quantized feature flag is set:
+ *      - vec3: quantization box minimum
+ *      - vec3: quantization box maximum
  *    - 1*uint32_t: M = number of meshes
  *    - repeat M times:
  *      - uint32_t : material index
  *      - uint32_t : V = number of vertices
  *      - uint32_t : I = number of indices
- *      - repeat V times: vec3 position
- *      - repeat V times: vec3 normal
- *      - repeat V times: vec2 texture coordinate
- *      - repeat I times: uint32_t index
+ *      - if the quantized feature flag is set:
+ *        - vec3: mesh bounding box minimum
+ *        - vec3: mesh bounding box maximum
+ *        - repeat V times: uint16_t[4] position; unorm relative to the
+ *          quantization box, w = 0
+ *        - repeat V times: int16_t[2] normal; snorm, octahedral encoding
+ *        - repeat V times: uint16_t[2] texture coordinate; half floats
+ *      - otherwise:
+ *        - repeat V times: vec3 position
+ *        - repeat V times: vec3 normal
+ *        - repeat V times: vec2 texture coordinate
+ *      - repeat V times: vec4 tangent; w = handedness (sign of the bitangent)
+ *      - repeat V times: uint32_t packed TBN quaternion (right-handed frame)
+ *      - repeat I times: uint16_t index if the 16-bit index feature flag is
+ *        set (meshes then have at most 65536 vertices), uint32_t otherwise
+ *      - if the LOD feature flag is set:
+ *        - uint32_t: L = number of levels of detail
+ *        - repeat L times: BakedMeshLod (see below; 12 bytes)
+ *    - if the compressed feature flag is set, each of the "repeat V times"
+ *      and "repeat I times" arrays above is replaced by
+ *      - uint32_t: S = size in bytes
+ *      - S bytes: the vertex arrays are encoded with
+ *        labutils::encode_geometry_stream(); the element size is that of
+ *        the array's entries, the component size that of its scalars (e.g.,
+ *        8 and 2 for quantized positions). The indices are encoded with
+ *        labutils::encode_index_stream(), which may rotate triangles.
+ *
+ *  5. Meshlets (only if the meshlet feature flag is set)
+ *    - repeat M times (once per mesh):
+ *      - uint32_t: C = number of meshlets
+ *      - repeat C times: BakedMeshlet (see below; 52 bytes)
  *
  * Strings are stored as
  *   - 1*uint32_t: N = length of string in chars, including terminating \0
  *   - repeat N times: char in string
  *
- * See cw2-bake/main.cpp (specifically write_model_data_()) for additional
- * information.
+ * See cw2-bake/main.cpp (specifically write_model_header_(), bake_meshes_()
+ * and write_mesh_()) for additional information.
  *
  *
  * My suggestion for loading the data into Vulkan is as follows:
@@ -84,16 +121,75 @@ struct BakedMaterialInfo
 	std::uint32_t normalMapTextureId; // May be set to 0xffffffff if no normal map
 };
 
+/* Meshlet: cluster of up to 124 triangles that is contiguous in the mesh's
+ * index buffer. The bounds are used for culling (see culling.hpp).
+ */
+struct BakedMeshlet
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+
+	glm::vec3 center;
+	float radius;
+
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+static_assert( sizeof(BakedMeshlet) == 2*sizeof(std::uint32_t) + 11*sizeof(float) );
+
+/* Level of detail: range in the mesh's index buffer. The error is the
+ * (approximate) geometric deviation from the original mesh, in model units.
+ * Level zero is the original mesh, with an error of zero.
+ */
+struct BakedMeshLod
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	float error;
+};
+
+static_assert( sizeof(BakedMeshLod) == 3*sizeof(std::uint32_t) );
+
 struct BakedMeshData
 {
 	std::uint32_t materialId;
+	std::uint32_t vertexCount;
 
+	// Empty if the model is quantized
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec2> texcoords;
 	std::vector<glm::vec3> normals;
-	std::vector<glm::vec4> tangents;
+
+	// Only if the model is quantized; see format above
+	std::vector<std::uint16_t> quantizedPositions; // 4 per vertex
+	std::vector<std::int16_t> octahedralNormals; // 2 per vertex
+	std::vector<std::uint16_t> halfTexcoords; // 2 per vertex
+
+	std::vector<glm::vec4> tangents; // Baked with cw2-bake; see format above
 	std::vector<glm::uint32> packedTBN;
+
+	// Indices are stored in one of the two vectors, depending on whether the
+	// file uses 16-bit indices
+	std::uint32_t indexCount;
 	std::vector<std::uint32_t> indices;
+	std::vector<std::uint16_t> indices16;
+
+	std::vector<BakedMeshlet> meshlets; // Empty if the file has no meshlets (LOD 0 only)
+	std::vector<BakedMeshLod> lods; // At least one (the full index buffer)
+
+	// Bounding sphere
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+
+	// Compressed models loaded with aDecodeStreams = false (see
+	// load_baked_model()) keep the encoded vertex and index streams here,
+	// in file order; stream i is encoded[encodedOffsets[i]] up to
+	// encoded[encodedOffsets[i+1]]. Their attribute and index vectors stay
+	// empty; decode_baked_mesh() decodes the streams. Empty otherwise.
+	std::vector<std::uint8_t> encoded;
+	std::vector<std::size_t> encodedOffsets;
 };
 
 struct BakedModel
@@ -101,9 +197,45 @@ struct BakedModel
 	std::vector<BakedTextureInfo> textures;
 	std::vector<BakedMaterialInfo> materials;
 	std::vector<BakedMeshData> meshes;
+
+	// Quantized models store the positions relative to a box around the
+	// model; dequantize maps them back to model space. Identity otherwise.
+	bool quantized;
+	glm::mat4 dequantize;
+
+	// Roughness and metalness are packed into one texture; see format above
+	bool packedOrm;
+
+	// labutils::kMeshFeature* flags of the file
+	std::uint32_t features;
 };
 
-BakedModel load_baked_model( char const* aModelPath );
+// Compressed meshes are decoded by up to aWorkerCount threads; zero uses
+// labutils::default_worker_count(). With aDecodeStreams = false, compressed
+// meshes keep their encoded streams instead, so that they can be decoded
+// straight into their final destination with decode_baked_mesh().
+BakedModel load_baked_model( char const* aModelPath, std::size_t aWorkerCount = 0, bool aDecodeStreams = true );
+
+// Size in bytes of the vertex or index stream aStream (in file order; see
+// labutils/mesh_file.hpp) of a mesh, once decoded.
+std::size_t baked_mesh_stream_bytes( BakedMeshData const&, std::uint32_t aFeatures, std::size_t aStream );
+
+// Data of the vertex or index stream aStream of a decoded mesh.
+void const* baked_mesh_stream( BakedMeshData const&, std::uint32_t aFeatures, std::size_t aStream );
+
+// Decode the vertex streams of a mesh with encoded streams (see above) into
+// aDest, one pointer per stream in file order, each with room for
+// baked_mesh_stream_bytes(). This can be, e.g., mapped staging memory. The
+// index stream is decoded into aDest as well; the mesh's vectors are left
+// untouched. Also computes the bounds of meshes that are not quantized, from
+// the decoded positions. Streams are decoded by up to aWorkerCount
+// threads. Throws labutils::Error if the data is corrupt.
+void decode_baked_mesh(
+	BakedMeshData&,
+	std::uint32_t aFeatures,
+	void* const (&aDest)[labutils::kMeshFileStreamCount],
+	std::size_t aWorkerCount = 1
+);
 
 #endif // BAKED_MODEL_HPP_7D7BFF3A_1743_43DF_8D4F_D67D80FD8282
 
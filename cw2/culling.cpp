@@ -0,0 +1,87 @@
+#include "culling.hpp"
+
+#include <glm/glm.hpp>
+
+Frustum extract_frustum( glm::mat4 const& aProjCamera )
+{
+	// Gribb & Hartmann. glm is column major, so row i of the matrix is
+	// (m[0][i], m[1][i], m[2][i], m[3][i]).
+	auto const row = [&] (int aRow) {
+		return glm::vec4( aProjCamera[0][aRow], aProjCamera[1][aRow], aProjCamera[2][aRow], aProjCamera[3][aRow] );
+	};
+
+	auto const r0 = row( 0 ), r1 = row( 1 ), r2 = row( 2 ), r3 = row( 3 );
+
+	Frustum ret;
+	ret.planes[0] = r3 + r0; // left
+	ret.planes[1] = r3 - r0; // right
+	ret.planes[2] = r3 + r1; // bottom (top with flipped Y)
+	ret.planes[3] = r3 - r1; // top (bottom with flipped Y)
+	ret.planes[4] = r2;      // near, depth in [0,1]
+	ret.planes[5] = r3 - r2; // far
+
+	for( auto& plane : ret.planes )
+		plane /= glm::length( glm::vec3( plane ) );
+
+	return ret;
+}
+
+bool sphere_in_frustum( Frustum const& aFrustum, glm::vec3 const& aCenter, float aRadius )
+{
+	// Reject if the sphere is fully outside of any plane
+	for( auto const& plane : aFrustum.planes )
+	{
+		if( glm::dot( glm::vec3( plane ), aCenter ) + plane.w < -aRadius )
+			return false;
+	}
+
+	return true;
+}
+
+std::size_t cull_meshlets( std::vector<BakedMeshlet> const& aMeshlets, Frustum const& aFrustum, glm::vec3 const& aCameraPosition, std::vector<IndexRange>& aRanges )
+{
+	aRanges.clear();
+
+	std::size_t indices = 0;
+	for( auto const& meshlet : aMeshlets )
+	{
+		// Frustum
+		if( !sphere_in_frustum( aFrustum, meshlet.center, meshlet.radius ) )
+			continue;
+
+		// Normal cone: reject if all triangles are back-facing
+		auto const view = meshlet.coneApex - aCameraPosition;
+		float const viewLength = glm::length( view );
+		if( viewLength > 0.f && glm::dot( view, meshlet.coneAxis ) >= meshlet.coneCutoff * viewLength )
+			continue;
+
+		// Emit, merging with the previous range if possible
+		if( !aRanges.empty() && aRanges.back().firstIndex + aRanges.back().indexCount == meshlet.firstIndex )
+			aRanges.back().indexCount += meshlet.indexCount;
+		else
+			aRanges.emplace_back( IndexRange{ meshlet.firstIndex, meshlet.indexCount } );
+
+		indices += meshlet.indexCount;
+	}
+
+	return indices;
+}
+
+std::size_t select_lod( std::vector<BakedMeshLod> const& aLods, float aDistance, float aPixelsPerUnit, float aMaxPixelError )
+{
+	// Inside the bounds, any error could end up right in front of the camera
+	if( !(aDistance > 0.f) )
+		return 0;
+
+	// Errors increase with the level. Walk down the chain until the next
+	// level's error becomes visible.
+	float const maxError = aMaxPixelError * aDistance / aPixelsPerUnit;
+
+	std::size_t ret = 0;
+	while( ret+1 < aLods.size() && aLods[ret+1].error <= maxError )
+		++ret;
+
+	return ret;
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,62 @@
+#ifndef CULLING_HPP_9A2F6E14_C3B8_4D71_A5E0_7F18D264B3C9
+#define CULLING_HPP_9A2F6E14_C3B8_4D71_A5E0_7F18D264B3C9
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "baked_model.hpp"
+
+// View frustum as six planes (xyz = normal pointing inwards, w = offset).
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Extract the frustum planes from a projection * camera (world to clip)
+// matrix. Assumes a Vulkan-style [0,1] depth range.
+Frustum extract_frustum( glm::mat4 const& aProjCamera );
+
+// Check if a bounding sphere is (at least partially) inside the frustum
+bool sphere_in_frustum(
+	Frustum const&,
+	glm::vec3 const& aCenter,
+	float aRadius
+);
+
+// Range of indices to draw with vkCmdDrawIndexed()
+struct IndexRange
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+};
+
+// Cull meshlets against the frustum and with their normal cones, and write
+// the index ranges of the remaining meshlets to aRanges. Meshlets that are
+// adjacent in the index buffer are merged into a single range.
+//
+// Returns the number of indices in aRanges.
+std::size_t cull_meshlets(
+	std::vector<BakedMeshlet> const&,
+	Frustum const&,
+	glm::vec3 const& aCameraPosition,
+	std::vector<IndexRange>& aRanges
+);
+
+// Select the coarsest level of detail whose error, projected to the screen,
+// is at most aMaxPixelError pixels. aDistance is the distance from the camera
+// to the closest point of the mesh's bounds; aPixelsPerUnit is the size in
+// pixels of one unit at a distance of one (viewport height divided by
+// 2*tan(fovy/2) for a perspective projection).
+std::size_t select_lod(
+	std::vector<BakedMeshLod> const&,
+	float aDistance,
+	float aPixelsPerUnit,
+	float aMaxPixelError
+);
+
+#endif // CULLING_HPP_9A2F6E14_C3B8_4D71_A5E0_7F18D264B3C9
@@ -6,6 +6,7 @@
 #include <stdexcept>
 
 #include <cstdio>
+#include <cmath>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -42,6 +43,7 @@ using namespace labutils::literals;
 namespace lut = labutils;
 
 #include "baked_model.hpp"
+#include "culling.hpp"
 
 
 namespace
@@ -81,6 +83,10 @@ namespace
 		constexpr float kCameraMouseSensitivity = 0.1f;
 
 		constexpr float kLightRotationSpeed = 0.1f;
+
+		// Levels of detail are selected such that their geometric error
+		// projects to at most this many pixels
+		constexpr float kLodMaxPixelError = 1.f;
 	}
 
 	using clock_ = std::chrono::steady_clock;
@@ -102,6 +108,7 @@ namespace
 			glm::mat4 camera;
 			glm::mat4 projection;
 			glm::mat4 projCamera;
+			glm::mat4 dequantize; // see BakedModel::dequantize
 		};
 
 		struct LightUniform
@@ -143,6 +150,9 @@ namespace
 		glm::vec3 lightPosition = {0,3,0};
 		glm::vec3 lightRotationCenter = {0,2.9999,0};
 		float lightAngle;
+
+		bool cullMeshlets = true; // toggle with C
+		bool selectLods = true; // toggle with L
 	};
 
 	void update_user_state(UserState&, float aElapsedTime);
@@ -159,10 +169,10 @@ namespace
 
 	lut::PipelineLayout create_ao_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aObjectLayout);
 
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, bool aQuantized, bool aPackedOrm);
 	//be used to create different loaded obj pipeline
 
-	lut::Pipeline create_ao_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
+	lut::Pipeline create_ao_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, bool aQuantized);
 
 	void create_swapchain_framebuffers( 
 		lut::VulkanWindow const&, 
@@ -256,10 +266,14 @@ int main() try
 	lut::PipelineLayout aopipeLayout = create_ao_pipeline_layout(window, sceneLayout.handle, aoLayout.handle);
 
 
+	//the vertex formats in the pipelines depend on whether the model is quantized
+	// Compressed streams are decoded by create_mesh(), into the staging buffers
+	BakedModel model = load_baked_model(cfg::MODEL_PATH, 0, false);
+
 	//pipeline with depth test
-	lut::Pipeline alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
+	lut::Pipeline alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle, model.quantized, model.packedOrm);
 
-	lut::Pipeline aoPipe = create_ao_pipeline(window, renderPass.handle, aopipeLayout.handle);
+	lut::Pipeline aoPipe = create_ao_pipeline(window, renderPass.handle, aopipeLayout.handle, model.quantized);
 
 	//the process of creating depth buffer kind of like create an image,sowe also need an
 	//image view(depth buffer view)
@@ -291,22 +305,25 @@ int main() try
 	lut::Semaphore renderFinished = lut::create_semaphore( window );
 
 	//------------------------------------------------------------------------------------------------------------------------------
-	BakedModel model = load_baked_model(cfg::MODEL_PATH);
-
 	//1.Create and load textures.This gives a list of Images(which includes a
 	//VkImage + VmaAllocation) and VkImageViews.We only need to keep these
 	//around -- place them in a vector.
 
 	//load textures into image
 	lut::CommandPool loadCmdPool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	//textures are baked with their full mip chain (see cw2-bake), so each one
+	//is a single buffer-to-image copy
 	std::vector<lut::Image> objTextures;
+	std::vector<VkFormat> objFormats;
 	for (const auto& t : model.textures)
 	{
+		VkFormat format;
 		lut::Image oneObjTex; 
-		oneObjTex = lut::load_image_texture2d(
+		oneObjTex = lut::load_baked_texture2d(
 			t.path.c_str(), window,
-			loadCmdPool.handle, allocator);
+			loadCmdPool.handle, allocator, &format);
 		objTextures.emplace_back(std::move(oneObjTex));
+		objFormats.emplace_back(format);
 	}
 
 	//create image view for texture image
@@ -314,7 +331,7 @@ int main() try
 	for (size_t i = 0; i < model.textures.size(); i++)
 	{
 		lut::ImageView oneObjView;
-		oneObjView = lut::create_image_view_texture2d(window, objTextures[i].image, VK_FORMAT_R8G8B8A8_SRGB);
+		oneObjView = lut::create_image_view_texture2d(window, objTextures[i].image, objFormats[i]);
 		objViews.emplace_back(std::move(oneObjView));
 	}
 
@@ -396,7 +413,7 @@ int main() try
 	//allocate and initialize descriptor sets for texture 
 	std::vector<VkDescriptorSet> objDescriptors;
 	labutils::Image defaultNormal = labutils::default_normal_texture(window, loadCmdPool.handle, allocator);
-	labutils::ImageView defaultNormalView = lut::create_image_view_texture2d(window, defaultNormal.image, VK_FORMAT_R8G8B8A8_SRGB);
+	labutils::ImageView defaultNormalView = lut::create_image_view_texture2d(window, defaultNormal.image, VK_FORMAT_R8G8B8A8_UNORM);
 	for (const auto& m:model.meshes)
 	{
 		VkDescriptorSet oneObjDescriptors = lut::alloc_desc_set(window, dpool.handle, objectLayout.handle);
@@ -510,9 +527,9 @@ int main() try
 	//for each mesh(one for each attribute and one for the indices).
 	//loda baked model and create buffer per mesh
 	std::vector<objMesh> oMesh;
-	for(auto const& m: model.meshes)
+	for(auto& m: model.meshes)
 	{
-		objMesh meshBuffer = create_mesh(window,allocator, m);
+		objMesh meshBuffer = create_mesh(window,allocator, model.features, m);
 		oMesh.emplace_back(std::move(meshBuffer));
 	}
 
@@ -546,8 +563,8 @@ int main() try
 
 			if (changes.changedSize) {
 				std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator);
-				alphaPipe= create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
-				aoPipe = create_ao_pipeline(window, renderPass.handle, aopipeLayout.handle);
+				alphaPipe= create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle, model.quantized, model.packedOrm);
+				aoPipe = create_ao_pipeline(window, renderPass.handle, aopipeLayout.handle, model.quantized);
 			}
 
 			framebuffers.clear();
@@ -608,6 +625,7 @@ int main() try
 
 		glsl::SceneUniform sceneUniforms{};
 		update_scene_uniforms(sceneUniforms, window.swapchainExtent.width, window.swapchainExtent.height, state);
+		sceneUniforms.dequantize = model.dequantize;
 
 		glsl::LightUniform lightUniforms{};
 		lightUniforms.position = glm::vec4(state.lightPosition,1.0f);
@@ -697,6 +715,14 @@ namespace
 		case GLFW_KEY_Q:
 			state->inputMap[std::size_t(EInputState::sink)] = !isReleased;
 			break;
+		case GLFW_KEY_C:
+			if (GLFW_PRESS == aAction)
+				state->cullMeshlets = !state->cullMeshlets;
+			break;
+		case GLFW_KEY_L:
+			if (GLFW_PRESS == aAction)
+				state->selectLods = !state->selectLods;
+			break;
 		case GLFW_KEY_LEFT_SHIFT: [[fallthrough]];
 		case GLFW_KEY_RIGHT_SHIFT:
 			state->inputMap[std::size_t(EInputState::fast)] = !isReleased;
@@ -951,7 +977,7 @@ namespace
 	}
 
 
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, bool aQuantized, bool aPackedOrm)
 	{
 		//load shader
 		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::defaultVertPath);
@@ -986,17 +1012,20 @@ namespace
 		VkPipelineVertexInputStateCreateInfo inputInfo{};
 		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
+		//quantized models store positions as 4x16-bit unorm (relative to the
+		//model's quantization box), octahedral normals as 2x16-bit snorm and
+		//texture coordinates as 2x16-bit half floats
 		VkVertexInputBindingDescription vertexInputs[5]{};
 		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
+		vertexInputs[0].stride = aQuantized ? sizeof(std::uint16_t) * 4 : sizeof(float) * 3;
 		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 2;
+		vertexInputs[1].stride = aQuantized ? sizeof(std::uint16_t) * 2 : sizeof(float) * 2;
 		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		vertexInputs[2].binding = 2;
-		vertexInputs[2].stride = sizeof(float) * 3;
+		vertexInputs[2].stride = aQuantized ? sizeof(std::int16_t) * 2 : sizeof(float) * 3;
 		vertexInputs[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		vertexInputs[3].binding = 3;
@@ -1010,17 +1039,17 @@ namespace
 		VkVertexInputAttributeDescription vertexAttributes[5]{};
 		vertexAttributes[0].binding = 0;		//must match binding above
 		vertexAttributes[0].location = 0;		//must match shader;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		vertexAttributes[0].format = aQuantized ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
 		vertexAttributes[0].offset = 0;
 
 		vertexAttributes[1].binding = 1;		//must match binding above
 		vertexAttributes[1].location = 1;		//must match shader;
-		vertexAttributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+		vertexAttributes[1].format = aQuantized ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
 		vertexAttributes[1].offset = 0;
 
 		vertexAttributes[2].binding = 2;		//must match binding above
 		vertexAttributes[2].location = 2;		//must match shader;
-		vertexAttributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+		vertexAttributes[2].format = aQuantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
 		vertexAttributes[2].offset = 0;
 
 		vertexAttributes[3].binding = 3;		//must match binding above
@@ -1033,6 +1062,40 @@ namespace
 		vertexAttributes[4].format = VK_FORMAT_R32_UINT;
 		vertexAttributes[4].offset = 0;
 		                                                                                                                                
+		//the vertex shader decodes octahedral normals if specialization
+		//constant 0 is set
+		VkBool32 const octahedralNormals = aQuantized ? VK_TRUE : VK_FALSE;
+
+		VkSpecializationMapEntry specEntry{};
+		specEntry.constantID = 0;
+		specEntry.offset = 0;
+		specEntry.size = sizeof(VkBool32);
+
+		VkSpecializationInfo specInfo{};
+		specInfo.mapEntryCount = 1;
+		specInfo.pMapEntries = &specEntry;
+		specInfo.dataSize = sizeof(VkBool32);
+		specInfo.pData = &octahedralNormals;
+
+		stages[0].pSpecializationInfo = &specInfo;
+
+		//the fragment shader reads roughness and metalness from one texture if
+		//specialization constant 1 is set
+		VkBool32 const packedOrm = aPackedOrm ? VK_TRUE : VK_FALSE;
+
+		VkSpecializationMapEntry fragSpecEntry{};
+		fragSpecEntry.constantID = 1;
+		fragSpecEntry.offset = 0;
+		fragSpecEntry.size = sizeof(VkBool32);
+
+		VkSpecializationInfo fragSpecInfo{};
+		fragSpecInfo.mapEntryCount = 1;
+		fragSpecInfo.pMapEntries = &fragSpecEntry;
+		fragSpecInfo.dataSize = sizeof(VkBool32);
+		fragSpecInfo.pData = &packedOrm;
+
+		stages[1].pSpecializationInfo = &fragSpecInfo;
+
 		inputInfo.vertexBindingDescriptionCount = 5;
 		inputInfo.pVertexBindingDescriptions = vertexInputs;
 		inputInfo.vertexAttributeDescriptionCount = 5;
@@ -1140,7 +1203,7 @@ namespace
 		return lut::Pipeline(aWindow.device, pipe);
 	}
 
-	lut::Pipeline create_ao_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	lut::Pipeline create_ao_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, bool aQuantized)
 	{
 		//load shader
 		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::aoVertPath);
@@ -1173,24 +1236,25 @@ namespace
 		VkPipelineVertexInputStateCreateInfo inputInfo{};
 		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
+		//see create_alpha_pipeline() for the quantized formats
 		VkVertexInputBindingDescription vertexInputs[2]{};
 		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
+		vertexInputs[0].stride = aQuantized ? sizeof(std::uint16_t) * 4 : sizeof(float) * 3;
 		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 2;
+		vertexInputs[1].stride = aQuantized ? sizeof(std::uint16_t) * 2 : sizeof(float) * 2;
 		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		VkVertexInputAttributeDescription vertexAttributes[2]{};
 		vertexAttributes[0].binding = 0;		//must match binding above
 		vertexAttributes[0].location = 0;		//must match shader;
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		vertexAttributes[0].format = aQuantized ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
 		vertexAttributes[0].offset = 0;
 
 		vertexAttributes[1].binding = 1;		//must match binding above
 		vertexAttributes[1].location = 1;		//must match shader;
-		vertexAttributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+		vertexAttributes[1].format = aQuantized ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
 		vertexAttributes[1].offset = 0;
 
 		inputInfo.vertexBindingDescriptionCount = 2;
@@ -1542,13 +1606,38 @@ namespace
 		passInfo.clearValueCount = 2;
 		passInfo.pClearValues = clearValues;
 
-		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+		//select a level of detail per mesh from its projected error. the full
+		//detail level is culled per meshlet; the simplified levels (which
+		//have no meshlets) are culled as a whole
 		glm::vec4 cameraPos = aState.camera2world[3];
+
+		float const pixelsPerUnit = float(aImageExtent.height) / (2.f * std::tan(0.5f * lut::Radians(cfg::kCameraFov).value()));
+
+		Frustum const frustum = extract_frustum(aSceneUniform.projCamera);
+		std::vector<std::vector<IndexRange>> drawRanges(aObjMesh.size());
+		for (std::size_t i = 0; i < aObjMesh.size(); ++i) {
+			auto const& mesh = aModel.meshes[i];
+
+			std::size_t lod = 0;
+			if (aState.selectLods) {
+				float const distance = glm::length(mesh.boundsCenter - glm::vec3(cameraPos)) - mesh.boundsRadius;
+				lod = select_lod(mesh.lods, distance, pixelsPerUnit, cfg::kLodMaxPixelError);
+			}
+
+			if (0 == lod && aState.cullMeshlets && !mesh.meshlets.empty())
+				cull_meshlets(mesh.meshlets, frustum, glm::vec3(cameraPos), drawRanges[i]);
+			else if (!aState.cullMeshlets || sphere_in_frustum(frustum, mesh.boundsCenter, mesh.boundsRadius))
+				drawRanges[i].emplace_back(IndexRange{ mesh.lods[lod].firstIndex, mesh.lods[lod].indexCount });
+		}
+
+		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
 		vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec4), &cameraPos);
 		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAlphaPipe);
 		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
 		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 2, 1, &aLightDescriptors, 0, nullptr);
 		for (uint32_t i = 0; i < aObjMesh.size(); i++) {
+			if (drawRanges[i].empty())
+				continue;
 
 			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aObjDescriptors[i], 0, nullptr);
 			//Bind vertex input
@@ -1556,13 +1645,17 @@ namespace
 			VkDeviceSize objOffsets[5]{};
 
 			vkCmdBindVertexBuffers(aCmdBuff, 0, 5, objBuffers, objOffsets);
-			vkCmdBindIndexBuffer(aCmdBuff, aObjMesh[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(aCmdBuff, aObjMesh[i].indices.buffer, 0, aObjMesh[i].indexType);
 
-			vkCmdDrawIndexed(aCmdBuff, static_cast<uint32_t>(aModel.meshes[i].indices.size()), 1, 0, 0, 0);
+			for (auto const& range : drawRanges[i])
+				vkCmdDrawIndexed(aCmdBuff, range.indexCount, 1, range.firstIndex, 0, 0);
 		}
 		//end the render pass
 
 		for (uint32_t i = 0; i < aObjMesh.size(); i++) {
+			if (drawRanges[i].empty())
+				continue;
+
 			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAOPipe);
 			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAOLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
 			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAOLayout, 1, 1, &aAODescriptors[i], 0, nullptr);
@@ -1571,9 +1664,10 @@ namespace
 			VkDeviceSize aoOffsets[2]{};
 
 			vkCmdBindVertexBuffers(aCmdBuff, 0, 2, aoBuffers, aoOffsets);
-			vkCmdBindIndexBuffer(aCmdBuff, aObjMesh[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(aCmdBuff, aObjMesh[i].indices.buffer, 0, aObjMesh[i].indexType);
 
-			vkCmdDrawIndexed(aCmdBuff, static_cast<uint32_t>(aModel.meshes[i].indices.size()), 1, 0, 0, 0);
+			for (auto const& range : drawRanges[i])
+				vkCmdDrawIndexed(aCmdBuff, range.indexCount, 1, range.firstIndex, 0, 0);
 		}
 		vkCmdEndRenderPass(aCmdBuff);
 
@@ -8,6 +8,7 @@ layout(set = 0,binding = 0) uniform UScene{
 	mat4 camera;
 	mat4 projection;
 	mat4 projCamera;
+	mat4 dequantize; //identity unless the model is quantized
 }uScene;
 
 
@@ -16,8 +17,9 @@ layout(location = 0) out vec2 texCoords;
 
 void main()
 {
+	vec3 position = (uScene.dequantize * vec4(iPosition,1.f)).xyz;
 	texCoords = iTexcoord;
-	gl_Position = uScene.projCamera * vec4(iPosition,1.f);
+	gl_Position = uScene.projCamera * vec4(position,1.f);
 
 }
 
@@ -19,6 +19,10 @@ layout(set = 1,binding = 2) uniform sampler2D roughnessMap;
 layout(set = 1,binding = 3) uniform sampler2D normalMap;
 layout(set = 1,binding = 4) uniform sampler2D aoMap;  
 
+//roughness and metalness are packed into the R and G channels of one texture
+//(bound to both metallicMap and roughnessMap), see cw2-bake
+layout(constant_id = 1) const bool kPackedOrm = false;
+
 layout(set = 2,binding = 0) uniform ULight{
 	vec4 position;
 	vec4 color;
@@ -30,7 +34,9 @@ layout(location = 0) out vec4 oColor;
 
 vec3 getNormalFromMap()
 {
-    vec3 tangentNormal = normalize(texture(normalMap, texCoords).xyz) * 2 - 1;
+    // normal maps are baked to two channels (BC5), reconstruct z
+    vec2 xy = texture(normalMap, texCoords).xy * 2 - 1;
+    vec3 tangentNormal = vec3(xy, sqrt(max(0.0, 1.0 - dot(xy, xy))));
 
 	vec3 N = normalize(normal);    
     vec3 T = normalize(tangents);   
@@ -63,9 +69,15 @@ void main()
     const float alphaThreshold = 0.5;
 
     vec3  albedo    =  texture(albedoMap, texCoords).rgb;
-    float metallic  = texture(metallicMap, texCoords).r;
-
-    float roughness = texture(roughnessMap, texCoords).r;
+    float metallic, roughness;
+    if (kPackedOrm) {
+        vec2 rm   = texture(metallicMap, texCoords).rg;
+        roughness = rm.r;
+        metallic  = rm.g;
+    } else {
+        metallic  = texture(metallicMap, texCoords).r;
+        roughness = texture(roughnessMap, texCoords).r;
+    }
     float ao        = texture(aoMap, texCoords).r;
 
     //roughness pattern
@@ -6,6 +6,9 @@ layout(location = 2) in vec3 iNormals;
 layout(location = 3) in vec3 iTangents;
 layout(location = 4) in uint iPackedTBN;
 
+//set for quantized models, where normals are octahedral-encoded (xy)
+layout(constant_id = 0) const bool kOctahedralNormals = false;
+
 
 
 
@@ -14,6 +17,7 @@ layout(set = 0,binding = 0) uniform UScene{
 	mat4 camera;
 	mat4 projection;
 	mat4 projCamera;
+	mat4 dequantize; //identity unless the model is quantized
 }uScene;
 
 
@@ -23,6 +27,16 @@ layout(location = 2) out vec3 normal;
 layout(location = 3) out vec3 tangents;
 layout(location = 4) out mat3 tbn;
 
+//must match decode_octahedral() in cw2-bake/quantize.cpp
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 vec3 unpackNormal(vec4 packedNormal)
 {
     return normalize(packedNormal.xyz * 2.0 - 1.0);
@@ -127,13 +141,14 @@ mat3 quaternionToTBNMatrix(vec4 quat)
 
 void main()
 {
+	vec3 position = (uScene.dequantize * vec4(iPosition,1.f)).xyz;
 	texCoords = iTexcoord;
-	worldPos = iPosition;
+	worldPos = position;
 	tangents = iTangents;
-	normal = iNormals;
+	normal = kOctahedralNormals ? oct_decode(iNormals.xy) : iNormals;
     vec4 quat = decode_quaternion();
     tbn = quaternionToTBNMatrix(quat);
-	gl_Position = uScene.projCamera * vec4(iPosition,1.f);
+	gl_Position = uScene.projCamera * vec4(position,1.f);
 
 }
 
@@ -0,0 +1,789 @@
+#include "geometry_codec.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+#include <cassert>
+
+#include "error.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <immintrin.h>
+#	define GEOMETRY_CODEC_SIMD_ 1
+#endif
+
+namespace labutils
+{
+	namespace
+	{
+		constexpr std::size_t kMinMatch_ = 4;
+		constexpr std::size_t kMaxOffset_ = 65535;
+
+		constexpr unsigned kHashBits_ = 16;
+
+		// Size of the fixed-size copies in the decoder
+		constexpr std::size_t kWildCopy_ = 16;
+
+		std::uint32_t load32_( std::uint8_t const* aPtr )
+		{
+			std::uint32_t ret;
+			std::memcpy( &ret, aPtr, sizeof(ret) );
+			return ret;
+		}
+
+		std::uint32_t hash_( std::uint32_t aValue )
+		{
+			return (aValue * 2654435761u) >> (32 - kHashBits_);
+		}
+
+		void write_length_( std::vector<std::uint8_t>& aOut, std::size_t aLength )
+		{
+			// Remainder after the 15 in the token
+			for( ; aLength >= 255; aLength -= 255 )
+				aOut.emplace_back( std::uint8_t(255) );
+			aOut.emplace_back( std::uint8_t(aLength) );
+		}
+
+		std::size_t read_length_( std::uint8_t const*& aIn, std::uint8_t const* aEnd )
+		{
+			std::size_t ret = 0;
+			std::uint8_t byte;
+			do
+			{
+				if( aIn == aEnd )
+					throw Error( "lz_decompress(): truncated length" );
+
+				byte = *aIn++;
+				ret += byte;
+			} while( 255 == byte );
+
+			return ret;
+		}
+
+		void emit_sequence_( std::vector<std::uint8_t>& aOut, std::uint8_t const* aLiterals, std::size_t aLiteralCount, std::size_t aOffset, std::size_t aMatchLength )
+		{
+			assert( 0 == aMatchLength || aMatchLength >= kMinMatch_ );
+			std::size_t const matchCode = aMatchLength ? aMatchLength - kMinMatch_ : 0;
+
+			aOut.emplace_back( std::uint8_t( (std::min<std::size_t>( aLiteralCount, 15 ) << 4) | std::min<std::size_t>( matchCode, 15 ) ) );
+
+			if( aLiteralCount >= 15 )
+				write_length_( aOut, aLiteralCount - 15 );
+
+			aOut.insert( aOut.end(), aLiterals, aLiterals + aLiteralCount );
+
+			if( !aMatchLength )
+				return;
+
+			aOut.emplace_back( std::uint8_t(aOffset & 0xff) );
+			aOut.emplace_back( std::uint8_t(aOffset >> 8) );
+
+			if( matchCode >= 15 )
+				write_length_( aOut, matchCode - 15 );
+		}
+
+		// Zig-zag encoding: 0, -1, 1, -2, ... => 0, 1, 2, 3, ...
+		template< typename tType >
+		tType zigzag_( tType aValue )
+		{
+			constexpr unsigned bits = 8*sizeof(tType);
+			return tType( tType(aValue << 1) ^ tType(0u - tType(aValue >> (bits-1))) );
+		}
+		template< typename tType >
+		tType unzigzag_( tType aValue )
+		{
+			return tType( tType(aValue >> 1) ^ tType(0u - tType(aValue & 1u)) );
+		}
+
+		template< typename tType >
+		void filter_( std::uint8_t* aPlanes, std::uint8_t const* aData, std::size_t aCount, std::size_t aElementSize )
+		{
+			std::size_t const components = aElementSize / sizeof(tType);
+
+			std::vector<tType> prev( components, tType(0) );
+			for( std::size_t i = 0; i < aCount; ++i )
+			{
+				for( std::size_t c = 0; c < components; ++c )
+				{
+					tType value;
+					std::memcpy( &value, aData + i*aElementSize + c*sizeof(tType), sizeof(tType) );
+
+					tType const delta = zigzag_<tType>( tType(value - prev[c]) );
+					prev[c] = value;
+
+					for( std::size_t b = 0; b < sizeof(tType); ++b )
+						aPlanes[(c*sizeof(tType) + b)*aCount + i] = std::uint8_t( delta >> (8*b) );
+				}
+			}
+		}
+
+		// Reassembles aCount components from their byte planes (aStride bytes
+		// apart) and undoes the zig-zag encoding.
+		template< typename tType >
+		void gather_deltas_( tType* aOut, std::uint8_t const* aPlanes, std::size_t aStride, std::size_t aCount )
+		{
+			std::size_t i = 0;
+
+#			if defined(GEOMETRY_CODEC_SIMD_)
+			// 16 components per iteration. Interleaving the planes with the
+			// unpack instructions yields the little endian values directly.
+			auto const load_ = [&] (std::size_t aPlane) {
+				return _mm_loadu_si128( reinterpret_cast<__m128i const*>(aPlanes + aPlane*aStride + i) );
+			};
+
+			for( ; i+16 <= aCount; i += 16 )
+			{
+				if constexpr( 1 == sizeof(tType) )
+				{
+					__m128i const v = load_( 0 );
+					__m128i const half = _mm_and_si128( _mm_srli_epi16( v, 1 ), _mm_set1_epi8( 0x7f ) );
+					__m128i const sign = _mm_sub_epi8( _mm_setzero_si128(), _mm_and_si128( v, _mm_set1_epi8( 1 ) ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>(aOut + i), _mm_xor_si128( half, sign ) );
+				}
+				else if constexpr( 2 == sizeof(tType) )
+				{
+					__m128i const p0 = load_( 0 ), p1 = load_( 1 );
+					__m128i const v[2] = { _mm_unpacklo_epi8( p0, p1 ), _mm_unpackhi_epi8( p0, p1 ) };
+
+					for( std::size_t j = 0; j < 2; ++j )
+					{
+						__m128i const sign = _mm_sub_epi16( _mm_setzero_si128(), _mm_and_si128( v[j], _mm_set1_epi16( 1 ) ) );
+						_mm_storeu_si128( reinterpret_cast<__m128i*>(aOut + i + 8*j), _mm_xor_si128( _mm_srli_epi16( v[j], 1 ), sign ) );
+					}
+				}
+				else
+				{
+					static_assert( 4 == sizeof(tType) );
+
+					__m128i const p0 = load_( 0 ), p1 = load_( 1 ), p2 = load_( 2 ), p3 = load_( 3 );
+					__m128i const lo[2] = { _mm_unpacklo_epi8( p0, p1 ), _mm_unpackhi_epi8( p0, p1 ) };
+					__m128i const hi[2] = { _mm_unpacklo_epi8( p2, p3 ), _mm_unpackhi_epi8( p2, p3 ) };
+					__m128i const v[4] = {
+						_mm_unpacklo_epi16( lo[0], hi[0] ), _mm_unpackhi_epi16( lo[0], hi[0] ),
+						_mm_unpacklo_epi16( lo[1], hi[1] ), _mm_unpackhi_epi16( lo[1], hi[1] )
+					};
+
+					for( std::size_t j = 0; j < 4; ++j )
+					{
+						__m128i const sign = _mm_sub_epi32( _mm_setzero_si128(), _mm_and_si128( v[j], _mm_set1_epi32( 1 ) ) );
+						_mm_storeu_si128( reinterpret_cast<__m128i*>(aOut + i + 4*j), _mm_xor_si128( _mm_srli_epi32( v[j], 1 ), sign ) );
+					}
+				}
+			}
+#			endif // ~ GEOMETRY_CODEC_SIMD_
+
+			// Remainder (or everything, without SIMD)
+			for( ; i < aCount; ++i )
+			{
+				tType delta = 0;
+				for( std::size_t b = 0; b < sizeof(tType); ++b )
+					delta = tType( delta | tType( tType(aPlanes[b*aStride + i]) << (8*b) ) );
+
+				aOut[i] = unzigzag_<tType>( delta );
+			}
+		}
+
+#		if defined(GEOMETRY_CODEC_SIMD_)
+		template< typename tType >
+		__m128i add_( __m128i aX, __m128i aY )
+		{
+			if constexpr( 1 == sizeof(tType) )
+				return _mm_add_epi8( aX, aY );
+			else if constexpr( 2 == sizeof(tType) )
+				return _mm_add_epi16( aX, aY );
+			else
+				return _mm_add_epi32( aX, aY );
+		}
+
+		// Running sum over elements of tElementSize bytes (1, 2, 4, 8 or 16),
+		// in place. Returns the number of elements processed; the rest is left
+		// to the caller.
+		template< typename tType, std::size_t tElementSize >
+		std::size_t running_sum_simd_( std::uint8_t* aData, std::size_t aCount )
+		{
+			constexpr std::size_t perVector = 16 / tElementSize;
+
+			// Last element of the previous vector, in all positions
+			__m128i prev = _mm_setzero_si128();
+
+			std::size_t i = 0;
+			for( ; i + perVector <= aCount; i += perVector )
+			{
+				auto* ptr = reinterpret_cast<__m128i*>(aData + i*tElementSize);
+				__m128i v = _mm_loadu_si128( ptr );
+
+				// Log-step prefix sum within the vector
+				if constexpr( tElementSize <= 1 )
+					v = add_<tType>( v, _mm_slli_si128( v, 1 ) );
+				if constexpr( tElementSize <= 2 )
+					v = add_<tType>( v, _mm_slli_si128( v, 2 ) );
+				if constexpr( tElementSize <= 4 )
+					v = add_<tType>( v, _mm_slli_si128( v, 4 ) );
+				if constexpr( tElementSize <= 8 )
+					v = add_<tType>( v, _mm_slli_si128( v, 8 ) );
+
+				v = add_<tType>( v, prev );
+				_mm_storeu_si128( ptr, v );
+
+				if constexpr( 1 == tElementSize )
+				{
+					__m128i const last = _mm_srli_si128( v, 15 );
+					__m128i const pair = _mm_unpacklo_epi8( last, last );
+					prev = _mm_shuffle_epi32( _mm_unpacklo_epi16( pair, pair ), _MM_SHUFFLE(0,0,0,0) );
+				}
+				else if constexpr( 2 == tElementSize )
+					prev = _mm_shuffle_epi32( _mm_shufflehi_epi16( v, _MM_SHUFFLE(3,3,3,3) ), _MM_SHUFFLE(3,3,3,3) );
+				else if constexpr( 4 == tElementSize )
+					prev = _mm_shuffle_epi32( v, _MM_SHUFFLE(3,3,3,3) );
+				else if constexpr( 8 == tElementSize )
+					prev = _mm_shuffle_epi32( v, _MM_SHUFFLE(3,2,3,2) );
+				else
+					prev = v;
+			}
+
+			return i;
+		}
+#		endif // ~ GEOMETRY_CODEC_SIMD_
+
+		// Common layouts have a fixed component count. The deltas of each
+		// component are gathered from the planes and interleaved into the
+		// destination, followed by the running sum. Only the latter is a
+		// serial step, and it is done with SIMD where the element size
+		// allows.
+		template< typename tType, std::size_t tComponents >
+		void unfilter_fixed_( std::uint8_t* aDest, std::uint8_t const* aPlanes, std::size_t aCount )
+		{
+			constexpr std::size_t kBlock = 512;
+			constexpr std::size_t elementSize = tComponents * sizeof(tType);
+
+#			if defined(GEOMETRY_CODEC_SIMD_)
+			constexpr bool simdSum = (16 % elementSize == 0);
+#			else
+			constexpr bool simdSum = false;
+#			endif
+
+			tType prev[tComponents] = {};
+			tType deltas[tComponents][kBlock];
+
+			for( std::size_t base = 0; base < aCount; base += kBlock )
+			{
+				std::size_t const count = std::min( kBlock, aCount - base );
+
+				for( std::size_t c = 0; c < tComponents; ++c )
+					gather_deltas_<tType>( deltas[c], aPlanes + c*sizeof(tType)*aCount + base, aCount, count );
+
+				// Without the SIMD pass, the running sum is done here
+				std::uint8_t* dest = aDest + base*elementSize;
+				for( std::size_t i = 0; i < count; ++i )
+				{
+					tType values[tComponents];
+					for( std::size_t c = 0; c < tComponents; ++c )
+						values[c] = simdSum ? deltas[c][i] : (prev[c] = tType( prev[c] + deltas[c][i] ));
+
+					std::memcpy( dest + i*elementSize, values, elementSize );
+				}
+			}
+
+#			if defined(GEOMETRY_CODEC_SIMD_)
+			if constexpr( simdSum )
+			{
+				std::size_t i = running_sum_simd_<tType,elementSize>( aDest, aCount );
+
+				// Remainder
+				if( i )
+					std::memcpy( prev, aDest + (i-1)*elementSize, elementSize );
+
+				for( ; i < aCount; ++i )
+				{
+					tType values[tComponents];
+					std::memcpy( values, aDest + i*elementSize, elementSize );
+
+					for( std::size_t c = 0; c < tComponents; ++c )
+						values[c] = prev[c] = tType( prev[c] + values[c] );
+
+					std::memcpy( aDest + i*elementSize, values, elementSize );
+				}
+			}
+#			endif // ~ GEOMETRY_CODEC_SIMD_
+		}
+
+		template< typename tType >
+		void unfilter_( std::uint8_t* aDest, std::uint8_t const* aPlanes, std::size_t aCount, std::size_t aElementSize )
+		{
+			std::size_t const components = aElementSize / sizeof(tType);
+
+			switch( components )
+			{
+				case 1: unfilter_fixed_<tType,1>( aDest, aPlanes, aCount ); return;
+				case 2: unfilter_fixed_<tType,2>( aDest, aPlanes, aCount ); return;
+				case 3: unfilter_fixed_<tType,3>( aDest, aPlanes, aCount ); return;
+				case 4: unfilter_fixed_<tType,4>( aDest, aPlanes, aCount ); return;
+			}
+
+			for( std::size_t c = 0; c < components; ++c )
+			{
+				std::uint8_t const* planes = aPlanes + c*sizeof(tType)*aCount;
+				std::uint8_t* dest = aDest + c*sizeof(tType);
+
+				tType prev = 0;
+				for( std::size_t i = 0; i < aCount; ++i )
+				{
+					tType delta = 0;
+					for( std::size_t b = 0; b < sizeof(tType); ++b )
+						delta = tType( delta | tType( tType(planes[b*aCount + i]) << (8*b) ) );
+
+					prev = tType( prev + unzigzag_<tType>( delta ) );
+					std::memcpy( dest + i*aElementSize, &prev, sizeof(tType) );
+				}
+			}
+		}
+
+		// Index codec state; see geometry_codec.hpp. Both FIFOs are rings of
+		// 16 entries, addressed by distance from the most recent entry.
+		constexpr std::size_t kFifoSize_ = 16;
+		constexpr std::size_t kEdgeRefs_ = 15; // code bytes 0x00-0xef
+		constexpr std::size_t kVertexRefs_ = 14; // vertex codes 1-14
+
+		constexpr std::uint8_t kNoEdgeCode_ = 0xf0;
+
+		constexpr std::uint8_t kNextVertex_ = 0;
+		constexpr std::uint8_t kDeltaVertex_ = 15;
+
+		struct IndexFifos_
+		{
+			std::uint32_t edges[kFifoSize_][2] = {};
+			std::uint32_t vertices[kFifoSize_] = {};
+			std::size_t edgeHead = 0, vertexHead = 0;
+
+			std::uint32_t next = 0, last = 0;
+
+			void push_edge( std::uint32_t aA, std::uint32_t aB )
+			{
+				edges[edgeHead][0] = aA;
+				edges[edgeHead][1] = aB;
+				edgeHead = (edgeHead+1) % kFifoSize_;
+			}
+			void push_vertex( std::uint32_t aV )
+			{
+				vertices[vertexHead] = aV;
+				vertexHead = (vertexHead+1) % kFifoSize_;
+			}
+
+			std::uint32_t const* edge( std::size_t aDistance ) const
+			{
+				return edges[(edgeHead + kFifoSize_-1 - aDistance) % kFifoSize_];
+			}
+			std::uint32_t vertex( std::size_t aDistance ) const
+			{
+				return vertices[(vertexHead + kFifoSize_-1 - aDistance) % kFifoSize_];
+			}
+
+			// Edges across which a neighbouring triangle (with the same
+			// winding) is expected; it will contain them reversed.
+			void push_triangle_edges( std::uint32_t aA, std::uint32_t aB, std::uint32_t aC, bool aFirstEdgeKnown )
+			{
+				if( !aFirstEdgeKnown )
+					push_edge( aB, aA );
+
+				push_edge( aC, aB );
+				push_edge( aA, aC );
+			}
+		};
+
+		void write_varint_( std::vector<std::uint8_t>& aOut, std::uint32_t aValue )
+		{
+			for( ; aValue >= 0x80; aValue >>= 7 )
+				aOut.emplace_back( std::uint8_t(aValue | 0x80) );
+			aOut.emplace_back( std::uint8_t(aValue) );
+		}
+
+		std::uint32_t read_varint_( std::uint8_t const*& aIn, std::uint8_t const* aEnd )
+		{
+			std::uint32_t ret = 0;
+			for( unsigned shift = 0; shift < 35; shift += 7 )
+			{
+				if( aIn == aEnd )
+					throw Error( "decode_index_stream(): truncated data" );
+
+				std::uint8_t const byte = *aIn++;
+				ret |= std::uint32_t(byte & 0x7f) << shift;
+
+				if( !(byte & 0x80) )
+					return ret;
+			}
+
+			throw Error( "decode_index_stream(): invalid varint" );
+		}
+
+		// Four bit vertex code, without changing the state
+		std::uint8_t vertex_code_( IndexFifos_ const& aFifos, std::uint32_t aIndex )
+		{
+			if( aIndex == aFifos.next )
+				return kNextVertex_;
+
+			for( std::size_t i = 0; i < kVertexRefs_; ++i )
+			{
+				if( aFifos.vertex( i ) == aIndex )
+					return std::uint8_t(1 + i);
+			}
+
+			return kDeltaVertex_;
+		}
+
+		// Updates the state for a vertex with the given code. Deltas are
+		// appended to aDeltas.
+		void encode_vertex_( std::vector<std::uint8_t>& aDeltas, IndexFifos_& aFifos, std::uint8_t aCode, std::uint32_t aIndex )
+		{
+			if( kNextVertex_ == aCode )
+			{
+				aFifos.push_vertex( aFifos.next++ );
+			}
+			else if( kDeltaVertex_ == aCode )
+			{
+				write_varint_( aDeltas, zigzag_<std::uint32_t>( aIndex - aFifos.last ) );
+				aFifos.last = aIndex;
+				aFifos.push_vertex( aIndex );
+			}
+		}
+
+		std::uint32_t decode_vertex_( std::uint8_t aCode, std::uint8_t const*& aIn, std::uint8_t const* aEnd, IndexFifos_& aFifos )
+		{
+			if( kNextVertex_ == aCode )
+			{
+				aFifos.push_vertex( aFifos.next );
+				return aFifos.next++;
+			}
+
+			if( kDeltaVertex_ != aCode )
+				return aFifos.vertex( aCode - 1 );
+
+			aFifos.last += unzigzag_<std::uint32_t>( read_varint_( aIn, aEnd ) );
+			aFifos.push_vertex( aFifos.last );
+			return aFifos.last;
+		}
+
+		template< typename tIndex >
+		void encode_indices_( std::vector<std::uint8_t>& aOut, tIndex const* aIndices, std::size_t aCount )
+		{
+			IndexFifos_ fifos;
+			std::vector<std::uint8_t> deltas;
+
+			auto const cost_ = [] (std::uint8_t aCode) {
+				return kNextVertex_ == aCode ? 0 : (kDeltaVertex_ == aCode ? 2 : 1);
+			};
+
+			for( std::size_t t = 0; t < aCount; t += 3 )
+			{
+				std::uint32_t const tri[3] = { aIndices[t+0], aIndices[t+1], aIndices[t+2] };
+
+				// Find a shared edge, in any rotation of the triangle. Among
+				// these, pick the cheapest third vertex, then the most recent
+				// edge.
+				std::size_t edge = kEdgeRefs_, rot = 0;
+				std::uint8_t third = kDeltaVertex_;
+				for( std::size_t e = 0; e < kEdgeRefs_; ++e )
+				{
+					auto const* ab = fifos.edge( e );
+					for( std::size_t r = 0; r < 3; ++r )
+					{
+						if( tri[r] != ab[0] || tri[(r+1)%3] != ab[1] )
+							continue;
+
+						auto const code = vertex_code_( fifos, tri[(r+2)%3] );
+						if( kEdgeRefs_ == edge || cost_( code ) < cost_( third ) )
+						{
+							edge = e;
+							rot = r;
+							third = code;
+						}
+					}
+
+					if( kEdgeRefs_ != edge && kNextVertex_ == third )
+						break;
+				}
+
+				deltas.clear();
+				if( kEdgeRefs_ != edge )
+				{
+					std::uint32_t const a = tri[rot], b = tri[(rot+1)%3], c = tri[(rot+2)%3];
+
+					aOut.emplace_back( std::uint8_t( (edge << 4) | third ) );
+					encode_vertex_( deltas, fifos, third, c );
+
+					fifos.push_triangle_edges( a, b, c, true );
+				}
+				else
+				{
+					std::uint8_t codes[3];
+					for( std::size_t i = 0; i < 3; ++i )
+					{
+						codes[i] = vertex_code_( fifos, tri[i] );
+						encode_vertex_( deltas, fifos, codes[i], tri[i] );
+					}
+
+					aOut.emplace_back( std::uint8_t( kNoEdgeCode_ | codes[0] ) );
+					aOut.emplace_back( std::uint8_t( (codes[1] << 4) | codes[2] ) );
+
+					fifos.push_triangle_edges( tri[0], tri[1], tri[2], false );
+				}
+
+				aOut.insert( aOut.end(), deltas.begin(), deltas.end() );
+			}
+		}
+
+		template< typename tIndex >
+		void decode_indices_( tIndex* aDest, std::size_t aCount, std::size_t aVertexCount, std::uint8_t const* aData, std::size_t aDataSize )
+		{
+			IndexFifos_ fifos;
+
+			std::uint8_t const* ip = aData;
+			std::uint8_t const* const iend = aData + aDataSize;
+
+			for( std::size_t t = 0; t < aCount; t += 3 )
+			{
+				if( ip == iend )
+					throw Error( "decode_index_stream(): truncated data" );
+
+				auto const code = *ip++;
+
+				std::uint32_t a, b, c;
+				if( code < kNoEdgeCode_ )
+				{
+					auto const* ab = fifos.edge( code >> 4 );
+					a = ab[0];
+					b = ab[1];
+					c = decode_vertex_( code & 15, ip, iend, fifos );
+
+					fifos.push_triangle_edges( a, b, c, true );
+				}
+				else
+				{
+					if( ip == iend )
+						throw Error( "decode_index_stream(): truncated data" );
+
+					auto const codes = *ip++;
+
+					a = decode_vertex_( code & 15, ip, iend, fifos );
+					b = decode_vertex_( codes >> 4, ip, iend, fifos );
+					c = decode_vertex_( codes & 15, ip, iend, fifos );
+
+					fifos.push_triangle_edges( a, b, c, false );
+				}
+
+				if( a >= aVertexCount || b >= aVertexCount || c >= aVertexCount )
+					throw Error( "decode_index_stream(): index out of range" );
+
+				aDest[t+0] = tIndex(a);
+				aDest[t+1] = tIndex(b);
+				aDest[t+2] = tIndex(c);
+			}
+
+			if( ip != iend )
+				throw Error( "decode_index_stream(): %zu trailing bytes", std::size_t(iend - ip) );
+		}
+
+		void check_index_layout_( std::size_t aCount, std::size_t aIndexSize )
+		{
+			if( (2 != aIndexSize && 4 != aIndexSize) || 0 != aCount % 3 )
+				throw Error( "Invalid index stream layout (%zu indices of %zu bytes)", aCount, aIndexSize );
+		}
+
+		void check_layout_( std::size_t aElementSize, std::size_t aComponentSize )
+		{
+			if( (1 != aComponentSize && 2 != aComponentSize && 4 != aComponentSize) || 0 == aElementSize || 0 != aElementSize % aComponentSize )
+				throw Error( "Invalid geometry stream layout (%zu byte elements, %zu byte components)", aElementSize, aComponentSize );
+		}
+	}
+
+	void encode_geometry_stream( std::vector<std::uint8_t>& aOut, void const* aData, std::size_t aCount, std::size_t aElementSize, std::size_t aComponentSize )
+	{
+		check_layout_( aElementSize, aComponentSize );
+
+		std::vector<std::uint8_t> planes( aCount * aElementSize );
+		auto const* data = static_cast<std::uint8_t const*>(aData);
+
+		switch( aComponentSize )
+		{
+			case 1: filter_<std::uint8_t>( planes.data(), data, aCount, aElementSize ); break;
+			case 2: filter_<std::uint16_t>( planes.data(), data, aCount, aElementSize ); break;
+			case 4: filter_<std::uint32_t>( planes.data(), data, aCount, aElementSize ); break;
+		}
+
+		lz_compress( aOut, planes.data(), planes.size() );
+	}
+
+	void decode_geometry_stream( void* aDest, std::size_t aCount, std::size_t aElementSize, std::size_t aComponentSize, std::uint8_t const* aData, std::size_t aDataSize, std::vector<std::uint8_t>& aScratch )
+	{
+		check_layout_( aElementSize, aComponentSize );
+
+		aScratch.resize( aCount * aElementSize );
+		lz_decompress( aScratch.data(), aScratch.size(), aData, aDataSize );
+
+		auto* dest = static_cast<std::uint8_t*>(aDest);
+
+		switch( aComponentSize )
+		{
+			case 1: unfilter_<std::uint8_t>( dest, aScratch.data(), aCount, aElementSize ); break;
+			case 2: unfilter_<std::uint16_t>( dest, aScratch.data(), aCount, aElementSize ); break;
+			case 4: unfilter_<std::uint32_t>( dest, aScratch.data(), aCount, aElementSize ); break;
+		}
+	}
+
+	void encode_index_stream( std::vector<std::uint8_t>& aOut, void const* aIndices, std::size_t aCount, std::size_t aIndexSize )
+	{
+		check_index_layout_( aCount, aIndexSize );
+
+		if( 2 == aIndexSize )
+			encode_indices_( aOut, static_cast<std::uint16_t const*>(aIndices), aCount );
+		else
+			encode_indices_( aOut, static_cast<std::uint32_t const*>(aIndices), aCount );
+	}
+
+	void decode_index_stream( void* aDest, std::size_t aCount, std::size_t aIndexSize, std::size_t aVertexCount, std::uint8_t const* aData, std::size_t aDataSize )
+	{
+		check_index_layout_( aCount, aIndexSize );
+
+		if( 2 == aIndexSize )
+			decode_indices_( static_cast<std::uint16_t*>(aDest), aCount, std::min<std::size_t>( aVertexCount, 65536 ), aData, aDataSize );
+		else
+			decode_indices_( static_cast<std::uint32_t*>(aDest), aCount, aVertexCount, aData, aDataSize );
+	}
+
+	void lz_compress( std::vector<std::uint8_t>& aOut, std::uint8_t const* aData, std::size_t aSize )
+	{
+		// Greedy matching against the most recent position with the same
+		// hash. The step grows while no matches are found, which keeps
+		// incompressible data cheap.
+		std::vector<std::uint32_t> table( std::size_t(1) << kHashBits_, 0 );
+
+		std::size_t anchor = 0, pos = 0;
+		while( pos + kMinMatch_ <= aSize )
+		{
+			auto const value = load32_( aData + pos );
+			auto& entry = table[hash_( value )];
+
+			std::size_t const candidate = entry;
+			entry = std::uint32_t(pos);
+
+			if( candidate < pos && pos - candidate <= kMaxOffset_ && load32_( aData + candidate ) == value )
+			{
+				std::size_t length = kMinMatch_;
+				while( pos + length < aSize && aData[candidate + length] == aData[pos + length] )
+					++length;
+
+				emit_sequence_( aOut, aData + anchor, pos - anchor, pos - candidate, length );
+
+				pos += length;
+				anchor = pos;
+
+				// Make the end of the match findable
+				if( pos >= 2 && pos - 2 + kMinMatch_ <= aSize )
+					table[hash_( load32_( aData + pos - 2 ) )] = std::uint32_t(pos - 2);
+			}
+			else
+			{
+				pos += 1 + ((pos - anchor) >> 6);
+			}
+		}
+
+		if( anchor < aSize || 0 == aSize )
+			emit_sequence_( aOut, aData + anchor, aSize - anchor, 0, 0 );
+	}
+
+	void lz_decompress( std::uint8_t* aDest, std::size_t aDestSize, std::uint8_t const* aData, std::size_t aDataSize )
+	{
+		std::uint8_t* op = aDest;
+		std::uint8_t* const oend = aDest + aDestSize;
+
+		std::uint8_t const* ip = aData;
+		std::uint8_t const* const iend = aData + aDataSize;
+
+		while( ip < iend )
+		{
+			auto const token = *ip++;
+
+			// Literals
+			std::size_t literals = token >> 4;
+			if( 15 == literals )
+				literals += read_length_( ip, iend );
+
+			if( literals > std::size_t(iend - ip) || literals > std::size_t(oend - op) )
+				throw Error( "lz_decompress(): literals out of bounds" );
+
+			// Short runs are copied with a fixed size when there is room to
+			// spare; the excess is overwritten by what follows.
+			if( literals <= kWildCopy_ && iend - ip >= std::ptrdiff_t(kWildCopy_) && oend - op >= std::ptrdiff_t(kWildCopy_) )
+				std::memcpy( op, ip, kWildCopy_ );
+			else
+				std::memcpy( op, ip, literals );
+
+			op += literals;
+			ip += literals;
+
+			if( ip == iend )
+				break;
+
+			// Match
+			if( iend - ip < 2 )
+				throw Error( "lz_decompress(): truncated match" );
+
+			std::size_t const offset = std::size_t(ip[0]) | (std::size_t(ip[1]) << 8);
+			ip += 2;
+
+			std::size_t length = token & 15;
+			if( 15 == length )
+				length += read_length_( ip, iend );
+			length += kMinMatch_;
+
+			if( 0 == offset || offset > std::size_t(op - aDest) || length > std::size_t(oend - op) )
+				throw Error( "lz_decompress(): match out of bounds" );
+
+			std::uint8_t const* match = op - offset;
+
+			if( offset >= kWildCopy_ && std::size_t(oend - op) >= length + kWildCopy_ )
+			{
+				// No overlap within a chunk; may write past the match as above
+				for( std::size_t i = 0; i < length; i += kWildCopy_ )
+					std::memcpy( op + i, match + i, kWildCopy_ );
+
+				op += length;
+				continue;
+			}
+
+			if( 1 == offset )
+			{
+				std::memset( op, *match, length );
+				op += length;
+				continue;
+			}
+
+			if( length <= kWildCopy_ )
+			{
+				for( std::size_t i = 0; i < length; ++i )
+					op[i] = match[i];
+
+				op += length;
+				continue;
+			}
+
+			// Overlapping matches repeat the last offset bytes. The copied
+			// distance can double after each step, since any multiple of the
+			// offset repeats the same pattern.
+			std::size_t distance = offset;
+			while( length )
+			{
+				auto const count = std::min( length, distance );
+				std::memcpy( op, op - distance, count );
+
+				op += count;
+				length -= count;
+				distance += count;
+			}
+		}
+
+		if( op != oend )
+			throw Error( "lz_decompress(): expected %zu bytes, got %zu", aDestSize, std::size_t(op - aDest) );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
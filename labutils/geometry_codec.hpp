@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Compression of vertex and index streams. Used by cw2-bake for the
+ * compressed geometry feature of the baked mesh files, and by the loader in
+ * cw2.
+ *
+ * A stream is an array of elements (e.g., one per vertex) of a fixed size,
+ * made up of components of 1, 2 or 4 bytes. Encoding happens in two steps:
+ *
+ *  1. Filter: each component is replaced by the difference to the same
+ *     component of the previous element (wrapping, zig-zag encoded so that
+ *     small negative differences become small numbers). The bytes are then
+ *     split into planes, i.e., all first bytes of all components, then all
+ *     second bytes, and so on. Smooth attributes and coherent indices thus
+ *     turn into long runs of (near) zero bytes.
+ *  2. LZ compression of the planes. The format is byte oriented, similar to
+ *     LZ4: a sequence of (literals, match) pairs, each starting with a token
+ *     byte. The upper four bits hold the number of literals, the lower four
+ *     the match length minus four. A value of 15 is continued by additional
+ *     bytes that are added to it, until a byte other than 255. The literals
+ *     follow, then a 16-bit little endian match offset (1-65535), then any
+ *     additional match length bytes. The last sequence only has literals.
+ *
+ * Decoding undoes both steps. The LZ decoder only does byte copies. The
+ * planes are then reassembled block by block into the destination, followed
+ * by the running sum over the elements (both use SSE2 where available).
+ *
+ * Index buffers (triangle lists) use a separate codec that exploits the
+ * connectivity of the triangles instead. Encoder and decoder track two FIFOs
+ * of 16 entries: edges that a following triangle may share (each triangle
+ * adds its edges reversed, as a neighbour with the same winding contains
+ * them), and recently added vertices. Additionally, "next" is the next
+ * vertex that has not been referenced yet (vertices are expected in the
+ * order of first use), and "last" the last vertex coded as a delta. Each
+ * vertex is referenced by a four-bit code: 0 is "next", 1-14 select a vertex
+ * FIFO entry (distance 0-13), and 15 is a delta, i.e., a varint with the
+ * zig-zag encoded difference to "last" follows. Each triangle starts with a
+ * code byte:
+ *
+ *  - 0x00-0xef: the upper four bits select an edge (a, b) from the edge FIFO
+ *    (0 = most recent). The lower four bits are the vertex code of the third
+ *    vertex c, followed by its varint if the code is 15. Only the two new
+ *    edges are added to the edge FIFO.
+ *  - 0xf0-0xff: a triangle without a shared edge. The lower four bits are
+ *    the vertex code of a. A second byte holds the vertex codes of b (upper
+ *    four bits) and c (lower four bits). The varints of the vertices with
+ *    code 15 follow, in the order a, b, c. All three edges are added to the
+ *    edge FIFO.
+ *
+ * Newly referenced vertices ("next" or deltas) are added to the vertex FIFO.
+ * Varints are little endian base 128. The decoded triangles may be rotated
+ * relative to the input (the winding is unchanged). A well-ordered mesh
+ * needs about one byte per triangle.
+ *
+ * All values are little endian.
+ */
+
+namespace labutils
+{
+	// Appends the encoded stream to aOut. aElementSize must be a multiple of
+	// aComponentSize, which is 1, 2 or 4.
+	void encode_geometry_stream(
+		std::vector<std::uint8_t>& aOut,
+		void const* aData,
+		std::size_t aCount,
+		std::size_t aElementSize,
+		std::size_t aComponentSize
+	);
+
+	// Decodes aCount elements into aDest (aCount * aElementSize bytes). The
+	// parameters must match the ones used for encoding. aScratch holds the
+	// planes; reuse it between calls to avoid allocations. Throws lut::Error
+	// if the data is corrupt.
+	void decode_geometry_stream(
+		void* aDest,
+		std::size_t aCount,
+		std::size_t aElementSize,
+		std::size_t aComponentSize,
+		std::uint8_t const* aData,
+		std::size_t aDataSize,
+		std::vector<std::uint8_t>& aScratch
+	);
+
+	// Index buffers of triangle lists; aCount must be a multiple of three and
+	// aIndexSize is 2 or 4. The decoder checks that all indices are below
+	// aVertexCount, and throws lut::Error if the data is corrupt.
+	void encode_index_stream(
+		std::vector<std::uint8_t>& aOut,
+		void const* aIndices,
+		std::size_t aCount,
+		std::size_t aIndexSize
+	);
+	void decode_index_stream(
+		void* aDest,
+		std::size_t aCount,
+		std::size_t aIndexSize,
+		std::size_t aVertexCount,
+		std::uint8_t const* aData,
+		std::size_t aDataSize
+	);
+
+	// The LZ codec by itself. lz_compress() appends to aOut. lz_decompress()
+	// expects exactly aDestSize bytes of output, and throws lut::Error
+	// otherwise.
+	void lz_compress(
+		std::vector<std::uint8_t>& aOut,
+		std::uint8_t const* aData,
+		std::size_t aSize
+	);
+	void lz_decompress(
+		std::uint8_t* aDest,
+		std::size_t aDestSize,
+		std::uint8_t const* aData,
+		std::size_t aDataSize
+	);
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
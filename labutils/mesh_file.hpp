@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Baked mesh file format (.comp5822mesh). The files are written by cw2-bake
+ * and loaded with load_baked_model() (see cw2/baked_model.hpp for the full
+ * layout). This header holds the parts that writers and readers must agree
+ * on: the header constants, the feature flags and the per-mesh vertex and
+ * index streams.
+ *
+ * Each mesh stores kMeshFileStreamCount streams, in the order given by
+ * mesh_file_stream(). The element and component sizes depend on the
+ * features of the file; with kMeshFeatureCompressed, the component size is
+ * the unit that is delta-encoded (see labutils/geometry_codec.hpp).
+ *
+ * All values are little endian.
+ */
+
+namespace labutils
+{
+	/* File "magic". The first 16 bytes of our custom file are equal to this
+	 * magic value. This allows us to check whether a certain file is
+	 * (probably) of the right type. Having a file magic is relatively common
+	 * practice -- you can find a list of such magic sequences e.g. here:
+	 * https://en.wikipedia.org/wiki/List_of_file_signatures
+	 *
+	 * When picking a signature there are a few considerations. For example,
+	 * including non-printable characters (e.g. the \0) early keeps the file
+	 * from being misidentified as text.
+	 */
+	constexpr char kMeshFileMagic[16] = "\0\0COMP5822Mmesh";
+
+	/* Note: change the file variant if you change the file format!
+	 *
+	 * Suggestion: use 'uid-tag'. For example, I would use "scsmbil-tan" to
+	 * indicate that this is a custom format by myself (=scsmbil) with
+	 * additional tangent space information.
+	 */
+	constexpr char kMeshFileVariant[16] = "cw2-ext-tbn";
+
+	/* Optional parts of the file. The header is followed by a uint32_t with
+	 * the set of features present in the file.
+	 */
+	constexpr std::uint32_t kMeshFeatureMeshlets = 1u << 0;
+	constexpr std::uint32_t kMeshFeatureLods = 1u << 1;
+	constexpr std::uint32_t kMeshFeatureQuantized = 1u << 2;
+	constexpr std::uint32_t kMeshFeatureIndex16 = 1u << 3;
+	constexpr std::uint32_t kMeshFeaturePackedOrm = 1u << 4;
+	constexpr std::uint32_t kMeshFeatureCompressed = 1u << 5;
+
+	constexpr std::uint32_t kMeshKnownFeatures = kMeshFeatureMeshlets | kMeshFeatureLods | kMeshFeatureQuantized | kMeshFeatureIndex16 | kMeshFeaturePackedOrm | kMeshFeatureCompressed;
+
+	// Vertex and index streams of a mesh
+	enum class MeshFileStream : std::uint32_t
+	{
+		position, // vec3, or uint16_t[4] (unorm, w = 0) if quantized
+		normal,   // vec3, or int16_t[2] (snorm, octahedral) if quantized
+		texcoord, // vec2, or uint16_t[2] (half float) if quantized
+		tangent,  // vec4 (w = handedness)
+		packedTbn, // uint32_t packed TBN quaternion
+		indices   // uint16_t with kMeshFeatureIndex16, uint32_t otherwise
+	};
+
+	struct MeshFileStreamLayout
+	{
+		MeshFileStream stream;
+		std::uint32_t elementSize;
+		std::uint32_t componentSize;
+	};
+
+	constexpr std::size_t kMeshFileStreamCount = 6;
+
+	// The aIndex-th stream of each mesh (in file order), for a file with
+	// the features aFeatures. Vertex streams have one element per vertex,
+	// the index stream one per index.
+	constexpr
+	MeshFileStreamLayout mesh_file_stream( std::uint32_t aFeatures, std::size_t aIndex )
+	{
+		bool const quantized = 0 != (aFeatures & kMeshFeatureQuantized);
+		bool const index16 = 0 != (aFeatures & kMeshFeatureIndex16);
+
+		switch( aIndex )
+		{
+			case 0: return quantized
+				? MeshFileStreamLayout{ MeshFileStream::position, 4*2, 2 }
+				: MeshFileStreamLayout{ MeshFileStream::position, 3*4, 4 };
+			case 1: return quantized
+				? MeshFileStreamLayout{ MeshFileStream::normal, 2*2, 2 }
+				: MeshFileStreamLayout{ MeshFileStream::normal, 3*4, 4 };
+			case 2: return quantized
+				? MeshFileStreamLayout{ MeshFileStream::texcoord, 2*2, 2 }
+				: MeshFileStreamLayout{ MeshFileStream::texcoord, 2*4, 4 };
+			case 3: return MeshFileStreamLayout{ MeshFileStream::tangent, 4*4, 4 };
+			case 4: return MeshFileStreamLayout{ MeshFileStream::packedTbn, 4, 4 };
+		}
+
+		return index16
+			? MeshFileStreamLayout{ MeshFileStream::indices, 2, 2 }
+			: MeshFileStreamLayout{ MeshFileStream::indices, 4, 4 };
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
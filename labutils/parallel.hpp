@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace labutils
+{
+	// Number of workers used when none is requested explicitly. This is the
+	// number of hardware threads reported by the system (at least one).
+	std::size_t default_worker_count();
+
+	// Call aFunc( i ) for every i in [0, aCount), spreading the calls over up to
+	// aWorkerCount threads. The calling thread is one of the workers, so with a
+	// worker count of one (or a single item), everything runs inline.
+	//
+	// Items are handed out one at a time from a shared counter. This keeps the
+	// workers busy even if the individual items vary a lot in cost (which meshes
+	// typically do). Note that the order in which items are processed is not
+	// defined; results should therefore be written to a per-item slot.
+	//
+	// If a call throws, no further items are started, and the first exception is
+	// rethrown in the calling thread once all workers have finished.
+	template< typename tFunc >
+	void parallel_for( std::size_t aCount, std::size_t aWorkerCount, tFunc&& aFunc );
+}
+
+#include "parallel.inl"
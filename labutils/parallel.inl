@@ -0,0 +1,88 @@
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+
+#include <algorithm>
+
+namespace labutils
+{
+	inline
+	std::size_t default_worker_count()
+	{
+		// hardware_concurrency() may return zero if the value is not computable.
+		return std::max( std::size_t(1), std::size_t(std::thread::hardware_concurrency()) );
+	}
+
+	template< typename tFunc >
+	inline
+	void parallel_for( std::size_t aCount, std::size_t aWorkerCount, tFunc&& aFunc )
+	{
+		auto const workers = std::min( std::max( std::size_t(1), aWorkerCount ), aCount );
+
+		if( workers <= 1 )
+		{
+			for( std::size_t i = 0; i < aCount; ++i )
+				aFunc( i );
+
+			return;
+		}
+
+		std::atomic<std::size_t> next{ 0 };
+		std::atomic<bool> failed{ false };
+
+		std::mutex errorMutex;
+		std::exception_ptr error;
+
+		auto const work_ = [&] {
+			while( !failed.load( std::memory_order_relaxed ) )
+			{
+				auto const item = next.fetch_add( 1, std::memory_order_relaxed );
+				if( item >= aCount )
+					break;
+
+				try
+				{
+					aFunc( item );
+				}
+				catch( ... )
+				{
+					std::lock_guard<std::mutex> lock( errorMutex );
+					if( !error )
+						error = std::current_exception();
+
+					failed.store( true, std::memory_order_relaxed );
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve( workers-1 );
+
+		try
+		{
+			for( std::size_t i = 1; i < workers; ++i )
+				threads.emplace_back( work_ );
+		}
+		catch( ... )
+		{
+			// Could not start (all) threads. Stop handing out work, and wait for
+			// the threads that did start before reporting the problem.
+			failed.store( true );
+			for( auto& thread : threads )
+				thread.join();
+			throw;
+		}
+
+		work_();
+
+		for( auto& thread : threads )
+			thread.join();
+
+		if( error )
+			std::rethrow_exception( error );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+/* Baked texture file format. The files are written by cw2-bake and loaded
+ * with labutils::load_baked_texture2d(). All levels of the mip chain are
+ * precomputed, so loading is a single copy into the image.
+ *
+ *  1. Header: TextureFileHeader
+ *  2. Mip table: TextureFileHeader::levelCount times TextureFileLevel,
+ *     starting with the full-resolution level
+ *  3. Level data: TextureFileHeader::dataSize bytes, starting at the first
+ *     multiple of kTextureFileAlignment after the mip table. The offsets in
+ *     the mip table are relative to the start of the level data and are
+ *     multiples of kTextureFileAlignment. Rows are tightly packed. For the
+ *     block-compressed formats, a level consists of ceil(w/4) x ceil(h/4)
+ *     blocks, in row-major order.
+ *
+ * The mip chain is complete (down to 1x1), i.e., it has as many levels as
+ * labutils::compute_mip_level_count() returns for the full-resolution image.
+ * Images are stored bottom row first (as if loaded with
+ * stbi_set_flip_vertically_on_load(1)).
+ *
+ * All values are little endian.
+ */
+
+namespace labutils
+{
+	constexpr char kTextureFileMagic[16] = "\0\0COMP5822Mtex";
+
+	// Alignment of the level data; enough for any texel or block size.
+	constexpr std::uint32_t kTextureFileAlignment = 16;
+
+	enum class TextureFileFormat : std::uint32_t
+	{
+		rgba8_srgb = 1, // VK_FORMAT_R8G8B8A8_SRGB
+		rgba8_unorm = 2, // VK_FORMAT_R8G8B8A8_UNORM
+		bc1_srgb = 3, // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+		bc3_srgb = 4, // VK_FORMAT_BC3_SRGB_BLOCK
+		bc4_unorm = 5, // VK_FORMAT_BC4_UNORM_BLOCK
+		bc5_unorm = 6, // VK_FORMAT_BC5_UNORM_BLOCK
+		bc1_unorm = 7, // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+
+		count // one past the largest format; not a valid format
+	};
+
+	// Size of a texel (uncompressed formats) or a 4x4 block (BCn formats)
+	constexpr
+	std::uint32_t texture_file_block_bytes( TextureFileFormat aFormat )
+	{
+		switch( aFormat )
+		{
+			case TextureFileFormat::rgba8_srgb:
+			case TextureFileFormat::rgba8_unorm:
+				return 4;
+			case TextureFileFormat::bc1_srgb:
+			case TextureFileFormat::bc1_unorm:
+			case TextureFileFormat::bc4_unorm:
+				return 8;
+			case TextureFileFormat::bc3_srgb:
+			case TextureFileFormat::bc5_unorm:
+				return 16;
+			case TextureFileFormat::count:
+				break;
+		}
+
+		return 0;
+	}
+
+	constexpr
+	bool texture_file_is_compressed( TextureFileFormat aFormat )
+	{
+		return TextureFileFormat::rgba8_srgb != aFormat && TextureFileFormat::rgba8_unorm != aFormat;
+	}
+
+	struct TextureFileHeader
+	{
+		char magic[16];
+		std::uint32_t format; // TextureFileFormat
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint32_t levelCount;
+		std::uint64_t dataSize;
+	};
+
+	struct TextureFileLevel
+	{
+		std::uint64_t offset;
+		std::uint64_t size;
+		std::uint32_t width;
+		std::uint32_t height;
+	};
+
+	static_assert( sizeof(TextureFileHeader) == 40 );
+	static_assert( sizeof(TextureFileLevel) == 24 );
+
+	// Offset of the level data from the start of the file
+	constexpr
+	std::uint64_t texture_file_data_offset( std::uint32_t aLevelCount )
+	{
+		std::uint64_t const end = sizeof(TextureFileHeader) + std::uint64_t(aLevelCount) * sizeof(TextureFileLevel);
+		return (end + kTextureFileAlignment-1) / kTextureFileAlignment * kTextureFileAlignment;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
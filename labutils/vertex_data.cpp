@@ -7,21 +7,43 @@
 #include "../labutils/error.hpp"
 #include "../labutils/vkutil.hpp"
 #include "../labutils/to_string.hpp"
+#include "../labutils/parallel.hpp"
+#include "../labutils/mesh_file.hpp"
 
 #include "glm/glm.hpp"
 
 namespace lut = labutils;
 
 
-objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator const& aAllocator, BakedMeshData aMesh)
+objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator const& aAllocator, std::uint32_t aFeatures, BakedMeshData& aMesh)
 {
 
 	objMesh tmpMesh;
 
+	// Stream sizes, in file order (see labutils/mesh_file.hpp). Quantized
+	// models provide 16-bit positions, normals and texture coordinates
+	// instead of the float ones, and the indices may be 16-bit (see
+	// baked_model.hpp).
+	std::size_t const posBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 0);
+	std::size_t const normBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 1);
+	std::size_t const texBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 2);
+	std::size_t const tanBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 3);
+	std::size_t const tbnBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 4);
+	std::size_t const indBytes = baked_mesh_stream_bytes(aMesh, aFeatures, 5);
+
+	bool const index16 = 0 != (aFeatures & lut::kMeshFeatureIndex16);
+
+	// Meshes whose streams are still encoded (see load_baked_model()) are
+	// decoded straight into the staging buffers. The decoder reads back the
+	// values it has written, so these use cached host memory rather than
+	// write-combined memory.
+	bool const encoded = !aMesh.encoded.empty();
+	VmaMemoryUsage const stagingUsage = encoded ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_CPU_TO_GPU;
+
 	//position
 	lut::Buffer VertexPosGPU = lut::create_buffer(
 		aAllocator,
-		aMesh.positions.size() * sizeof(glm::vec3),
+		posBytes,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		//VMA_MEMORY_USAGE_CPU_TO_GPU:This indicates that VMA should try to use device local memory for
 		//the on - GPU buffer whenever possible
@@ -31,7 +53,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//normal
 	lut::Buffer VertexNormGPU = lut::create_buffer(
 		aAllocator,
-		aMesh.normals.size() * sizeof(glm::vec3),
+		normBytes,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		//VMA_MEMORY_USAGE_CPU_TO_GPU:This indicates that VMA should try to use device local memory for
 		//the on - GPU buffer whenever possible
@@ -41,7 +63,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//texcoords
 	lut::Buffer VertexTexGPU = lut::create_buffer(
 		aAllocator,
-		aMesh.texcoords.size() * sizeof(glm::vec2),
+		texBytes,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VMA_MEMORY_USAGE_GPU_ONLY
 	);
@@ -50,7 +72,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//tangents
 	lut::Buffer VertexTanGPU = lut::create_buffer(
 		aAllocator,
-		aMesh.tangents.size() * sizeof(glm::vec4),
+		tanBytes,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VMA_MEMORY_USAGE_GPU_ONLY
 	);
@@ -58,7 +80,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//indices
 	lut::Buffer VertexIndGPU = lut::create_buffer(
 		aAllocator,
-		aMesh.indices.size() * sizeof(std::uint32_t),
+		indBytes,
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VMA_MEMORY_USAGE_GPU_ONLY
 	);
@@ -66,7 +88,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//tbn
 	lut::Buffer VertextbnGPU = lut::create_buffer(
 		aAllocator,
-		sizeof(std::uint32_t) * aMesh.packedTBN.size(),
+		tbnBytes,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT| VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 		VMA_MEMORY_USAGE_GPU_ONLY
 	);
@@ -75,118 +97,113 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	//position
 	lut::Buffer posStaging = lut::create_buffer(
 		aAllocator,
-		aMesh.positions.size() * sizeof(glm::vec3),
+		posBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//normal
 	lut::Buffer normStaging = lut::create_buffer(
 		aAllocator,
-		aMesh.normals.size() * sizeof(glm::vec3),
+		normBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//texcoords
 	lut::Buffer texStaging = lut::create_buffer(
 		aAllocator,
-		aMesh.texcoords.size() * sizeof(glm::vec2),
+		texBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//tangents
 	lut::Buffer tanStaging = lut::create_buffer(
 		aAllocator,
-		aMesh.tangents.size() * sizeof(glm::vec4),
+		tanBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//indices
 	lut::Buffer indStaging = lut::create_buffer(
 		aAllocator,
-		aMesh.indices.size() * sizeof(std::uint32_t),
+		indBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//tbn
 	lut::Buffer tbnStaging = lut::create_buffer(
 		aAllocator,
-		sizeof(std::uint32_t) * aMesh.packedTBN.size(),
+		tbnBytes,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
+		stagingUsage
 	);
 
 	//-------------------------------------------------------------------------------------------------------
-	void* posPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, posStaging.allocation, &posPtr);
-		VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
-	}
-	std::memcpy(posPtr, aMesh.positions.data(), aMesh.positions.size() * sizeof(glm::vec3));
-	vmaUnmapMemory(aAllocator.allocator, posStaging.allocation);
-
-
-	void* normPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, normStaging.allocation, &normPtr);
-		VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
-	}
-	std::memcpy(normPtr, aMesh.normals.data(), aMesh.normals.size() * sizeof(glm::vec3));
-	vmaUnmapMemory(aAllocator.allocator, normStaging.allocation);
-
-	void* texPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, texStaging.allocation, &texPtr);
-		VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
-	}
-	std::memcpy(texPtr, aMesh.texcoords.data(), aMesh.texcoords.size() * sizeof(glm::vec2));
-	vmaUnmapMemory(aAllocator.allocator, texStaging.allocation);
-
-	void* tanPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, tanStaging.allocation, &tanPtr);
-		VK_SUCCESS != res)
+	// Map all staging buffers first, so that encoded streams can be decoded
+	// into them. The mappings are released when leaving this block, also
+	// if decoding fails.
 	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
+		struct Mapping_
+		{
+			VmaAllocator allocator = VK_NULL_HANDLE;
+			VmaAllocation allocation = VK_NULL_HANDLE;
+			void* data = nullptr;
+
+			Mapping_() = default;
+			Mapping_(Mapping_ const&) = delete;
+			Mapping_& operator=(Mapping_ const&) = delete;
+
+			~Mapping_()
+			{
+				if (data)
+					vmaUnmapMemory(allocator, allocation);
+			}
+		};
+
+		// In file order
+		Mapping_ mappings[lut::kMeshFileStreamCount];
+		lut::Buffer const* stagings[lut::kMeshFileStreamCount] = { &posStaging, &normStaging, &texStaging, &tanStaging, &tbnStaging, &indStaging };
+
+		void* ptrs[lut::kMeshFileStreamCount];
+		for (std::size_t i = 0; i < lut::kMeshFileStreamCount; ++i)
+		{
+			if (const auto res = vmaMapMemory(aAllocator.allocator, stagings[i]->allocation, &ptrs[i]);
+				VK_SUCCESS != res)
+			{
+				throw lut::Error("Mapping memory for writing\n"
+					"vmaMapMemory() returned %s", lut::to_string(res).c_str()
+				);
+			}
+
+			mappings[i].allocator = aAllocator.allocator;
+			mappings[i].allocation = stagings[i]->allocation;
+			mappings[i].data = ptrs[i];
+		}
+
+		if (encoded)
+			decode_baked_mesh(aMesh, aFeatures, ptrs, lut::default_worker_count());
+		else
+		{
+			for (std::size_t i = 0; i < lut::kMeshFileStreamCount; ++i)
+				std::memcpy(ptrs[i], baked_mesh_stream(aMesh, aFeatures, i), baked_mesh_stream_bytes(aMesh, aFeatures, i));
+		}
+
+		// Cached host memory is not necessarily coherent
+		for (std::size_t i = 0; i < lut::kMeshFileStreamCount; ++i)
+		{
+			if (const auto res = vmaFlushAllocation(aAllocator.allocator, stagings[i]->allocation, 0, VK_WHOLE_SIZE);
+				VK_SUCCESS != res)
+			{
+				throw lut::Error("Flushing staging memory\n"
+					"vmaFlushAllocation() returned %s", lut::to_string(res).c_str()
+				);
+			}
+		}
 	}
-	std::memcpy(tanPtr, aMesh.tangents.data(), aMesh.tangents.size() * sizeof(glm::vec4));
-	vmaUnmapMemory(aAllocator.allocator, tanStaging.allocation);
-
-	void* indPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, indStaging.allocation, &indPtr);
-		VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
-	}
-	std::memcpy(indPtr, aMesh.indices.data(), aMesh.indices.size() * sizeof(std::uint32_t));
-	vmaUnmapMemory(aAllocator.allocator, indStaging.allocation);
-
-	void* tbnPtr = nullptr;
-	if (const auto res = vmaMapMemory(aAllocator.allocator, tbnStaging.allocation, &tbnPtr);
-		VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str()
-		);
-	}
-	std::memcpy(tbnPtr, aMesh.packedTBN.data(), aMesh.packedTBN.size() * sizeof(std::uint32_t));
-	vmaUnmapMemory(aAllocator.allocator, tbnStaging.allocation);
 
 	//-----------------------------------------------------------------------------------------------------------
 	//prepare for issuing the transfer commands that copy data from the staging buffers to
@@ -214,7 +231,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 
 	//position
 	VkBufferCopy pcopy{};
-	pcopy.size = aMesh.positions.size() * sizeof(glm::vec3);
+	pcopy.size = posBytes;
 
 	vkCmdCopyBuffer(uploadCmd, posStaging.buffer, VertexPosGPU.buffer, 1, &pcopy);
 
@@ -228,7 +245,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 
 	//normal
 	VkBufferCopy ncopy{};
-	ncopy.size = aMesh.normals.size() * sizeof(glm::vec3);
+	ncopy.size = normBytes;
 
 	vkCmdCopyBuffer(uploadCmd, normStaging.buffer, VertexNormGPU.buffer, 1, &ncopy);
 
@@ -242,7 +259,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 
 	//texcoords
 	VkBufferCopy tcopy{};
-	tcopy.size = aMesh.texcoords.size() * sizeof(glm::vec2);
+	tcopy.size = texBytes;
 
 	vkCmdCopyBuffer(uploadCmd, texStaging.buffer, VertexTexGPU.buffer, 1, &tcopy);
 
@@ -256,7 +273,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 
 	//tangents
 	VkBufferCopy tancopy{};
-	tancopy.size = aMesh.tangents.size() * sizeof(glm::vec4);
+	tancopy.size = tanBytes;
 
 	vkCmdCopyBuffer(uploadCmd, tanStaging.buffer, VertexTanGPU.buffer, 1, &tancopy);
 
@@ -270,21 +287,21 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 
 	//indices
 	VkBufferCopy icopy{};
-	icopy.size = aMesh.indices.size() * sizeof(std::uint32_t);
+	icopy.size = indBytes;
 
 	vkCmdCopyBuffer(uploadCmd, indStaging.buffer, VertexIndGPU.buffer, 1, &icopy);
 
 	lut::buffer_barrier(uploadCmd,
 		VertexIndGPU.buffer,
 		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+		VK_ACCESS_INDEX_READ_BIT,
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
 	);
 
 	//tbn
 	VkBufferCopy tbncopy{};
-	tbncopy.size = aMesh.packedTBN.size() * sizeof(glm::uint32_t);
+	tbncopy.size = tbnBytes;
 
 	vkCmdCopyBuffer(uploadCmd, tbnStaging.buffer, VertextbnGPU.buffer, 1, &tbncopy);
 
@@ -337,6 +354,7 @@ objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator
 	tmpMesh.texcoords = std::move(VertexTexGPU);
 	tmpMesh.tangents= std::move(VertexTanGPU);
 	tmpMesh.indices = std::move(VertexIndGPU);
+	tmpMesh.indexType = index16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 	tmpMesh.packedTBN = std::move(VertextbnGPU);
 
 	return tmpMesh;
@@ -18,8 +18,13 @@ struct objMesh
 	labutils::Buffer indices;
 	labutils::Buffer packedTBN;
 
+	VkIndexType indexType; // for vkCmdBindIndexBuffer()
+
 };
 
 
-objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator const& aAllocator, BakedMeshData aModel);
+// Upload the vertex and index streams of a mesh of a model with the features
+// aFeatures. Encoded streams (see load_baked_model()) are decoded straight
+// into the staging buffers.
+objMesh create_mesh(labutils::VulkanContext const& aContext, labutils::Allocator const& aAllocator, std::uint32_t aFeatures, BakedMeshData& aMesh);
 
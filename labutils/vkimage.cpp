@@ -9,12 +9,11 @@
 #include <cassert>
 #include <cstring> // for std::memcpy()
 
-#include <stb_image.h>
-
 #include "error.hpp"
 #include "vkutil.hpp"
 #include "vkbuffer.hpp"
 #include "to_string.hpp"
+#include "texture_file.hpp"
 
 
 
@@ -108,7 +107,8 @@ namespace labutils
 		std::memcpy(sptr, Pixel, sizeInBytes);
 		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
 
-		Image ret = create_image_texture2d(aAllocator, width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		// Normal maps hold linear data (see cw2-bake)
+		Image ret = create_image_texture2d(aAllocator, width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 		VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
 
 		VkCommandBufferBeginInfo beginInfo{};
@@ -202,196 +202,170 @@ namespace labutils
 		return ret;
 	}
 
-	Image load_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator)
+	Image load_baked_texture2d( char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat* aFormat )
 	{
-		stbi_set_flip_vertically_on_load(1);
+		FILE* fin = std::fopen( aPath, "rb" );
+		if( !fin )
+			throw Error( "%s: unable to open baked texture", aPath );
+
+		struct Closer_ { FILE* f; ~Closer_() { std::fclose( f ); } } closer{ fin };
 
-		//load base image
-		int baseWidthi, baseHeighti, baseChannelsi;
-		stbi_uc* data = stbi_load(aPath, &baseWidthi, &baseHeighti, &baseChannelsi, 4);
+		// Header and mip table
+		TextureFileHeader header;
+		if( 1 != std::fread( &header, sizeof(header), 1, fin ) || 0 != std::memcmp( header.magic, kTextureFileMagic, sizeof(header.magic) ) )
+			throw Error( "%s: not a baked texture", aPath );
 
-		if (!data)
+		VkFormat format;
+		switch( TextureFileFormat(header.format) )
 		{
-			throw Error("%s: unable to load texture base image (%s)", aPath, 0,
-				stbi_failure_reason());
+			case TextureFileFormat::rgba8_srgb: format = VK_FORMAT_R8G8B8A8_SRGB; break;
+			case TextureFileFormat::rgba8_unorm: format = VK_FORMAT_R8G8B8A8_UNORM; break;
+			case TextureFileFormat::bc1_srgb: format = VK_FORMAT_BC1_RGB_SRGB_BLOCK; break;
+			case TextureFileFormat::bc3_srgb: format = VK_FORMAT_BC3_SRGB_BLOCK; break;
+			case TextureFileFormat::bc4_unorm: format = VK_FORMAT_BC4_UNORM_BLOCK; break;
+			case TextureFileFormat::bc5_unorm: format = VK_FORMAT_BC5_UNORM_BLOCK; break;
+			case TextureFileFormat::bc1_unorm: format = VK_FORMAT_BC1_RGB_UNORM_BLOCK; break;
+			default:
+				throw Error( "%s: unknown texture format %u", aPath, header.format );
 		}
 
-		const auto baseWidth = std::uint32_t(baseWidthi);
-		const auto baseHeight = std::uint32_t(baseHeighti);
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties( aContext.physicalDevice, format, &props );
+		if( !(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) )
+			throw Error( "%s: texture format %u is not supported by the device (bake with --no-compress-textures)", aPath, header.format );
 
-		auto const sizeInBytes = baseHeight * baseWidth * 4;
+		if( 0 == header.width || 0 == header.height || header.levelCount != compute_mip_level_count( header.width, header.height ) )
+			throw Error( "%s: invalid size or mip chain (%ux%u, %u levels)", aPath, header.width, header.height, header.levelCount );
 
-		auto staging = create_buffer(aAllocator, sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		std::vector<TextureFileLevel> levels( header.levelCount );
+		if( header.levelCount != std::fread( levels.data(), sizeof(TextureFileLevel), header.levelCount, fin ) )
+			throw Error( "%s: truncated mip table", aPath );
+
+		std::vector<VkBufferImageCopy> copies( header.levelCount );
+		for( std::uint32_t i = 0; i < header.levelCount; ++i )
+		{
+			auto const& level = levels[i];
+			if( level.offset % kTextureFileAlignment || level.offset + level.size > header.dataSize )
+				throw Error( "%s: level %u is out of bounds", aPath, i );
+
+			auto const fileFormat = TextureFileFormat(header.format);
+			auto const expectedWidth = std::max( 1u, header.width >> i ), expectedHeight = std::max( 1u, header.height >> i );
+			auto const blockSize = texture_file_is_compressed( fileFormat ) ? 4u : 1u;
+			auto const blocks = std::uint64_t( (expectedWidth + blockSize-1) / blockSize ) * ((expectedHeight + blockSize-1) / blockSize);
+			if( level.width != expectedWidth || level.height != expectedHeight || level.size != blocks * texture_file_block_bytes( fileFormat ) )
+				throw Error( "%s: level %u has an unexpected size", aPath, i );
+
+			auto& copy = copies[i];
+			copy.bufferOffset = level.offset;
+			copy.bufferRowLength = 0;
+			copy.bufferImageHeight = 0;
+			copy.imageSubresource = VkImageSubresourceLayers{
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				i,
+				0, 1
+			};
+			copy.imageOffset = VkOffset3D{ 0, 0, 0 };
+			copy.imageExtent = VkExtent3D{ level.width, level.height, 1 };
+		}
+
+		// Read level data straight into the staging buffer
+		auto staging = create_buffer( aAllocator, header.dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU );
 
 		void* sptr = nullptr;
-		if (const auto res = vmaMapMemory(aAllocator.allocator, staging.allocation, &sptr); VK_SUCCESS != res)
+		if( auto const res = vmaMapMemory( aAllocator.allocator, staging.allocation, &sptr ); VK_SUCCESS != res )
 		{
-			throw Error("Mapping memory for writing\n"
+			throw Error( "Mapping memory for writing\n"
 				"vmaMapMemory() returned %s", to_string(res).c_str()
 			);
 		}
 
-		std::memcpy(sptr, data, sizeInBytes);
-		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
+		bool const ok = 0 == std::fseek( fin, long(texture_file_data_offset( header.levelCount )), SEEK_SET )
+			&& header.dataSize == std::fread( sptr, 1, std::size_t(header.dataSize), fin );
 
-		stbi_image_free(data);
+		vmaUnmapMemory( aAllocator.allocator, staging.allocation );
 
-		Image ret = create_image_texture2d(aAllocator, baseWidth, baseHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		if( !ok )
+			throw Error( "%s: truncated level data", aPath );
 
-		VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
+		// Upload
+		Image ret = create_image_texture2d( aAllocator, header.width, header.height, format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
+
+		VkCommandBuffer cbuff = alloc_command_buffer( aContext, aCmdPool );
 
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		if (const auto res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+		if( auto const res = vkBeginCommandBuffer( cbuff, &beginInfo ); VK_SUCCESS != res )
 		{
-			throw Error("Beginning command buffer recording\n"
+			throw Error( "Beginning command buffer recording\n"
 				"vkBeginCommandBuffer() returned %s", to_string(res).c_str()
 			);
 		}
 
-		const auto mipLevels = compute_mip_level_count(baseWidth, baseHeight);
+		VkImageSubresourceRange const allLevels{
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			0, header.levelCount,
+			0, 1
+		};
 
-		image_barrier(cbuff, ret.image,
+		image_barrier( cbuff, ret.image,
 			0,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VkImageSubresourceRange{
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				0, mipLevels,
-				0, 1
-			}
+			allLevels
 		);
 
-		VkBufferImageCopy copy;
-		copy.bufferOffset = 0;
-		copy.bufferRowLength = 0;
-		copy.bufferImageHeight = 0;
-		copy.imageSubresource = VkImageSubresourceLayers{
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			0,
-			0,1
-		};
-		copy.imageOffset = VkOffset3D{ 0,0,0 };
-		copy.imageExtent = VkExtent3D{ baseWidth,baseHeight,1 };
-
-		vkCmdCopyBufferToImage(cbuff, staging.buffer, ret.image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+		vkCmdCopyBufferToImage( cbuff, staging.buffer, ret.image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, std::uint32_t(copies.size()), copies.data() );
 
-		image_barrier(cbuff, ret.image,
+		image_barrier( cbuff, ret.image,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VkImageSubresourceRange{
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				0, 1,
-				0, 1
-			}
-		);
-
-		std::uint32_t width = baseWidth, height = baseHeight;
-
-		for (std::uint32_t level = 1; level < mipLevels; ++level)
-		{
-			VkImageBlit blit{};
-			blit.srcSubresource = VkImageSubresourceLayers{
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				level - 1,
-				0,1
-			};
-			blit.srcOffsets[0] = { 0,0,0 };
-			blit.srcOffsets[1] = { std::int32_t(width),std::int32_t(height),1 };
-
-			width >>= 1; if (width == 0) width = 1;
-			height >>= 1; if (height == 0) height = 1;
-
-			blit.dstSubresource = VkImageSubresourceLayers{
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				level,
-				0,1
-			};
-
-			blit.dstOffsets[0] = { 0,0,0 };
-			blit.dstOffsets[1] = { std::int32_t(width),std::int32_t(height),1 };
-
-			vkCmdBlitImage(cbuff,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1, &blit,
-				VK_FILTER_LINEAR
-			);
-
-			image_barrier(cbuff, ret.image,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_ACCESS_TRANSFER_READ_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VkImageSubresourceRange{
-					VK_IMAGE_ASPECT_COLOR_BIT,
-					level, 1,
-					0, 1
-				}
-			);
-		}
-
-		image_barrier(cbuff, ret.image,
-			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			VkImageSubresourceRange{
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				0, mipLevels,
-				0, 1
-			}
+			allLevels
 		);
 
-		if (const auto res = vkEndCommandBuffer(cbuff);
-			VK_SUCCESS != res)
+		if( auto const res = vkEndCommandBuffer( cbuff ); VK_SUCCESS != res )
 		{
-			throw Error("Ending command buffer recording\n"
+			throw Error( "Ending command buffer recording\n"
 				"vkEndCommandBuffer() returned %s", to_string(res).c_str()
 			);
 		}
 
-		Fence uploadComplete = create_fence(aContext);
+		Fence uploadComplete = create_fence( aContext );
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cbuff; 
+		submitInfo.pCommandBuffers = &cbuff;
 
-		if (const auto res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle);
-				VK_SUCCESS != res)
+		if( auto const res = vkQueueSubmit( aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle ); VK_SUCCESS != res )
 		{
-			throw Error("Submitting commands\n"
+			throw Error( "Submitting commands\n"
 				"vkQueueSubmit() returned %s", to_string(res).c_str()
 			);
 		}
 
-		if (const auto res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+		if( auto const res = vkWaitForFences( aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
 		{
-			throw Error("Waiting for upload to complete\n"
+			throw Error( "Waiting for upload to complete\n"
 				"vkWaitForFences() returned %s", to_string(res).c_str()
 			);
 		}
 
-		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
+		vkFreeCommandBuffers( aContext.device, aCmdPool, 1, &cbuff );
 
-		return ret;
+		if( aFormat )
+			*aFormat = format;
 
+		return ret;
 	}
 
 	Image create_image_texture2d( Allocator const& aAllocator, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat aFormat, VkImageUsageFlags aUsage )
@@ -34,7 +34,10 @@ namespace labutils
 
 	Image default_normal_texture(VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator);
 
-	Image load_image_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const& );
+	// Load a texture written by cw2-bake (see texture_file.hpp). All mip
+	// levels are uploaded with a single copy. Optionally returns the image's
+	// format, e.g., for creating views.
+	Image load_baked_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const&, VkFormat* aFormat = nullptr );
 
 	Image create_image_texture2d( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
 
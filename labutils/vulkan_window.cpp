@@ -610,8 +610,14 @@ namespace
 			queueInfo.pQueuePriorities  = queuePriorities;
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures{};
+		vkGetPhysicalDeviceFeatures( aPhysicalDev, &supportedFeatures );
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+
+		// Baked textures are block compressed (see cw2-bake)
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 		
 		
 		VkDeviceCreateInfo deviceInfo{};
@@ -116,6 +116,42 @@ project "cw2-bake"
 
 	links "labutils" -- for lut::Error
 	links "x-tgen" -- Task 1.4
+	links "x-stb" -- texture baking
+
+	dependson "x-glm" 
+	dependson "x-rapidobj"
+
+project "cw2-bench"
+	local sources = { 
+		"cw2-bench/**.cpp",
+		"cw2-bench/**.hpp",
+		"cw2-bench/**.hxx",
+
+		-- code under test
+		"cw2-bake/index_mesh.cpp",
+		"cw2-bake/index_mesh.hpp",
+		"cw2-bake/tangent_space.cpp",
+		"cw2-bake/tangent_space.hpp",
+		"cw2-bake/quantize.cpp",
+		"cw2-bake/quantize.hpp",
+		"cw2-bake/load_model_obj.cpp",
+		"cw2-bake/load_model_obj.hpp",
+		"cw2-bake/mesh_writer.cpp",
+		"cw2-bake/mesh_writer.hpp",
+		"cw2-bake/output_file.cpp",
+		"cw2-bake/output_file.hpp",
+		"cw2-bake/simplify_mesh.hpp",
+		"cw2/baked_model.cpp",
+		"cw2/baked_model.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "cw2-bench"
+
+	files( sources )
+
+	links "labutils" -- for lut::Error and the geometry codec
+	links "x-tgen" -- tangent space
 
 	dependson "x-glm" 
 	dependson "x-rapidobj"
@@ -124,7 +160,8 @@ project "labutils"
 	local sources = { 
 		"labutils/**.cpp",
 		"labutils/**.hpp",
-		"labutils/**.hxx"
+		"labutils/**.hxx",
+		"labutils/**.inl"
 	}
 
 	kind "StaticLib"